@@ -0,0 +1,500 @@
+/* sane - Scanner Access Now Easy.
+
+   Copyright (C) 2026 agent <agent@local>
+
+   This file is part of the SANE package.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+   As a special exception, the authors of SANE give permission for
+   additional uses of the libraries contained in this release of SANE.
+
+   The exception is that, if you link a SANE library with other files
+   to produce an executable, this does not by itself cause the
+   resulting executable to be covered by the GNU General Public
+   License.  Your use of that executable is in no way restricted on
+   account of linking the SANE library code into it.
+
+   This exception does not, however, invalidate any other reasons why
+   the executable file might be covered by the GNU General Public
+   License.
+
+   If you submit changes to SANE to the maintainers to be included in
+   a subsequent release, you agree by submitting the changes that
+   those changes may be distributed with this exception intact.
+
+   If you write modifications of your own for SANE, it is your choice
+   whether to permit this exception to apply to your modifications.
+   If you do not wish that, delete this exception notice.
+*/
+
+#define DEBUG_DECLARE_ONLY
+
+#include "calibration.h"
+#include "error.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+#ifdef HAVE_MMAP
+    #define USE_MMAP_CALIBRATION_CACHE 1
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#else
+    #define USE_MMAP_CALIBRATION_CACHE 0
+#endif
+
+namespace genesys {
+
+namespace {
+
+// All integers in the file are stored in little-endian byte order.
+//
+// File header:
+//  - 8 bytes:  CALIBRATION_CACHE_MAGIC
+//  - uint32:   CALIBRATION_CACHE_FORMAT_VERSION
+//  - uint32:   CALIBRATION_VERSION, the version of the serialized payloads
+//
+// Record header:
+//  - uint32:   CALIBRATION_CACHE_RECORD_MARKER
+//  - uint32:   scan_method, xres, yres, channels, startx, pixels of the key
+//  - uint64:   size of the payload that follows the header
+const char CALIBRATION_CACHE_MAGIC[8] = { 's', 'g', 'e', 'n', 'c', 'a', 'l', '\n' };
+const std::uint32_t CALIBRATION_CACHE_FORMAT_VERSION = 1;
+const std::uint32_t CALIBRATION_CACHE_RECORD_MARKER = 0x52434347;
+
+const std::size_t FILE_HEADER_SIZE = 16;
+const std::size_t RECORD_HEADER_SIZE = 36;
+
+void write_u32(std::string& out, std::uint32_t value)
+{
+    for (unsigned i = 0; i < 4; ++i) {
+        out.push_back(static_cast<char>((value >> (i * 8)) & 0xff));
+    }
+}
+
+void write_u64(std::string& out, std::uint64_t value)
+{
+    for (unsigned i = 0; i < 8; ++i) {
+        out.push_back(static_cast<char>((value >> (i * 8)) & 0xff));
+    }
+}
+
+std::uint32_t read_u32(const std::uint8_t* data)
+{
+    return data[0] | (data[1] << 8) | (data[2] << 16) | (static_cast<std::uint32_t>(data[3]) << 24);
+}
+
+std::uint64_t read_u64(const std::uint8_t* data)
+{
+    return read_u32(data) | (static_cast<std::uint64_t>(read_u32(data + 4)) << 32);
+}
+
+std::string create_file_header()
+{
+    std::string out{CALIBRATION_CACHE_MAGIC, sizeof(CALIBRATION_CACHE_MAGIC)};
+    write_u32(out, CALIBRATION_CACHE_FORMAT_VERSION);
+    write_u32(out, CALIBRATION_VERSION);
+    return out;
+}
+
+void append_record(std::string& out, const CalibrationCacheKey& key, const std::string& payload)
+{
+    write_u32(out, CALIBRATION_CACHE_RECORD_MARKER);
+    write_u32(out, static_cast<std::uint32_t>(key.scan_method));
+    write_u32(out, key.xres);
+    write_u32(out, key.yres);
+    write_u32(out, key.channels);
+    write_u32(out, key.startx);
+    write_u32(out, key.pixels);
+    write_u64(out, payload.size());
+    out += payload;
+}
+
+std::string serialize_entry(Genesys_Calibration_Cache& entry)
+{
+    std::ostringstream str;
+    serialize(str, entry);
+    return str.str();
+}
+
+// Returns the size of the file or the maximum uint64 value if it does not exist
+std::uint64_t get_file_size(const std::string& path)
+{
+    std::ifstream str{path, std::ios::binary | std::ios::ate};
+    if (!str.is_open()) {
+        return std::numeric_limits<std::uint64_t>::max();
+    }
+    return static_cast<std::uint64_t>(str.tellg());
+}
+
+void write_file(const std::string& path, const std::string& data, bool append)
+{
+    auto mode = std::ios::binary | (append ? std::ios::app : std::ios::trunc);
+    std::ofstream str{path, mode};
+    if (!str.is_open()) {
+        throw SaneException("Cannot open calibration for writing");
+    }
+    str.write(data.data(), data.size());
+    str.flush();
+    if (!str) {
+        throw SaneException("Could not write calibration to %s", path.c_str());
+    }
+}
+
+// Replaces the file at the given path with a new file. Other processes may have the old file
+// mapped into memory, which must not be truncated under them.
+void replace_file(const std::string& path, const std::string& data)
+{
+    auto tmp_path = path + ".tmp";
+    try {
+        write_file(tmp_path, data, false);
+    } catch (...) {
+        std::remove(tmp_path.c_str());
+        throw;
+    }
+    if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        std::remove(tmp_path.c_str());
+        throw SaneException("Could not replace calibration file %s", path.c_str());
+    }
+}
+
+} // namespace
+
+CalibrationCacheKey::CalibrationCacheKey(const SetupParams& params) :
+    scan_method{params.scan_method},
+    xres{params.xres},
+    yres{params.yres},
+    channels{params.channels},
+    startx{params.startx},
+    pixels{params.pixels}
+{}
+
+std::size_t CalibrationCacheKeyHash::operator()(const CalibrationCacheKey& key) const
+{
+    std::size_t hash = static_cast<std::size_t>(key.scan_method);
+    for (unsigned value : { key.xres, key.yres, key.channels, key.startx, key.pixels }) {
+        hash = hash * 31 + value;
+    }
+    return hash;
+}
+
+// The contents of the cache file, either memory-mapped or read into memory
+struct CalibrationCache::FileData
+{
+    FileData() = default;
+    FileData(const FileData&) = delete;
+    FileData& operator=(const FileData&) = delete;
+
+    ~FileData()
+    {
+#if USE_MMAP_CALIBRATION_CACHE
+        if (mapping != nullptr) {
+            munmap(mapping, size);
+        }
+#endif
+    }
+
+    // returns nullptr if the file can't be read
+    static std::unique_ptr<FileData> read(const std::string& path);
+
+    // Returns false if the data can no longer be accessed because the mapped file has been
+    // truncated. Accessing pages beyond the end of the file would raise SIGBUS.
+    bool is_valid(const std::string& path) const;
+
+    const std::uint8_t* data = nullptr;
+    std::size_t size = 0;
+
+    std::vector<std::uint8_t> buffer;
+#if USE_MMAP_CALIBRATION_CACHE
+    void* mapping = nullptr;
+    dev_t device = 0;
+    ino_t inode = 0;
+#endif
+};
+
+std::unique_ptr<CalibrationCache::FileData> CalibrationCache::FileData::read(const std::string& path)
+{
+    std::unique_ptr<FileData> file{new FileData};
+
+#if USE_MMAP_CALIBRATION_CACHE
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED) {
+            file->mapping = mapping;
+            file->data = static_cast<const std::uint8_t*>(mapping);
+            file->size = st.st_size;
+            file->device = st.st_dev;
+            file->inode = st.st_ino;
+        }
+    }
+    ::close(fd);
+
+    if (file->mapping != nullptr) {
+        return file;
+    }
+#endif
+
+    std::ifstream str{path, std::ios::binary};
+    if (!str.is_open()) {
+        return nullptr;
+    }
+    file->buffer.assign(std::istreambuf_iterator<char>(str), std::istreambuf_iterator<char>());
+    file->data = file->buffer.data();
+    file->size = file->buffer.size();
+    return file;
+}
+
+bool CalibrationCache::FileData::is_valid(const std::string& path) const
+{
+#if USE_MMAP_CALIBRATION_CACHE
+    if (mapping == nullptr) {
+        return true;
+    }
+    // The file is replaced via rename() when rewritten and appended to otherwise, neither of
+    // which affects the mapping. A different file at the path, or no file at all, means that the
+    // mapped one has been replaced or removed, which is fine too.
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || st.st_dev != device || st.st_ino != inode) {
+        return true;
+    }
+    return static_cast<std::uint64_t>(st.st_size) >= size;
+#else
+    (void) path;
+    return true;
+#endif
+}
+
+CalibrationCache::CalibrationCache() = default;
+CalibrationCache::CalibrationCache(CalibrationCache&& other) = default;
+CalibrationCache& CalibrationCache::operator=(CalibrationCache&& other) = default;
+CalibrationCache::~CalibrationCache() = default;
+
+bool CalibrationCache::open(const std::string& path)
+{
+    DBG_HELPER(dbg);
+
+    auto file = FileData::read(path);
+    if (!file) {
+        DBG(DBG_info, "%s: Cannot open %s\n", __func__, path.c_str());
+        return false;
+    }
+
+    const auto* data = file->data;
+    auto size = file->size;
+
+    if (size < FILE_HEADER_SIZE ||
+        std::memcmp(data, CALIBRATION_CACHE_MAGIC, sizeof(CALIBRATION_CACHE_MAGIC)) != 0)
+    {
+        DBG(DBG_info, "%s: Incorrect calibration file '%s' header\n", __func__, path.c_str());
+        return false;
+    }
+
+    if (read_u32(data + 8) != CALIBRATION_CACHE_FORMAT_VERSION ||
+        read_u32(data + 12) != CALIBRATION_VERSION)
+    {
+        DBG(DBG_info, "%s: Incorrect calibration file '%s' version\n", __func__, path.c_str());
+        return false;
+    }
+
+    std::unordered_map<CalibrationCacheKey, Entry, CalibrationCacheKeyHash> entries;
+    std::size_t record_count = 0;
+    std::size_t offset = FILE_HEADER_SIZE;
+
+    while (size - offset >= RECORD_HEADER_SIZE) {
+        const auto* header = data + offset;
+        if (read_u32(header) != CALIBRATION_CACHE_RECORD_MARKER) {
+            break;
+        }
+        auto payload_size = read_u64(header + 28);
+        if (payload_size > size - offset - RECORD_HEADER_SIZE) {
+            break;
+        }
+
+        CalibrationCacheKey key;
+        key.scan_method = static_cast<ScanMethod>(read_u32(header + 4));
+        key.xres = read_u32(header + 8);
+        key.yres = read_u32(header + 12);
+        key.channels = read_u32(header + 16);
+        key.startx = read_u32(header + 20);
+        key.pixels = read_u32(header + 24);
+
+        auto& entry = entries[key];
+        entry.payload_offset = offset + RECORD_HEADER_SIZE;
+        entry.payload_size = payload_size;
+
+        offset += RECORD_HEADER_SIZE + payload_size;
+        record_count++;
+    }
+
+    bool truncated = offset != size;
+    if (truncated) {
+        // most likely an interrupted write. The valid records are still used, but the file will
+        // be rewritten on next save as appending would leave garbage in the middle.
+        DBG(DBG_warn, "%s: Ignoring %zu bytes of invalid data at the end of '%s'\n", __func__,
+            size - offset, path.c_str());
+    }
+
+    DBG(DBG_info, "%s: Loaded index of %zu entries from %zu records\n", __func__,
+        entries.size(), record_count);
+
+    path_ = path;
+    file_ = std::move(file);
+    file_size_ = truncated ? std::numeric_limits<std::uint64_t>::max() : size;
+    file_record_count_ = record_count;
+    entries_ = std::move(entries);
+    return true;
+}
+
+void CalibrationCache::clear()
+{
+    entries_.clear();
+    file_.reset();
+    path_.clear();
+    file_size_ = 0;
+    file_record_count_ = 0;
+}
+
+const Genesys_Calibration_Cache* CalibrationCache::load_entry(Entry& entry)
+{
+    if (entry.data) {
+        return entry.data.get();
+    }
+
+    if (!file_->is_valid(path_)) {
+        throw SaneException("Calibration file %s has been truncated", path_.c_str());
+    }
+
+    std::unique_ptr<Genesys_Calibration_Cache> data{new Genesys_Calibration_Cache};
+    std::istringstream str{std::string{reinterpret_cast<const char*>(file_->data) +
+                                           entry.payload_offset, entry.payload_size}};
+    serialize(str, *data);
+    if (str.fail()) {
+        throw SaneException("Could not parse calibration entry in %s", path_.c_str());
+    }
+    entry.data = std::move(data);
+    return entry.data.get();
+}
+
+const Genesys_Calibration_Cache* CalibrationCache::find(const SetupParams& params)
+{
+    auto it = entries_.find(CalibrationCacheKey{params});
+    if (it == entries_.end()) {
+        return nullptr;
+    }
+
+    try {
+        return load_entry(it->second);
+    } catch (const std::exception& e) {
+        DBG(DBG_error, "%s: %s\n", __func__, e.what());
+        entries_.erase(it);
+        return nullptr;
+    }
+}
+
+void CalibrationCache::insert(Genesys_Calibration_Cache entry)
+{
+    auto& cache_entry = entries_[CalibrationCacheKey{entry.params}];
+    cache_entry.data.reset(new Genesys_Calibration_Cache(std::move(entry)));
+    cache_entry.modified = true;
+}
+
+std::vector<Genesys_Calibration_Cache> CalibrationCache::get_all()
+{
+    std::vector<Genesys_Calibration_Cache> ret;
+    for (auto& entry : entries_) {
+        ret.push_back(*load_entry(entry.second));
+    }
+    return ret;
+}
+
+void CalibrationCache::save(const std::string& path)
+{
+    DBG_HELPER(dbg);
+
+    bool can_append = path == path_ && file_size_ == get_file_size(path) &&
+            file_record_count_ <= 2 * entries_.size();
+
+    if (!can_append) {
+        rewrite_file(path);
+        return;
+    }
+
+    std::string data;
+    std::size_t record_count = 0;
+    for (auto& it : entries_) {
+        if (it.second.modified) {
+            append_record(data, it.first, serialize_entry(*it.second.data));
+            record_count++;
+        }
+    }
+
+    if (data.empty()) {
+        return;
+    }
+
+    DBG(DBG_info, "%s: Appending %zu entries to '%s'\n", __func__, record_count, path.c_str());
+    write_file(path, data, true);
+
+    for (auto& it : entries_) {
+        it.second.modified = false;
+    }
+    file_size_ += data.size();
+    file_record_count_ += record_count;
+}
+
+void CalibrationCache::rewrite_file(const std::string& path)
+{
+    DBG(DBG_info, "%s: Writing %zu entries to '%s'\n", __func__, entries_.size(), path.c_str());
+
+    // the payload offsets refer to the old file which is replaced, thus all entries are loaded
+    // first. Entries that can't be parsed are dropped.
+    for (auto it = entries_.begin(); it != entries_.end();) {
+        try {
+            load_entry(it->second);
+            ++it;
+        } catch (const std::exception& e) {
+            DBG(DBG_error, "%s: %s\n", __func__, e.what());
+            it = entries_.erase(it);
+        }
+    }
+    file_.reset();
+
+    std::string data = create_file_header();
+    for (auto& it : entries_) {
+        append_record(data, it.first, serialize_entry(*it.second.data));
+    }
+
+    replace_file(path, data);
+
+    for (auto& it : entries_) {
+        it.second.modified = false;
+    }
+    path_ = path;
+    file_size_ = data.size();
+    file_record_count_ = entries_.size();
+}
+
+} // namespace genesys
@@ -45,9 +45,19 @@
 #include "sensor.h"
 #include "settings.h"
 #include <ctime>
+#include <memory>
+#include <unordered_map>
 
 namespace genesys {
 
+/**
+ * This should be changed if one of the substructures of
+   Genesys_Calibration_Cache change, but it must be changed if there are
+   changes that don't change size -- at least for now, as we store most
+   of Genesys_Calibration_Cache as is.
+*/
+static const int CALIBRATION_VERSION = 31;
+
 struct Genesys_Calibration_Cache
 {
     Genesys_Calibration_Cache() = default;
@@ -98,6 +108,113 @@ void serialize(Stream& str, Genesys_Calibration_Cache& x)
     serialize(str, x.dark_average_data);
 }
 
+// The parameters of a scan that must match for a calibration cache entry to be usable. These are
+// the parameters that are checked by sanei_genesys_is_compatible_calibration().
+struct CalibrationCacheKey
+{
+    CalibrationCacheKey() = default;
+    explicit CalibrationCacheKey(const SetupParams& params);
+
+    ScanMethod scan_method = ScanMethod::FLATBED;
+    unsigned xres = 0;
+    unsigned yres = 0;
+    unsigned channels = 0;
+    unsigned startx = 0;
+    unsigned pixels = 0;
+
+    bool operator==(const CalibrationCacheKey& other) const
+    {
+        return scan_method == other.scan_method &&
+            xres == other.xres &&
+            yres == other.yres &&
+            channels == other.channels &&
+            startx == other.startx &&
+            pixels == other.pixels;
+    }
+};
+
+struct CalibrationCacheKeyHash
+{
+    std::size_t operator()(const CalibrationCacheKey& key) const;
+};
+
+/*  Holds the calibration cache entries of a device, at most one entry per key.
+
+    The entries are stored in a binary file which consists of a fixed header and a sequence of
+    records. Each record has a fixed-size header that contains the key of the entry and the size
+    of the payload, followed by the payload which is the entry written by serialize(). When a
+    file is opened only the record headers are read to build an index of the entries. The
+    payloads are parsed when the respective entry is first accessed. The file is memory-mapped
+    where possible.
+
+    Saving appends the records of the new and modified entries to the file. A later record
+    replaces any earlier record with the same key. The file is rewritten from scratch when the
+    number of replaced records becomes larger than the number of entries.
+*/
+class CalibrationCache
+{
+public:
+    CalibrationCache();
+    CalibrationCache(CalibrationCache&& other);
+    CalibrationCache& operator=(CalibrationCache&& other);
+    ~CalibrationCache();
+
+    // Replaces the contents of the cache with the contents of the file at the given path. Returns
+    // false and leaves the cache unchanged if the file can't be read or is not a calibration
+    // cache of the current version.
+    bool open(const std::string& path);
+
+    // Returns the path of the file that the cache has been opened from or saved to last
+    const std::string& path() const { return path_; }
+
+    bool empty() const { return entries_.empty(); }
+    std::size_t size() const { return entries_.size(); }
+
+    // Removes all entries. The file is not modified.
+    void clear();
+
+    // Returns the entry that has the same key as the given parameters or nullptr if there is no
+    // such entry. The returned pointer is valid until the cache is modified.
+    const Genesys_Calibration_Cache* find(const SetupParams& params);
+
+    // Adds the given entry replacing any entry with the same key
+    void insert(Genesys_Calibration_Cache entry);
+
+    // Returns all entries in unspecified order
+    std::vector<Genesys_Calibration_Cache> get_all();
+
+    // Writes the cache to the file at the given path. New and modified entries are appended if
+    // the file is the one the cache was opened from or saved to and it has not been changed by
+    // anyone else since then. Otherwise the whole file is written.
+    void save(const std::string& path);
+
+private:
+    struct FileData;
+
+    struct Entry
+    {
+        // nullptr if the entry has not been loaded from the file yet
+        std::unique_ptr<Genesys_Calibration_Cache> data;
+        // the location of the payload within file_, valid only if the entry is not loaded
+        std::size_t payload_offset = 0;
+        std::size_t payload_size = 0;
+        // whether the entry needs to be written to the file
+        bool modified = false;
+    };
+
+    const Genesys_Calibration_Cache* load_entry(Entry& entry);
+    void rewrite_file(const std::string& path);
+
+    std::string path_;
+    std::unique_ptr<FileData> file_;
+    // the size of the file at path_ as of the last time the cache has read or written it
+    std::uint64_t file_size_ = 0;
+    // the number of records in the file at path_ including replaced ones
+    std::size_t file_record_count_ = 0;
+
+    std::unordered_map<CalibrationCacheKey, Entry, CalibrationCacheKeyHash> entries_;
+};
+
 } // namespace genesys
 
 #endif // BACKEND_GENESYS_CALIBRATION_H
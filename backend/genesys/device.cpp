@@ -100,6 +100,8 @@ Genesys_Device::~Genesys_Device()
 
 void Genesys_Device::clear()
 {
+    stop_calibration_warmup();
+
     calib_file.clear();
 
     calibration_cache.clear();
@@ -113,6 +115,33 @@ ImagePipelineNodeBufferedCallableSource& Genesys_Device::get_pipeline_source()
     return static_cast<ImagePipelineNodeBufferedCallableSource&>(pipeline.front());
 }
 
+void Genesys_Device::stop_pipeline_read_ahead()
+{
+    if (!pipeline.empty()) {
+        get_pipeline_source().stop_read_ahead();
+    }
+}
+
+std::unique_lock<std::mutex> Genesys_Device::lock_calibration_warmup()
+{
+    if (!calibration_warmup) {
+        return std::unique_lock<std::mutex>{};
+    }
+    return std::unique_lock<std::mutex>{calibration_warmup->mutex};
+}
+
+void Genesys_Device::stop_calibration_warmup()
+{
+    if (!calibration_warmup) {
+        return;
+    }
+    calibration_warmup->cancel_requested = true;
+    if (calibration_warmup->thread.joinable()) {
+        calibration_warmup->thread.join();
+    }
+    calibration_warmup.reset();
+}
+
 bool Genesys_Device::is_head_pos_known(ScanHeadId scan_head) const
 {
     switch (scan_head) {
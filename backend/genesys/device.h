@@ -47,12 +47,16 @@
 #include "enums.h"
 #include "image_pipeline.h"
 #include "motor.h"
+#include "perf_counters.h"
 #include "settings.h"
 #include "sensor.h"
 #include "register.h"
 #include "usb_device.h"
 #include "scanner_interface.h"
 #include "utilities.h"
+#include <atomic>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 namespace genesys {
@@ -247,6 +251,22 @@ struct Genesys_Model
     bool has_method(ScanMethod method) const;
 };
 
+// The state of the calibration that runs in the background after the device is opened so that
+// the first scan at each of the configured resolutions does not need to wait for it
+struct CalibrationWarmupState
+{
+    std::thread thread;
+    // held by the warm-up thread whenever it accesses the device. It is released between the
+    // phases of the calibration, see calibration_checkpoint().
+    std::mutex mutex;
+    std::atomic<bool> cancel_requested{false};
+    // the lock of the above mutex owned by the warm-up thread. Accessed only by that thread.
+    std::unique_lock<std::mutex>* thread_lock = nullptr;
+    // the settings of the device that other threads see while the warm-up thread has replaced
+    // them with the settings of the calibration target
+    Genesys_Settings saved_settings;
+};
+
 /**
  * Describes the current device status for the backend
  * session. This should be more accurately called
@@ -292,6 +312,8 @@ struct Genesys_Device
     Genesys_Gpo gpo;
     MemoryLayout memory_layout;
     Genesys_Motor motor;
+    // slope tables that have been created for the motor
+    MotorSlopeTableCache slope_table_cache;
     std::uint8_t control[6] = {};
 
     size_t average_size = 0;
@@ -323,7 +345,7 @@ struct Genesys_Device
     // contains computed data for the current setup
     ScanSession session;
 
-    Calibration calibration_cache;
+    CalibrationCache calibration_cache;
 
     // number of scan lines used during scan
     int line_count = 0;
@@ -331,6 +353,10 @@ struct Genesys_Device
     // array describing the order of the sub-segments of the sensor
     std::vector<unsigned> segment_order;
 
+    // performance counters of the current scan. Declared before `pipeline` which adds its
+    // counters here when it is destroyed.
+    PerfCounters perf_counters;
+
     // stores information about how the input image should be processed
     ImagePipelineStack pipeline;
 
@@ -339,6 +365,21 @@ struct Genesys_Device
 
     ImagePipelineNodeBufferedCallableSource& get_pipeline_source();
 
+    // stops reading image data from the scanner in the background. Must be called before
+    // communicating with the scanner in any other way while a scan is active.
+    void stop_pipeline_read_ahead();
+
+    // nullptr if no calibration warm-up has been started
+    std::unique_ptr<CalibrationWarmupState> calibration_warmup;
+
+    // returns a lock that prevents the calibration warm-up from accessing the device while held.
+    // The lock is empty if there's no warm-up.
+    std::unique_lock<std::mutex> lock_calibration_warmup();
+
+    // stops the calibration warm-up. The calibration phase that is in progress, if any, is
+    // completed first so that the scanner is left in a consistent state.
+    void stop_calibration_warmup();
+
     std::unique_ptr<ScannerInterface> interface;
 
     bool is_head_pos_known(ScanHeadId scan_head) const;
@@ -361,6 +361,23 @@ std::ostream& operator<<(std::ostream& out, StepType type)
     return out;
 }
 
+std::ostream& operator<<(std::ostream& out, AsicType type)
+{
+    switch (type) {
+        case AsicType::UNKNOWN: out << "UNKNOWN"; break;
+        case AsicType::GL646: out << "GL646"; break;
+        case AsicType::GL841: out << "GL841"; break;
+        case AsicType::GL842: out << "GL842"; break;
+        case AsicType::GL843: out << "GL843"; break;
+        case AsicType::GL845: out << "GL845"; break;
+        case AsicType::GL846: out << "GL846"; break;
+        case AsicType::GL847: out << "GL847"; break;
+        case AsicType::GL124: out << "GL124"; break;
+        default: out << static_cast<unsigned>(type); break;
+    }
+    return out;
+}
+
 std::ostream& operator<<(std::ostream& out, ScanFlag flags)
 {
     StreamStateSaver state_saver{out};
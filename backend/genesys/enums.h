@@ -479,6 +479,8 @@ enum class AsicType : unsigned
     GL124,
 };
 
+std::ostream& operator<<(std::ostream& out, AsicType type);
+
 
 enum class ModelFlag : unsigned
 {
@@ -88,6 +88,11 @@ struct MotorSlope;
 struct MotorProfile;
 struct MotorSlopeTable;
 
+// perf_counters.h
+struct PerfCounter;
+class PerfCounters;
+class PerfTimer;
+
 // register.h
 class Genesys_Register_Set;
 struct GenesysRegisterSetState;
@@ -73,6 +73,7 @@
 #include "../include/sane/sanei_config.h"
 
 #include <array>
+#include <chrono>
 #include <cmath>
 #include <cstring>
 #include <fstream>
@@ -80,6 +81,8 @@
 #include <list>
 #include <numeric>
 #include <exception>
+#include <sstream>
+#include <thread>
 #include <vector>
 
 #ifndef SANE_GENESYS_API_LINKAGE
@@ -179,10 +182,9 @@ static const SANE_Range expiration_range = {
 const Genesys_Sensor& sanei_genesys_find_sensor_any(const Genesys_Device* dev)
 {
     DBG_HELPER(dbg);
-    for (const auto& sensor : *s_sensors) {
-        if (dev->model->sensor_id == sensor.sensor_id) {
-            return sensor;
-        }
+    const auto* sensor = s_sensor_index->find_any(dev->model->sensor_id);
+    if (sensor) {
+        return *sensor;
     }
     throw std::runtime_error("Given device does not have sensor defined");
 }
@@ -192,14 +194,7 @@ Genesys_Sensor* find_sensor_impl(const Genesys_Device* dev, unsigned dpi, unsign
 {
     DBG_HELPER_ARGS(dbg, "dpi: %d, channels: %d, scan_method: %d", dpi, channels,
                     static_cast<unsigned>(scan_method));
-    for (auto& sensor : *s_sensors) {
-        if (dev->model->sensor_id == sensor.sensor_id && sensor.resolutions.matches(dpi) &&
-            sensor.matches_channel_count(channels) && sensor.method == scan_method)
-        {
-            return &sensor;
-        }
-    }
-    return nullptr;
+    return s_sensor_index->find(dev->model->sensor_id, dpi, channels, scan_method);
 }
 
 bool sanei_genesys_has_sensor(const Genesys_Device* dev, unsigned dpi, unsigned channels,
@@ -238,26 +233,15 @@ std::vector<std::reference_wrapper<const Genesys_Sensor>>
     sanei_genesys_find_sensors_all(const Genesys_Device* dev, ScanMethod scan_method)
 {
     DBG_HELPER_ARGS(dbg, "scan_method: %d", static_cast<unsigned>(scan_method));
-    std::vector<std::reference_wrapper<const Genesys_Sensor>> ret;
-    for (auto& sensor : *s_sensors) {
-        if (dev->model->sensor_id == sensor.sensor_id && sensor.method == scan_method) {
-            ret.push_back(sensor);
-        }
-    }
-    return ret;
+    const auto& sensors = s_sensor_index->find_all(dev->model->sensor_id, scan_method);
+    return {sensors.begin(), sensors.end()};
 }
 
 std::vector<std::reference_wrapper<Genesys_Sensor>>
     sanei_genesys_find_sensors_all_for_write(Genesys_Device* dev, ScanMethod scan_method)
 {
     DBG_HELPER_ARGS(dbg, "scan_method: %d", static_cast<unsigned>(scan_method));
-    std::vector<std::reference_wrapper<Genesys_Sensor>> ret;
-    for (auto& sensor : *s_sensors) {
-        if (dev->model->sensor_id == sensor.sensor_id && sensor.method == scan_method) {
-            ret.push_back(sensor);
-        }
-    }
-    return ret;
+    return s_sensor_index->find_all(dev->model->sensor_id, scan_method);
 }
 
 void sanei_genesys_init_structs (Genesys_Device * dev)
@@ -278,21 +262,17 @@ void sanei_genesys_init_structs (Genesys_Device * dev)
     }
 
     // initialize the motor data stuff
-    for (const auto& motor : *s_motors) {
-        if (dev->model->motor_id == motor.id) {
-            dev->motor = motor;
-            motor_ok = true;
-            break;
-        }
+    auto motor_index = s_motor_index->find(dev->model->motor_id);
+    if (motor_index >= 0) {
+        dev->motor = (*s_motors)[motor_index];
+        motor_ok = true;
     }
 
-    for (const auto& frontend : *s_frontends) {
-        if (dev->model->adc_id == frontend.id) {
-            dev->frontend_initial = frontend;
-            dev->frontend = frontend;
-            fe_ok = true;
-            break;
-        }
+    auto frontend_index = s_frontend_index->find(dev->model->adc_id);
+    if (frontend_index >= 0) {
+        dev->frontend_initial = (*s_frontends)[frontend_index];
+        dev->frontend = (*s_frontends)[frontend_index];
+        fe_ok = true;
     }
 
     if (dev->model->asic_type == AsicType::GL845 ||
@@ -2368,7 +2348,6 @@ static void genesys_shading_calibration_impl(Genesys_Device* dev, const Genesys_
         size = channels * 2 * pixels_per_line * (dev->calib_session.params.lines + 1);
     }
 
-  std::vector<uint16_t> calibration_data(size / 2);
 
     // turn off motor and lamp power for flatbed scanners, but not for sheetfed scanners
     // because they have a calibration sheet with a sufficient black strip
@@ -2401,37 +2380,24 @@ static void genesys_shading_calibration_impl(Genesys_Device* dev, const Genesys_
         return;
     }
 
-    sanei_genesys_read_data_from_scanner(dev, reinterpret_cast<std::uint8_t*>(calibration_data.data()),
-                                         size);
-
-    dev->cmd_set->end_scan(dev, &local_reg, true);
-
-    if (has_flag(dev->model->flags, ModelFlag::SWAP_16BIT_DATA)) {
-        for (std::size_t i = 0; i < size / 2; ++i) {
-            auto value = calibration_data[i];
-            value = ((value >> 8) & 0xff) | ((value << 8) & 0xff00);
-            calibration_data[i] = value;
-        }
+    std::string debug_path;
+    if (dbg_log_image_data()) {
+        debug_path = log_filename_prefix + "_shading.tiff";
     }
 
-    if (has_flag(dev->model->flags, ModelFlag::INVERT_PIXEL_DATA)) {
-        for (std::size_t i = 0; i < size / 2; ++i) {
-            calibration_data[i] = 0xffff - calibration_data[i];
-        }
-    }
+    auto averages = read_raw_calibration_averages(dev, dev->calib_session, pixels_per_line,
+                                                  dev->calib_session.params.lines, size,
+                                                  debug_path);
+
+    dev->cmd_set->end_scan(dev, &local_reg, true);
 
     std::fill(out_average_data.begin(),
               out_average_data.begin() + start_offset * channels, 0);
 
-    compute_array_percentile_approx(out_average_data.data() +
-                                        start_offset * channels,
-                                    calibration_data.data(),
-                                    dev->calib_session.params.lines, pixels_per_line * channels,
-                                    0.5f);
+    std::copy(averages.begin(), averages.end(),
+              out_average_data.begin() + start_offset * channels);
 
     if (dbg_log_image_data()) {
-        write_tiff_file(log_filename_prefix + "_shading.tiff", calibration_data.data(), 16,
-                        channels, pixels_per_line, dev->calib_session.params.lines);
         write_tiff_file(log_filename_prefix + "_average.tiff", out_average_data.data(), 16,
                         channels, out_pixels_per_line, 1);
     }
@@ -2599,7 +2565,14 @@ static void genesys_host_shading_calibration_impl(Genesys_Device& dev, const Gen
         return;
     }
 
-    Image image = read_unshuffled_image_from_scanner(&dev, session, session.output_total_bytes_raw);
+    std::string debug_path;
+    if (dbg_log_image_data()) {
+        debug_path = log_filename_prefix + "_host_shading.tiff";
+    }
+
+    auto averages = read_unshuffled_calibration_averages(&dev, session,
+                                                         session.output_total_bytes_raw,
+                                                         debug_path);
     scanner_stop_action(dev);
 
     auto start_offset = session.params.startx;
@@ -2615,15 +2588,12 @@ static void genesys_host_shading_calibration_impl(Genesys_Device& dev, const Gen
     std::fill(out_average_data.begin(),
               out_average_data.begin() + start_offset * session.params.channels, 0);
 
-    compute_array_percentile_approx(out_average_data.data() +
-                                        start_offset * session.params.channels,
-                                    reinterpret_cast<std::uint16_t*>(image.get_row_ptr(0)),
-                                    session.params.lines,
-                                    session.output_pixels * session.params.channels,
-                                    0.5f);
+    auto count = std::min<std::size_t>(averages.size(),
+                                       session.output_pixels * session.params.channels);
+    std::copy(averages.begin(), averages.begin() + count,
+              out_average_data.begin() + start_offset * session.params.channels);
 
     if (dbg_log_image_data()) {
-        write_tiff_file(log_filename_prefix + "_host_shading.tiff", image);
         write_tiff_file(log_filename_prefix + "_host_average.tiff", out_average_data.data(), 16,
                         session.params.channels, out_pixels_per_line, 1);
     }
@@ -2633,6 +2603,7 @@ static void genesys_dark_shading_calibration(Genesys_Device* dev, const Genesys_
                                              Genesys_Register_Set& local_reg)
 {
     DBG_HELPER(dbg);
+    PerfTimer timer{dev->perf_counters, "calibration.dark_shading"};
     if (has_flag(dev->model->flags, ModelFlag::HOST_SIDE_CALIBRATION_COMPLETE_SCAN)) {
         genesys_host_shading_calibration_impl(*dev, sensor, dev->dark_average_data, true,
                                               "gl_black");
@@ -2646,6 +2617,7 @@ static void genesys_white_shading_calibration(Genesys_Device* dev, const Genesys
                                               Genesys_Register_Set& local_reg)
 {
     DBG_HELPER(dbg);
+    PerfTimer timer{dev->perf_counters, "calibration.white_shading"};
     if (has_flag(dev->model->flags, ModelFlag::HOST_SIDE_CALIBRATION_COMPLETE_SCAN)) {
         genesys_host_shading_calibration_impl(*dev, sensor, dev->white_average_data, false,
                                               "gl_white");
@@ -2662,6 +2634,7 @@ static void genesys_dark_white_shading_calibration(Genesys_Device* dev,
                                                    Genesys_Register_Set& local_reg)
 {
     DBG_HELPER(dbg);
+    PerfTimer timer{dev->perf_counters, "calibration.dark_white_shading"};
 
     if (dev->model->asic_type == AsicType::GL646) {
         dev->cmd_set->init_regs_for_shading(dev, sensor, local_reg);
@@ -3603,31 +3576,29 @@ genesys_restore_calibration(Genesys_Device * dev, Genesys_Sensor& sensor)
 
     auto session = dev->cmd_set->calculate_scan_session(dev, sensor, dev->settings);
 
-  /* we walk the link list of calibration cache in search for a
-   * matching one */
-  for (auto& cache : dev->calibration_cache)
-    {
-        if (sanei_genesys_is_compatible_calibration(dev, session, &cache, false)) {
-            dev->frontend = cache.frontend;
-          /* we don't restore the gamma fields */
-          sensor.exposure = cache.sensor.exposure;
+    // the cache holds at most one entry for the parameters that are checked for compatibility
+    const auto* cache = dev->calibration_cache.find(session.params);
+    if (cache == nullptr || !sanei_genesys_is_compatible_calibration(dev, session, cache, false)) {
+        DBG(DBG_proc, "%s: completed(nothing found)\n", __func__);
+        return false;
+    }
 
-            dev->calib_session = cache.session;
-          dev->average_size = cache.average_size;
+    dev->frontend = cache->frontend;
+    /* we don't restore the gamma fields */
+    sensor.exposure = cache->sensor.exposure;
 
-          dev->dark_average_data = cache.dark_average_data;
-          dev->white_average_data = cache.white_average_data;
+    dev->calib_session = cache->session;
+    dev->average_size = cache->average_size;
 
-            if (!dev->cmd_set->has_send_shading_data()) {
-            genesys_send_shading_coefficient(dev, sensor);
-          }
+    dev->dark_average_data = cache->dark_average_data;
+    dev->white_average_data = cache->white_average_data;
 
-          DBG(DBG_proc, "%s: restored\n", __func__);
-          return true;
-	}
+    if (!dev->cmd_set->has_send_shading_data()) {
+        genesys_send_shading_coefficient(dev, sensor);
     }
-  DBG(DBG_proc, "%s: completed(nothing found)\n", __func__);
-  return false;
+
+    DBG(DBG_proc, "%s: restored\n", __func__);
+    return true;
 }
 
 
@@ -3640,39 +3611,75 @@ static void genesys_save_calibration(Genesys_Device* dev, const Genesys_Sensor&
 
     auto session = dev->cmd_set->calculate_scan_session(dev, sensor, dev->settings);
 
-  auto found_cache_it = dev->calibration_cache.end();
-  for (auto cache_it = dev->calibration_cache.begin(); cache_it != dev->calibration_cache.end();
-       cache_it++)
-    {
-        if (sanei_genesys_is_compatible_calibration(dev, session, &*cache_it, true)) {
-            found_cache_it = cache_it;
-            break;
-        }
-    }
-
-  /* if we found on overridable cache, we reuse it */
-  if (found_cache_it == dev->calibration_cache.end())
-    {
-      /* create a new cache entry and insert it in the linked list */
-      dev->calibration_cache.push_back(Genesys_Calibration_Cache());
-      found_cache_it = std::prev(dev->calibration_cache.end());
-    }
-
-  found_cache_it->average_size = dev->average_size;
+    Genesys_Calibration_Cache cache;
+    cache.average_size = dev->average_size;
 
-  found_cache_it->dark_average_data = dev->dark_average_data;
-  found_cache_it->white_average_data = dev->white_average_data;
+    cache.dark_average_data = dev->dark_average_data;
+    cache.white_average_data = dev->white_average_data;
 
-    found_cache_it->params = session.params;
-  found_cache_it->frontend = dev->frontend;
-  found_cache_it->sensor = sensor;
+    cache.params = session.params;
+    cache.frontend = dev->frontend;
+    cache.sensor = sensor;
 
-    found_cache_it->session = dev->calib_session;
+    cache.session = dev->calib_session;
 
 #ifdef HAVE_SYS_TIME_H
     gettimeofday(&time, nullptr);
-  found_cache_it->last_calibration = time.tv_sec;
+    cache.last_calibration = time.tv_sec;
 #endif
+
+    // replaces any existing entry for the same scan parameters
+    dev->calibration_cache.insert(std::move(cache));
+}
+
+static void genesys_offset_calibration(Genesys_Device* dev, const Genesys_Sensor& sensor,
+                                       Genesys_Register_Set& regs)
+{
+    dev->interface->record_progress_message("offset_calibration");
+    PerfTimer timer{dev->perf_counters, "calibration.offset"};
+    dev->cmd_set->offset_calibration(dev, sensor, regs);
+}
+
+static void genesys_coarse_gain_calibration(Genesys_Device* dev, const Genesys_Sensor& sensor,
+                                            Genesys_Register_Set& regs, unsigned dpi)
+{
+    dev->interface->record_progress_message("coarse_gain_calibration");
+    PerfTimer timer{dev->perf_counters, "calibration.coarse_gain"};
+    dev->cmd_set->coarse_gain_calibration(dev, sensor, regs, dpi);
+}
+
+static SensorExposure genesys_led_calibration(Genesys_Device* dev, const Genesys_Sensor& sensor,
+                                              Genesys_Register_Set& regs)
+{
+    dev->interface->record_progress_message("led_calibration");
+    PerfTimer timer{dev->perf_counters, "calibration.led"};
+    return dev->cmd_set->led_calibration(dev, sensor, regs);
+}
+
+/**
+ * called between the phases of the calibration, when the scanner is not in the middle of a scan.
+ * If the calibration runs in the calibration warm-up thread, lets other threads access the device
+ * and aborts the calibration if the warm-up has been stopped.
+ */
+static void calibration_checkpoint(Genesys_Device* dev)
+{
+    // the warm-up is stopped before any calibration is started from other threads, thus if it
+    // exists we are running in the warm-up thread
+    auto* warmup = dev->calibration_warmup.get();
+    if (warmup == nullptr) {
+        return;
+    }
+
+    if (!warmup->cancel_requested) {
+        std::swap(dev->settings, warmup->saved_settings);
+        warmup->thread_lock->unlock();
+        std::this_thread::yield();
+        warmup->thread_lock->lock();
+        std::swap(dev->settings, warmup->saved_settings);
+    }
+    if (warmup->cancel_requested) {
+        throw SaneException(SANE_STATUS_CANCELLED, "calibration warm-up has been stopped");
+    }
 }
 
 static void genesys_flatbed_calibration(Genesys_Device* dev, Genesys_Sensor& sensor)
@@ -3699,25 +3706,22 @@ static void genesys_flatbed_calibration(Genesys_Device* dev, Genesys_Sensor& sen
 
     if (!has_flag(dev->model->flags, ModelFlag::DISABLE_ADC_CALIBRATION)) {
         // do ADC calibration first.
-        dev->interface->record_progress_message("offset_calibration");
-        dev->cmd_set->offset_calibration(dev, sensor, local_reg);
-
-        dev->interface->record_progress_message("coarse_gain_calibration");
-        dev->cmd_set->coarse_gain_calibration(dev, sensor, local_reg, coarse_res);
+        genesys_offset_calibration(dev, sensor, local_reg);
+        genesys_coarse_gain_calibration(dev, sensor, local_reg, coarse_res);
+        calibration_checkpoint(dev);
     }
 
     if (dev->model->is_cis &&
         !has_flag(dev->model->flags, ModelFlag::DISABLE_EXPOSURE_CALIBRATION))
     {
         // ADC now sends correct data, we can configure the exposure for the LEDs
-        dev->interface->record_progress_message("led_calibration");
         switch (dev->model->asic_type) {
             case AsicType::GL124:
             case AsicType::GL841:
             case AsicType::GL845:
             case AsicType::GL846:
             case AsicType::GL847: {
-                auto calib_exposure = dev->cmd_set->led_calibration(dev, sensor, local_reg);
+                auto calib_exposure = genesys_led_calibration(dev, sensor, local_reg);
                 for (auto& sensor_update :
                         sanei_genesys_find_sensors_all_for_write(dev, sensor.method)) {
                     sensor_update.get().exposure = calib_exposure;
@@ -3726,18 +3730,16 @@ static void genesys_flatbed_calibration(Genesys_Device* dev, Genesys_Sensor& sen
                 break;
             }
             default: {
-                sensor.exposure = dev->cmd_set->led_calibration(dev, sensor, local_reg);
+                sensor.exposure = genesys_led_calibration(dev, sensor, local_reg);
             }
         }
 
         if (!has_flag(dev->model->flags, ModelFlag::DISABLE_ADC_CALIBRATION)) {
             // recalibrate ADC again for the new LED exposure
-            dev->interface->record_progress_message("offset_calibration");
-            dev->cmd_set->offset_calibration(dev, sensor, local_reg);
-
-            dev->interface->record_progress_message("coarse_gain_calibration");
-            dev->cmd_set->coarse_gain_calibration(dev, sensor, local_reg, coarse_res);
+            genesys_offset_calibration(dev, sensor, local_reg);
+            genesys_coarse_gain_calibration(dev, sensor, local_reg, coarse_res);
         }
+        calibration_checkpoint(dev);
     }
 
   /* we always use sensor pixel number when the ASIC can't handle multi-segments sensor */
@@ -3772,6 +3774,7 @@ static void genesys_flatbed_calibration(Genesys_Device* dev, Genesys_Sensor& sen
                 dev->interface->record_progress_message("genesys_dark_shading_calibration");
                 genesys_dark_shading_calibration(dev, sensor, local_reg);
                 genesys_repark_sensor_before_shading(dev);
+                calibration_checkpoint(dev);
             }
 
             dev->interface->record_progress_message("genesys_white_shading_calibration");
@@ -3828,27 +3831,20 @@ static void genesys_sheetfed_calibration(Genesys_Device* dev, Genesys_Sensor& se
 
     if (!has_flag(dev->model->flags, ModelFlag::DISABLE_ADC_CALIBRATION)) {
         // do ADC calibration first.
-        dev->interface->record_progress_message("offset_calibration");
-        dev->cmd_set->offset_calibration(dev, sensor, local_reg);
-
-        dev->interface->record_progress_message("coarse_gain_calibration");
-        dev->cmd_set->coarse_gain_calibration(dev, sensor, local_reg, coarse_res);
+        genesys_offset_calibration(dev, sensor, local_reg);
+        genesys_coarse_gain_calibration(dev, sensor, local_reg, coarse_res);
     }
 
     if (dev->model->is_cis &&
         !has_flag(dev->model->flags, ModelFlag::DISABLE_EXPOSURE_CALIBRATION))
     {
         // ADC now sends correct data, we can configure the exposure for the LEDs
-        dev->interface->record_progress_message("led_calibration");
-        dev->cmd_set->led_calibration(dev, sensor, local_reg);
+        genesys_led_calibration(dev, sensor, local_reg);
 
         if (!has_flag(dev->model->flags, ModelFlag::DISABLE_ADC_CALIBRATION)) {
             // recalibrate ADC again for the new LED exposure
-            dev->interface->record_progress_message("offset_calibration");
-            dev->cmd_set->offset_calibration(dev, sensor, local_reg);
-
-            dev->interface->record_progress_message("coarse_gain_calibration");
-            dev->cmd_set->coarse_gain_calibration(dev, sensor, local_reg, coarse_res);
+            genesys_offset_calibration(dev, sensor, local_reg);
+            genesys_coarse_gain_calibration(dev, sensor, local_reg, coarse_res);
         }
     }
 
@@ -3920,6 +3916,7 @@ static void genesys_sheetfed_calibration(Genesys_Device* dev, Genesys_Sensor& se
 static void genesys_scanner_calibration(Genesys_Device* dev, Genesys_Sensor& sensor)
 {
     DBG_HELPER(dbg);
+    PerfTimer timer{dev->perf_counters, "calibration"};
     if (!dev->model->is_sheetfed) {
         genesys_flatbed_calibration(dev, sensor);
         return;
@@ -4005,6 +4002,7 @@ static void genesys_warmup_lamp(Genesys_Device* dev)
             break;
         }
 
+        calibration_checkpoint(dev);
         dev->interface->sleep_ms(1000);
         seconds++;
     } while (seconds < WARMUP_TIME);
@@ -4138,7 +4136,15 @@ static void genesys_start_scan(Genesys_Device* dev, bool lamp_off)
         scanner_move_to_ta(*dev);
     }
 
-    init_regs_for_scan(*dev, sensor, dev->reg);
+    if (!is_testing_mode()) {
+        init_regs_for_scan(*dev, sensor, dev->reg);
+    } else {
+        auto begin = std::chrono::steady_clock::now();
+        init_regs_for_scan(*dev, sensor, dev->reg);
+        auto end = std::chrono::steady_clock::now();
+        static_cast<TestScannerInterface&>(*dev->interface).record_time_ms("init_regs_for_scan",
+                std::chrono::duration<double, std::milli>(end - begin).count());
+    }
 
   /* no lamp during scan */
     if (lamp_off) {
@@ -4244,6 +4250,7 @@ static void genesys_read_ordered_data(Genesys_Device* dev, SANE_Byte* destinatio
   /* end scan if all needed data have been read */
    if(dev->total_bytes_read >= dev->total_bytes_to_read)
     {
+        dev->stop_pipeline_read_ahead();
         dev->cmd_set->end_scan(dev, &dev->reg, true);
         if (dev->model->is_sheetfed) {
             dev->cmd_set->eject_document (dev);
@@ -4881,6 +4888,30 @@ static void init_options(Genesys_Scanner* s)
   s->opt[OPT_EXPIRATION_TIME].constraint.range = &expiration_range;
   s->expiration_time = 60;  // 60 minutes by default
 
+    // resolutions to calibrate in the background
+    s->opt[OPT_CALIBRATION_WARMUP].name = "calibration-warmup";
+    s->opt[OPT_CALIBRATION_WARMUP].title = SANE_I18N("Calibration warm-up");
+    s->opt[OPT_CALIBRATION_WARMUP].desc =
+        SANE_I18N("Comma-separated list of resolutions to calibrate in the background so that "
+                  "the first scan at these resolutions does not need to wait for calibration. "
+                  "Each resolution may be prefixed by 'flatbed:', 'transparency:' or "
+                  "'transparency-infrared:' to select the source. Setting the option starts the "
+                  "calibration.");
+    s->opt[OPT_CALIBRATION_WARMUP].type = SANE_TYPE_STRING;
+    s->opt[OPT_CALIBRATION_WARMUP].unit = SANE_UNIT_NONE;
+    s->opt[OPT_CALIBRATION_WARMUP].size = 256;
+    s->opt[OPT_CALIBRATION_WARMUP].cap = SANE_CAP_SOFT_DETECT | SANE_CAP_SOFT_SELECT |
+                                         SANE_CAP_ADVANCED;
+    s->opt[OPT_CALIBRATION_WARMUP].constraint_type = SANE_CONSTRAINT_NONE;
+    s->calibration_warmup.clear();
+    if (const auto* warmup_setting = std::getenv("SANE_GENESYS_CALIBRATION_WARMUP")) {
+        s->calibration_warmup = warmup_setting;
+    }
+    if (model->is_sheetfed) {
+        // sheetfed scanners can calibrate only with a calibration sheet
+        DISABLE(OPT_CALIBRATION_WARMUP);
+    }
+
   /* Powersave time (turn lamp off) */
   s->opt[OPT_LAMP_OFF_TIME].name = "lamp-off-time";
   s->opt[OPT_LAMP_OFF_TIME].title = SANE_I18N ("Lamp off time");
@@ -5224,14 +5255,7 @@ static void probe_genesys_devices()
     DBG(DBG_info, "%s: %zu devices currently attached\n", __func__, s_devices->size());
 }
 
-/**
- * This should be changed if one of the substructures of
-   Genesys_Calibration_Cache change, but it must be changed if there are
-   changes that don't change size -- at least for now, as we store most
-   of Genesys_Calibration_Cache as is.
-*/
 static const char* CALIBRATION_IDENT = "sane_genesys";
-static const int CALIBRATION_VERSION = 31;
 
 bool read_calibration(std::istream& str, Genesys_Device::Calibration& calibration,
                       const std::string& path)
@@ -5261,21 +5285,34 @@ bool read_calibration(std::istream& str, Genesys_Device::Calibration& calibratio
 
 /**
  * reads previously cached calibration data
- * from file defined in dev->calib_file
+ * from file defined in dev->calib_file. Files written in the older text
+ * format are imported and will be converted to the binary format on next save.
  */
-static bool sanei_genesys_read_calibration(Genesys_Device::Calibration& calibration,
+static bool sanei_genesys_read_calibration(CalibrationCache& calibration,
                                            const std::string& path)
 {
     DBG_HELPER(dbg);
 
+    if (calibration.open(path)) {
+        return true;
+    }
+
     std::ifstream str;
     str.open(path);
     if (!str.is_open()) {
-        DBG(DBG_info, "%s: Cannot open %s\n", __func__, path.c_str());
         return false;
     }
 
-    return read_calibration(str, calibration, path);
+    Genesys_Device::Calibration entries;
+    if (!read_calibration(str, entries, path)) {
+        return false;
+    }
+
+    calibration.clear();
+    for (auto& entry : entries) {
+        calibration.insert(std::move(entry));
+    }
+    return true;
 }
 
 void write_calibration(std::ostream& str, Genesys_Device::Calibration& calibration)
@@ -5288,16 +5325,257 @@ void write_calibration(std::ostream& str, Genesys_Device::Calibration& calibrati
     serialize(str, calibration);
 }
 
-static void write_calibration(Genesys_Device::Calibration& calibration, const std::string& path)
+/**
+ * sets up the calibration file name and reads the calibration cache from it unless it has
+ * already been read
+ */
+static void load_calibration_cache(Genesys_Scanner* s)
 {
     DBG_HELPER(dbg);
+    auto* dev = s->dev;
 
-    std::ofstream str;
-    str.open(path);
-    if (!str.is_open()) {
-        throw SaneException("Cannot open calibration for writing");
+    auto path = calibration_filename(dev);
+    s->calibration_file = path;
+    dev->calib_file = path;
+    DBG(DBG_info, "%s: Calibration filename set to:\n", __func__);
+    DBG(DBG_info, "%s: >%s<\n", __func__, dev->calib_file.c_str());
+
+    // the index of the file is kept between scans, so the file needs to be read only when
+    // the path changes
+    if (dev->calibration_cache.path() != dev->calib_file) {
+        catch_all_exceptions(__func__, [&]()
+        {
+            sanei_genesys_read_calibration(dev->calibration_cache, dev->calib_file);
+        });
+    }
+}
+
+struct CalibrationWarmupTarget
+{
+    ScanMethod scan_method = ScanMethod::FLATBED;
+    unsigned resolution = 0;
+};
+
+/**
+ * parses a comma-separated list of resolutions, each optionally prefixed by the scan method,
+ * e.g. "300,600,transparency:1200". Resolutions without a prefix use default_method.
+ */
+static std::vector<CalibrationWarmupTarget>
+    parse_calibration_warmup_targets(const std::string& str, ScanMethod default_method)
+{
+    std::vector<CalibrationWarmupTarget> targets;
+
+    std::istringstream items{str};
+    std::string item;
+    while (std::getline(items, item, ',')) {
+        item.erase(0, item.find_first_not_of(" \t"));
+        item.erase(item.find_last_not_of(" \t") + 1);
+        if (item.empty()) {
+            continue;
+        }
+
+        CalibrationWarmupTarget target;
+        target.scan_method = default_method;
+
+        auto separator = item.find(':');
+        if (separator != std::string::npos) {
+            auto method = item.substr(0, separator);
+            if (method == "flatbed") {
+                target.scan_method = ScanMethod::FLATBED;
+            } else if (method == "transparency") {
+                target.scan_method = ScanMethod::TRANSPARENCY;
+            } else if (method == "transparency-infrared") {
+                target.scan_method = ScanMethod::TRANSPARENCY_INFRARED;
+            } else {
+                throw SaneException(SANE_STATUS_INVAL, "Unknown calibration warm-up source '%s'",
+                                    method.c_str());
+            }
+            item.erase(0, separator + 1);
+        }
+
+        char* end = nullptr;
+        auto resolution = std::strtol(item.c_str(), &end, 10);
+        if (end == item.c_str() || *end != '\0' || resolution <= 0) {
+            throw SaneException(SANE_STATUS_INVAL, "Invalid calibration warm-up resolution '%s'",
+                                item.c_str());
+        }
+        target.resolution = static_cast<unsigned>(resolution);
+        targets.push_back(target);
     }
-    write_calibration(str, calibration);
+    return targets;
+}
+
+/**
+ * calibrates the device for a scan at the given target with the current scan options unless the
+ * calibration cache already has an usable entry. Returns whether calibration has been performed.
+ * Must be called from the calibration warm-up thread with its lock held. The lock is released
+ * between the calibration phases, see calibration_checkpoint().
+ */
+static bool calibrate_warmup_target(Genesys_Scanner* s, const CalibrationWarmupTarget& target,
+                                    bool& lamp_warmed_up)
+{
+    DBG_HELPER_ARGS(dbg, "method: %d, resolution: %d",
+                    static_cast<unsigned>(target.scan_method), target.resolution);
+    auto* dev = s->dev;
+
+    if (!dev->model->has_method(target.scan_method)) {
+        dbg.log(DBG_warn, "scan method not supported by the device");
+        return false;
+    }
+
+    // the settings are computed in the same way as for a scan so that the calibration cache entry
+    // matches the first scan at the target resolution
+    auto saved_resolution = s->resolution;
+    auto saved_scan_method = s->scan_method;
+    s->resolution = target.resolution;
+    s->scan_method = target.scan_method;
+    Genesys_Settings settings;
+    try {
+        settings = calculate_scan_settings(s);
+    } catch (...) {
+        s->resolution = saved_resolution;
+        s->scan_method = saved_scan_method;
+        throw;
+    }
+    s->resolution = saved_resolution;
+    s->scan_method = saved_scan_method;
+
+    auto& warmup = *dev->calibration_warmup;
+    warmup.saved_settings = dev->settings;
+    dev->settings = settings;
+
+    bool calibrated = false;
+    try {
+        auto& sensor = sanei_genesys_find_sensor_for_write(dev, settings.xres,
+                                                           settings.get_channels(),
+                                                           settings.scan_method);
+
+        auto session = dev->cmd_set->calculate_scan_session(dev, sensor, settings);
+        const auto* cache = dev->calibration_cache.find(session.params);
+        if (cache != nullptr &&
+            sanei_genesys_is_compatible_calibration(dev, session, cache, false))
+        {
+            dbg.log(DBG_info, "calibration cache entry already exists");
+        } else {
+            // same preparation as in genesys_start_scan()
+            if (dev->parking) {
+                sanei_genesys_wait_for_home(dev);
+            }
+
+            dev->cmd_set->save_power(dev, false);
+
+            if (!lamp_warmed_up && has_flag(dev->model->flags, ModelFlag::WARMUP) &&
+                settings.scan_method != ScanMethod::TRANSPARENCY_INFRARED)
+            {
+                if (settings.scan_method == ScanMethod::TRANSPARENCY) {
+                    scanner_move_to_ta(*dev);
+                }
+                genesys_warmup_lamp(dev);
+                lamp_warmed_up = true;
+            }
+
+            dev->parking = false;
+            dev->cmd_set->move_back_home(dev, true);
+
+            if (settings.scan_method == ScanMethod::TRANSPARENCY ||
+                settings.scan_method == ScanMethod::TRANSPARENCY_INFRARED)
+            {
+                scanner_move_to_ta(*dev);
+            }
+            calibration_checkpoint(dev);
+
+            dev->cmd_set->send_gamma_table(dev, sensor);
+            genesys_scanner_calibration(dev, sensor);
+            genesys_save_calibration(dev, sensor);
+            calibrated = true;
+        }
+    } catch (...) {
+        dev->settings = warmup.saved_settings;
+        throw;
+    }
+    dev->settings = warmup.saved_settings;
+    return calibrated;
+}
+
+static void run_calibration_warmup(Genesys_Scanner* s, CalibrationWarmupState* state,
+                                   std::vector<CalibrationWarmupTarget> targets)
+{
+    DBG_HELPER(dbg);
+    auto* dev = s->dev;
+
+    bool lamp_warmed_up = false;
+    bool calibrated = false;
+
+    // the lock is released between targets and between the phases of the calibration of each
+    // target, so that stopping the warm-up waits only for the phase that is in progress
+    std::unique_lock<std::mutex> lock{state->mutex, std::defer_lock};
+    state->thread_lock = &lock;
+
+    for (const auto& target : targets) {
+        lock.lock();
+        if (state->cancel_requested) {
+            dbg.log(DBG_info, "cancelled");
+            return;
+        }
+        catch_all_exceptions(__func__, [&]()
+        {
+            if (calibrate_warmup_target(s, target, lamp_warmed_up)) {
+                calibrated = true;
+            }
+        });
+        lock.unlock();
+    }
+
+    lock.lock();
+    if (state->cancel_requested || !calibrated) {
+        return;
+    }
+
+    catch_all_exceptions(__func__, [&]()
+    {
+        dev->cmd_set->move_back_home(dev, true);
+        dev->cmd_set->save_power(dev, true);
+    });
+
+    if (dev->force_calibration == 0 && !is_testing_mode()) {
+        catch_all_exceptions(__func__, [&](){ dev->calibration_cache.save(dev->calib_file); });
+    }
+}
+
+/**
+ * starts calibrating the resolutions listed in the calibration-warmup option in the background
+ * with the current scan options, stopping any previous warm-up. The warm-up is stopped by
+ * sane_start(), so it only ever runs while the device is otherwise idle.
+ */
+static void start_calibration_warmup(Genesys_Scanner* s)
+{
+    DBG_HELPER(dbg);
+    auto* dev = s->dev;
+
+    dev->stop_calibration_warmup();
+
+    auto targets = parse_calibration_warmup_targets(s->calibration_warmup, s->scan_method);
+    if (targets.empty()) {
+        return;
+    }
+
+    bool shading_disabled =
+            has_flag(dev->model->flags, ModelFlag::DISABLE_ADC_CALIBRATION) &&
+            has_flag(dev->model->flags, ModelFlag::DISABLE_EXPOSURE_CALIBRATION) &&
+            has_flag(dev->model->flags, ModelFlag::DISABLE_SHADING_CALIBRATION);
+    if (dev->model->is_sheetfed || shading_disabled || dev->force_calibration != 0) {
+        dbg.log(DBG_info, "calibration is not cached for this device, skipping warm-up");
+        return;
+    }
+
+    // the cache must be read before it's filled, otherwise sane_start() would replace it
+    load_calibration_cache(s);
+
+    // the warm-up thread accesses dev->calibration_warmup, thus it must be set before the thread
+    // is started
+    dev->calibration_warmup.reset(new CalibrationWarmupState);
+    auto* state = dev->calibration_warmup.get();
+    state->thread = std::thread(run_calibration_warmup, s, state, std::move(targets));
 }
 
 /* -------------------------- SANE API functions ------------------------- */
@@ -5542,6 +5820,10 @@ static void sane_open_impl(SANE_String_Const devicename, SANE_Handle * handle)
 
     // some hardware capabilities are detected through sensors
     dev->cmd_set->update_hardware_sensors (s);
+
+    if (!s->calibration_warmup.empty()) {
+        catch_all_exceptions(__func__, [&](){ start_calibration_warmup(s); });
+    }
 }
 
 SANE_GENESYS_API_LINKAGE
@@ -5575,6 +5857,8 @@ sane_close_impl(SANE_Handle handle)
 
     auto* dev = it->dev;
 
+    dev->stop_calibration_warmup();
+
     // eject document for sheetfed scanners
     if (dev->model->is_sheetfed) {
         catch_all_exceptions(__func__, [&](){ dev->cmd_set->eject_document(dev); });
@@ -5590,8 +5874,7 @@ sane_close_impl(SANE_Handle handle)
 
     // here is the place to store calibration cache
     if (dev->force_calibration == 0 && !is_testing_mode()) {
-        catch_all_exceptions(__func__, [&](){ write_calibration(dev->calibration_cache,
-                                                                dev->calib_file); });
+        catch_all_exceptions(__func__, [&](){ dev->calibration_cache.save(dev->calib_file); });
     }
 
     dev->already_initialized = false;
@@ -5745,6 +6028,9 @@ static void get_option_value(Genesys_Scanner* s, int option, void* val)
     case OPT_CALIBRATION_FILE:
         std::strcpy(reinterpret_cast<char*>(val), s->calibration_file.c_str());
         break;
+    case OPT_CALIBRATION_WARMUP:
+        std::strcpy(reinterpret_cast<char*>(val), s->calibration_warmup.c_str());
+        break;
     case OPT_SOURCE:
         std::strcpy(reinterpret_cast<char*>(val), scan_method_to_option_string(s->scan_method));
         break;
@@ -5837,10 +6123,11 @@ static void get_option_value(Genesys_Scanner* s, int option, void* val)
 
             auto session = dev->cmd_set->calculate_scan_session(dev, *sensor, dev->settings);
 
-            for (auto& cache : dev->calibration_cache) {
-                if (sanei_genesys_is_compatible_calibration(dev, session, &cache, false)) {
-                    *reinterpret_cast<SANE_Bool*>(val) = SANE_FALSE;
-                }
+            const auto* cache = dev->calibration_cache.find(session.params);
+            if (cache != nullptr &&
+                sanei_genesys_is_compatible_calibration(dev, session, cache, false))
+            {
+                *reinterpret_cast<SANE_Bool*>(val) = SANE_FALSE;
             }
             *reinterpret_cast<SANE_Bool*>(val) = result;
             break;
@@ -5860,7 +6147,7 @@ static void set_calibration_value(Genesys_Scanner* s, const char* val)
     auto dev = s->dev;
 
     std::string new_calib_path = val;
-    Genesys_Device::Calibration new_calibration;
+    CalibrationCache new_calibration;
 
     bool is_calib_success = false;
     catch_all_exceptions(__func__, [&]()
@@ -6011,6 +6298,11 @@ static void set_option_value(Genesys_Scanner* s, int option, void *val, SANE_Int
             }
             break;
         }
+        case OPT_CALIBRATION_WARMUP: {
+            s->calibration_warmup = reinterpret_cast<const char*>(val);
+            start_calibration_warmup(s);
+            break;
+        }
         case OPT_LAMP_OFF_TIME: {
             if (*reinterpret_cast<SANE_Word*>(val) != s->lamp_off_time) {
                 s->lamp_off_time = *reinterpret_cast<SANE_Word*>(val);
@@ -6145,6 +6437,20 @@ static void set_option_value(Genesys_Scanner* s, int option, void *val, SANE_Int
 
 
 /* sets and gets scanner option values */
+static bool is_calibration_cache_option(int option)
+{
+    switch (option) {
+        case OPT_CALIBRATION_FILE:
+        case OPT_CALIBRATION_WARMUP:
+        case OPT_CALIBRATE:
+        case OPT_CLEAR_CALIBRATION:
+        case OPT_FORCE_CALIBRATION:
+            return true;
+        default:
+            return false;
+    }
+}
+
 void sane_control_option_impl(SANE_Handle handle, SANE_Int option,
                               SANE_Action action, void *val, SANE_Int * info)
 {
@@ -6177,6 +6483,15 @@ void sane_control_option_impl(SANE_Handle handle, SANE_Int option,
         throw SaneException("option %d is inactive", option);
     }
 
+    // options that change the calibration cache stop the calibration warm-up. Other options
+    // only need to wait until it does not access the device.
+    std::unique_lock<std::mutex> warmup_lock;
+    if (action == SANE_ACTION_SET_VALUE && is_calibration_cache_option(option)) {
+        s->dev->stop_calibration_warmup();
+    } else {
+        warmup_lock = s->dev->lock_calibration_warmup();
+    }
+
     switch (action) {
         case SANE_ACTION_GET_VALUE:
             get_option_value(s, option, val);
@@ -6221,6 +6536,7 @@ void sane_get_parameters_impl(SANE_Handle handle, SANE_Parameters* params)
 
   /* don't recompute parameters once data reading is active, ie during scan */
     if (!dev->read_active) {
+        auto warmup_lock = dev->lock_calibration_warmup();
         calc_parameters(s);
     }
     if (params) {
@@ -6249,6 +6565,17 @@ SANE_Status sane_get_parameters(SANE_Handle handle, SANE_Parameters* params)
     });
 }
 
+// Writes the performance counters collected since the last call, if enabled, and resets them
+static void report_perf_counters(Genesys_Device& dev)
+{
+    if (!dev.perf_counters.enabled()) {
+        return;
+    }
+    dev.pipeline.flush_perf_counters();
+    dev.perf_counters.report(dev.file_name);
+    dev.perf_counters.clear();
+}
+
 void sane_start_impl(SANE_Handle handle)
 {
     DBG_HELPER(dbg);
@@ -6262,18 +6589,15 @@ void sane_start_impl(SANE_Handle handle)
         throw SaneException("top left y >= bottom right y");
     }
 
+    // the scan must not wait for calibration of resolutions other than the one being scanned
+    dev->stop_calibration_warmup();
+
+    // the counters of the previous page are reported if sane_cancel() has not been called
+    report_perf_counters(*dev);
+
     // fetch stored calibration
     if (dev->force_calibration == 0) {
-        auto path = calibration_filename(dev);
-        s->calibration_file = path;
-        dev->calib_file = path;
-        DBG(DBG_info, "%s: Calibration filename set to:\n", __func__);
-        DBG(DBG_info, "%s: >%s<\n", __func__, dev->calib_file.c_str());
-
-        catch_all_exceptions(__func__, [&]()
-        {
-            sanei_genesys_read_calibration(dev->calibration_cache, dev->calib_file);
-        });
+        load_calibration_cache(s);
     }
 
     // First make sure we have a current parameter set.  Some of the
@@ -6374,6 +6698,9 @@ void sane_cancel_impl(SANE_Handle handle)
     s->scanning = false;
     dev->read_active = false;
 
+    // the scanner must not be accessed from the background while we stop it
+    dev->stop_pipeline_read_ahead();
+
     // no need to end scan if we are parking the head
     if (!dev->parking) {
         dev->cmd_set->end_scan(dev, &dev->reg, true);
@@ -6394,6 +6721,8 @@ void sane_cancel_impl(SANE_Handle handle)
     if (!dev->parking) {
         dev->cmd_set->save_power(dev, true);
     }
+
+    report_perf_counters(*dev);
 }
 
 SANE_GENESYS_API_LINKAGE
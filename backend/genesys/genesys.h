@@ -114,6 +114,7 @@ enum Genesys_Option
   OPT_COLOR_FILTER,
   OPT_CALIBRATION_FILE,
   OPT_EXPIRATION_TIME,
+  OPT_CALIBRATION_WARMUP,
 
   OPT_SENSOR_GROUP,
   OPT_SCAN_SW,
@@ -221,6 +222,8 @@ struct Genesys_Scanner
     ScanMethod scan_method = ScanMethod::FLATBED;
 
     std::string calibration_file;
+    // the list of resolutions to calibrate in the background, see start_calibration_warmup()
+    std::string calibration_warmup;
     // Button states
     GenesysButton buttons[NUM_BUTTONS];
 
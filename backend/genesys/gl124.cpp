@@ -540,8 +540,7 @@ static void gl124_init_motor_regs_scan(Genesys_Device* dev,
     reg->set16(REG_SCANFED, 4);
 
   /* scan and backtracking slope table */
-    auto scan_table = create_slope_table(dev->model->asic_type, dev->motor, yres,
-                                         scan_exposure_time, 1, motor_profile);
+    auto scan_table = create_slope_table(*dev, yres, scan_exposure_time, 1, motor_profile);
     scanner_send_slope_table(dev, sensor, SCAN_TABLE, scan_table.table);
     scanner_send_slope_table(dev, sensor, BACKTRACK_TABLE, scan_table.table);
 
@@ -556,8 +555,7 @@ static void gl124_init_motor_regs_scan(Genesys_Device* dev,
       fast_dpi*=3;
     }
     */
-    auto fast_table = create_slope_table(dev->model->asic_type, dev->motor, fast_dpi,
-                                         scan_exposure_time, 1, motor_profile);
+    auto fast_table = create_slope_table(*dev, fast_dpi, scan_exposure_time, 1, motor_profile);
     scanner_send_slope_table(dev, sensor, STOP_TABLE, fast_table.table);
     scanner_send_slope_table(dev, sensor, FAST_TABLE, fast_table.table);
 
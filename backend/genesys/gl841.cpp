@@ -567,8 +567,7 @@ static void gl841_init_motor_regs_feed(Genesys_Device* dev, const Genesys_Sensor
     if (fast_profile == nullptr) {
         fast_profile = get_motor_profile_ptr(dev->motor.profiles, 0, session);
     }
-    auto fast_table = create_slope_table_fastest(dev->model->asic_type, step_multiplier,
-                                                 *fast_profile);
+    auto fast_table = create_slope_table_fastest(*dev, step_multiplier, *fast_profile);
 
     // BUG: fast table is counted in base_ydpi / 4
     feedl = feed_steps - fast_table.table.size() * 2;
@@ -658,16 +657,15 @@ static void gl841_init_motor_regs_scan(Genesys_Device* dev, const Genesys_Sensor
         fast_profile = &motor_profile;
     }
 
-    auto slow_table = create_slope_table(dev->model->asic_type, dev->motor, scan_yres,
-                                         scan_exposure_time, step_multiplier, motor_profile);
+    auto slow_table = create_slope_table(*dev, scan_yres, scan_exposure_time, step_multiplier,
+                                         motor_profile);
 
     if (feed_steps < (slow_table.table.size() >> static_cast<unsigned>(motor_profile.step_type))) {
 	/*TODO: what should we do here?? go back to exposure calculation?*/
         feed_steps = slow_table.table.size() >> static_cast<unsigned>(motor_profile.step_type);
     }
 
-    auto fast_table = create_slope_table_fastest(dev->model->asic_type, step_multiplier,
-                                                 *fast_profile);
+    auto fast_table = create_slope_table_fastest(*dev, step_multiplier, *fast_profile);
 
     unsigned max_fast_slope_steps_count = step_multiplier;
     if (feed_steps > (slow_table.table.size() >> static_cast<unsigned>(motor_profile.step_type)) + 2) {
@@ -745,8 +745,7 @@ static void gl843_init_motor_regs_scan(Genesys_Device* dev,
     reg->set8(REG_0x02, reg02);
 
     // scan and backtracking slope table
-    auto scan_table = create_slope_table(dev->model->asic_type, dev->motor, scan_yres, exposure,
-                                         step_multiplier, motor_profile);
+    auto scan_table = create_slope_table(*dev, scan_yres, exposure, step_multiplier, motor_profile);
 
     scanner_send_slope_table(dev, sensor, SCAN_TABLE, scan_table.table);
     scanner_send_slope_table(dev, sensor, BACKTRACK_TABLE, scan_table.table);
@@ -762,8 +761,7 @@ static void gl843_init_motor_regs_scan(Genesys_Device* dev,
         fast_profile = &motor_profile;
     }
 
-    auto fast_table = create_slope_table_fastest(dev->model->asic_type, step_multiplier,
-                                                 *fast_profile);
+    auto fast_table = create_slope_table_fastest(*dev, step_multiplier, *fast_profile);
 
     scanner_send_slope_table(dev, sensor, FAST_TABLE, fast_table.table);
     scanner_send_slope_table(dev, sensor, HOME_TABLE, fast_table.table);
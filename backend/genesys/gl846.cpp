@@ -409,8 +409,8 @@ static void gl846_init_motor_regs_scan(Genesys_Device* dev,
     reg->set8(REG_0x02, reg02);
 
     // scan and backtracking slope table
-    auto scan_table = create_slope_table(dev->model->asic_type, dev->motor, scan_yres,
-                                         scan_exposure_time, step_multiplier, motor_profile);
+    auto scan_table = create_slope_table(*dev, scan_yres, scan_exposure_time, step_multiplier,
+                                         motor_profile);
 
     scanner_send_slope_table(dev, sensor, SCAN_TABLE, scan_table.table);
     scanner_send_slope_table(dev, sensor, BACKTRACK_TABLE, scan_table.table);
@@ -426,8 +426,7 @@ static void gl846_init_motor_regs_scan(Genesys_Device* dev,
         fast_profile = &motor_profile;
     }
 
-    auto fast_table = create_slope_table_fastest(dev->model->asic_type, step_multiplier,
-                                                 *fast_profile);
+    auto fast_table = create_slope_table_fastest(*dev, step_multiplier, *fast_profile);
 
     scanner_send_slope_table(dev, sensor, FAST_TABLE, fast_table.table);
     scanner_send_slope_table(dev, sensor, HOME_TABLE, fast_table.table);
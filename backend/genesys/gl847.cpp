@@ -373,8 +373,8 @@ static void gl847_init_motor_regs_scan(Genesys_Device* dev,
     reg->set8(REG_0x02, reg02);
 
     // scan and backtracking slope table
-    auto scan_table = create_slope_table(dev->model->asic_type, dev->motor, scan_yres,
-                                         scan_exposure_time, step_multiplier, motor_profile);
+    auto scan_table = create_slope_table(*dev, scan_yres, scan_exposure_time, step_multiplier,
+                                         motor_profile);
     scanner_send_slope_table(dev, sensor, SCAN_TABLE, scan_table.table);
     scanner_send_slope_table(dev, sensor, BACKTRACK_TABLE, scan_table.table);
 
@@ -390,8 +390,8 @@ static void gl847_init_motor_regs_scan(Genesys_Device* dev,
     MotorProfile fast_motor_profile = motor_profile;
     fast_motor_profile.step_type = fast_step_type;
 
-    auto fast_table = create_slope_table(dev->model->asic_type, dev->motor, fast_dpi,
-                                         scan_exposure_time, step_multiplier, fast_motor_profile);
+    auto fast_table = create_slope_table(*dev, fast_dpi, scan_exposure_time, step_multiplier,
+                                         fast_motor_profile);
 
     scanner_send_slope_table(dev, sensor, STOP_TABLE, fast_table.table);
     scanner_send_slope_table(dev, sensor, FAST_TABLE, fast_table.table);
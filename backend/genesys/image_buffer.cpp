@@ -45,8 +45,155 @@
 #include "image.h"
 #include "utilities.h"
 
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+
 namespace genesys {
 
+// The state shared between the consumer and the read ahead thread. It is kept separately from
+// ImageBuffer so that the latter can be moved while the thread is running.
+struct ImageBuffer::ReadAheadState
+{
+    struct Chunk
+    {
+        std::vector<std::uint8_t> data;
+        std::size_t size = 0;
+        bool got_data = false;
+    };
+
+    ReadAheadState(ProducerCallback producer, std::size_t chunk_size, std::size_t chunk_count,
+                   std::uint64_t remaining_size, std::uint64_t last_read_multiple) :
+        producer{producer},
+        chunk_size{chunk_size},
+        remaining_size{remaining_size},
+        last_read_multiple{last_read_multiple}
+    {
+        free_buffers.resize(chunk_count);
+        for (auto& buffer : free_buffers) {
+            buffer.resize(chunk_size);
+        }
+        thread = std::thread([this]() { run(); });
+    }
+
+    ~ReadAheadState()
+    {
+        stop();
+    }
+
+    void run();
+    void stop();
+
+    // returns false if no more chunks will be produced
+    bool wait_for_chunk(Chunk& chunk);
+    void release_buffer(std::vector<std::uint8_t>&& buffer);
+
+    ProducerCallback producer;
+    std::size_t chunk_size = 0;
+
+    // accessed only from the read ahead thread
+    std::uint64_t remaining_size = BUFFER_SIZE_UNSET;
+    std::uint64_t last_read_multiple = BUFFER_SIZE_UNSET;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<Chunk> ready_chunks;
+    std::vector<std::vector<std::uint8_t>> free_buffers;
+    bool stop_requested = false;
+    bool finished = false;
+    std::exception_ptr error;
+
+    std::thread thread;
+};
+
+void ImageBuffer::ReadAheadState::run()
+{
+    try {
+        bool got_data = true;
+        while (got_data && remaining_size > 0) {
+            std::vector<std::uint8_t> data;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cond.wait(lock, [&]() { return stop_requested || !free_buffers.empty(); });
+                if (stop_requested) {
+                    break;
+                }
+                data = std::move(free_buffers.back());
+                free_buffers.pop_back();
+            }
+
+            std::size_t size_to_read = chunk_size;
+            if (remaining_size != BUFFER_SIZE_UNSET) {
+                size_to_read = std::min<std::uint64_t>(size_to_read, remaining_size);
+                remaining_size -= size_to_read;
+            }
+
+            std::size_t aligned_size_to_read = size_to_read;
+            if (remaining_size == 0 && last_read_multiple != BUFFER_SIZE_UNSET) {
+                aligned_size_to_read = align_multiple_ceil(size_to_read, last_read_multiple);
+            }
+
+            got_data = producer(aligned_size_to_read, data.data());
+
+            Chunk chunk;
+            chunk.data = std::move(data);
+            chunk.size = size_to_read;
+            chunk.got_data = got_data;
+
+            std::lock_guard<std::mutex> lock(mutex);
+            ready_chunks.push_back(std::move(chunk));
+            cond.notify_all();
+        }
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex);
+        error = std::current_exception();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    finished = true;
+    cond.notify_all();
+}
+
+void ImageBuffer::ReadAheadState::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop_requested = true;
+        cond.notify_all();
+    }
+    if (thread.joinable()) {
+        thread.join();
+    }
+    ready_chunks.clear();
+}
+
+bool ImageBuffer::ReadAheadState::wait_for_chunk(Chunk& chunk)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    cond.wait(lock, [&]() { return finished || !ready_chunks.empty(); });
+
+    if (ready_chunks.empty()) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        return false;
+    }
+    chunk = std::move(ready_chunks.front());
+    ready_chunks.pop_front();
+    return true;
+}
+
+void ImageBuffer::ReadAheadState::release_buffer(std::vector<std::uint8_t>&& buffer)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    free_buffers.push_back(std::move(buffer));
+    cond.notify_all();
+}
+
+ImageBuffer::ImageBuffer() = default;
+
 ImageBuffer::ImageBuffer(std::size_t size, ProducerCallback producer) :
     producer_{producer},
     size_{size}
@@ -54,6 +201,71 @@ ImageBuffer::ImageBuffer(std::size_t size, ProducerCallback producer) :
     buffer_.resize(size_);
 }
 
+ImageBuffer::ImageBuffer(ImageBuffer&& other) = default;
+ImageBuffer& ImageBuffer::operator=(ImageBuffer&& other) = default;
+ImageBuffer::~ImageBuffer() = default;
+
+void ImageBuffer::set_remaining_size(std::uint64_t bytes)
+{
+    if (read_ahead_) {
+        throw SaneException("Can't change remaining size while reading ahead");
+    }
+    remaining_size_ = bytes;
+}
+
+void ImageBuffer::enable_read_ahead(std::size_t chunk_count)
+{
+    if (read_ahead_) {
+        throw SaneException("Read ahead has already been started");
+    }
+    read_ahead_chunk_count_ = chunk_count;
+}
+
+void ImageBuffer::stop_read_ahead()
+{
+    if (read_ahead_) {
+        read_ahead_->stop();
+    } else {
+        // nothing has been read yet, so we can just fall back to reading synchronously
+        read_ahead_chunk_count_ = 0;
+    }
+}
+
+bool ImageBuffer::read_next_chunk(std::size_t size_to_read, std::size_t aligned_size_to_read)
+{
+    if (read_ahead_chunk_count_ == 0) {
+        bool got_data = producer_(aligned_size_to_read, buffer_.data());
+        curr_size_ = size_to_read;
+        return got_data;
+    }
+
+    if (!read_ahead_) {
+        // the data for the current call is read by the thread as well, thus we need to account
+        // for it
+        auto remaining_size = remaining_size_;
+        if (remaining_size != BUFFER_SIZE_UNSET) {
+            remaining_size += size_to_read;
+        }
+        read_ahead_.reset(new ReadAheadState(producer_, size_, read_ahead_chunk_count_,
+                                             remaining_size, last_read_multiple_));
+    }
+
+    ReadAheadState::Chunk chunk;
+    if (!read_ahead_->wait_for_chunk(chunk)) {
+        curr_size_ = 0;
+        return false;
+    }
+    if (chunk.size != size_to_read) {
+        throw SaneException("Unexpected read ahead chunk size %zu, expected %zu",
+                            chunk.size, size_to_read);
+    }
+
+    std::swap(buffer_, chunk.data);
+    read_ahead_->release_buffer(std::move(chunk.data));
+    curr_size_ = chunk.size;
+    return chunk.got_data;
+}
+
 bool ImageBuffer::get_data(std::size_t size, std::uint8_t* out_data)
 {
     const std::uint8_t* out_data_end = out_data + size;
@@ -91,10 +303,19 @@ bool ImageBuffer::get_data(std::size_t size, std::uint8_t* out_data)
             aligned_size_to_read = align_multiple_ceil(size_to_read, last_read_multiple_);
         }
 
-        got_data &= producer_(aligned_size_to_read, buffer_.data());
-        curr_size_ = size_to_read;
-
-        copy_buffer();
+        if (read_ahead_chunk_count_ == 0 && size_to_read == size_ &&
+            aligned_size_to_read == size_to_read &&
+            static_cast<std::size_t>(out_data_end - out_data) >= size_to_read)
+        {
+            // The whole chunk fits into the output, so the producer can write to it directly
+            // without going through the buffer. Only partial chunks need to be buffered.
+            got_data &= producer_(size_to_read, out_data);
+            out_data += size_to_read;
+            curr_size_ = 0;
+        } else {
+            got_data &= read_next_chunk(size_to_read, aligned_size_to_read);
+            copy_buffer();
+        }
 
         if (remaining_size_ == 0 && out_data < out_data_end) {
             got_data = false;
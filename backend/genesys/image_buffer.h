@@ -46,6 +46,7 @@
 #include "row_buffer.h"
 #include <algorithm>
 #include <functional>
+#include <memory>
 
 namespace genesys {
 
@@ -56,22 +57,42 @@ public:
     using ProducerCallback = std::function<bool(std::size_t size, std::uint8_t* out_data)>;
     static constexpr std::uint64_t BUFFER_SIZE_UNSET = std::numeric_limits<std::uint64_t>::max();
 
-    ImageBuffer() {}
+    ImageBuffer();
     ImageBuffer(std::size_t size, ProducerCallback producer);
+    ImageBuffer(ImageBuffer&& other);
+    ImageBuffer& operator=(ImageBuffer&& other);
+    ~ImageBuffer();
 
     std::size_t available() const { return curr_size_ - buffer_offset_; }
 
     // allows adjusting the amount of data left so that we don't do a full size read from the
     // producer on the last iteration. Set to BUFFER_SIZE_UNSET to ignore buffer size.
     std::uint64_t remaining_size() const { return remaining_size_; }
-    void set_remaining_size(std::uint64_t bytes) { remaining_size_ = bytes; }
+    void set_remaining_size(std::uint64_t bytes);
 
     // May be used to force the last read to be rounded up of a certain number of bytes
     void set_last_read_multiple(std::uint64_t bytes) { last_read_multiple_ = bytes; }
 
+    // Enables reading ahead from the producer on a separate thread into a ring of chunk_count
+    // preallocated buffers of the same size as the main buffer. The producer is called from the
+    // worker thread only. The thread is started on the first call to get_data() so that the
+    // remaining size can still be adjusted before that. Once started, the remaining size can no
+    // longer be changed.
+    void enable_read_ahead(std::size_t chunk_count);
+
+    // Stops the read ahead thread, if any. Blocks until the producer call that is currently in
+    // progress finishes. Data that has been read ahead but not consumed is discarded.
+    void stop_read_ahead();
+
+    // Reads size bytes of data into out_data. Whole chunks are written to out_data by the
+    // producer directly unless read ahead is enabled.
     bool get_data(std::size_t size, std::uint8_t* out_data);
 
 private:
+    struct ReadAheadState;
+
+    bool read_next_chunk(std::size_t size_to_read, std::size_t aligned_size_to_read);
+
     ProducerCallback producer_;
     std::size_t size_ = 0;
     std::size_t curr_size_ = 0;
@@ -81,6 +102,9 @@ private:
 
     std::size_t buffer_offset_ = 0;
     std::vector<std::uint8_t> buffer_;
+
+    std::size_t read_ahead_chunk_count_ = 0;
+    std::unique_ptr<ReadAheadState> read_ahead_;
 };
 
 } // namespace genesys
@@ -44,8 +44,26 @@
 #include "image_pipeline.h"
 #include "image.h"
 #include "low.h"
+#include <cctype>
+#include <cfloat>
+#include <chrono>
 #include <cmath>
+#include <condition_variable>
+#include <exception>
+#include <limits>
+#include <mutex>
 #include <numeric>
+#include <sstream>
+#include <thread>
+
+// The SSE2 calibration code produces the same results as the scalar code only if the latter
+// does not use excess floating-point precision
+#if defined(__SSE2__) && defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+    #define USE_SSE2_CALIBRATION 1
+    #include <emmintrin.h>
+#else
+    #define USE_SSE2_CALIBRATION 0
+#endif
 
 namespace genesys {
 
@@ -89,6 +107,14 @@ bool ImagePipelineNodeBufferedCallableSource::get_next_row_data(std::uint8_t* ou
     return got_data;
 }
 
+void ImagePipelineNodeBufferedCallableSource::enable_read_ahead(std::size_t chunk_count)
+{
+    if (buffer_.remaining_size() == ImageBuffer::BUFFER_SIZE_UNSET) {
+        throw SaneException("Can't read ahead when the amount of data to read is not known");
+    }
+    buffer_.enable_read_ahead(chunk_count);
+}
+
 ImagePipelineNodeArraySource::ImagePipelineNodeArraySource(std::size_t width, std::size_t height,
                                                            PixelFormat format,
                                                            std::vector<std::uint8_t> data) :
@@ -171,6 +197,7 @@ ImagePipelineNodeDesegment::ImagePipelineNodeDesegment(ImagePipelineNode& source
         throw SaneException("Height is not a multiple of the number of lines to interelave %zu/%zu",
                             source_.get_height(), interleaved_lines_);
     }
+    row_function_ = get_row_function(get_format());
 }
 
 ImagePipelineNodeDesegment::ImagePipelineNodeDesegment(ImagePipelineNode& source,
@@ -192,27 +219,38 @@ ImagePipelineNodeDesegment::ImagePipelineNodeDesegment(ImagePipelineNode& source
 
     segment_order_.resize(segment_count);
     std::iota(segment_order_.begin(), segment_order_.end(), 0);
+    row_function_ = get_row_function(get_format());
 }
 
-bool ImagePipelineNodeDesegment::get_next_row_data(uint8_t* out_data)
+ImagePipelineNodeDesegment::RowFunction
+    ImagePipelineNodeDesegment::get_row_function(PixelFormat format)
 {
-    bool got_data = true;
-
-    buffer_.clear();
-    for (std::size_t i = 0; i < interleaved_lines_; ++i) {
-        buffer_.push_back();
-        got_data &= source_.get_next_row_data(buffer_.get_row_ptr(i));
-    }
-    if (!buffer_.is_linear()) {
-        throw SaneException("Buffer is not linear");
+    switch (format) {
+        case PixelFormat::I1: return &ImagePipelineNodeDesegment::desegment_row<PixelFormat::I1>;
+        case PixelFormat::RGB111:
+            return &ImagePipelineNodeDesegment::desegment_row<PixelFormat::RGB111>;
+        case PixelFormat::I8: return &ImagePipelineNodeDesegment::desegment_row<PixelFormat::I8>;
+        case PixelFormat::RGB888:
+            return &ImagePipelineNodeDesegment::desegment_row<PixelFormat::RGB888>;
+        case PixelFormat::BGR888:
+            return &ImagePipelineNodeDesegment::desegment_row<PixelFormat::BGR888>;
+        case PixelFormat::I16: return &ImagePipelineNodeDesegment::desegment_row<PixelFormat::I16>;
+        case PixelFormat::RGB161616:
+            return &ImagePipelineNodeDesegment::desegment_row<PixelFormat::RGB161616>;
+        case PixelFormat::BGR161616:
+            return &ImagePipelineNodeDesegment::desegment_row<PixelFormat::BGR161616>;
+        default:
+            throw SaneException("Unknown pixel format %d", static_cast<unsigned>(format));
     }
+}
 
-    auto format = get_format();
-    auto segment_count = segment_order_.size();
-
-    const std::uint8_t* in_data = buffer_.get_row_ptr(0);
+template<PixelFormat Format>
+void ImagePipelineNodeDesegment::desegment_row(const std::uint8_t* in_data, std::uint8_t* out_data)
+{
+    constexpr std::size_t pixel_bytes = PixelFormatTraits<Format>::bytes_per_pixel;
 
-    std::size_t groups_count = output_width_ / (segment_order_.size() * pixels_per_chunk_);
+    auto segment_count = segment_order_.size();
+    std::size_t groups_count = output_width_ / (segment_count * pixels_per_chunk_);
 
     for (std::size_t igroup = 0; igroup < groups_count; ++igroup) {
         for (std::size_t isegment = 0; isegment < segment_count; ++isegment) {
@@ -220,12 +258,39 @@ bool ImagePipelineNodeDesegment::get_next_row_data(uint8_t* out_data)
             input_offset += segment_pixels_ * segment_order_[isegment];
             auto output_offset = (igroup * segment_count + isegment) * pixels_per_chunk_;
 
-            for (std::size_t ipixel = 0; ipixel < pixels_per_chunk_; ++ipixel) {
-                auto pixel = get_raw_pixel_from_row(in_data, input_offset + ipixel, format);
-                set_raw_pixel_to_row(out_data, output_offset + ipixel, pixel, format);
+            if (pixel_bytes == 0) {
+                // there's no per-bit addressing, so pixels need to be copied one by one
+                for (std::size_t ipixel = 0; ipixel < pixels_per_chunk_; ++ipixel) {
+                    auto pixel = get_raw_pixel_from_row(in_data, input_offset + ipixel, Format);
+                    set_raw_pixel_to_row(out_data, output_offset + ipixel, pixel, Format);
+                }
+            } else if (pixels_per_chunk_ == 1) {
+                // the most common case, the copy size is known at compile time
+                std::memcpy(out_data + output_offset * pixel_bytes,
+                            in_data + input_offset * pixel_bytes, pixel_bytes);
+            } else {
+                std::memcpy(out_data + output_offset * pixel_bytes,
+                            in_data + input_offset * pixel_bytes,
+                            pixels_per_chunk_ * pixel_bytes);
             }
         }
     }
+}
+
+bool ImagePipelineNodeDesegment::get_next_row_data(uint8_t* out_data)
+{
+    bool got_data = true;
+
+    buffer_.clear();
+    for (std::size_t i = 0; i < interleaved_lines_; ++i) {
+        buffer_.push_back();
+        got_data &= source_.get_next_row_data(buffer_.get_row_ptr(i));
+    }
+    if (!buffer_.is_linear()) {
+        throw SaneException("Buffer is not linear");
+    }
+
+    (this->*row_function_)(buffer_.get_row_ptr(0), out_data);
     return got_data;
 }
 
@@ -490,6 +555,52 @@ ImagePipelineNodePixelShiftLines::ImagePipelineNodePixelShiftLines(
     } else {
         height_ -= extra_height_;
     }
+    row_function_ = get_row_function(get_format());
+    rows_.resize(pixel_shifts_.size(), nullptr);
+}
+
+ImagePipelineNodePixelShiftLines::RowFunction
+    ImagePipelineNodePixelShiftLines::get_row_function(PixelFormat format)
+{
+    switch (format) {
+        case PixelFormat::I1: return &ImagePipelineNodePixelShiftLines::shift_row<PixelFormat::I1>;
+        case PixelFormat::RGB111:
+            return &ImagePipelineNodePixelShiftLines::shift_row<PixelFormat::RGB111>;
+        case PixelFormat::I8: return &ImagePipelineNodePixelShiftLines::shift_row<PixelFormat::I8>;
+        case PixelFormat::RGB888:
+            return &ImagePipelineNodePixelShiftLines::shift_row<PixelFormat::RGB888>;
+        case PixelFormat::BGR888:
+            return &ImagePipelineNodePixelShiftLines::shift_row<PixelFormat::BGR888>;
+        case PixelFormat::I16:
+            return &ImagePipelineNodePixelShiftLines::shift_row<PixelFormat::I16>;
+        case PixelFormat::RGB161616:
+            return &ImagePipelineNodePixelShiftLines::shift_row<PixelFormat::RGB161616>;
+        case PixelFormat::BGR161616:
+            return &ImagePipelineNodePixelShiftLines::shift_row<PixelFormat::BGR161616>;
+        default:
+            throw SaneException("Unknown pixel format %d", static_cast<unsigned>(format));
+    }
+}
+
+template<PixelFormat Format>
+void ImagePipelineNodePixelShiftLines::shift_row(std::uint8_t* out_data)
+{
+    constexpr std::size_t pixel_bytes = PixelFormatTraits<Format>::bytes_per_pixel;
+
+    auto shift_count = rows_.size();
+
+    for (std::size_t x = 0, width = get_width(); x < width;) {
+        for (std::size_t irow = 0; irow < shift_count && x < width; irow++, x++) {
+            if (pixel_bytes == 0) {
+                // there's no per-bit addressing, so pixels need to be copied one by one
+                RawPixel pixel = get_raw_pixel_from_row(rows_[irow], x, Format);
+                set_raw_pixel_to_row(out_data, x, pixel, Format);
+            } else {
+                std::memcpy(out_data + x * pixel_bytes, rows_[irow] + x * pixel_bytes,
+                            pixel_bytes);
+            }
+        }
+    }
 }
 
 bool ImagePipelineNodePixelShiftLines::get_next_row_data(std::uint8_t* out_data)
@@ -504,22 +615,11 @@ bool ImagePipelineNodePixelShiftLines::get_next_row_data(std::uint8_t* out_data)
         got_data &= source_.get_next_row_data(buffer_.get_back_row_ptr());
     }
 
-    auto format = get_format();
-    auto shift_count = pixel_shifts_.size();
-
-    std::vector<std::uint8_t*> rows;
-    rows.resize(shift_count, nullptr);
-
-    for (std::size_t irow = 0; irow < shift_count; ++irow) {
-        rows[irow] = buffer_.get_row_ptr(pixel_shifts_[irow]);
+    for (std::size_t irow = 0; irow < rows_.size(); ++irow) {
+        rows_[irow] = buffer_.get_row_ptr(pixel_shifts_[irow]);
     }
 
-    for (std::size_t x = 0, width = get_width(); x < width;) {
-        for (std::size_t irow = 0; irow < shift_count && x < width; irow++, x++) {
-            RawPixel pixel = get_raw_pixel_from_row(rows[irow], x, format);
-            set_raw_pixel_to_row(out_data, x, pixel, format);
-        }
-    }
+    (this->*row_function_)(out_data);
     return got_data;
 }
 
@@ -600,63 +700,176 @@ ImagePipelineNodeScaleRows::ImagePipelineNodeScaleRows(ImagePipelineNode& source
     width_{width}
 {
     cached_line_.resize(source_.get_row_bytes());
-}
 
-bool ImagePipelineNodeScaleRows::get_next_row_data(std::uint8_t* out_data)
-{
     auto src_width = source_.get_width();
     auto dst_width = width_;
+    bool downscale = src_width > dst_width;
 
-    bool got_data = source_.get_next_row_data(cached_line_.data());
-
-    const auto* src_data = cached_line_.data();
-    auto format = get_format();
-    auto channels = get_pixel_channels(format);
+    // The source pixels that contribute to each output pixel are distributed using Bresenham's
+    // algorithm. They don't depend on the row data, so they are computed once.
+    if (downscale) {
+        average_spans_.reserve(dst_width);
 
-    if (src_width > dst_width) {
-        // average
         std::uint32_t counter = src_width / 2;
-        unsigned src_x = 0;
-        for (unsigned dst_x = 0; dst_x < dst_width; dst_x++) {
-            unsigned avg[3] = {0, 0, 0};
-            unsigned count = 0;
+        std::size_t src_x = 0;
+        for (std::size_t dst_x = 0; dst_x < dst_width; dst_x++) {
+            std::uint32_t count = 0;
             while (counter < src_width && src_x < src_width) {
                 counter += dst_width;
-
-                for (unsigned c = 0; c < channels; c++) {
-                    avg[c] += get_raw_channel_from_row(src_data, src_x, c, format);
-                }
-
                 src_x++;
                 count++;
             }
             counter -= src_width;
 
-            for (unsigned c = 0; c < channels; c++) {
-                set_raw_channel_to_row(out_data, dst_x, c, avg[c] / count, format);
-            }
+            AverageSpan span;
+            span.count = count;
+            span.reciprocal = 1.0 / count;
+            average_spans_.push_back(span);
         }
     } else {
-        // interpolate and copy pixels
+        src_indices_.reserve(dst_width);
+
         std::uint32_t counter = dst_width / 2;
-        unsigned dst_x = 0;
+        for (std::size_t src_x = 0; src_x < src_width; src_x++) {
+            while ((counter < dst_width || src_x + 1 == src_width) &&
+                   src_indices_.size() < dst_width)
+            {
+                counter += src_width;
+                src_indices_.push_back(src_x);
+            }
+            counter -= dst_width;
+        }
+    }
+
+    row_function_ = get_row_function(get_format(), downscale);
+}
+
+ImagePipelineNodeScaleRows::RowFunction
+    ImagePipelineNodeScaleRows::get_row_function(PixelFormat format, bool downscale)
+{
+    switch (format) {
+        case PixelFormat::I1:
+            return downscale ? &ImagePipelineNodeScaleRows::average_row<PixelFormat::I1>
+                             : &ImagePipelineNodeScaleRows::copy_row<PixelFormat::I1>;
+        case PixelFormat::RGB111:
+            return downscale ? &ImagePipelineNodeScaleRows::average_row<PixelFormat::RGB111>
+                             : &ImagePipelineNodeScaleRows::copy_row<PixelFormat::RGB111>;
+        case PixelFormat::I8:
+            return downscale ? &ImagePipelineNodeScaleRows::average_row<PixelFormat::I8>
+                             : &ImagePipelineNodeScaleRows::copy_row<PixelFormat::I8>;
+        case PixelFormat::RGB888:
+            return downscale ? &ImagePipelineNodeScaleRows::average_row<PixelFormat::RGB888>
+                             : &ImagePipelineNodeScaleRows::copy_row<PixelFormat::RGB888>;
+        case PixelFormat::BGR888:
+            return downscale ? &ImagePipelineNodeScaleRows::average_row<PixelFormat::BGR888>
+                             : &ImagePipelineNodeScaleRows::copy_row<PixelFormat::BGR888>;
+        case PixelFormat::I16:
+            return downscale ? &ImagePipelineNodeScaleRows::average_row<PixelFormat::I16>
+                             : &ImagePipelineNodeScaleRows::copy_row<PixelFormat::I16>;
+        case PixelFormat::RGB161616:
+            return downscale ? &ImagePipelineNodeScaleRows::average_row<PixelFormat::RGB161616>
+                             : &ImagePipelineNodeScaleRows::copy_row<PixelFormat::RGB161616>;
+        case PixelFormat::BGR161616:
+            return downscale ? &ImagePipelineNodeScaleRows::average_row<PixelFormat::BGR161616>
+                             : &ImagePipelineNodeScaleRows::copy_row<PixelFormat::BGR161616>;
+        default:
+            throw SaneException("Unknown pixel format %d", static_cast<unsigned>(format));
+    }
+}
+
+namespace {
 
-        for (unsigned src_x = 0; src_x < src_width; src_x++) {
-            unsigned avg[3] = {0, 0, 0};
+// Accesses a single channel of a pixel. Byte-aligned samples are accessed directly, without
+// dispatching on the pixel format at runtime.
+template<PixelFormat Format>
+inline std::uint32_t read_scale_sample(const std::uint8_t* data, std::size_t x, unsigned channel)
+{
+    constexpr unsigned depth = PixelFormatTraits<Format>::depth;
+    constexpr unsigned channels = PixelFormatTraits<Format>::channels;
+    if (depth == 8) {
+        return data[x * channels + channel];
+    }
+    if (depth == 16) {
+        auto i = (x * channels + channel) * 2;
+        return data[i] | (data[i + 1] << 8);
+    }
+    return get_raw_channel_from_row(data, x, channel, Format);
+}
+
+template<PixelFormat Format>
+inline void write_scale_sample(std::uint8_t* data, std::size_t x, unsigned channel,
+                               std::uint32_t value)
+{
+    constexpr unsigned depth = PixelFormatTraits<Format>::depth;
+    constexpr unsigned channels = PixelFormatTraits<Format>::channels;
+    if (depth == 8) {
+        data[x * channels + channel] = value;
+        return;
+    }
+    if (depth == 16) {
+        auto i = (x * channels + channel) * 2;
+        data[i] = value & 0xff;
+        data[i + 1] = (value >> 8) & 0xff;
+        return;
+    }
+    set_raw_channel_to_row(data, x, channel, value, Format);
+}
+
+} // namespace
+
+template<PixelFormat Format>
+void ImagePipelineNodeScaleRows::average_row(const std::uint8_t* src_data, std::uint8_t* out_data)
+{
+    constexpr unsigned channels = PixelFormatTraits<Format>::channels;
+
+    std::size_t src_x = 0;
+    for (std::size_t dst_x = 0, dst_width = average_spans_.size(); dst_x < dst_width; dst_x++) {
+        const auto& span = average_spans_[dst_x];
+
+        std::uint32_t sums[channels] = {};
+        for (std::uint32_t i = 0; i < span.count; ++i, ++src_x) {
             for (unsigned c = 0; c < channels; c++) {
-                avg[c] += get_raw_channel_from_row(src_data, src_x, c, format);
+                sums[c] += read_scale_sample<Format>(src_data, src_x, c);
             }
-            while ((counter < dst_width || src_x + 1 == src_width) && dst_x < dst_width) {
-                counter += src_width;
+        }
 
-                for (unsigned c = 0; c < channels; c++) {
-                    set_raw_channel_to_row(out_data, dst_x, c, avg[c], format);
-                }
-                dst_x++;
-            }
-            counter -= dst_width;
+        // Computes floor(sum / count) without a division. (sum + 0.5) / count is always at
+        // least 1 / (2 * count) away from an integer, which is much more than the rounding error
+        // of the multiplication, thus the truncated result is exact.
+        for (unsigned c = 0; c < channels; c++) {
+            auto value = static_cast<std::uint32_t>((sums[c] + 0.5) * span.reciprocal);
+            write_scale_sample<Format>(out_data, dst_x, c, value);
+        }
+    }
+}
+
+template<PixelFormat Format>
+void ImagePipelineNodeScaleRows::copy_row(const std::uint8_t* src_data, std::uint8_t* out_data)
+{
+    constexpr std::size_t pixel_bytes = PixelFormatTraits<Format>::bytes_per_pixel;
+
+    if (pixel_bytes != 0 && src_indices_.size() == source_.get_width()) {
+        std::memcpy(out_data, src_data, pixel_bytes * src_indices_.size());
+        return;
+    }
+
+    for (std::size_t dst_x = 0, dst_width = src_indices_.size(); dst_x < dst_width; dst_x++) {
+        auto src_x = src_indices_[dst_x];
+        if (pixel_bytes == 0) {
+            // there's no per-bit addressing, so pixels need to be copied one by one
+            auto pixel = get_raw_pixel_from_row(src_data, src_x, Format);
+            set_raw_pixel_to_row(out_data, dst_x, pixel, Format);
+        } else {
+            std::memcpy(out_data + dst_x * pixel_bytes, src_data + src_x * pixel_bytes,
+                        pixel_bytes);
         }
     }
+}
+
+bool ImagePipelineNodeScaleRows::get_next_row_data(std::uint8_t* out_data)
+{
+    bool got_data = source_.get_next_row_data(cached_line_.data());
+    (this->*row_function_)(cached_line_.data(), out_data);
     return got_data;
 }
 
@@ -708,31 +921,30 @@ bool ImagePipelineNodeExtract::get_next_row_data(std::uint8_t* out_data)
     return got_data;
 }
 
-ImagePipelineNodeCalibrate::ImagePipelineNodeCalibrate(ImagePipelineNode& source,
-                                                       const std::vector<std::uint16_t>& bottom,
-                                                       const std::vector<std::uint16_t>& top,
-                                                       std::size_t x_start) :
-    source_{source}
+namespace {
+
+void compute_calibration(const std::vector<std::uint16_t>& bottom,
+                         const std::vector<std::uint16_t>& top, std::size_t x_start,
+                         std::vector<float>& offset, std::vector<float>& multiplier)
 {
     std::size_t size = 0;
     if (bottom.size() >= x_start && top.size() >= x_start) {
         size = std::min(bottom.size() - x_start, top.size() - x_start);
     }
 
-    offset_.reserve(size);
-    multiplier_.reserve(size);
+    offset.reserve(size);
+    multiplier.reserve(size);
 
     for (std::size_t i = 0; i < size; ++i) {
-        offset_.push_back(bottom[i + x_start] / 65535.0f);
-        multiplier_.push_back(65535.0f / (top[i + x_start] - bottom[i + x_start]));
+        offset.push_back(bottom[i + x_start] / 65535.0f);
+        multiplier.push_back(65535.0f / (top[i + x_start] - bottom[i + x_start]));
     }
 }
 
-bool ImagePipelineNodeCalibrate::get_next_row_data(std::uint8_t* out_data)
+void apply_calibration_reference(std::uint8_t* data, PixelFormat format, std::size_t width,
+                                 const std::vector<float>& offset,
+                                 const std::vector<float>& multiplier)
 {
-    bool ret = source_.get_next_row_data(out_data);
-
-    auto format = get_format();
     auto depth = get_pixel_format_depth(format);
     std::size_t max_value = 1;
     switch (depth) {
@@ -743,25 +955,292 @@ bool ImagePipelineNodeCalibrate::get_next_row_data(std::uint8_t* out_data)
     }
     unsigned channels = get_pixel_channels(format);
 
-    std::size_t max_calib_i = offset_.size();
+    std::size_t max_calib_i = offset.size();
     std::size_t curr_calib_i = 0;
 
-    for (std::size_t x = 0, width = get_width(); x < width && curr_calib_i < max_calib_i; ++x) {
+    for (std::size_t x = 0; x < width && curr_calib_i < max_calib_i; ++x) {
         for (unsigned ch = 0; ch < channels && curr_calib_i < max_calib_i; ++ch) {
-            std::int32_t value = get_raw_channel_from_row(out_data, x, ch, format);
+            std::int32_t value = get_raw_channel_from_row(data, x, ch, format);
 
             float value_f = static_cast<float>(value) / max_value;
-            value_f = (value_f - offset_[curr_calib_i]) * multiplier_[curr_calib_i];
+            value_f = (value_f - offset[curr_calib_i]) * multiplier[curr_calib_i];
             value_f = std::round(value_f * max_value);
             value = clamp<std::int32_t>(static_cast<std::int32_t>(value_f), 0, max_value);
-            set_raw_channel_to_row(out_data, x, ch, value, format);
+            set_raw_channel_to_row(data, x, ch, value, format);
 
             curr_calib_i++;
         }
     }
+}
+
+// Must perform exactly the same operations as apply_calibration_reference()
+inline std::int32_t calibrate_sample(std::int32_t value, float max_value,
+                                     float offset, float multiplier)
+{
+    float value_f = static_cast<float>(value) / max_value;
+    value_f = (value_f - offset) * multiplier;
+    value_f = std::round(value_f * max_value);
+    return clamp<std::int32_t>(static_cast<std::int32_t>(value_f), 0,
+                               static_cast<std::int32_t>(max_value));
+}
+
+inline std::int32_t read_calibration_sample(const std::uint8_t* data, std::size_t i,
+                                            std::size_t sample_bytes)
+{
+    if (sample_bytes == 1) {
+        return data[i];
+    }
+    return data[i * 2] | (data[i * 2 + 1] << 8);
+}
+
+inline void write_calibration_sample(std::uint8_t* data, std::size_t i, std::size_t sample_bytes,
+                                     std::int32_t value)
+{
+    if (sample_bytes == 1) {
+        data[i] = value;
+        return;
+    }
+    data[i * 2] = value & 0xff;
+    data[i * 2 + 1] = (value >> 8) & 0xff;
+}
+
+#if USE_SSE2_CALIBRATION
+// Calibrates 4 samples with the same operations as calibrate_sample(). The division, subtraction
+// and multiplications are correctly rounded in SSE just like in scalar code. std::round() is
+// emulated exactly: the fractional part of a float below 2^23 is computed without rounding error
+// and values at or above 2^23 are already integral. Out of range values and NaNs convert to
+// INT32_MIN just like scalar conversions on x86 and thus are clamped to zero.
+inline __m128i calibrate_samples_sse2(__m128i values, __m128 max_value, const float* offset,
+                                      const float* multiplier)
+{
+    __m128 value_f = _mm_div_ps(_mm_cvtepi32_ps(values), max_value);
+    value_f = _mm_mul_ps(_mm_sub_ps(value_f, _mm_loadu_ps(offset)), _mm_loadu_ps(multiplier));
+    value_f = _mm_mul_ps(value_f, max_value);
+
+    __m128i truncated = _mm_cvttps_epi32(value_f);
+    __m128 fraction = _mm_sub_ps(value_f, _mm_cvtepi32_ps(truncated));
+    __m128 abs_value = _mm_and_ps(value_f, _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff)));
+    __m128 has_fraction = _mm_cmplt_ps(abs_value, _mm_set1_ps(8388608.0f));
+
+    // the comparison masks are -1 where true
+    __m128i round_up = _mm_castps_si128(_mm_and_ps(_mm_cmpge_ps(fraction, _mm_set1_ps(0.5f)),
+                                                   has_fraction));
+    __m128i round_down = _mm_castps_si128(_mm_and_ps(_mm_cmple_ps(fraction, _mm_set1_ps(-0.5f)),
+                                                     has_fraction));
+    __m128i result = _mm_add_epi32(_mm_sub_epi32(truncated, round_up), round_down);
+
+    __m128i max_int = _mm_cvttps_epi32(max_value);
+    result = _mm_and_si128(result, _mm_cmpgt_epi32(result, _mm_setzero_si128()));
+    __m128i above_max = _mm_cmpgt_epi32(result, max_int);
+    return _mm_or_si128(_mm_andnot_si128(above_max, result), _mm_and_si128(above_max, max_int));
+}
+
+std::size_t calibrate_samples_sse2_8bit(std::uint8_t* data, std::size_t count,
+                                        const float* offset, const float* multiplier)
+{
+    __m128 max_value = _mm_set1_ps(255.0f);
+    __m128i zero = _mm_setzero_si128();
+
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i values = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<__m128i*>(data + i)),
+                                           zero);
+        __m128i lo = calibrate_samples_sse2(_mm_unpacklo_epi16(values, zero), max_value,
+                                            offset + i, multiplier + i);
+        __m128i hi = calibrate_samples_sse2(_mm_unpackhi_epi16(values, zero), max_value,
+                                            offset + i + 4, multiplier + i + 4);
+        // the values are already in the [0, 255] range, so saturation does not change them
+        values = _mm_packus_epi16(_mm_packs_epi32(lo, hi), zero);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(data + i), values);
+    }
+    return i;
+}
+
+std::size_t calibrate_samples_sse2_16bit(std::uint8_t* data, std::size_t count,
+                                         const float* offset, const float* multiplier)
+{
+    __m128 max_value = _mm_set1_ps(65535.0f);
+    __m128i zero = _mm_setzero_si128();
+    __m128i bias32 = _mm_set1_epi32(0x8000);
+    __m128i bias16 = _mm_set1_epi16(static_cast<std::int16_t>(0x8000));
+
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        auto* ptr = reinterpret_cast<__m128i*>(data + i * 2);
+        __m128i values = _mm_loadu_si128(ptr);
+        __m128i lo = calibrate_samples_sse2(_mm_unpacklo_epi16(values, zero), max_value,
+                                            offset + i, multiplier + i);
+        __m128i hi = calibrate_samples_sse2(_mm_unpackhi_epi16(values, zero), max_value,
+                                            offset + i + 4, multiplier + i + 4);
+        // SSE2 can only pack with signed saturation, thus the values are shifted into the signed
+        // 16-bit range and back
+        values = _mm_packs_epi32(_mm_sub_epi32(lo, bias32), _mm_sub_epi32(hi, bias32));
+        _mm_storeu_si128(ptr, _mm_xor_si128(values, bias16));
+    }
+    return i;
+}
+#endif
+
+void apply_calibration(std::uint8_t* data, PixelFormat format, std::size_t width,
+                       const std::vector<float>& offset_data,
+                       const std::vector<float>& multiplier_data)
+{
+    std::size_t sample_bytes = 0;
+    float max_value = 0;
+    switch (format) {
+        case PixelFormat::I8:
+        case PixelFormat::RGB888:
+            sample_bytes = 1;
+            max_value = 255;
+            break;
+        case PixelFormat::I16:
+        case PixelFormat::RGB161616:
+            sample_bytes = 2;
+            max_value = 65535;
+            break;
+        default:
+            // BGR formats store channels in a different order than the calibration data
+            apply_calibration_reference(data, format, width, offset_data, multiplier_data);
+            return;
+    }
+
+    std::size_t count = std::min(width * get_pixel_channels(format), offset_data.size());
+    const float* offset = offset_data.data();
+    const float* multiplier = multiplier_data.data();
+
+    std::size_t i = 0;
+#if USE_SSE2_CALIBRATION
+    if (sample_bytes == 1) {
+        i = calibrate_samples_sse2_8bit(data, count, offset, multiplier);
+    } else {
+        i = calibrate_samples_sse2_16bit(data, count, offset, multiplier);
+    }
+#endif
+
+    for (; i < count; ++i) {
+        auto value = read_calibration_sample(data, i, sample_bytes);
+        value = calibrate_sample(value, max_value, offset[i], multiplier[i]);
+        write_calibration_sample(data, i, sample_bytes, value);
+    }
+}
+
+} // namespace
+
+ImagePipelineNodeCalibrate::ImagePipelineNodeCalibrate(ImagePipelineNode& source,
+                                                       const std::vector<std::uint16_t>& bottom,
+                                                       const std::vector<std::uint16_t>& top,
+                                                       std::size_t x_start) :
+    source_{source}
+{
+    compute_calibration(bottom, top, x_start, offset_, multiplier_);
+}
+
+bool ImagePipelineNodeCalibrate::get_next_row_data(std::uint8_t* out_data)
+{
+    bool ret = source_.get_next_row_data(out_data);
+    calibrate_row(out_data);
     return ret;
 }
 
+void ImagePipelineNodeCalibrate::calibrate_row(std::uint8_t* data) const
+{
+    apply_calibration(data, get_format(), get_width(), offset_, multiplier_);
+}
+
+void ImagePipelineNodeCalibrate::calibrate_row_reference(std::uint8_t* data) const
+{
+    apply_calibration_reference(data, get_format(), get_width(), offset_, multiplier_);
+}
+
+ImagePipelineNodeFusedPixelOperations::ImagePipelineNodeFusedPixelOperations(
+        ImagePipelineNode& source, const FusedPixelOperations& operations) :
+    source_(source),
+    format_{source.get_format()},
+    invert_{operations.invert},
+    calibrate_{operations.calibrate}
+{
+    auto src_format = source_.get_format();
+    auto depth = get_pixel_format_depth(src_format);
+    auto channels = get_pixel_channels(src_format);
+
+    bool swap_bytes = operations.swap_16bit_endian && depth == 16;
+    bool swap_channels = false;
+
+    if (operations.dst_format != PixelFormat::UNKNOWN && operations.dst_format != src_format) {
+        if (get_pixel_format_depth(operations.dst_format) != depth || channels != 3 ||
+            get_pixel_channels(operations.dst_format) != 3)
+        {
+            throw SaneException("Unsupported format conversion %d -> %d",
+                                static_cast<unsigned>(src_format),
+                                static_cast<unsigned>(operations.dst_format));
+        }
+        format_ = operations.dst_format;
+        // RGB and BGR formats store the channels in opposite order
+        swap_channels = true;
+    }
+
+    if (swap_bytes || swap_channels) {
+        unsigned sample_bytes = depth / 8;
+        for (unsigned ch = 0; ch < channels; ++ch) {
+            unsigned src_ch = swap_channels ? channels - 1 - ch : ch;
+            for (unsigned i = 0; i < sample_bytes; ++i) {
+                unsigned src_i = swap_bytes ? sample_bytes - 1 - i : i;
+                pixel_permutation_.push_back(src_ch * sample_bytes + src_i);
+            }
+        }
+    }
+
+    if (calibrate_) {
+        compute_calibration(operations.calibration_bottom, operations.calibration_top,
+                            operations.calibration_x_start, offset_, multiplier_);
+    }
+}
+
+template<std::size_t PixelBytes>
+void ImagePipelineNodeFusedPixelOperations::permute_row(std::uint8_t* data)
+{
+    std::uint8_t permutation[PixelBytes];
+    std::copy(pixel_permutation_.begin(), pixel_permutation_.end(), permutation);
+
+    // inversion is the same as flipping all bits regardless of the pixel depth
+    std::uint8_t mask = invert_ ? 0xff : 0;
+
+    for (std::size_t x = 0, width = get_width(); x < width; ++x) {
+        std::uint8_t pixel[PixelBytes];
+        std::memcpy(pixel, data, PixelBytes);
+        for (std::size_t i = 0; i < PixelBytes; ++i) {
+            data[i] = pixel[permutation[i]] ^ mask;
+        }
+        data += PixelBytes;
+    }
+}
+
+bool ImagePipelineNodeFusedPixelOperations::get_next_row_data(std::uint8_t* out_data)
+{
+    bool got_data = source_.get_next_row_data(out_data);
+
+    switch (pixel_permutation_.size()) {
+        case 0: {
+            if (invert_) {
+                for (std::size_t i = 0, size = get_row_bytes(); i < size; ++i) {
+                    out_data[i] = ~out_data[i];
+                }
+            }
+            break;
+        }
+        case 2: permute_row<2>(out_data); break;
+        case 3: permute_row<3>(out_data); break;
+        case 6: permute_row<6>(out_data); break;
+        default:
+            throw SaneException("Unsupported pixel size %zu", pixel_permutation_.size());
+    }
+
+    if (calibrate_) {
+        apply_calibration(out_data, format_, get_width(), offset_, multiplier_);
+    }
+    return got_data;
+}
+
 ImagePipelineNodeDebug::ImagePipelineNodeDebug(ImagePipelineNode& source,
                                                const std::string& path) :
     source_(source),
@@ -791,6 +1270,126 @@ bool ImagePipelineNodeDebug::get_next_row_data(std::uint8_t* out_data)
     return got_data;
 }
 
+ImagePipelineNodeCalibrationAccumulator::ImagePipelineNodeCalibrationAccumulator(
+        ImagePipelineNode& source) :
+    source_(source)
+{
+    auto count = get_width() * get_pixel_channels(get_format());
+    sums_.resize(count, 0);
+    mins_.resize(count, std::numeric_limits<std::uint16_t>::max());
+    maxs_.resize(count, 0);
+    row_function_ = get_row_function(get_format());
+}
+
+ImagePipelineNodeCalibrationAccumulator::RowFunction
+    ImagePipelineNodeCalibrationAccumulator::get_row_function(PixelFormat format)
+{
+    using Node = ImagePipelineNodeCalibrationAccumulator;
+    switch (format) {
+        case PixelFormat::I1: return &Node::accumulate_row<PixelFormat::I1>;
+        case PixelFormat::RGB111: return &Node::accumulate_row<PixelFormat::RGB111>;
+        case PixelFormat::I8: return &Node::accumulate_row<PixelFormat::I8>;
+        case PixelFormat::RGB888: return &Node::accumulate_row<PixelFormat::RGB888>;
+        case PixelFormat::BGR888: return &Node::accumulate_row<PixelFormat::BGR888>;
+        case PixelFormat::I16: return &Node::accumulate_row<PixelFormat::I16>;
+        case PixelFormat::RGB161616: return &Node::accumulate_row<PixelFormat::RGB161616>;
+        case PixelFormat::BGR161616: return &Node::accumulate_row<PixelFormat::BGR161616>;
+        default:
+            throw SaneException("Unknown pixel format %d", static_cast<unsigned>(format));
+    }
+}
+
+template<PixelFormat Format>
+void ImagePipelineNodeCalibrationAccumulator::accumulate_row(const std::uint8_t* data)
+{
+    constexpr unsigned channels = PixelFormatTraits<Format>::channels;
+
+    auto width = get_width();
+
+    if (PixelFormatTraits<Format>::depth == 16) {
+        // 16-bit data has already been converted to host byte order at this point, so it's read
+        // directly just like the rest of the calibration code does.
+        for (std::size_t i = 0; i < width * channels; ++i) {
+            std::uint16_t value;
+            std::memcpy(&value, data + i * 2, 2);
+            sums_[i] += value;
+            mins_[i] = std::min(mins_[i], value);
+            maxs_[i] = std::max(maxs_[i], value);
+        }
+        return;
+    }
+
+    std::size_t i = 0;
+    for (std::size_t x = 0; x < width; ++x) {
+        for (unsigned ch = 0; ch < channels; ++ch, ++i) {
+            auto value = get_raw_channel_from_row<Format>(data, x, ch);
+            sums_[i] += value;
+            mins_[i] = std::min(mins_[i], value);
+            maxs_[i] = std::max(maxs_[i], value);
+        }
+    }
+}
+
+bool ImagePipelineNodeCalibrationAccumulator::get_next_row_data(std::uint8_t* out_data)
+{
+    bool got_data = source_.get_next_row_data(out_data);
+    if (got_data) {
+        (this->*row_function_)(out_data);
+        row_count_++;
+    }
+    return got_data;
+}
+
+void ImagePipelineNodeCalibrationAccumulator::consume_remaining_rows()
+{
+    std::vector<std::uint8_t> row(get_row_bytes());
+    while (!eof()) {
+        if (!get_next_row_data(row.data())) {
+            break;
+        }
+    }
+}
+
+std::vector<std::uint16_t> ImagePipelineNodeCalibrationAccumulator::get_averages() const
+{
+    std::vector<std::uint16_t> averages(sums_.size(), 0);
+    if (row_count_ == 0) {
+        return averages;
+    }
+
+    for (std::size_t i = 0; i < sums_.size(); ++i) {
+        auto sum = sums_[i];
+        auto count = row_count_;
+        if (count >= 3) {
+            sum -= mins_[i];
+            sum -= maxs_[i];
+            count -= 2;
+        }
+        averages[i] = static_cast<std::uint16_t>((sum + count / 2) / count);
+    }
+    return averages;
+}
+
+bool ImagePipelineNodePerfCounter::get_next_row_data(std::uint8_t* out_data)
+{
+    auto start = std::chrono::steady_clock::now();
+    bool got_data = source_.get_next_row_data(out_data);
+    auto time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count();
+
+    time_ns_ += static_cast<std::uint64_t>(time_ns);
+    if (got_data) {
+        row_count_++;
+    }
+    return got_data;
+}
+
+void ImagePipelineNodePerfCounter::reset_counters()
+{
+    row_count_ = 0;
+    time_ns_ = 0;
+}
+
 std::size_t ImagePipelineStack::get_input_width() const
 {
     ensure_node_exists();
@@ -848,6 +1447,10 @@ void ImagePipelineStack::ensure_node_exists() const
 
 void ImagePipelineStack::clear()
 {
+    flush_perf_counters();
+    perf_counter_nodes_.clear();
+    perf_counters_ = nullptr;
+
     // we need to destroy the nodes back to front, so that the destructors still have valid
     // references to sources
     for (auto it = nodes_.rbegin(); it != nodes_.rend(); ++it) {
@@ -856,6 +1459,104 @@ void ImagePipelineStack::clear()
     nodes_.clear();
 }
 
+void ImagePipelineStack::move_from(ImagePipelineStack& other)
+{
+    nodes_ = std::move(other.nodes_);
+    perf_counters_ = other.perf_counters_;
+    perf_counters_prefix_ = std::move(other.perf_counters_prefix_);
+    perf_counter_nodes_ = std::move(other.perf_counter_nodes_);
+
+    other.nodes_.clear();
+    other.perf_counters_ = nullptr;
+    other.perf_counter_nodes_.clear();
+}
+
+void ImagePipelineStack::enable_perf_counters(PerfCounters& counters, const std::string& prefix)
+{
+    if (!counters.enabled()) {
+        return;
+    }
+    perf_counters_ = &counters;
+    perf_counters_prefix_ = prefix;
+}
+
+// Returns the name of the node class without the ImagePipelineNode prefix, e.g. "Desegment"
+static std::string get_pipeline_node_name(const std::type_info& node_type)
+{
+    const std::string prefix = "ImagePipelineNode";
+
+    std::string name = node_type.name();
+    auto pos = name.find(prefix);
+    if (pos == std::string::npos) {
+        return name;
+    }
+
+    // the Itanium C++ ABI mangles identifiers as <length><identifier>, other ABIs include the
+    // plain class name
+    auto digits_begin = pos;
+    while (digits_begin > 0 && std::isdigit(static_cast<unsigned char>(name[digits_begin - 1]))) {
+        digits_begin--;
+    }
+
+    auto end = pos + prefix.size();
+    if (digits_begin < pos) {
+        auto length = std::strtoul(name.substr(digits_begin, pos - digits_begin).c_str(),
+                                   nullptr, 10);
+        end = std::min(name.size(), pos + length);
+    } else {
+        while (end < name.size() &&
+               (std::isalnum(static_cast<unsigned char>(name[end])) || name[end] == '_'))
+        {
+            end++;
+        }
+    }
+    return name.substr(pos + prefix.size(), end - pos - prefix.size());
+}
+
+void ImagePipelineStack::push_perf_counter_node(const std::type_info& node_type)
+{
+    if (!perf_counters_) {
+        return;
+    }
+
+    std::ostringstream name;
+    name << perf_counters_prefix_ << '.';
+    if (perf_counter_nodes_.size() < 10) {
+        name << '0';
+    }
+    name << perf_counter_nodes_.size() << '.' << get_pipeline_node_name(node_type);
+
+    auto* node = new ImagePipelineNodePerfCounter(*nodes_.back(), name.str());
+    nodes_.emplace_back(std::unique_ptr<ImagePipelineNode>(node));
+    perf_counter_nodes_.push_back(node);
+}
+
+void ImagePipelineStack::flush_perf_counters()
+{
+    if (!perf_counters_) {
+        return;
+    }
+
+    // each node measures the time spent in its source including the nodes before it, so the
+    // time measured by the preceding node is subtracted
+    std::uint64_t prev_time_ns = 0;
+    for (auto* node : perf_counter_nodes_) {
+        auto time_ns = node->get_time_ns();
+        auto own_time_ns = time_ns > prev_time_ns ? time_ns - prev_time_ns : 0;
+        prev_time_ns = time_ns;
+
+        if (node->get_row_count() == 0 && time_ns == 0) {
+            continue;
+        }
+        perf_counters_->add(node->get_name(), node->get_row_count(),
+                            node->get_row_count() * node->get_row_bytes(), own_time_ns);
+    }
+
+    for (auto* node : perf_counter_nodes_) {
+        node->reset_counters();
+    }
+}
+
 std::vector<std::uint8_t> ImagePipelineStack::get_all_data()
 {
     auto row_bytes = get_output_row_bytes();
@@ -883,4 +1584,205 @@ Image ImagePipelineStack::get_image()
     return ret;
 }
 
+// The threads that process rows together with the calling thread. Each thread processes rows
+// using a stack with the same index as the thread.
+struct ImagePipelineNodeRowParallel::WorkerPool
+{
+    WorkerPool(ImagePipelineNodeRowParallel& node, std::size_t thread_count) :
+        node{node}
+    {
+        try {
+            for (std::size_t i = 0; i < thread_count; ++i) {
+                threads.emplace_back([this, i]() { run(i + 1); });
+            }
+        } catch (...) {
+            stop();
+            throw;
+        }
+    }
+
+    ~WorkerPool()
+    {
+        stop();
+    }
+
+    // Processes the current batch of rows on all threads. Rethrows any exception thrown while
+    // processing the rows.
+    void process_batch();
+
+    void run(std::size_t stack_index);
+    void stop();
+
+    ImagePipelineNodeRowParallel& node;
+
+    std::mutex mutex;
+    std::condition_variable start_cond;
+    std::condition_variable done_cond;
+    std::size_t generation = 0;
+    std::size_t pending_threads = 0;
+    bool stop_requested = false;
+    std::exception_ptr error;
+
+    std::vector<std::thread> threads;
+};
+
+void ImagePipelineNodeRowParallel::WorkerPool::process_batch()
+{
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        generation++;
+        pending_threads = threads.size();
+        error = nullptr;
+    }
+    start_cond.notify_all();
+
+    std::exception_ptr first_error;
+    try {
+        node.process_rows(0);
+    } catch (...) {
+        first_error = std::current_exception();
+    }
+
+    std::unique_lock<std::mutex> lock{mutex};
+    done_cond.wait(lock, [this]() { return pending_threads == 0; });
+    if (!first_error) {
+        first_error = error;
+    }
+    lock.unlock();
+
+    if (first_error) {
+        std::rethrow_exception(first_error);
+    }
+}
+
+void ImagePipelineNodeRowParallel::WorkerPool::run(std::size_t stack_index)
+{
+    std::size_t processed_generation = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock{mutex};
+            start_cond.wait(lock, [&]()
+            {
+                return stop_requested || generation != processed_generation;
+            });
+            if (stop_requested) {
+                return;
+            }
+            processed_generation = generation;
+        }
+
+        std::exception_ptr thread_error;
+        try {
+            node.process_rows(stack_index);
+        } catch (...) {
+            thread_error = std::current_exception();
+        }
+
+        std::lock_guard<std::mutex> lock{mutex};
+        if (thread_error && !error) {
+            error = thread_error;
+        }
+        if (--pending_threads == 0) {
+            done_cond.notify_one();
+        }
+    }
+}
+
+void ImagePipelineNodeRowParallel::WorkerPool::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        stop_requested = true;
+    }
+    start_cond.notify_all();
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    threads.clear();
+}
+
+ImagePipelineNodeRowParallel::ImagePipelineNodeRowParallel(ImagePipelineNode& source,
+                                                           std::size_t thread_count,
+                                                           std::size_t batch_rows,
+                                                           StageBuilder build_stages) :
+    source_(source),
+    batch_rows_{std::max<std::size_t>(batch_rows, 1)}
+{
+    thread_count = std::max<std::size_t>(thread_count, 1);
+
+    stacks_.resize(thread_count);
+    stack_rows_.resize(thread_count, 0);
+
+    for (std::size_t i = 0; i < thread_count; ++i) {
+        auto& stack = stacks_[i];
+        stack.push_first_node<ImagePipelineNodeCallableSource>(
+                    source_.get_width(), source_.get_height(), source_.get_format(),
+                    [this, i](std::size_t size, std::uint8_t* out_data)
+        {
+            std::memcpy(out_data, in_batch_.data() + stack_rows_[i] * size, size);
+            return true;
+        });
+        build_stages(stack);
+    }
+}
+
+ImagePipelineNodeRowParallel::~ImagePipelineNodeRowParallel() = default;
+
+bool ImagePipelineNodeRowParallel::get_next_row_data(std::uint8_t* out_data)
+{
+    if (next_row_ >= batch_size_) {
+        read_batch();
+    }
+
+    auto row_bytes = get_row_bytes();
+    std::memcpy(out_data, out_batch_.data() + next_row_ * row_bytes, row_bytes);
+    return row_got_data_[next_row_++];
+}
+
+void ImagePipelineNodeRowParallel::read_batch()
+{
+    auto in_row_bytes = source_.get_row_bytes();
+    if (in_batch_.empty()) {
+        in_batch_.resize(batch_rows_ * in_row_bytes);
+        out_batch_.resize(batch_rows_ * get_row_bytes());
+        row_got_data_.resize(batch_rows_);
+    }
+
+    // any rows past the end of the image are passed through one at a time
+    auto height = source_.get_height();
+    batch_size_ = 1;
+    if (rows_read_ < height) {
+        batch_size_ = std::min(batch_rows_, height - rows_read_);
+    }
+
+    for (std::size_t i = 0; i < batch_size_; ++i) {
+        row_got_data_[i] = source_.get_next_row_data(in_batch_.data() + i * in_row_bytes);
+    }
+    rows_read_ += batch_size_;
+    next_row_ = 0;
+
+    if (batch_size_ > 1 && stacks_.size() > 1) {
+        if (!workers_) {
+            workers_.reset(new WorkerPool(*this, stacks_.size() - 1));
+        }
+        workers_->process_batch();
+    } else {
+        process_rows(0);
+    }
+}
+
+void ImagePipelineNodeRowParallel::process_rows(std::size_t stack_index)
+{
+    auto out_row_bytes = get_row_bytes();
+    auto stack_count = stacks_.size();
+
+    for (std::size_t row = stack_index; row < batch_size_; row += stack_count) {
+        stack_rows_[stack_index] = row;
+        bool got_data = stacks_[stack_index].get_next_row_data(out_batch_.data() +
+                                                               row * out_row_bytes);
+        row_got_data_[row] = row_got_data_[row] && got_data;
+    }
+}
+
 } // namespace genesys
@@ -45,10 +45,12 @@
 #include "image.h"
 #include "image_pixel.h"
 #include "image_buffer.h"
+#include "perf_counters.h"
 
 #include <algorithm>
 #include <functional>
 #include <memory>
+#include <typeinfo>
 
 namespace genesys {
 
@@ -125,6 +127,11 @@ public:
     void set_remaining_bytes(std::size_t bytes) { buffer_.set_remaining_size(bytes); }
     void set_last_read_multiple(std::size_t bytes) { buffer_.set_last_read_multiple(bytes); }
 
+    // See ImageBuffer::enable_read_ahead() and ImageBuffer::stop_read_ahead(). The remaining
+    // number of bytes must be known so that the read ahead thread stops at the end of the image.
+    void enable_read_ahead(std::size_t chunk_count);
+    void stop_read_ahead() { buffer_.stop_read_ahead(); }
+
 private:
     ProducerCallback producer_;
     std::size_t width_ = 0;
@@ -239,6 +246,14 @@ public:
     bool get_next_row_data(std::uint8_t* out_data) override;
 
 private:
+    using RowFunction = void (ImagePipelineNodeDesegment::*)(const std::uint8_t* in_data,
+                                                             std::uint8_t* out_data);
+
+    static RowFunction get_row_function(PixelFormat format);
+
+    template<PixelFormat Format>
+    void desegment_row(const std::uint8_t* in_data, std::uint8_t* out_data);
+
     ImagePipelineNode& source_;
     std::size_t output_width_;
     std::vector<unsigned> segment_order_;
@@ -246,6 +261,8 @@ private:
     std::size_t interleaved_lines_ = 0;
     std::size_t pixels_per_chunk_ = 0;
 
+    RowFunction row_function_ = nullptr;
+
     RowBuffer buffer_;
 };
 
@@ -384,13 +401,23 @@ public:
     bool get_next_row_data(std::uint8_t* out_data) override;
 
 private:
+    using RowFunction = void (ImagePipelineNodePixelShiftLines::*)(std::uint8_t* out_data);
+
+    static RowFunction get_row_function(PixelFormat format);
+
+    template<PixelFormat Format>
+    void shift_row(std::uint8_t* out_data);
+
     ImagePipelineNode& source_;
     std::size_t extra_height_ = 0;
     std::size_t height_ = 0;
 
     std::vector<std::size_t> pixel_shifts_;
 
+    RowFunction row_function_ = nullptr;
+
     RowBuffer buffer_;
+    std::vector<const std::uint8_t*> rows_;
 };
 
 // A pipeline node that shifts pixels across columns by the given offsets. Each row is divided
@@ -469,9 +496,35 @@ public:
     bool get_next_row_data(std::uint8_t* out_data) override;
 
 private:
+    using RowFunction = void (ImagePipelineNodeScaleRows::*)(const std::uint8_t* src_data,
+                                                             std::uint8_t* out_data);
+
+    static RowFunction get_row_function(PixelFormat format, bool downscale);
+
+    template<PixelFormat Format>
+    void average_row(const std::uint8_t* src_data, std::uint8_t* out_data);
+
+    template<PixelFormat Format>
+    void copy_row(const std::uint8_t* src_data, std::uint8_t* out_data);
+
+    // Describes how many consecutive source pixels are averaged into a single output pixel
+    struct AverageSpan
+    {
+        std::uint32_t count;
+        // 1.0 / count
+        double reciprocal;
+    };
+
     ImagePipelineNode& source_;
     std::size_t width_ = 0;
 
+    RowFunction row_function_ = nullptr;
+
+    // used when downscaling
+    std::vector<AverageSpan> average_spans_;
+    // used when upscaling, source pixel index for each output pixel
+    std::vector<std::uint32_t> src_indices_;
+
     std::vector<std::uint8_t> cached_line_;
 };
 
@@ -491,6 +544,13 @@ public:
 
     bool get_next_row_data(std::uint8_t* out_data) override;
 
+    // Calibrates a row of data in place. 8 and 16-bit gray and RGB data is processed in bulk,
+    // with SIMD instructions where available. Output is identical to calibrate_row_reference().
+    void calibrate_row(std::uint8_t* data) const;
+
+    // Calibrates a row of data in place using floating-point math one sample at a time.
+    void calibrate_row_reference(std::uint8_t* data) const;
+
 private:
     ImagePipelineNode& source_;
 
@@ -498,6 +558,67 @@ private:
     std::vector<float> multiplier_;
 };
 
+// Describes the per-pixel operations performed by ImagePipelineNodeFusedPixelOperations
+struct FusedPixelOperations
+{
+    // same as ImagePipelineNodeSwap16BitEndian
+    bool swap_16bit_endian = false;
+
+    // same as ImagePipelineNodeInvert
+    bool invert = false;
+
+    // same as ImagePipelineNodeFormatConvert if not PixelFormat::UNKNOWN. Only conversion between
+    // RGB and BGR channel orders is supported.
+    PixelFormat dst_format = PixelFormat::UNKNOWN;
+
+    // same as ImagePipelineNodeCalibrate
+    bool calibrate = false;
+    std::vector<std::uint16_t> calibration_bottom;
+    std::vector<std::uint16_t> calibration_top;
+    std::size_t calibration_x_start = 0;
+
+    bool empty() const
+    {
+        return !swap_16bit_endian && !invert && dst_format == PixelFormat::UNKNOWN && !calibrate;
+    }
+};
+
+// A pipeline node that performs several operations that depend only on the value of each
+// individual pixel. The operations are performed in the order they are listed in
+// FusedPixelOperations and the output is identical to a chain of the respective nodes. The
+// endianness swap, inversion and channel reordering are done in a single pass over the row
+// data, and the data is calibrated while it's still in cache.
+class ImagePipelineNodeFusedPixelOperations : public ImagePipelineNode
+{
+public:
+    ImagePipelineNodeFusedPixelOperations(ImagePipelineNode& source,
+                                          const FusedPixelOperations& operations);
+
+    std::size_t get_width() const override { return source_.get_width(); }
+    std::size_t get_height() const override { return source_.get_height(); }
+    PixelFormat get_format() const override { return format_; }
+
+    bool eof() const override { return source_.eof(); }
+
+    bool get_next_row_data(std::uint8_t* out_data) override;
+
+private:
+    template<std::size_t PixelBytes>
+    void permute_row(std::uint8_t* data);
+
+    ImagePipelineNode& source_;
+    PixelFormat format_ = PixelFormat::UNKNOWN;
+
+    // The endianness swap and channel reordering move bytes within each pixel. Output byte i of
+    // a pixel is taken from byte pixel_permutation_[i]. Empty if no bytes are moved.
+    std::vector<std::uint8_t> pixel_permutation_;
+    bool invert_ = false;
+
+    bool calibrate_ = false;
+    std::vector<float> offset_;
+    std::vector<float> multiplier_;
+};
+
 class ImagePipelineNodeDebug : public ImagePipelineNode
 {
 public:
@@ -518,6 +639,82 @@ private:
     RowBuffer buffer_;
 };
 
+// A pipeline node that passes the data through unchanged and accumulates the sum, the minimum and
+// the maximum of each channel of each pixel over the rows that pass through it. This is used to
+// compute calibration averages while the calibration scan is being read without keeping the whole
+// image in memory.
+class ImagePipelineNodeCalibrationAccumulator : public ImagePipelineNode
+{
+public:
+    ImagePipelineNodeCalibrationAccumulator(ImagePipelineNode& source);
+
+    std::size_t get_width() const override { return source_.get_width(); }
+    std::size_t get_height() const override { return source_.get_height(); }
+    PixelFormat get_format() const override { return source_.get_format(); }
+
+    bool eof() const override { return source_.eof(); }
+
+    bool get_next_row_data(std::uint8_t* out_data) override;
+
+    // Reads all remaining rows from the source and discards them after accumulating
+    void consume_remaining_rows();
+
+    std::size_t get_row_count() const { return row_count_; }
+
+    // Returns the average value of each channel of each pixel, in the order the channels are laid
+    // out in memory. If at least 3 rows have been accumulated, the minimum and the maximum of each
+    // value are excluded from the average so that single outliers caused e.g. by dust don't
+    // affect the result.
+    std::vector<std::uint16_t> get_averages() const;
+
+private:
+    using RowFunction = void (ImagePipelineNodeCalibrationAccumulator::*)(const std::uint8_t* data);
+
+    static RowFunction get_row_function(PixelFormat format);
+
+    template<PixelFormat Format>
+    void accumulate_row(const std::uint8_t* data);
+
+    ImagePipelineNode& source_;
+    std::size_t row_count_ = 0;
+    std::vector<std::uint64_t> sums_;
+    std::vector<std::uint16_t> mins_;
+    std::vector<std::uint16_t> maxs_;
+
+    RowFunction row_function_ = nullptr;
+};
+
+// A pipeline node that passes the data of its source through and measures how many rows the
+// source produced and how long it took. Used by ImagePipelineStack to collect performance counters.
+class ImagePipelineNodePerfCounter : public ImagePipelineNode
+{
+public:
+    ImagePipelineNodePerfCounter(ImagePipelineNode& source, const std::string& name) :
+        source_(source),
+        name_{name}
+    {}
+
+    std::size_t get_width() const override { return source_.get_width(); }
+    std::size_t get_height() const override { return source_.get_height(); }
+    PixelFormat get_format() const override { return source_.get_format(); }
+
+    bool eof() const override { return source_.eof(); }
+
+    bool get_next_row_data(std::uint8_t* out_data) override;
+
+    const std::string& get_name() const { return name_; }
+    std::uint64_t get_row_count() const { return row_count_; }
+    // the time includes the time spent in the nodes before the source
+    std::uint64_t get_time_ns() const { return time_ns_; }
+    void reset_counters();
+
+private:
+    ImagePipelineNode& source_;
+    std::string name_;
+    std::uint64_t row_count_ = 0;
+    std::uint64_t time_ns_ = 0;
+};
+
 class ImagePipelineStack
 {
 public:
@@ -525,13 +722,13 @@ public:
     ImagePipelineStack(ImagePipelineStack&& other)
     {
         clear();
-        nodes_ = std::move(other.nodes_);
+        move_from(other);
     }
 
     ImagePipelineStack& operator=(ImagePipelineStack&& other)
     {
         clear();
-        nodes_ = std::move(other.nodes_);
+        move_from(other);
         return *this;
     }
 
@@ -549,6 +746,8 @@ public:
 
     ImagePipelineNode& front() { return *(nodes_.front().get()); }
 
+    bool empty() const { return nodes_.empty(); }
+
     bool eof() const { return nodes_.back()->eof(); }
 
     void clear();
@@ -559,19 +758,29 @@ public:
         if (!nodes_.empty()) {
             throw SaneException("Trying to append first node when there are existing nodes");
         }
-        nodes_.emplace_back(std::unique_ptr<Node>(new Node(std::forward<Args>(args)...)));
-        return static_cast<Node&>(*nodes_.back());
+        auto* node = new Node(std::forward<Args>(args)...);
+        nodes_.emplace_back(std::unique_ptr<Node>(node));
+        push_perf_counter_node(typeid(Node));
+        return *node;
     }
 
     template<class Node, class... Args>
     Node& push_node(Args&&... args)
     {
         ensure_node_exists();
-        nodes_.emplace_back(std::unique_ptr<Node>(new Node(*nodes_.back(),
-                                                           std::forward<Args>(args)...)));
-        return static_cast<Node&>(*nodes_.back());
+        auto* node = new Node(*nodes_.back(), std::forward<Args>(args)...);
+        nodes_.emplace_back(std::unique_ptr<Node>(node));
+        push_perf_counter_node(typeid(Node));
+        return *node;
     }
 
+    // Enables measuring the number of rows produced and the time spent by each node pushed
+    // afterwards. The counters are named "<prefix>.<index>.<node type>" and are added to
+    // the given object on flush_perf_counters() and when the pipeline is cleared. Does nothing
+    // if the counters are disabled.
+    void enable_perf_counters(PerfCounters& counters, const std::string& prefix);
+    void flush_perf_counters();
+
     bool get_next_row_data(std::uint8_t* out_data)
     {
         return nodes_.back()->get_next_row_data(out_data);
@@ -583,8 +792,62 @@ public:
 
 private:
     void ensure_node_exists() const;
+    void move_from(ImagePipelineStack& other);
+    void push_perf_counter_node(const std::type_info& node_type);
 
     std::vector<std::unique_ptr<ImagePipelineNode>> nodes_;
+
+    PerfCounters* perf_counters_ = nullptr;
+    std::string perf_counters_prefix_;
+    std::vector<ImagePipelineNodePerfCounter*> perf_counter_nodes_;
+};
+
+// A pipeline node that runs a sequence of nodes that don't depend on data from other rows on
+// multiple threads. Batches of rows are read from the source on the calling thread, then the rows
+// are distributed across the threads and are returned in the original order. Each thread uses its
+// own copy of the nodes.
+class ImagePipelineNodeRowParallel : public ImagePipelineNode
+{
+public:
+    // Pushes the nodes to run in parallel onto a stack that already contains the first node
+    using StageBuilder = std::function<void(ImagePipelineStack& stack)>;
+
+    ImagePipelineNodeRowParallel(ImagePipelineNode& source, std::size_t thread_count,
+                                 std::size_t batch_rows, StageBuilder build_stages);
+    ~ImagePipelineNodeRowParallel() override;
+
+    std::size_t get_width() const override { return stacks_.front().get_output_width(); }
+    std::size_t get_height() const override { return stacks_.front().get_output_height(); }
+    PixelFormat get_format() const override { return stacks_.front().get_output_format(); }
+
+    bool eof() const override { return source_.eof() && next_row_ >= batch_size_; }
+
+    bool get_next_row_data(std::uint8_t* out_data) override;
+
+private:
+    struct WorkerPool;
+
+    void read_batch();
+    void process_rows(std::size_t stack_index);
+
+    ImagePipelineNode& source_;
+    std::size_t batch_rows_ = 0;
+
+    // stack with index 0 is used by the calling thread
+    std::vector<ImagePipelineStack> stacks_;
+    // the row within the current batch that each stack is processing
+    std::vector<std::size_t> stack_rows_;
+
+    std::size_t rows_read_ = 0;
+    std::size_t batch_size_ = 0;
+    std::size_t next_row_ = 0;
+    std::vector<std::uint8_t> in_batch_;
+    std::vector<std::uint8_t> out_batch_;
+    // std::vector<bool> is not used because its elements can't be written from multiple threads
+    std::vector<std::uint8_t> row_got_data_;
+
+    // started on the first batch
+    std::unique_ptr<WorkerPool> workers_;
 };
 
 } // namespace genesys
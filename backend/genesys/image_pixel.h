@@ -105,6 +105,27 @@ std::size_t get_pixels_from_row_bytes(PixelFormat format, std::size_t row_bytes)
 
 PixelFormat create_pixel_format(unsigned depth, unsigned channels, ColorOrder order);
 
+// Compile-time properties of pixel formats. Used by row functions that are specialized for a
+// specific format to avoid per-pixel dispatch on the format.
+template<unsigned Depth, unsigned Channels>
+struct PixelFormatTraitsBase
+{
+    static constexpr unsigned depth = Depth;
+    static constexpr unsigned channels = Channels;
+    // zero if pixels are not byte-aligned
+    static constexpr std::size_t bytes_per_pixel = Depth >= 8 ? Depth * Channels / 8 : 0;
+};
+
+template<PixelFormat Format> struct PixelFormatTraits;
+template<> struct PixelFormatTraits<PixelFormat::I1> : PixelFormatTraitsBase<1, 1> {};
+template<> struct PixelFormatTraits<PixelFormat::RGB111> : PixelFormatTraitsBase<1, 3> {};
+template<> struct PixelFormatTraits<PixelFormat::I8> : PixelFormatTraitsBase<8, 1> {};
+template<> struct PixelFormatTraits<PixelFormat::RGB888> : PixelFormatTraitsBase<8, 3> {};
+template<> struct PixelFormatTraits<PixelFormat::BGR888> : PixelFormatTraitsBase<8, 3> {};
+template<> struct PixelFormatTraits<PixelFormat::I16> : PixelFormatTraitsBase<16, 1> {};
+template<> struct PixelFormatTraits<PixelFormat::RGB161616> : PixelFormatTraitsBase<16, 3> {};
+template<> struct PixelFormatTraits<PixelFormat::BGR161616> : PixelFormatTraitsBase<16, 3> {};
+
 // retrieves or sets the logical pixel values in 16-bit range.
 Pixel get_pixel_from_row(const std::uint8_t* data, std::size_t x, PixelFormat format);
 void set_pixel_to_row(std::uint8_t* data, std::size_t x, Pixel pixel, PixelFormat format);
@@ -44,6 +44,7 @@
 
 #include "low.h"
 #include "assert.h"
+#include "test_scanner_interface.h"
 #include "test_settings.h"
 
 #include "gl124_registers.h"
@@ -65,8 +66,10 @@
 #include "gl646.h"
 
 #include <cstdio>
+#include <cstdlib>
 #include <chrono>
 #include <cmath>
+#include <thread>
 #include <vector>
 
 /* ------------------------------------------------------------------------ */
@@ -344,6 +347,8 @@ void wait_until_buffer_non_empty(Genesys_Device* dev, bool check_status_twice)
 {
     // FIXME: reduce MAX_RETRIES once tests are updated
     const unsigned MAX_RETRIES = 100000;
+    // counts the number of polls and the total time spent waiting
+    PerfTimer timer{dev->perf_counters, "wait_until_buffer_non_empty"};
     for (unsigned i = 0; i < MAX_RETRIES; ++i) {
 
         if (check_status_twice) {
@@ -351,6 +356,8 @@ void wait_until_buffer_non_empty(Genesys_Device* dev, bool check_status_twice)
             scanner_read_status(*dev);
         }
 
+        timer.set_count(i + 1);
+
         bool empty = sanei_genesys_is_buffer_empty(dev);
         dev->interface->sleep_ms(10);
         if (!empty)
@@ -389,6 +396,48 @@ void sanei_genesys_read_data_from_scanner(Genesys_Device* dev, uint8_t* data, si
     dev->interface->bulk_read_data(0x45, data, size);
 }
 
+// Adds the nodes that convert the raw data of the given session as read from the scanner to
+// unshuffled, host byte order data
+static void push_unshuffle_nodes(ImagePipelineStack& pipeline, Genesys_Device* dev,
+                                 const ScanSession& session)
+{
+    if (session.segment_count > 1) {
+        auto output_width = session.output_segment_pixel_group_count * session.segment_count;
+        pipeline.push_node<ImagePipelineNodeDesegment>(output_width, dev->segment_order,
+                                                       session.conseq_pixel_dist,
+                                                       1, 1);
+    }
+
+    if (session.params.depth == 16) {
+        unsigned num_swaps = 0;
+        if (has_flag(dev->model->flags, ModelFlag::SWAP_16BIT_DATA)) {
+            num_swaps++;
+        }
+#ifdef WORDS_BIGENDIAN
+        num_swaps++;
+#endif
+        if (num_swaps % 2 != 0) {
+            pipeline.push_node<ImagePipelineNodeSwap16BitEndian>();
+        }
+    }
+
+    if (has_flag(dev->model->flags, ModelFlag::INVERT_PIXEL_DATA)) {
+        pipeline.push_node<ImagePipelineNodeInvert>();
+    }
+
+    if (dev->model->is_cis && session.params.channels == 3) {
+        pipeline.push_node<ImagePipelineNodeMergeMonoLines>(dev->model->line_mode_color_order);
+    }
+
+    if (pipeline.get_output_format() == PixelFormat::BGR888) {
+        pipeline.push_node<ImagePipelineNodeFormatConvert>(PixelFormat::RGB888);
+    }
+
+    if (pipeline.get_output_format() == PixelFormat::BGR161616) {
+        pipeline.push_node<ImagePipelineNodeFormatConvert>(PixelFormat::RGB161616);
+    }
+}
+
 Image read_unshuffled_image_from_scanner(Genesys_Device* dev, const ScanSession& session,
                                          std::size_t total_bytes)
 {
@@ -417,43 +466,141 @@ Image read_unshuffled_image_from_scanner(Genesys_Device* dev, const ScanSession&
     ImagePipelineStack pipeline;
     pipeline.push_first_node<ImagePipelineNodeImageSource>(image);
 
-    if (session.segment_count > 1) {
-        auto output_width = session.output_segment_pixel_group_count * session.segment_count;
-        pipeline.push_node<ImagePipelineNodeDesegment>(output_width, dev->segment_order,
-                                                       session.conseq_pixel_dist,
-                                                       1, 1);
+    push_unshuffle_nodes(pipeline, dev, session);
+
+    return pipeline.get_image();
+}
+
+std::vector<std::uint16_t> read_unshuffled_calibration_averages(Genesys_Device* dev,
+                                                                const ScanSession& session,
+                                                                std::size_t total_bytes,
+                                                                const std::string& debug_path)
+{
+    DBG_HELPER(dbg);
+
+    auto format = create_pixel_format(session.params.depth,
+                                      dev->model->is_cis ? 1 : session.params.channels,
+                                      dev->model->line_mode_color_order);
+
+    auto width = get_pixels_from_row_bytes(format, session.output_line_bytes_raw);
+    auto height = session.optical_line_count;
+
+    auto max_bytes = get_pixel_row_bytes(format, width) * height;
+    if (total_bytes > max_bytes) {
+        throw SaneException("Trying to read too much data %zu (max %zu)", total_bytes, max_bytes);
+    }
+    if (total_bytes != max_bytes) {
+        DBG(DBG_info, "WARNING %s: trying to read not enough data (%zu, full fill %zu)\n", __func__,
+            total_bytes, max_bytes);
     }
 
-    if (session.params.depth == 16) {
-        unsigned num_swaps = 0;
-        if (has_flag(dev->model->flags, ModelFlag::SWAP_16BIT_DATA)) {
-            num_swaps++;
-        }
-#ifdef WORDS_BIGENDIAN
+    wait_until_has_valid_words(dev);
+
+    auto read_data_from_usb = [dev](std::size_t size, std::uint8_t* data)
+    {
+        dev->interface->bulk_read_data(0x45, data, size);
+        return true;
+    };
+
+    // At least GL841 requires reads to be aligned to 2 bytes
+    auto buffer_size = align_multiple_ceil(std::min(session.buffer_size_read, total_bytes), 2);
+
+    ImagePipelineStack pipeline;
+    auto& src_node = pipeline.push_first_node<ImagePipelineNodeBufferedCallableSource>(
+                          width, height, format, buffer_size, read_data_from_usb);
+    src_node.set_remaining_bytes(total_bytes);
+    src_node.set_last_read_multiple(2);
+
+    push_unshuffle_nodes(pipeline, dev, session);
+
+    if (!debug_path.empty()) {
+        pipeline.push_node<ImagePipelineNodeDebug>(debug_path);
+    }
+
+    auto& accumulator = pipeline.push_node<ImagePipelineNodeCalibrationAccumulator>();
+    accumulator.consume_remaining_rows();
+
+    DBG(DBG_info, "%s: accumulated %zu rows\n", __func__, accumulator.get_row_count());
+    return accumulator.get_averages();
+}
+
+std::vector<std::uint16_t> read_raw_calibration_averages(Genesys_Device* dev,
+                                                         const ScanSession& session,
+                                                         std::size_t pixels_per_line,
+                                                         std::size_t line_count,
+                                                         std::size_t total_bytes,
+                                                         const std::string& debug_path)
+{
+    DBG_HELPER_ARGS(dbg, "size = %zu bytes", total_bytes);
+
+    if (line_count == 0) {
+        throw SaneException("invalid line count");
+    }
+
+    // The rows are averaged value by value, so the layout of the channels within a row doesn't
+    // matter. The format only affects how the debug image is written.
+    auto format = session.params.channels == 3 ? PixelFormat::RGB161616 : PixelFormat::I16;
+    auto row_bytes = get_pixel_row_bytes(format, pixels_per_line);
+    auto height = (total_bytes + row_bytes - 1) / row_bytes;
+
+    if (height < line_count) {
+        throw SaneException("Trying to average %zu rows out of %zu", line_count, height);
+    }
+
+    wait_until_has_valid_words(dev);
+
+    auto read_data_from_usb = [dev](std::size_t size, std::uint8_t* data)
+    {
+        dev->interface->bulk_read_data(0x45, data, size);
+        return true;
+    };
+
+    // At least GL841 requires reads to be aligned to 2 bytes
+    auto buffer_size = align_multiple_ceil(std::min(session.buffer_size_read, total_bytes), 2);
+
+    ImagePipelineStack pipeline;
+    auto& src_node = pipeline.push_first_node<ImagePipelineNodeBufferedCallableSource>(
+                          pixels_per_line, height, format, buffer_size, read_data_from_usb);
+    src_node.set_remaining_bytes(total_bytes);
+    src_node.set_last_read_multiple(2);
+
+    unsigned num_swaps = 0;
+    if (has_flag(dev->model->flags, ModelFlag::SWAP_16BIT_DATA)) {
         num_swaps++;
+    }
+#ifdef WORDS_BIGENDIAN
+    num_swaps++;
 #endif
-        if (num_swaps % 2 != 0) {
-            dev->pipeline.push_node<ImagePipelineNodeSwap16BitEndian>();
-        }
+    if (num_swaps % 2 != 0) {
+        pipeline.push_node<ImagePipelineNodeSwap16BitEndian>();
     }
 
     if (has_flag(dev->model->flags, ModelFlag::INVERT_PIXEL_DATA)) {
         pipeline.push_node<ImagePipelineNodeInvert>();
     }
 
-    if (dev->model->is_cis && session.params.channels == 3) {
-        pipeline.push_node<ImagePipelineNodeMergeMonoLines>(dev->model->line_mode_color_order);
+    if (!debug_path.empty()) {
+        pipeline.push_node<ImagePipelineNodeDebug>(debug_path);
     }
 
-    if (pipeline.get_output_format() == PixelFormat::BGR888) {
-        pipeline.push_node<ImagePipelineNodeFormatConvert>(PixelFormat::RGB888);
+    auto& accumulator = pipeline.push_node<ImagePipelineNodeCalibrationAccumulator>();
+
+    std::vector<std::uint8_t> row(row_bytes);
+    for (std::size_t y = 0; y < line_count; ++y) {
+        if (!accumulator.get_next_row_data(row.data())) {
+            throw SaneException("Could not read calibration row %zu", y);
+        }
     }
 
-    if (pipeline.get_output_format() == PixelFormat::BGR161616) {
-        pipeline.push_node<ImagePipelineNodeFormatConvert>(PixelFormat::RGB161616);
+    // the scanner may send more data than is averaged, e.g. an extra line on some ASICs
+    while (src_node.remaining_bytes() > 0) {
+        if (!src_node.get_next_row_data(row.data())) {
+            break;
+        }
     }
 
-    return pipeline.get_image();
+    DBG(DBG_info, "%s: accumulated %zu rows\n", __func__, accumulator.get_row_count());
+    return accumulator.get_averages();
 }
 
 
@@ -914,7 +1061,8 @@ unsigned session_adjust_output_pixels(unsigned output_pixels,
     return output_pixels;
 }
 
-void compute_session(const Genesys_Device* dev, ScanSession& s, const Genesys_Sensor& sensor)
+static void compute_session_impl(const Genesys_Device* dev, ScanSession& s,
+                                 const Genesys_Sensor& sensor)
 {
     DBG_HELPER(dbg);
 
@@ -1135,8 +1283,45 @@ void compute_session(const Genesys_Device* dev, ScanSession& s, const Genesys_Se
     debug_dump(DBG_info, s);
 }
 
+void compute_session(const Genesys_Device* dev, ScanSession& s, const Genesys_Sensor& sensor)
+{
+    if (!is_testing_mode()) {
+        compute_session_impl(dev, s, sensor);
+        return;
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    compute_session_impl(dev, s, sensor);
+    auto end = std::chrono::steady_clock::now();
+    static_cast<TestScannerInterface&>(*dev->interface).record_time_ms("compute_session",
+            std::chrono::duration<double, std::milli>(end - begin).count());
+}
+
+// The number of rows each thread processes at once when the image pipeline runs on multiple
+// threads
+static constexpr std::size_t PIPELINE_ROWS_PER_THREAD = 8;
+
+// The maximum number of threads used by default to process image data
+static constexpr unsigned PIPELINE_DEFAULT_MAX_THREADS = 4;
+
+// Returns the number of threads to process image data on. This is the value of the
+// SANE_GENESYS_PIPELINE_THREADS environment variable if it's set, or a default depending on the
+// number of available processors otherwise.
+static unsigned get_pipeline_thread_count()
+{
+    auto* setting = std::getenv("SANE_GENESYS_PIPELINE_THREADS");
+    if (setting) {
+        auto setting_int = std::strtol(setting, nullptr, 10);
+        if (setting_int > 0) {
+            return std::min<long>(setting_int, 64);
+        }
+    }
+    return std::min(std::thread::hardware_concurrency(), PIPELINE_DEFAULT_MAX_THREADS);
+}
+
 ImagePipelineStack build_image_pipeline(const Genesys_Device& dev, const ScanSession& session,
-                                        unsigned pipeline_index, bool log_image_data)
+                                        unsigned pipeline_index, bool log_image_data,
+                                        PerfCounters* perf_counters)
 {
     auto format = create_pixel_format(session.params.depth,
                                       dev.model->is_cis ? 1 : session.params.channels,
@@ -1159,6 +1344,9 @@ ImagePipelineStack build_image_pipeline(const Genesys_Device& dev, const ScanSes
     auto debug_prefix = "gl_pipeline_" + std::to_string(pipeline_index);
 
     ImagePipelineStack pipeline;
+    if (perf_counters) {
+        pipeline.enable_perf_counters(*perf_counters, "pipeline");
+    }
 
     auto lines = session.optical_line_count;
     auto buffer_size = session.buffer_size_read;
@@ -1186,6 +1374,18 @@ ImagePipelineStack build_image_pipeline(const Genesys_Device& dev, const ScanSes
         }
     }
 
+    // Operations that depend only on the value of each pixel are collected and then performed by
+    // a single pipeline node. When image data is logged, each operation is done separately so that
+    // the intermediate results can be saved.
+    FusedPixelOperations pixel_ops;
+    auto push_pixel_ops = [&]()
+    {
+        if (!pixel_ops.empty()) {
+            pipeline.push_node<ImagePipelineNodeFusedPixelOperations>(pixel_ops);
+            pixel_ops = FusedPixelOperations();
+        }
+    };
+
     if (depth == 16) {
         unsigned num_swaps = 0;
         if (has_flag(dev.model->flags, ModelFlag::SWAP_16BIT_DATA)) {
@@ -1195,23 +1395,26 @@ ImagePipelineStack build_image_pipeline(const Genesys_Device& dev, const ScanSes
         num_swaps++;
 #endif
         if (num_swaps % 2 != 0) {
-            pipeline.push_node<ImagePipelineNodeSwap16BitEndian>();
+            pixel_ops.swap_16bit_endian = true;
 
             if (log_image_data) {
+                push_pixel_ops();
                 pipeline.push_node<ImagePipelineNodeDebug>(debug_prefix + "_2_after_swap.tiff");
             }
         }
     }
 
     if (has_flag(dev.model->flags, ModelFlag::INVERT_PIXEL_DATA)) {
-        pipeline.push_node<ImagePipelineNodeInvert>();
+        pixel_ops.invert = true;
 
         if (log_image_data) {
+            push_pixel_ops();
             pipeline.push_node<ImagePipelineNodeDebug>(debug_prefix + "_3_after_invert.tiff");
         }
     }
 
     if (dev.model->is_cis && session.params.channels == 3) {
+        push_pixel_ops();
         pipeline.push_node<ImagePipelineNodeMergeMonoLines>(dev.model->line_mode_color_order);
 
         if (log_image_data) {
@@ -1220,18 +1423,20 @@ ImagePipelineStack build_image_pipeline(const Genesys_Device& dev, const ScanSes
     }
 
     if (pipeline.get_output_format() == PixelFormat::BGR888) {
-        pipeline.push_node<ImagePipelineNodeFormatConvert>(PixelFormat::RGB888);
+        pixel_ops.dst_format = PixelFormat::RGB888;
     }
 
     if (pipeline.get_output_format() == PixelFormat::BGR161616) {
-        pipeline.push_node<ImagePipelineNodeFormatConvert>(PixelFormat::RGB161616);
+        pixel_ops.dst_format = PixelFormat::RGB161616;
     }
 
     if (log_image_data) {
+        push_pixel_ops();
         pipeline.push_node<ImagePipelineNodeDebug>(debug_prefix + "_5_after_format.tiff");
     }
 
     if (session.max_color_shift_lines > 0 && session.params.channels == 3) {
+        push_pixel_ops();
         pipeline.push_node<ImagePipelineNodeComponentShiftLines>(
                     session.color_shift_lines_r,
                     session.color_shift_lines_g,
@@ -1245,6 +1450,7 @@ ImagePipelineStack build_image_pipeline(const Genesys_Device& dev, const ScanSes
     if (!session.stagger_x.empty()) {
         // FIXME: the image will be scaled to requested pixel count without regard to the reduction
         // of image size in this step.
+        push_pixel_ops();
         pipeline.push_node<ImagePipelineNodePixelShiftColumns>(session.stagger_x.shifts());
 
         if (log_image_data) {
@@ -1253,6 +1459,7 @@ ImagePipelineStack build_image_pipeline(const Genesys_Device& dev, const ScanSes
     }
 
     if (session.num_staggered_lines > 0) {
+        push_pixel_ops();
         pipeline.push_node<ImagePipelineNodePixelShiftLines>(session.stagger_y.shifts());
 
         if (log_image_data) {
@@ -1266,28 +1473,75 @@ ImagePipelineStack build_image_pipeline(const Genesys_Device& dev, const ScanSes
     {
         unsigned offset_pixels = session.params.startx + dev.calib_session.shading_pixel_offset;
         unsigned offset_bytes = offset_pixels * dev.calib_session.params.channels;
-        pipeline.push_node<ImagePipelineNodeCalibrate>(dev.dark_average_data,
-                                                       dev.white_average_data, offset_bytes);
+        pixel_ops.calibrate = true;
+        pixel_ops.calibration_bottom = dev.dark_average_data;
+        pixel_ops.calibration_top = dev.white_average_data;
+        pixel_ops.calibration_x_start = offset_bytes;
 
         if (log_image_data) {
+            push_pixel_ops();
             pipeline.push_node<ImagePipelineNodeDebug>(debug_prefix + "_9_after_calibrate.tiff");
         }
     }
 
-    if (pipeline.get_output_width() != session.params.get_requested_pixels()) {
-        pipeline.push_node<ImagePipelineNodeScaleRows>(session.params.get_requested_pixels());
+    // The remaining operations don't depend on data from other rows
+    auto requested_pixels = session.params.get_requested_pixels();
+    bool needs_scaling = pipeline.get_output_width() != requested_pixels;
+
+    auto push_row_local_nodes = [pixel_ops, needs_scaling, requested_pixels](
+            ImagePipelineStack& stack)
+    {
+        if (!pixel_ops.empty()) {
+            stack.push_node<ImagePipelineNodeFusedPixelOperations>(pixel_ops);
+        }
+        if (needs_scaling) {
+            stack.push_node<ImagePipelineNodeScaleRows>(requested_pixels);
+        }
+    };
+
+    // Sheetfed scanners adjust the amount of data to read after the document end is detected,
+    // thus rows must not be read from the scanner ahead of time.
+    auto thread_count = get_pipeline_thread_count();
+    if (thread_count > 1 && !dev.model->is_sheetfed && (!pixel_ops.empty() || needs_scaling)) {
+        pipeline.push_node<ImagePipelineNodeRowParallel>(thread_count,
+                                                         thread_count * PIPELINE_ROWS_PER_THREAD,
+                                                         push_row_local_nodes);
+    } else {
+        push_row_local_nodes(pipeline);
     }
 
     return pipeline;
 }
 
+// The number of chunks of session.buffer_size_read bytes that may be read from the scanner ahead
+// of the image pipeline
+static constexpr std::size_t PIPELINE_READ_AHEAD_CHUNK_COUNT = 3;
+
 void setup_image_pipeline(Genesys_Device& dev, const ScanSession& session)
 {
     static unsigned s_pipeline_index = 0;
 
     s_pipeline_index++;
 
-    dev.pipeline = build_image_pipeline(dev, session, s_pipeline_index, dbg_log_image_data());
+    dev.pipeline = build_image_pipeline(dev, session, s_pipeline_index, dbg_log_image_data(),
+                                        &dev.perf_counters);
+
+    // Keep reading from USB while the image data is being processed so that the scanner buffer
+    // does not fill up and the head does not need to stop and move back. Sheetfed scanners
+    // adjust the amount of data to read after document end is detected, so this can't be used
+    // there.
+    //
+    // The read ahead thread must stop at the end of the image, otherwise it would issue bulk
+    // reads that block until the USB timeout. sanei_usb is not safe to be called concurrently
+    // for the same device, thus while reading ahead the device is accessed only from the read
+    // ahead thread. Any other access must be preceded by a call to
+    // Genesys_Device::stop_pipeline_read_ahead().
+    if (!dev.model->is_sheetfed) {
+        auto& src_node = dev.get_pipeline_source();
+        src_node.set_remaining_bytes(static_cast<std::uint64_t>(session.output_line_bytes_raw) *
+                                     session.optical_line_count);
+        src_node.enable_read_ahead(PIPELINE_READ_AHEAD_CHUNK_COUNT);
+    }
 
     auto read_from_pipeline = [&dev](std::size_t size, std::uint8_t* out_data)
     {
@@ -1737,26 +1991,25 @@ const MotorProfile& get_motor_profile(const std::vector<MotorProfile>& profiles,
     return *profile;
 }
 
-MotorSlopeTable create_slope_table(AsicType asic_type, const Genesys_Motor& motor, unsigned ydpi,
-                                   unsigned exposure, unsigned step_multiplier,
-                                   const MotorProfile& motor_profile)
+MotorSlopeTable create_slope_table(Genesys_Device& dev, unsigned ydpi, unsigned exposure,
+                                   unsigned step_multiplier, const MotorProfile& motor_profile)
 {
-    unsigned target_speed_w = ((exposure * ydpi) / motor.base_ydpi);
+    unsigned target_speed_w = ((exposure * ydpi) / dev.motor.base_ydpi);
 
-    auto table = create_slope_table_for_speed(motor_profile.slope, target_speed_w,
-                                              motor_profile.step_type,
-                                              step_multiplier, 2 * step_multiplier,
-                                              get_slope_table_max_size(asic_type));
+    auto table = dev.slope_table_cache.get(motor_profile.slope, target_speed_w,
+                                           motor_profile.step_type,
+                                           step_multiplier, 2 * step_multiplier,
+                                           get_slope_table_max_size(dev.model->asic_type));
     return table;
 }
 
-MotorSlopeTable create_slope_table_fastest(AsicType asic_type, unsigned step_multiplier,
+MotorSlopeTable create_slope_table_fastest(Genesys_Device& dev, unsigned step_multiplier,
                                            const MotorProfile& motor_profile)
 {
-    return create_slope_table_for_speed(motor_profile.slope, motor_profile.slope.max_speed_w,
-                                        motor_profile.step_type,
-                                        step_multiplier, 2 * step_multiplier,
-                                        get_slope_table_max_size(asic_type));
+    return dev.slope_table_cache.get(motor_profile.slope, motor_profile.slope.max_speed_w,
+                                     motor_profile.step_type,
+                                     step_multiplier, 2 * step_multiplier,
+                                     get_slope_table_max_size(dev.model->asic_type));
 }
 
 /** @brief returns the lowest possible ydpi for the device
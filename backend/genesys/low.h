@@ -87,6 +87,7 @@
 #include "serialize.h"
 #include "settings.h"
 #include "static_init.h"
+#include "table_index.h"
 #include "status.h"
 #include "register.h"
 
@@ -339,6 +340,27 @@ extern void sanei_genesys_read_data_from_scanner(Genesys_Device* dev, uint8_t* d
 Image read_unshuffled_image_from_scanner(Genesys_Device* dev, const ScanSession& session,
                                          std::size_t total_bytes);
 
+// Reads the data of a calibration scan in chunks, unshuffles it the same way as
+// read_unshuffled_image_from_scanner() and returns the average of each channel of each pixel
+// across all rows. The whole image is never held in memory. If debug_path is not empty, the
+// unshuffled image is additionally written to that file.
+std::vector<std::uint16_t> read_unshuffled_calibration_averages(Genesys_Device* dev,
+                                                                const ScanSession& session,
+                                                                std::size_t total_bytes,
+                                                                const std::string& debug_path);
+
+// Reads the data of a calibration scan in chunks exactly as it comes from the scanner, without
+// unshuffling, and returns the average of each 16-bit value of a row of pixels_per_line pixels
+// across the first line_count rows. Any remaining data is read and discarded. The whole image is
+// never held in memory. If debug_path is not empty, the averaged rows are additionally written to
+// that file.
+std::vector<std::uint16_t> read_raw_calibration_averages(Genesys_Device* dev,
+                                                         const ScanSession& session,
+                                                         std::size_t pixels_per_line,
+                                                         std::size_t line_count,
+                                                         std::size_t total_bytes,
+                                                         const std::string& debug_path);
+
 void regs_set_exposure(AsicType asic_type, Genesys_Register_Set& regs,
                        const SensorExposure& exposure);
 
@@ -377,11 +399,12 @@ const MotorProfile& get_motor_profile(const std::vector<MotorProfile>& profiles,
                                       unsigned exposure,
                                       const ScanSession& session);
 
-MotorSlopeTable create_slope_table(AsicType asic_type, const Genesys_Motor& motor, unsigned ydpi,
-                                   unsigned exposure, unsigned step_multiplier,
-                                   const MotorProfile& motor_profile);
+// The following functions create slope tables for the motor of the given device. The tables are
+// cached in dev.slope_table_cache.
+MotorSlopeTable create_slope_table(Genesys_Device& dev, unsigned ydpi, unsigned exposure,
+                                   unsigned step_multiplier, const MotorProfile& motor_profile);
 
-MotorSlopeTable create_slope_table_fastest(AsicType asic_type, unsigned step_multiplier,
+MotorSlopeTable create_slope_table_fastest(Genesys_Device& dev, unsigned step_multiplier,
                                            const MotorProfile& motor_profile);
 
 /** @brief find lowest motor resolution for the device.
@@ -426,8 +449,11 @@ unsigned session_adjust_output_pixels(unsigned output_pixels,
 
 void compute_session(const Genesys_Device* dev, ScanSession& s, const Genesys_Sensor& sensor);
 
+// If perf_counters is not null, the number of rows produced and the time spent by each node of
+// the pipeline are added to it.
 ImagePipelineStack build_image_pipeline(const Genesys_Device& dev, const ScanSession& session,
-                                        unsigned pipeline_index, bool log_image_data);
+                                        unsigned pipeline_index, bool log_image_data,
+                                        PerfCounters* perf_counters = nullptr);
 
 // sets up a image pipeline for device `dev`
 void setup_image_pipeline(Genesys_Device& dev, const ScanSession& session);
@@ -446,6 +472,12 @@ extern StaticInit<std::vector<MemoryLayout>> s_memory_layout;
 extern StaticInit<std::vector<Genesys_Motor>> s_motors;
 extern StaticInit<std::vector<UsbDeviceEntry>> s_usb_devices;
 
+// Lookup indices for the above tables. These are built at the end of the corresponding
+// genesys_init_*_tables() function.
+extern StaticInit<SensorTableIndex> s_sensor_index;
+extern StaticInit<IdTableIndex<AdcId>> s_frontend_index;
+extern StaticInit<IdTableIndex<MotorId>> s_motor_index;
+
 void genesys_init_sensor_tables();
 void genesys_init_frontend_tables();
 void genesys_init_gpo_tables();
@@ -171,6 +171,76 @@ MotorSlopeTable create_slope_table_for_speed(const MotorSlope& slope, unsigned t
     return table;
 }
 
+bool MotorSlopeTableCache::Key::operator==(const Key& other) const
+{
+    return initial_speed_w == other.initial_speed_w &&
+            max_speed_w == other.max_speed_w &&
+            acceleration == other.acceleration &&
+            target_speed_w == other.target_speed_w &&
+            step_type == other.step_type &&
+            steps_alignment == other.steps_alignment &&
+            min_size == other.min_size &&
+            max_size == other.max_size;
+}
+
+std::size_t MotorSlopeTableCache::KeyHash::operator()(const Key& key) const
+{
+    std::size_t hash = std::hash<float>()(key.acceleration);
+    for (unsigned value : { key.initial_speed_w, key.max_speed_w, key.target_speed_w,
+                            static_cast<unsigned>(key.step_type), key.steps_alignment,
+                            key.min_size, key.max_size })
+    {
+        hash = hash * 31 + value;
+    }
+    return hash;
+}
+
+MotorSlopeTable MotorSlopeTableCache::get(const MotorSlope& slope, unsigned target_speed_w,
+                                          StepType step_type, unsigned steps_alignment,
+                                          unsigned min_size, unsigned max_size)
+{
+    // note that MotorSlope::max_step_count is not used when creating the table
+    Key key;
+    key.initial_speed_w = slope.initial_speed_w;
+    key.max_speed_w = slope.max_speed_w;
+    key.acceleration = slope.acceleration;
+    key.target_speed_w = target_speed_w;
+    key.step_type = step_type;
+    key.steps_alignment = steps_alignment;
+    key.min_size = min_size;
+    key.max_size = max_size;
+
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        auto it = tables_.find(key);
+        if (it != tables_.end()) {
+            return it->second;
+        }
+    }
+
+    auto table = create_slope_table_for_speed(slope, target_speed_w, step_type, steps_alignment,
+                                              min_size, max_size);
+
+    std::lock_guard<std::mutex> lock{mutex_};
+    if (tables_.size() >= MAX_SIZE) {
+        tables_.clear();
+    }
+    tables_.emplace(key, table);
+    return table;
+}
+
+std::size_t MotorSlopeTableCache::size() const
+{
+    std::lock_guard<std::mutex> lock{mutex_};
+    return tables_.size();
+}
+
+void MotorSlopeTableCache::clear()
+{
+    std::lock_guard<std::mutex> lock{mutex_};
+    tables_.clear();
+}
+
 std::ostream& operator<<(std::ostream& out, const MotorSlope& slope)
 {
     out << "MotorSlope{\n"
@@ -44,6 +44,8 @@
 
 #include <algorithm>
 #include <cstdint>
+#include <mutex>
+#include <unordered_map>
 #include <vector>
 #include "enums.h"
 #include "sensor.h"
@@ -143,6 +145,48 @@ MotorSlopeTable create_slope_table_for_speed(const MotorSlope& slope, unsigned t
                                              StepType step_type, unsigned steps_alignment,
                                              unsigned min_size, unsigned max_size);
 
+// Caches the slope tables created by create_slope_table_for_speed(). The tables depend only on
+// the parameters of that function, but computing them requires a square root per step and the
+// same few tables are needed for each scan, calibration pass, move and park.
+class MotorSlopeTableCache
+{
+public:
+    // Returns the same table as create_slope_table_for_speed() would return for the same
+    // parameters
+    MotorSlopeTable get(const MotorSlope& slope, unsigned target_speed_w, StepType step_type,
+                        unsigned steps_alignment, unsigned min_size, unsigned max_size);
+
+    std::size_t size() const;
+    void clear();
+
+private:
+    struct Key
+    {
+        unsigned initial_speed_w = 0;
+        unsigned max_speed_w = 0;
+        float acceleration = 0;
+        unsigned target_speed_w = 0;
+        StepType step_type = StepType::FULL;
+        unsigned steps_alignment = 0;
+        unsigned min_size = 0;
+        unsigned max_size = 0;
+
+        bool operator==(const Key& other) const;
+    };
+
+    struct KeyHash
+    {
+        std::size_t operator()(const Key& key) const;
+    };
+
+    // The maximum number of tables to keep. The number of distinct tables used by a device is
+    // small, so this limit is reached only if exposure changes a lot, e.g. during calibration.
+    static constexpr std::size_t MAX_SIZE = 256;
+
+    mutable std::mutex mutex_;
+    std::unordered_map<Key, MotorSlopeTable, KeyHash> tables_;
+};
+
 std::ostream& operator<<(std::ostream& out, const MotorSlope& slope);
 
 struct MotorProfile
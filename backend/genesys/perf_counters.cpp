@@ -0,0 +1,207 @@
+/* sane - Scanner Access Now Easy.
+
+   Copyright (C) 2026 agent <agent@local>
+
+   This file is part of the SANE package.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+   As a special exception, the authors of SANE give permission for
+   additional uses of the libraries contained in this release of SANE.
+
+   The exception is that, if you link a SANE library with other files
+   to produce an executable, this does not by itself cause the
+   resulting executable to be covered by the GNU General Public
+   License.  Your use of that executable is in no way restricted on
+   account of linking the SANE library code into it.
+
+   This exception does not, however, invalidate any other reasons why
+   the executable file might be covered by the GNU General Public
+   License.
+
+   If you submit changes to SANE to the maintainers to be included in
+   a subsequent release, you agree by submitting the changes that
+   those changes may be distributed with this exception intact.
+
+   If you write modifications of your own for SANE, it is your choice
+   whether to permit this exception to apply to your modifications.
+   If you do not wish that, delete this exception notice.
+*/
+
+#define DEBUG_DECLARE_ONLY
+
+#include "perf_counters.h"
+#include "error.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+namespace genesys {
+
+namespace {
+
+struct PerfCountersSetting
+{
+    bool enabled = false;
+    // empty if the report should be written to stderr
+    std::string path;
+};
+
+PerfCountersSetting read_perf_counters_setting()
+{
+    PerfCountersSetting setting;
+
+    const char* value = std::getenv("SANE_DEBUG_GENESYS_PERF");
+    if (value == nullptr || *value == '\0') {
+        return setting;
+    }
+
+    char* end = nullptr;
+    auto value_int = std::strtol(value, &end, 10);
+    if (*end == '\0') {
+        setting.enabled = value_int != 0;
+        return setting;
+    }
+
+    setting.enabled = true;
+    setting.path = value;
+    return setting;
+}
+
+const PerfCountersSetting& get_perf_counters_setting()
+{
+    static const PerfCountersSetting setting = read_perf_counters_setting();
+    return setting;
+}
+
+void write_json_string(std::ostream& out, const std::string& str)
+{
+    out << '"';
+    for (char c : str) {
+        if (c == '"' || c == '\\') {
+            out << '\\';
+        }
+        out << c;
+    }
+    out << '"';
+}
+
+} // namespace
+
+bool perf_counters_enabled()
+{
+    return get_perf_counters_setting().enabled;
+}
+
+void PerfCounters::add(const char* name, std::uint64_t count, std::uint64_t bytes,
+                       std::uint64_t time_ns)
+{
+    if (!enabled_) {
+        return;
+    }
+    add(std::string{name}, count, bytes, time_ns);
+}
+
+void PerfCounters::add(const std::string& name, std::uint64_t count, std::uint64_t bytes,
+                       std::uint64_t time_ns)
+{
+    if (!enabled_) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock{mutex_};
+    auto& counter = counters_[name];
+    counter.count += count;
+    counter.bytes += bytes;
+    counter.time_ns += time_ns;
+}
+
+PerfCounter PerfCounters::get(const std::string& name) const
+{
+    std::lock_guard<std::mutex> lock{mutex_};
+    auto it = counters_.find(name);
+    if (it == counters_.end()) {
+        return PerfCounter{};
+    }
+    return it->second;
+}
+
+std::map<std::string, PerfCounter> PerfCounters::get_all() const
+{
+    std::lock_guard<std::mutex> lock{mutex_};
+    return counters_;
+}
+
+bool PerfCounters::empty() const
+{
+    std::lock_guard<std::mutex> lock{mutex_};
+    return counters_.empty();
+}
+
+void PerfCounters::clear()
+{
+    std::lock_guard<std::mutex> lock{mutex_};
+    counters_.clear();
+}
+
+void PerfCounters::write_json(std::ostream& out) const
+{
+    std::lock_guard<std::mutex> lock{mutex_};
+
+    out << '{';
+    bool first = true;
+    for (const auto& item : counters_) {
+        if (!first) {
+            out << ", ";
+        }
+        first = false;
+
+        const auto& counter = item.second;
+        write_json_string(out, item.first);
+        out << ": {\"count\": " << counter.count
+            << ", \"bytes\": " << counter.bytes
+            << ", \"time_ns\": " << counter.time_ns
+            << ", \"avg_time_ns\": " << (counter.count > 0 ? counter.time_ns / counter.count : 0)
+            << '}';
+    }
+    out << '}';
+}
+
+void PerfCounters::report(const std::string& context) const
+{
+    if (!enabled_ || empty()) {
+        return;
+    }
+
+    const auto& setting = get_perf_counters_setting();
+
+    std::ofstream file;
+    if (!setting.path.empty()) {
+        file.open(setting.path, std::ios::out | std::ios::app);
+        if (!file) {
+            DBG(DBG_error, "%s: could not open %s\n", __func__, setting.path.c_str());
+            return;
+        }
+    }
+    std::ostream& out = setting.path.empty() ? std::cerr : file;
+
+    out << "{\"context\": ";
+    write_json_string(out, context);
+    out << ", \"counters\": ";
+    write_json(out);
+    out << "}\n";
+    out.flush();
+}
+
+} // namespace genesys
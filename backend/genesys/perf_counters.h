@@ -0,0 +1,156 @@
+/* sane - Scanner Access Now Easy.
+
+   Copyright (C) 2026 agent <agent@local>
+
+   This file is part of the SANE package.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+   As a special exception, the authors of SANE give permission for
+   additional uses of the libraries contained in this release of SANE.
+
+   The exception is that, if you link a SANE library with other files
+   to produce an executable, this does not by itself cause the
+   resulting executable to be covered by the GNU General Public
+   License.  Your use of that executable is in no way restricted on
+   account of linking the SANE library code into it.
+
+   This exception does not, however, invalidate any other reasons why
+   the executable file might be covered by the GNU General Public
+   License.
+
+   If you submit changes to SANE to the maintainers to be included in
+   a subsequent release, you agree by submitting the changes that
+   those changes may be distributed with this exception intact.
+
+   If you write modifications of your own for SANE, it is your choice
+   whether to permit this exception to apply to your modifications.
+   If you do not wish that, delete this exception notice.
+*/
+
+#ifndef BACKEND_GENESYS_PERF_COUNTERS_H
+#define BACKEND_GENESYS_PERF_COUNTERS_H
+
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace genesys {
+
+// Returns whether collection of performance counters has been requested by setting the
+// SANE_DEBUG_GENESYS_PERF environment variable. If the variable contains a number, it enables or
+// disables the counters and the report is written to stderr. Any other value is interpreted as a
+// path to a file that the reports are appended to.
+bool perf_counters_enabled();
+
+struct PerfCounter
+{
+    // The number of events, e.g. USB transfers, polls or image rows
+    std::uint64_t count = 0;
+    // The number of bytes transferred or produced, if applicable
+    std::uint64_t bytes = 0;
+    // The total time spent in the events
+    std::uint64_t time_ns = 0;
+
+    bool operator==(const PerfCounter& other) const
+    {
+        return count == other.count && bytes == other.bytes && time_ns == other.time_ns;
+    }
+};
+
+// Collects named performance counters of a single scan. All operations do nothing if the counters
+// are disabled, so instrumented code only pays for a check of a boolean. Counters may be updated
+// from multiple threads.
+class PerfCounters
+{
+public:
+    PerfCounters() : enabled_{perf_counters_enabled()} {}
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool enabled() const { return enabled_; }
+    void set_enabled(bool enabled) { enabled_ = enabled; }
+
+    void add(const char* name, std::uint64_t count, std::uint64_t bytes, std::uint64_t time_ns);
+    void add(const std::string& name, std::uint64_t count, std::uint64_t bytes,
+             std::uint64_t time_ns);
+
+    PerfCounter get(const std::string& name) const;
+    std::map<std::string, PerfCounter> get_all() const;
+
+    bool empty() const;
+    void clear();
+
+    // Writes the counters as a single-line JSON object of the form
+    // {"name": {"count": N, "bytes": N, "time_ns": N, "avg_time_ns": N}, ...}
+    void write_json(std::ostream& out) const;
+
+    // Writes the counters to the destination selected by SANE_DEBUG_GENESYS_PERF. Does nothing if
+    // the counters are disabled or no counters have been collected.
+    void report(const std::string& context) const;
+
+private:
+    bool enabled_ = false;
+
+    mutable std::mutex mutex_;
+    std::map<std::string, PerfCounter> counters_;
+};
+
+// Measures the time from construction to destruction and adds it to the given counter
+class PerfTimer
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    PerfTimer(PerfCounters& counters, const char* name) :
+        counters_{counters},
+        name_{name},
+        enabled_{counters.enabled()}
+    {
+        if (enabled_) {
+            start_ = Clock::now();
+        }
+    }
+
+    PerfTimer(const PerfTimer&) = delete;
+    PerfTimer& operator=(const PerfTimer&) = delete;
+
+    ~PerfTimer()
+    {
+        if (enabled_) {
+            auto time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        Clock::now() - start_).count();
+            counters_.add(name_, count_, bytes_, static_cast<std::uint64_t>(time_ns));
+        }
+    }
+
+    void set_count(std::uint64_t count) { count_ = count; }
+    void add_bytes(std::uint64_t bytes) { bytes_ += bytes; }
+
+private:
+    PerfCounters& counters_;
+    const char* name_ = nullptr;
+    bool enabled_ = false;
+    std::uint64_t count_ = 1;
+    std::uint64_t bytes_ = 0;
+    Clock::time_point start_;
+};
+
+} // namespace genesys
+
+#endif // BACKEND_GENESYS_PERF_COUNTERS_H
@@ -71,6 +71,17 @@ public:
         return regs_.get(address);
     }
 
+    bool has(std::uint16_t address) const { return regs_.has_reg(address); }
+
+    void remove(std::uint16_t address)
+    {
+        if (regs_.has_reg(address)) {
+            regs_.remove_reg(address);
+        }
+    }
+
+    void clear() { regs_.clear(); }
+
 private:
     RegisterContainer<Value> regs_;
 
@@ -85,6 +96,70 @@ std::ostream& operator<<(std::ostream& out, const RegisterCache<Value>& cache)
     return out;
 }
 
+/*  Tracks the values of the registers that have been written to the scanner, so that writing a
+    register set can skip the registers which are already known to hold the same value.
+
+    Only the registers accepted by the is_cacheable predicate passed to write() are tracked and
+    skipped. These must be plain configuration registers which the scanner never
+    changes by itself and which have no side effects when written. All other registers, such as
+    command, status and GPIO registers, are always written. Writing register 0x0e resets the chip
+    and thus forgets all values.
+*/
+class RegisterWriteCache
+{
+public:
+    // Passes the registers of the given set, in the same order, whose value is not known to be
+    // the same as the one in the scanner to write_regs, unless there are none. The values are
+    // recorded as written only once write_regs returns, thus if it throws, the registers are
+    // written again next time. Returns the number of registers passed to write_regs.
+    template<class F, class W>
+    std::size_t write(const Genesys_Register_Set& regs, F is_cacheable, W write_regs)
+    {
+        Genesys_Register_Set filtered{Genesys_Register_Set::SEQUENTIAL};
+        for (const auto& reg : regs) {
+            if (!is_cacheable(reg.address)) {
+                invalidate(reg.address);
+                filtered.init_reg(reg.address, reg.value);
+                continue;
+            }
+            if (cache_.has(reg.address) && cache_.get(reg.address) == reg.value) {
+                continue;
+            }
+            filtered.init_reg(reg.address, reg.value);
+        }
+
+        if (filtered.size() == 0) {
+            return 0;
+        }
+        write_regs(filtered);
+
+        for (const auto& reg : filtered) {
+            if (is_cacheable(reg.address)) {
+                cache_.update(reg.address, reg.value);
+            } else {
+                invalidate(reg.address);
+            }
+        }
+        return filtered.size();
+    }
+
+    // Forgets the value of the given register. Must be called whenever the register is written
+    // without going through write().
+    void invalidate(std::uint16_t address)
+    {
+        if (address == 0x0e) {
+            cache_.clear();
+            return;
+        }
+        cache_.remove(address);
+    }
+
+    void clear() { cache_.clear(); }
+
+private:
+    RegisterCache<std::uint8_t> cache_;
+};
+
 } // namespace genesys
 
 #endif // BACKEND_GENESYS_LINE_BUFFER_H
@@ -42,9 +42,163 @@
 #define DEBUG_DECLARE_ONLY
 
 #include "scanner_interface.h"
+#include "gl124_registers.h"
+#include "gl842_registers.h"
+#include "gl843_registers.h"
+#include "gl846_registers.h"
+#include "gl847_registers.h"
+
+#include <initializer_list>
 
 namespace genesys {
 
 ScannerInterface::~ScannerInterface() = default;
 
+namespace {
+
+// A multi-byte register value that occupies size consecutive register addresses
+struct RegisterRange
+{
+    std::uint16_t address;
+    unsigned size;
+};
+
+bool is_in_register_ranges(std::initializer_list<RegisterRange> ranges, std::uint16_t address)
+{
+    for (const auto& range : ranges) {
+        if (address >= range.address && address < range.address + range.size) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+bool has_register_write_cache(AsicType asic_type)
+{
+    switch (asic_type) {
+        case AsicType::GL842:
+        case AsicType::GL843:
+        case AsicType::GL845:
+        case AsicType::GL846:
+        case AsicType::GL847:
+        case AsicType::GL124:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool is_register_write_cacheable(AsicType asic_type, std::uint16_t address)
+{
+    // Only the scan geometry, exposure and motor setup registers are listed. These are written
+    // as a whole for each scan and the ASIC never modifies them by itself.
+    switch (asic_type) {
+        case AsicType::GL842: {
+            using namespace gl842;
+            return is_in_register_ranges({
+                { REG_EXPR, 2 }, { REG_EXPG, 2 }, { REG_EXPB, 2 }, { REG_EXPDMY, 1 },
+                { REG_STEPNO, 1 }, { REG_FWDSTEP, 1 }, { REG_BWDSTEP, 1 }, { REG_FASTNO, 1 },
+                { REG_LINCNT, 3 }, { REG_DPISET, 2 }, { REG_STRPIXEL, 2 }, { REG_ENDPIXEL, 2 },
+                { REG_DUMMY, 1 }, { REG_MAXWD, 3 }, { REG_LPERIOD, 2 }, { REG_FEEDL, 3 },
+                { REG_FMOVDEC, 1 }, { REG_Z1MOD, 3 }, { REG_Z2MOD, 3 }, { REG_FSHDEC, 1 },
+                { REG_FMOVNO, 1 }, { REG_CK1MAP, 3 }, { REG_CK3MAP, 3 }, { REG_CK4MAP, 3 },
+            }, address);
+        }
+        case AsicType::GL843: {
+            using namespace gl843;
+            return is_in_register_ranges({
+                { REG_EXPR, 2 }, { REG_EXPG, 2 }, { REG_EXPB, 2 }, { REG_EXPDMY, 1 },
+                { REG_STEPNO, 1 }, { REG_FWDSTEP, 1 }, { REG_BWDSTEP, 1 }, { REG_FASTNO, 1 },
+                { REG_LINCNT, 3 }, { REG_DPISET, 2 }, { REG_STRPIXEL, 2 }, { REG_ENDPIXEL, 2 },
+                { REG_DUMMY, 1 }, { REG_MAXWD, 3 }, { REG_LPERIOD, 2 }, { REG_FEEDL, 3 },
+                { REG_FMOVDEC, 1 }, { REG_Z1MOD, 3 }, { REG_Z2MOD, 3 }, { REG_FSHDEC, 1 },
+                { REG_FMOVNO, 1 }, { REG_CK1MAP, 3 }, { REG_CK3MAP, 3 }, { REG_CK4MAP, 3 },
+            }, address);
+        }
+        case AsicType::GL845:
+        case AsicType::GL846: {
+            using namespace gl846;
+            return is_in_register_ranges({
+                { REG_EXPR, 2 }, { REG_EXPG, 2 }, { REG_EXPB, 2 }, { REG_EXPDMY, 1 },
+                { REG_FEDCNT, 1 }, { REG_STEPNO, 1 }, { REG_FWDSTEP, 1 }, { REG_BWDSTEP, 1 },
+                { REG_FASTNO, 1 }, { REG_LINCNT, 3 }, { REG_DPISET, 2 }, { REG_STRPIXEL, 2 },
+                { REG_ENDPIXEL, 2 }, { REG_MAXWD, 3 }, { REG_LPERIOD, 2 }, { REG_FEEDL, 3 },
+                { REG_FMOVDEC, 1 }, { REG_FSHDEC, 1 }, { REG_FMOVNO, 1 }, { REG_CK1MAP, 3 },
+                { REG_CK3MAP, 3 }, { REG_CK4MAP, 3 },
+            }, address);
+        }
+        case AsicType::GL847: {
+            using namespace gl847;
+            return is_in_register_ranges({
+                { REG_EXPR, 2 }, { REG_EXPG, 2 }, { REG_EXPB, 2 }, { REG_EXPDMY, 1 },
+                { REG_FEDCNT, 1 }, { REG_STEPNO, 1 }, { REG_FWDSTEP, 1 }, { REG_BWDSTEP, 1 },
+                { REG_FASTNO, 1 }, { REG_LINCNT, 3 }, { REG_DPISET, 2 }, { REG_STRPIXEL, 2 },
+                { REG_ENDPIXEL, 2 }, { REG_MAXWD, 3 }, { REG_LPERIOD, 2 }, { REG_FEEDL, 3 },
+                { REG_FMOVDEC, 1 }, { REG_FSHDEC, 1 }, { REG_FMOVNO, 1 }, { REG_CK1MAP, 3 },
+                { REG_CK3MAP, 3 }, { REG_CK4MAP, 3 },
+            }, address);
+        }
+        case AsicType::GL124: {
+            using namespace gl124;
+            return is_in_register_ranges({
+                { REG_LINCNT, 3 }, { REG_MAXWD, 3 }, { REG_DPISET, 2 }, { REG_FEEDL, 3 },
+                { REG_CK1MAP, 3 }, { REG_CK3MAP, 3 }, { REG_CK4MAP, 3 }, { REG_LPERIOD, 3 },
+                { REG_DUMMY, 2 }, { REG_STRPIXEL, 3 }, { REG_ENDPIXEL, 3 }, { REG_EXPR, 3 },
+                { REG_EXPG, 3 }, { REG_EXPB, 3 }, { REG_SCANFED, 2 }, { REG_STEPNO, 2 },
+                { REG_FASTNO, 2 }, { REG_FSHDEC, 2 }, { REG_FMOVNO, 2 }, { REG_FMOVDEC, 2 },
+                { REG_Z1MOD, 3 }, { REG_Z2MOD, 3 },
+            }, address);
+        }
+        default:
+            return false;
+    }
+}
+
+std::size_t get_max_registers_per_write(AsicType asic_type)
+{
+    switch (asic_type) {
+        case AsicType::GL646:
+            // registers are sent via a bulk transfer
+            return 0;
+        case AsicType::GL841:
+            // 32 is max on GL841, checked on real hardware. Multi-register writes have not been
+            // verified on other ASICs yet.
+            return 32;
+        default:
+            return 1;
+    }
+}
+
+std::size_t get_single_register_write_transactions(AsicType asic_type)
+{
+    switch (asic_type) {
+        case AsicType::GL845:
+        case AsicType::GL846:
+        case AsicType::GL847:
+        case AsicType::GL124:
+            return 1;
+        default:
+            // address and value are sent separately
+            return 2;
+    }
+}
+
+std::size_t get_register_write_transactions(AsicType asic_type, std::size_t count)
+{
+    if (count == 0) {
+        return 0;
+    }
+    auto max_registers = get_max_registers_per_write(asic_type);
+    if (max_registers == 0) {
+        // the header and the register data
+        return 2;
+    }
+    if (max_registers == 1) {
+        return count * get_single_register_write_transactions(asic_type);
+    }
+    return (count + max_registers - 1) / max_registers;
+}
+
 } // namespace genesys
@@ -43,6 +43,7 @@
 #define BACKEND_GENESYS_SCANNER_INTERFACE_H
 
 #include "fwd.h"
+#include "enums.h"
 #include <cstddef>
 #include <cstdint>
 #include <string>
@@ -99,6 +100,25 @@ public:
     virtual void test_checkpoint(const std::string& name) = 0;
 };
 
+// Returns whether write_registers() skips the registers that are known to already hold the
+// value being written, see RegisterWriteCache
+bool has_register_write_cache(AsicType asic_type);
+
+// Returns whether the given register is a plain configuration register whose writes may be
+// skipped by RegisterWriteCache. Status, command and GPIO registers are never listed.
+bool is_register_write_cacheable(AsicType asic_type, std::uint16_t address);
+
+// Returns the maximum number of registers that can be written in a single USB control transaction,
+// 1 if the ASIC does not support multi-register writes or 0 if there is no limit.
+std::size_t get_max_registers_per_write(AsicType asic_type);
+
+// Returns the number of USB transactions that are needed to write a single register
+std::size_t get_single_register_write_transactions(AsicType asic_type);
+
+// Returns the number of USB transactions that are needed to write the given number of registers
+// in a single write_registers() call
+std::size_t get_register_write_transactions(AsicType asic_type, std::size_t count);
+
 } // namespace genesys
 
 #endif
@@ -74,7 +74,7 @@ std::uint8_t ScannerInterfaceUsb::read_register(std::uint16_t address)
             usb_value |= 0x100;
         }
 
-        usb_dev_.control_msg(REQUEST_TYPE_IN, REQUEST_BUFFER, usb_value, address16, 2, value2x8);
+        usb_control_msg(REQUEST_TYPE_IN, REQUEST_BUFFER, usb_value, address16, 2, value2x8);
 
         // check usb link status
         if (value2x8[1] != 0x55) {
@@ -93,15 +93,23 @@ std::uint8_t ScannerInterfaceUsb::read_register(std::uint16_t address)
 
         std::uint8_t address8 = address & 0xff;
 
-        usb_dev_.control_msg(REQUEST_TYPE_OUT, REQUEST_REGISTER, VALUE_SET_REGISTER, INDEX,
-                             1, &address8);
-        usb_dev_.control_msg(REQUEST_TYPE_IN, REQUEST_REGISTER, VALUE_READ_REGISTER, INDEX,
-                             1, &value);
+        usb_control_msg(REQUEST_TYPE_OUT, REQUEST_REGISTER, VALUE_SET_REGISTER, INDEX,
+                        1, &address8);
+        usb_control_msg(REQUEST_TYPE_IN, REQUEST_REGISTER, VALUE_READ_REGISTER, INDEX,
+                        1, &value);
     }
     return value;
 }
 
 void ScannerInterfaceUsb::write_register(std::uint16_t address, std::uint8_t value)
+{
+    // single register writes are used for registers with side effects, thus the value is not
+    // remembered
+    written_regs_.invalidate(address);
+    write_register_impl(address, value);
+}
+
+void ScannerInterfaceUsb::write_register_impl(std::uint16_t address, std::uint8_t value)
 {
     DBG_HELPER_ARGS(dbg, "address: 0x%04x, value: 0x%02x", static_cast<unsigned>(address),
                     static_cast<unsigned>(value));
@@ -121,8 +129,8 @@ void ScannerInterfaceUsb::write_register(std::uint16_t address, std::uint8_t val
             usb_value |= 0x100;
         }
 
-        usb_dev_.control_msg(REQUEST_TYPE_OUT, REQUEST_BUFFER, usb_value, INDEX,
-                                  2, buffer);
+        usb_control_msg(REQUEST_TYPE_OUT, REQUEST_BUFFER, usb_value, INDEX,
+                        2, buffer);
 
     } else {
         if (address > 0xff) {
@@ -131,11 +139,11 @@ void ScannerInterfaceUsb::write_register(std::uint16_t address, std::uint8_t val
 
         std::uint8_t address8 = address & 0xff;
 
-        usb_dev_.control_msg(REQUEST_TYPE_OUT, REQUEST_REGISTER, VALUE_SET_REGISTER, INDEX,
-                             1, &address8);
+        usb_control_msg(REQUEST_TYPE_OUT, REQUEST_REGISTER, VALUE_SET_REGISTER, INDEX,
+                        1, &address8);
 
-        usb_dev_.control_msg(REQUEST_TYPE_OUT, REQUEST_REGISTER, VALUE_WRITE_REGISTER, INDEX,
-                             1, &value);
+        usb_control_msg(REQUEST_TYPE_OUT, REQUEST_REGISTER, VALUE_WRITE_REGISTER, INDEX,
+                        1, &value);
 
     }
     DBG(DBG_io, "%s (0x%02x, 0x%02x) completed\n", __func__, address, value);
@@ -144,9 +152,35 @@ void ScannerInterfaceUsb::write_register(std::uint16_t address, std::uint8_t val
 void ScannerInterfaceUsb::write_registers(const Genesys_Register_Set& regs)
 {
     DBG_HELPER(dbg);
-    if (dev_->model->asic_type == AsicType::GL646 ||
-        dev_->model->asic_type == AsicType::GL841)
+    if (!has_register_write_cache(dev_->model->asic_type)) {
+        write_registers_impl(regs);
+        return;
+    }
+
+    auto asic_type = dev_->model->asic_type;
+    auto written_count = written_regs_.write(regs, [&](std::uint16_t address)
     {
+        return is_register_write_cacheable(asic_type, address);
+    },
+    [&](const Genesys_Register_Set& changed_regs)
+    {
+        write_registers_impl(changed_regs);
+    });
+    DBG(DBG_io, "%s: skipped %zu unchanged registers\n", __func__, regs.size() - written_count);
+}
+
+void ScannerInterfaceUsb::write_registers_uncached(const Genesys_Register_Set& regs)
+{
+    for (const auto& r : regs) {
+        written_regs_.invalidate(r.address);
+    }
+    write_registers_impl(regs);
+}
+
+void ScannerInterfaceUsb::write_registers_impl(const Genesys_Register_Set& regs)
+{
+    auto max_registers = get_max_registers_per_write(dev_->model->asic_type);
+    if (max_registers != 1) {
         uint8_t outdata[8];
         std::vector<uint8_t> buffer;
         buffer.reserve(regs.size() * 2);
@@ -169,27 +203,25 @@ void ScannerInterfaceUsb::write_registers(const Genesys_Register_Set& regs)
             outdata[6] = ((buffer.size() >> 16) & 0xff);
             outdata[7] = ((buffer.size() >> 24) & 0xff);
 
-            usb_dev_.control_msg(REQUEST_TYPE_OUT, REQUEST_BUFFER, VALUE_BUFFER, INDEX,
-                                 sizeof(outdata), outdata);
+            usb_control_msg(REQUEST_TYPE_OUT, REQUEST_BUFFER, VALUE_BUFFER, INDEX,
+                            sizeof(outdata), outdata);
 
             size_t write_size = buffer.size();
 
-            usb_dev_.bulk_write(buffer.data(), &write_size);
+            usb_bulk_write(buffer.data(), &write_size);
         } else {
             for (std::size_t i = 0; i < regs.size();) {
-                std::size_t c = regs.size() - i;
-                if (c > 32)  /*32 is max on GL841. checked that.*/
-                    c = 32;
+                std::size_t c = std::min(regs.size() - i, max_registers);
 
-                usb_dev_.control_msg(REQUEST_TYPE_OUT, REQUEST_BUFFER, VALUE_SET_REGISTER,
-                                     INDEX, c * 2, buffer.data() + i * 2);
+                usb_control_msg(REQUEST_TYPE_OUT, REQUEST_BUFFER, VALUE_SET_REGISTER,
+                                INDEX, c * 2, buffer.data() + i * 2);
 
                 i += c;
             }
         }
     } else {
         for (const auto& r : regs) {
-            write_register(r.address, r.value);
+            write_register_impl(r.address, r.value);
         }
     }
 
@@ -199,10 +231,10 @@ void ScannerInterfaceUsb::write_registers(const Genesys_Register_Set& regs)
 void ScannerInterfaceUsb::write_0x8c(std::uint8_t index, std::uint8_t value)
 {
     DBG_HELPER_ARGS(dbg, "0x%02x,0x%02x", index, value);
-    usb_dev_.control_msg(REQUEST_TYPE_OUT, REQUEST_REGISTER, VALUE_BUF_ENDACCESS, index, 1, &value);
+    usb_control_msg(REQUEST_TYPE_OUT, REQUEST_REGISTER, VALUE_BUF_ENDACCESS, index, 1, &value);
 }
 
-static void bulk_read_data_send_header(UsbDevice& usb_dev, AsicType asic_type, size_t size)
+void ScannerInterfaceUsb::bulk_read_data_send_header(AsicType asic_type, std::size_t size)
 {
     DBG_HELPER(dbg);
 
@@ -238,8 +270,8 @@ static void bulk_read_data_send_header(UsbDevice& usb_dev, AsicType asic_type, s
     outdata[6] = ((size >> 16) & 0xff);
     outdata[7] = ((size >> 24) & 0xff);
 
-   usb_dev.control_msg(REQUEST_TYPE_OUT, REQUEST_BUFFER, VALUE_BUFFER, 0x00,
-                       sizeof(outdata), outdata);
+   usb_control_msg(REQUEST_TYPE_OUT, REQUEST_BUFFER, VALUE_BUFFER, 0x00,
+                   sizeof(outdata), outdata);
 }
 
 void ScannerInterfaceUsb::bulk_read_data(std::uint8_t addr, std::uint8_t* data, std::size_t size)
@@ -268,8 +300,8 @@ void ScannerInterfaceUsb::bulk_read_data(std::uint8_t addr, std::uint8_t* data,
         return;
 
     if (is_addr_used) {
-        usb_dev_.control_msg(REQUEST_TYPE_OUT, REQUEST_REGISTER, VALUE_SET_REGISTER, 0x00,
-                             1, &addr);
+        usb_control_msg(REQUEST_TYPE_OUT, REQUEST_REGISTER, VALUE_SET_REGISTER, 0x00,
+                        1, &addr);
     }
 
     std::size_t target_size = size;
@@ -277,7 +309,7 @@ void ScannerInterfaceUsb::bulk_read_data(std::uint8_t addr, std::uint8_t* data,
     std::size_t max_in_size = sanei_genesys_get_bulk_max_size(dev_->model->asic_type);
 
     if (!has_header_before_each_chunk) {
-        bulk_read_data_send_header(usb_dev_, dev_->model->asic_type, size);
+        bulk_read_data_send_header(dev_->model->asic_type, size);
     }
 
     // loop until computed data size is read
@@ -285,12 +317,12 @@ void ScannerInterfaceUsb::bulk_read_data(std::uint8_t addr, std::uint8_t* data,
         std::size_t block_size = std::min(target_size, max_in_size);
 
         if (has_header_before_each_chunk) {
-            bulk_read_data_send_header(usb_dev_, dev_->model->asic_type, block_size);
+            bulk_read_data_send_header(dev_->model->asic_type, block_size);
         }
 
         DBG(DBG_io2, "%s: trying to read %zu bytes of data\n", __func__, block_size);
 
-        usb_dev_.bulk_read(data, &block_size);
+        usb_bulk_read(data, &block_size);
 
         DBG(DBG_io2, "%s: read %zu bytes, %zu remaining\n", __func__, block_size, target_size - block_size);
 
@@ -307,8 +339,8 @@ void ScannerInterfaceUsb::bulk_write_data(std::uint8_t addr, std::uint8_t* data,
     std::size_t size;
     std::uint8_t outdata[8];
 
-    usb_dev_.control_msg(REQUEST_TYPE_OUT, REQUEST_REGISTER, VALUE_SET_REGISTER, INDEX,
-                             1, &addr);
+    usb_control_msg(REQUEST_TYPE_OUT, REQUEST_REGISTER, VALUE_SET_REGISTER, INDEX,
+                    1, &addr);
 
     std::size_t max_out_size = sanei_genesys_get_bulk_max_size(dev_->model->asic_type);
 
@@ -337,10 +369,10 @@ void ScannerInterfaceUsb::bulk_write_data(std::uint8_t addr, std::uint8_t* data,
         outdata[6] = ((size >> 16) & 0xff);
         outdata[7] = ((size >> 24) & 0xff);
 
-        usb_dev_.control_msg(REQUEST_TYPE_OUT, REQUEST_BUFFER, VALUE_BUFFER, 0x00,
-                             sizeof(outdata), outdata);
+        usb_control_msg(REQUEST_TYPE_OUT, REQUEST_BUFFER, VALUE_BUFFER, 0x00,
+                        sizeof(outdata), outdata);
 
-        usb_dev_.bulk_write(data, &size);
+        usb_bulk_write(data, &size);
 
         DBG(DBG_io2, "%s: wrote %zu bytes, %zu remaining\n", __func__, size, len - size);
 
@@ -420,7 +452,7 @@ void ScannerInterfaceUsb::write_ahb(std::uint32_t addr, std::uint32_t size, std:
     outdata[7] = ((size >> 24) & 0xff);
 
     // write addr and size for AHB
-    usb_dev_.control_msg(REQUEST_TYPE_OUT, REQUEST_BUFFER, VALUE_BUFFER, 0x01, 8, outdata);
+    usb_control_msg(REQUEST_TYPE_OUT, REQUEST_BUFFER, VALUE_BUFFER, 0x01, 8, outdata);
 
     std::size_t max_out_size = sanei_genesys_get_bulk_max_size(dev_->model->asic_type);
 
@@ -429,7 +461,7 @@ void ScannerInterfaceUsb::write_ahb(std::uint32_t addr, std::uint32_t size, std:
     do {
         std::size_t block_size = std::min(size - written, max_out_size);
 
-        usb_dev_.bulk_write(data + written, &block_size);
+        usb_bulk_write(data + written, &block_size);
 
         written += block_size;
     } while (written < size);
@@ -443,7 +475,7 @@ std::uint16_t ScannerInterfaceUsb::read_fe_register(std::uint8_t address)
     reg.init_reg(0x50, address);
 
     // set up read address
-    write_registers(reg);
+    write_registers_uncached(reg);
 
     // read data
     std::uint16_t value = read_register(0x46) << 8;
@@ -467,7 +499,31 @@ void ScannerInterfaceUsb::write_fe_register(std::uint8_t address, std::uint16_t
         reg.init_reg(0x3b, value & 0xff);
     }
 
-    write_registers(reg);
+    // writing the registers triggers the transfer to the frontend, so none of them can be skipped
+    write_registers_uncached(reg);
+}
+
+void ScannerInterfaceUsb::usb_control_msg(int rtype, int reg, int value, int index, int length,
+                                          std::uint8_t* data)
+{
+    PerfTimer timer{dev_->perf_counters,
+                    rtype == REQUEST_TYPE_IN ? "usb.control_in" : "usb.control_out"};
+    usb_dev_.control_msg(rtype, reg, value, index, length, data);
+    timer.add_bytes(length);
+}
+
+void ScannerInterfaceUsb::usb_bulk_read(std::uint8_t* buffer, std::size_t* size)
+{
+    PerfTimer timer{dev_->perf_counters, "usb.bulk_in"};
+    usb_dev_.bulk_read(buffer, size);
+    timer.add_bytes(*size);
+}
+
+void ScannerInterfaceUsb::usb_bulk_write(const std::uint8_t* buffer, std::size_t* size)
+{
+    PerfTimer timer{dev_->perf_counters, "usb.bulk_out"};
+    usb_dev_.bulk_write(buffer, size);
+    timer.add_bytes(*size);
 }
 
 IUsbDevice& ScannerInterfaceUsb::get_usb_device()
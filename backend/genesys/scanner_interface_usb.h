@@ -43,6 +43,7 @@
 #define BACKEND_GENESYS_SCANNER_INTERFACE_USB_H
 
 #include "scanner_interface.h"
+#include "register_cache.h"
 #include "usb_device.h"
 
 namespace genesys {
@@ -84,11 +85,27 @@ public:
 
     void record_key_value(const std::string& key, const std::string& value) override;
 
+
     void test_checkpoint(const std::string& name) override;
 
 private:
+    // writes all given registers, forgetting their values in written_regs_
+    void write_registers_uncached(const Genesys_Register_Set& regs);
+    void write_registers_impl(const Genesys_Register_Set& regs);
+    void write_register_impl(std::uint16_t address, std::uint8_t value);
+    void bulk_read_data_send_header(AsicType asic_type, std::size_t size);
+
+    // wrappers of usb_dev_ functions that update the performance counters of the device
+    void usb_control_msg(int rtype, int reg, int value, int index, int length,
+                         std::uint8_t* data);
+    void usb_bulk_read(std::uint8_t* buffer, std::size_t* size);
+    void usb_bulk_write(const std::uint8_t* buffer, std::size_t* size);
+
     Genesys_Device* dev_;
     UsbDevice usb_dev_;
+
+    // the registers known to have been written to the scanner
+    RegisterWriteCache written_regs_;
 };
 
 } // namespace genesys
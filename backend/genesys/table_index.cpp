@@ -0,0 +1,126 @@
+/* sane - Scanner Access Now Easy.
+
+   Copyright (C) 2026 agent <agent@local>
+
+   This file is part of the SANE package.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+   As a special exception, the authors of SANE give permission for
+   additional uses of the libraries contained in this release of SANE.
+
+   The exception is that, if you link a SANE library with other files
+   to produce an executable, this does not by itself cause the
+   resulting executable to be covered by the GNU General Public
+   License.  Your use of that executable is in no way restricted on
+   account of linking the SANE library code into it.
+
+   This exception does not, however, invalidate any other reasons why
+   the executable file might be covered by the GNU General Public
+   License.
+
+   If you submit changes to SANE to the maintainers to be included in
+   a subsequent release, you agree by submitting the changes that
+   those changes may be distributed with this exception intact.
+
+   If you write modifications of your own for SANE, it is your choice
+   whether to permit this exception to apply to your modifications.
+   If you do not wish that, delete this exception notice.
+*/
+
+#define DEBUG_DECLARE_ONLY
+
+#include "table_index.h"
+
+namespace genesys {
+
+SensorTableIndex::SensorTableIndex(std::vector<Genesys_Sensor>& sensors)
+{
+    for (auto& sensor : sensors) {
+        sensors_by_method_[get_key(sensor.sensor_id, sensor.method)].push_back(sensor);
+        sensors_by_id_.emplace(static_cast<unsigned>(sensor.sensor_id), &sensor);
+    }
+
+    // Precompute the lookups for each resolution that is explicitly listed by any sensor. Any
+    // other resolution may only be matched by sensors that accept any resolution, so find() falls
+    // back to walking the (short) list of sensors with the same ID and scan method in that case.
+    for (const auto& kv : sensors_by_method_) {
+        const auto& group = kv.second;
+
+        std::vector<unsigned> resolutions;
+        std::vector<unsigned> channel_counts;
+        for (const Genesys_Sensor& sensor : group) {
+            const auto& values = sensor.resolutions.values();
+            resolutions.insert(resolutions.end(), values.begin(), values.end());
+            channel_counts.insert(channel_counts.end(), sensor.channels.begin(),
+                                  sensor.channels.end());
+        }
+
+        const Genesys_Sensor& first = group.front();
+        for (auto dpi : resolutions) {
+            for (auto channels : channel_counts) {
+                auto key = get_key(first.sensor_id, dpi, channels, first.method);
+                if (sensors_by_resolution_.count(key)) {
+                    continue;
+                }
+                Genesys_Sensor* found = nullptr;
+                for (Genesys_Sensor& sensor : group) {
+                    if (sensor.resolutions.matches(dpi) && sensor.matches_channel_count(channels)) {
+                        found = &sensor;
+                        break;
+                    }
+                }
+                sensors_by_resolution_.emplace(key, found);
+            }
+        }
+    }
+}
+
+Genesys_Sensor* SensorTableIndex::find(SensorId sensor_id, unsigned dpi, unsigned channels,
+                                       ScanMethod scan_method) const
+{
+    auto it = sensors_by_resolution_.find(get_key(sensor_id, dpi, channels, scan_method));
+    if (it != sensors_by_resolution_.end()) {
+        return it->second;
+    }
+
+    for (Genesys_Sensor& sensor : find_all(sensor_id, scan_method)) {
+        if (sensor.resolutions.matches(dpi) && sensor.matches_channel_count(channels)) {
+            return &sensor;
+        }
+    }
+    return nullptr;
+}
+
+Genesys_Sensor* SensorTableIndex::find_any(SensorId sensor_id) const
+{
+    auto it = sensors_by_id_.find(static_cast<unsigned>(sensor_id));
+    if (it == sensors_by_id_.end()) {
+        return nullptr;
+    }
+    return it->second;
+}
+
+const SensorTableIndex::SensorRefs&
+    SensorTableIndex::find_all(SensorId sensor_id, ScanMethod scan_method) const
+{
+    static const SensorRefs empty;
+    auto it = sensors_by_method_.find(get_key(sensor_id, scan_method));
+    if (it == sensors_by_method_.end()) {
+        return empty;
+    }
+    return it->second;
+}
+
+} // namespace genesys
@@ -0,0 +1,132 @@
+/* sane - Scanner Access Now Easy.
+
+   Copyright (C) 2026 agent <agent@local>
+
+   This file is part of the SANE package.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+   As a special exception, the authors of SANE give permission for
+   additional uses of the libraries contained in this release of SANE.
+
+   The exception is that, if you link a SANE library with other files
+   to produce an executable, this does not by itself cause the
+   resulting executable to be covered by the GNU General Public
+   License.  Your use of that executable is in no way restricted on
+   account of linking the SANE library code into it.
+
+   This exception does not, however, invalidate any other reasons why
+   the executable file might be covered by the GNU General Public
+   License.
+
+   If you submit changes to SANE to the maintainers to be included in
+   a subsequent release, you agree by submitting the changes that
+   those changes may be distributed with this exception intact.
+
+   If you write modifications of your own for SANE, it is your choice
+   whether to permit this exception to apply to your modifications.
+   If you do not wish that, delete this exception notice.
+*/
+
+#ifndef BACKEND_GENESYS_TABLE_INDEX_H
+#define BACKEND_GENESYS_TABLE_INDEX_H
+
+#include "enums.h"
+#include "sensor.h"
+#include "motor.h"
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+namespace genesys {
+
+// Lookup index for the sensor table. The sensors of each sensor ID and scan method are kept in
+// table order. Additionally, the first matching sensor is precomputed for each resolution that is
+// listed explicitly in the table, so that the common lookups don't need to walk the table at all.
+// The index stores pointers into the table, thus the table must not be modified after the index
+// is built.
+class SensorTableIndex
+{
+public:
+    using SensorRefs = std::vector<std::reference_wrapper<Genesys_Sensor>>;
+
+    SensorTableIndex() = default;
+    explicit SensorTableIndex(std::vector<Genesys_Sensor>& sensors);
+
+    // Returns the first sensor in table order that matches the given parameters or nullptr
+    Genesys_Sensor* find(SensorId sensor_id, unsigned dpi, unsigned channels,
+                         ScanMethod scan_method) const;
+
+    // Returns the first sensor in table order that has the given ID or nullptr
+    Genesys_Sensor* find_any(SensorId sensor_id) const;
+
+    // Returns all sensors with the given ID and scan method in table order
+    const SensorRefs& find_all(SensorId sensor_id, ScanMethod scan_method) const;
+
+private:
+    static std::uint64_t get_key(SensorId sensor_id, ScanMethod scan_method)
+    {
+        return (static_cast<std::uint64_t>(sensor_id) << 32) |
+                static_cast<std::uint64_t>(scan_method);
+    }
+
+    static std::uint64_t get_key(SensorId sensor_id, unsigned dpi, unsigned channels,
+                                 ScanMethod scan_method)
+    {
+        return (static_cast<std::uint64_t>(sensor_id) << 40) |
+                (static_cast<std::uint64_t>(scan_method) << 36) |
+                (static_cast<std::uint64_t>(channels & 0xf) << 32) | dpi;
+    }
+
+    std::unordered_map<std::uint64_t, SensorRefs> sensors_by_method_;
+    std::unordered_map<std::uint64_t, Genesys_Sensor*> sensors_by_resolution_;
+    std::unordered_map<unsigned, Genesys_Sensor*> sensors_by_id_;
+};
+
+// Lookup index for tables whose entries are identified by a single `id` member, e.g. the motor
+// and frontend tables. The index stores positions in the table, thus entries must not be added
+// or removed after the index is built.
+template<class Id>
+class IdTableIndex
+{
+public:
+    IdTableIndex() = default;
+
+    template<class T>
+    explicit IdTableIndex(const std::vector<T>& table)
+    {
+        for (std::size_t i = 0; i < table.size(); ++i) {
+            // the first entry with a given ID wins, just like with a linear search
+            indices_.emplace(static_cast<unsigned>(table[i].id), i);
+        }
+    }
+
+    // Returns the position of the first entry with the given ID or -1 if there's no such entry
+    std::ptrdiff_t find(Id id) const
+    {
+        auto it = indices_.find(static_cast<unsigned>(id));
+        if (it == indices_.end()) {
+            return -1;
+        }
+        return static_cast<std::ptrdiff_t>(it->second);
+    }
+
+private:
+    std::unordered_map<unsigned, std::size_t> indices_;
+};
+
+} // namespace genesys
+
+#endif // BACKEND_GENESYS_TABLE_INDEX_H
@@ -46,6 +46,7 @@
 namespace genesys {
 
 StaticInit<std::vector<Genesys_Frontend>> s_frontends;
+StaticInit<IdTableIndex<AdcId>> s_frontend_index;
 
 void genesys_init_frontend_tables()
 {
@@ -740,6 +741,8 @@ void genesys_init_frontend_tables()
     };
     fe.reg2 = {0x00, 0x00, 0x00};
     s_frontends->push_back(fe);
+
+    s_frontend_index.init(*s_frontends);
 }
 
 } // namespace genesys
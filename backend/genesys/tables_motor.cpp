@@ -46,6 +46,7 @@
 namespace genesys {
 
 StaticInit<std::vector<Genesys_Motor>> s_motors;
+StaticInit<IdTableIndex<MotorId>> s_motor_index;
 
 void genesys_init_motor_tables()
 {
@@ -632,6 +633,8 @@ void genesys_init_motor_tables()
     motor.base_ydpi = 2400;
     motor.profiles.push_back({MotorSlope::create_from_steps(9560, 1912, 31), StepType::FULL, 0});
     s_motors->push_back(std::move(motor));
+
+    s_motor_index.init(*s_motors);
 }
 
 } // namespace genesys
@@ -47,6 +47,7 @@
 namespace genesys {
 
 StaticInit<std::vector<Genesys_Sensor>> s_sensors;
+StaticInit<SensorTableIndex> s_sensor_index;
 
 void genesys_init_sensor_tables()
 {
@@ -3818,6 +3819,8 @@ void genesys_init_sensor_tables()
             s_sensors->push_back(sensor);
         }
     }
+
+    s_sensor_index.init(*s_sensors);
 }
 
 void verify_sensor_tables()
@@ -111,11 +111,43 @@ std::uint8_t TestScannerInterface::read_register(std::uint16_t address)
 void TestScannerInterface::write_register(std::uint16_t address, std::uint8_t value)
 {
     cached_regs_.update(address, value);
+
+    auto transactions = get_single_register_write_transactions(dev_->model->asic_type);
+    register_write_transactions_ += transactions;
+    unoptimized_register_write_transactions_ += transactions;
+    written_regs_.invalidate(address);
 }
 
 void TestScannerInterface::write_registers(const Genesys_Register_Set& regs)
 {
     cached_regs_.update(regs);
+
+    auto asic_type = dev_->model->asic_type;
+
+    // GL646 and GL841 were the only ASICs that used multi-register writes originally
+    if (asic_type == AsicType::GL646 || asic_type == AsicType::GL841) {
+        unoptimized_register_write_transactions_ +=
+                get_register_write_transactions(asic_type, regs.size());
+    } else {
+        unoptimized_register_write_transactions_ +=
+                regs.size() * get_single_register_write_transactions(asic_type);
+    }
+
+    std::size_t count = regs.size();
+    if (has_register_write_cache(asic_type)) {
+        count = written_regs_.write(regs, [&](std::uint16_t address)
+        {
+            return is_register_write_cacheable(asic_type, address);
+        },
+        [](const Genesys_Register_Set&) {});
+    }
+    register_write_transactions_ += get_register_write_transactions(asic_type, count);
+}
+
+void TestScannerInterface::reset_register_write_transactions()
+{
+    register_write_transactions_ = 0;
+    unoptimized_register_write_transactions_ = 0;
 }
 
 
@@ -214,6 +246,11 @@ std::map<std::string, std::string>& TestScannerInterface::recorded_key_values()
     return key_values_;
 }
 
+void TestScannerInterface::record_time_ms(const char* name, double ms)
+{
+    times_ms_[name] += ms;
+}
+
 void TestScannerInterface::test_checkpoint(const std::string& name)
 {
     if (checkpoint_callback_) {
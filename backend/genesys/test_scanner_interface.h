@@ -64,6 +64,16 @@ public:
     const RegisterCache<std::uint8_t>& cached_regs() const { return cached_regs_; }
     const RegisterCache<std::uint16_t>& cached_fe_regs() const { return cached_fe_regs_; }
 
+    // the number of USB transactions that ScannerInterfaceUsb would use to write registers and
+    // the number it would use without multi-register writes and without skipping unchanged
+    // registers
+    std::size_t register_write_transactions() const { return register_write_transactions_; }
+    std::size_t unoptimized_register_write_transactions() const
+    {
+        return unoptimized_register_write_transactions_;
+    }
+    void reset_register_write_transactions();
+
     std::uint8_t read_register(std::uint16_t address) override;
     void write_register(std::uint16_t address, std::uint8_t value) override;
     void write_registers(const Genesys_Register_Set& regs) override;
@@ -97,6 +107,13 @@ public:
 
     std::map<std::string, std::string>& recorded_key_values();
 
+    // records the wall time in milliseconds that a step of scan setup (e.g. compute_session)
+    // took. Repeated steps add up.
+    void record_time_ms(const char* name, double ms);
+
+    const std::map<std::string, double>& recorded_times_ms() const { return times_ms_; }
+    void reset_recorded_times() { times_ms_.clear(); }
+
     void test_checkpoint(const std::string& name) override;
 
     void set_checkpoint_callback(TestCheckpointCallback callback);
@@ -108,12 +125,17 @@ private:
     RegisterCache<std::uint16_t> cached_fe_regs_;
     TestUsbDevice usb_dev_;
 
+    RegisterWriteCache written_regs_;
+    std::size_t register_write_transactions_ = 0;
+    std::size_t unoptimized_register_write_transactions_ = 0;
+
     TestCheckpointCallback checkpoint_callback_;
 
     std::map<unsigned, std::vector<std::uint16_t>> slope_tables_;
 
     std::string last_progress_message_;
     std::map<std::string, std::string> key_values_;
+    std::map<std::string, double> times_ms_;
 };
 
 } // namespace genesys
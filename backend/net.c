@@ -143,6 +143,10 @@ static int hang_over;
 */
 static int left_over;
 
+/* Size of the read-ahead buffer of the data socket.  Several records are
+   usually received with one read() call.  */
+#define NET_READ_BUF_SIZE (256 * 1024)
+
 
 #ifdef NET_USES_AF_INDEP
 static SANE_Status
@@ -520,6 +524,7 @@ connect_dev (Net_Device * dev)
       goto fail;
     }
   if (SANE_VERSION_BUILD (version_code) != SANEI_NET_PROTOCOL_VERSION
+      && SANE_VERSION_BUILD (version_code) != 3
       && SANE_VERSION_BUILD (version_code) != 2)
     {
       DBG (1, "connect_dev: network protocol version mismatch: "
@@ -540,36 +545,163 @@ fail:
 }
 
 
+/* Changes the number of cached option descriptors, keeping the existing
+   ones and their hashes.  */
+static SANE_Status
+resize_options (Net_Scanner * s, SANE_Word num_options)
+{
+  Wire *w = &s->hw->wire;
+  SANE_Option_Descriptor **desc;
+  SANE_Word *hashes;
+  int i;
+
+  DBG (3, "resize_options: %d -> %d options\n", s->opt.num_options,
+       num_options);
+
+  hashes = malloc (num_options * sizeof (hashes[0]));
+  if (!hashes)
+    return SANE_STATUS_NO_MEM;
+  for (i = 0; i < num_options; ++i)
+    hashes[i] = (s->opt_hashes && i < s->opt.num_options) ?
+      s->opt_hashes[i] : 0;
+
+  sanei_w_set_dir (w, WIRE_FREE);
+  for (i = num_options; i < s->opt.num_options; ++i)
+    {
+      sanei_w_option_descriptor_ptr (w, &s->opt.desc[i]);
+      s->opt.desc[i] = 0;
+    }
+
+  desc = realloc (s->opt.desc, num_options * sizeof (desc[0]));
+  if (!desc)
+    {
+      free (hashes);
+      return SANE_STATUS_NO_MEM;
+    }
+  for (i = s->opt.num_options; i < num_options; ++i)
+    desc[i] = 0;
+
+  /* the array is freed by sanei_w_option_descriptor_array() */
+  w->allocated_memory += (num_options - s->opt.num_options)
+    * (int) sizeof (desc[0]);
+
+  free (s->opt_hashes);
+  s->opt_hashes = hashes;
+  s->opt.desc = desc;
+  s->opt.num_options = num_options;
+  return SANE_STATUS_GOOD;
+}
+
+/* Updates the cached option descriptors with the ones that changed on the
+   server since they were fetched.  */
+static SANE_Status
+fetch_option_deltas (Net_Scanner * s)
+{
+  Wire *w = &s->hw->wire;
+  SANE_Option_Descriptor_Delta_Req req;
+  SANE_Option_Descriptor_Delta_Reply reply;
+  SANE_Option_Descriptor_Delta *delta;
+  SANE_Status status = SANE_STATUS_GOOD;
+  int i;
+
+  req.handle = s->handle;
+  req.num_hashes = s->opt_hashes ? s->opt.num_options : 0;
+  req.hashes = s->opt_hashes;
+
+  DBG (3, "fetch_option_deltas: get_option_descriptors_delta\n");
+  sanei_w_call (w, SANE_NET_GET_OPTION_DESCRIPTORS_DELTA,
+		(WireCodecFunc) sanei_w_option_descriptor_delta_req, &req,
+		(WireCodecFunc) sanei_w_option_descriptor_delta_reply, &reply);
+  if (w->status)
+    {
+      DBG (1, "fetch_option_deltas: failed to get option descriptors (%s)\n",
+	   strerror (w->status));
+      return SANE_STATUS_IO_ERROR;
+    }
+  DBG (3, "fetch_option_deltas: %d of %d descriptors changed\n",
+       reply.num_changed, reply.num_options);
+
+  if (reply.num_options < 1)
+    {
+      DBG (1, "fetch_option_deltas: invalid number of options %d\n",
+	   reply.num_options);
+      status = SANE_STATUS_IO_ERROR;
+    }
+  else if (reply.num_options != s->opt.num_options || !s->opt_hashes)
+    status = resize_options (s, reply.num_options);
+
+  for (i = 0; status == SANE_STATUS_GOOD && i < reply.num_changed; ++i)
+    {
+      delta = &reply.changed[i];
+      if (delta->index < 0 || delta->index >= s->opt.num_options)
+	{
+	  DBG (1, "fetch_option_deltas: invalid option index %d\n",
+	       delta->index);
+	  status = SANE_STATUS_IO_ERROR;
+	  break;
+	}
+
+      /* replace the cached descriptor by the received one */
+      sanei_w_set_dir (w, WIRE_FREE);
+      if (s->opt.desc[delta->index])
+	sanei_w_option_descriptor_ptr (w, &s->opt.desc[delta->index]);
+      s->opt.desc[delta->index] = delta->desc;
+      s->opt_hashes[delta->index] = delta->hash;
+      delta->desc = 0;
+    }
+
+  sanei_w_free (w, (WireCodecFunc) sanei_w_option_descriptor_delta_reply,
+		&reply);
+
+  if (status != SANE_STATUS_GOOD)
+    {
+      /* fetch everything again next time */
+      free (s->opt_hashes);
+      s->opt_hashes = 0;
+    }
+  return status;
+}
+
 static SANE_Status
 fetch_options (Net_Scanner * s)
 {
   int option_number;
+  SANE_Status status;
   DBG (3, "fetch_options: %p\n", (void *) s);
 
-  if (s->opt.num_options)
+  if (s->hw->wire.version >= 4)
     {
-      DBG (2, "fetch_options: %d option descriptors cached... freeing\n",
-	   s->opt.num_options);
-      sanei_w_set_dir (&s->hw->wire, WIRE_FREE);
-      s->hw->wire.status = 0;
-      sanei_w_option_descriptor_array (&s->hw->wire, &s->opt);
+      status = fetch_option_deltas (s);
+      if (status != SANE_STATUS_GOOD)
+	return status;
+    }
+  else
+    {
+      if (s->opt.num_options)
+	{
+	  DBG (2, "fetch_options: %d option descriptors cached... freeing\n",
+	       s->opt.num_options);
+	  sanei_w_set_dir (&s->hw->wire, WIRE_FREE);
+	  s->hw->wire.status = 0;
+	  sanei_w_option_descriptor_array (&s->hw->wire, &s->opt);
+	  if (s->hw->wire.status)
+	    {
+	      DBG (1, "fetch_options: failed to free old list (%s)\n",
+		   strerror (s->hw->wire.status));
+	      return SANE_STATUS_IO_ERROR;
+	    }
+	}
+      DBG (3, "fetch_options: get_option_descriptors\n");
+      sanei_w_call (&s->hw->wire, SANE_NET_GET_OPTION_DESCRIPTORS,
+		    (WireCodecFunc) sanei_w_word, &s->handle,
+		    (WireCodecFunc) sanei_w_option_descriptor_array, &s->opt);
       if (s->hw->wire.status)
 	{
-	  DBG (1, "fetch_options: failed to free old list (%s)\n",
+	  DBG (1, "fetch_options: failed to get option descriptors (%s)\n",
 	       strerror (s->hw->wire.status));
 	  return SANE_STATUS_IO_ERROR;
 	}
     }
-  DBG (3, "fetch_options: get_option_descriptors\n");
-  sanei_w_call (&s->hw->wire, SANE_NET_GET_OPTION_DESCRIPTORS,
-		(WireCodecFunc) sanei_w_word, &s->handle,
-		(WireCodecFunc) sanei_w_option_descriptor_array, &s->opt);
-  if (s->hw->wire.status)
-    {
-      DBG (1, "fetch_options: failed to get option descriptors (%s)\n",
-	   strerror (s->hw->wire.status));
-      return SANE_STATUS_IO_ERROR;
-    }
 
   if (s->local_opt.num_options == 0)
     {
@@ -1682,6 +1814,8 @@ sane_close (SANE_Handle handle)
       DBG (2, "sane_close: closing data pipe\n");
       close (s->data);
     }
+  free (s->opt_hashes);
+  free (s->read_buf);
   free (s);
   DBG (2, "sane_close: done\n");
 }
@@ -2005,6 +2139,8 @@ sane_start (SANE_Handle handle)
   s->data = fd;
   s->reclen_buf_offset = 0;
   s->bytes_remaining = 0;
+  s->read_buf_start = 0;
+  s->read_buf_end = 0;
   DBG (3, "sane_start: done (%s)\n", sane_strstatus (status));
   return status;
 }
@@ -2112,24 +2248,76 @@ sane_start (SANE_Handle handle)
   s->data = fd;
   s->reclen_buf_offset = 0;
   s->bytes_remaining = 0;
+  s->read_buf_start = 0;
+  s->read_buf_end = 0;
   DBG (3, "sane_start: done (%s)\n", sane_strstatus (status));
   return status;
 }
 #endif /* NET_USES_AF_INDEP */
 
 
+/* Receives as much data as is available from the data socket into the
+   read-ahead buffer, which must be empty.  Returns the result of read().  */
+static ssize_t
+fill_read_buf (Net_Scanner * s)
+{
+  ssize_t nread;
+
+  if (!s->read_buf)
+    {
+      s->read_buf = malloc (NET_READ_BUF_SIZE);
+      if (!s->read_buf)
+	{
+	  errno = ENOMEM;
+	  return -1;
+	}
+    }
+
+  s->read_buf_start = 0;
+  s->read_buf_end = 0;
+  nread = read (s->data, s->read_buf, NET_READ_BUF_SIZE);
+  if (nread > 0)
+    s->read_buf_end = nread;
+  DBG (4, "fill_read_buf: received %ld bytes\n", (long) nread);
+  return nread;
+}
+
+/* Swaps the bytes of the 16 bit samples in data, eight bytes at a time so
+   that the compiler can vectorize the loop.  */
+static void
+swap_16bit_samples (SANE_Byte * data, size_t size)
+{
+  size_t i = 0;
+  uint64_t word;
+  SANE_Byte swap_buf;
+
+  for (; i + 8 <= size; i += 8)
+    {
+      memcpy (&word, data + i, 8);
+      word = ((word & 0x00ff00ff00ff00ffULL) << 8)
+	| ((word >> 8) & 0x00ff00ff00ff00ffULL);
+      memcpy (data + i, &word, 8);
+    }
+  for (; i + 1 < size; i += 2)
+    {
+      swap_buf = data[i];
+      data[i] = data[i + 1];
+      data[i + 1] = swap_buf;
+    }
+}
+
 SANE_Status
 sane_read (SANE_Handle handle, SANE_Byte * data, SANE_Int max_length,
 	   SANE_Int * length)
 {
   Net_Scanner *s = handle;
   ssize_t nread;
-  SANE_Int cnt;
+  size_t available, n;
   SANE_Int start_cnt;
   SANE_Int end_cnt;
-  SANE_Byte swap_buf;
   SANE_Byte temp_hang_over;
   int is_even;
+  int swap;
 
   DBG (3, "sane_read: handle=%p, data=%p, max_length=%d, length=%p\n",
        handle, data, max_length, (void *) length);
@@ -2166,85 +2354,127 @@ sane_read (SANE_Handle handle, SANE_Byte * data, SANE_Int max_length,
       return SANE_STATUS_CANCELLED;
     }
 
-  if (s->bytes_remaining == 0)
-    {
-      /* boy, is this painful or what? */
+  /* deliver whole samples if possible, so that no byte has to be kept back
+     for swapping */
+  swap = (depth == 16) && (server_big_endian != client_big_endian);
+  if (swap && max_length > 1)
+    max_length &= ~1;
 
-      DBG (4, "sane_read: reading packet length\n");
-      nread = read (s->data, s->reclen_buf + s->reclen_buf_offset,
-		    4 - s->reclen_buf_offset);
-      if (nread < 0)
+  /* Copy data from as many records as are available without blocking once
+     some data has been copied.  */
+  nread = 0;
+  while (nread < max_length)
+    {
+      if (s->bytes_remaining == 0 && s->reclen_buf_offset == 4)
 	{
-	  DBG (3, "sane_read: read failed (%s)\n", strerror (errno));
-	  if (errno == EAGAIN)
-	    {
-	      DBG (3, "sane_read: try again later\n");
-	      return SANE_STATUS_GOOD;
-	    }
-	  else
+	  s->bytes_remaining = (((u_long) s->reclen_buf[0] << 24)
+				| ((u_long) s->reclen_buf[1] << 16)
+				| ((u_long) s->reclen_buf[2] << 8)
+				| ((u_long) s->reclen_buf[3] << 0));
+	  if (s->bytes_remaining == 0xffffffff)
 	    {
-	      DBG (1, "sane_read: cancelling read\n");
+	      char ch;
+
+	      /* return the data received so far first */
+	      s->bytes_remaining = 0;
+	      if (nread > 0)
+		break;
+
+	      DBG (2, "sane_read: received error signal\n");
+	      s->reclen_buf_offset = 0;
+
+	      /* read the status byte: */
+	      if (s->read_buf_start < s->read_buf_end)
+		ch = s->read_buf[s->read_buf_start++];
+	      else
+		{
+		  /* turn off non-blocking I/O (s->data will be closed
+		     anyhow): */
+		  fcntl (s->data, F_SETFL, 0);
+
+		  if (read (s->data, &ch, sizeof (ch)) != 1)
+		    {
+		      DBG (1, "sane_read: failed to read error code\n");
+		      ch = SANE_STATUS_IO_ERROR;
+		    }
+		}
+	      DBG (1, "sane_read: error code %s\n",
+		   sane_strstatus ((SANE_Status) ch));
 	      do_cancel (s);
-	      return SANE_STATUS_IO_ERROR;
+	      return (SANE_Status) ch;
 	    }
-	}
-      DBG (4, "sane_read: read %lu bytes, %d from 4 total\n", (u_long) nread,
-	   s->reclen_buf_offset);
-      s->reclen_buf_offset += nread;
-      if (s->reclen_buf_offset < 4)
-	{
-	  DBG (4, "sane_read: enough for now\n");
-	  return SANE_STATUS_GOOD;
+	  s->reclen_buf_offset = 0;
+	  DBG (3, "sane_read: next record length=%ld bytes\n",
+	       (long) s->bytes_remaining);
+	  continue;
 	}
 
-      s->reclen_buf_offset = 0;
-      s->bytes_remaining = (((u_long) s->reclen_buf[0] << 24)
-			    | ((u_long) s->reclen_buf[1] << 16)
-			    | ((u_long) s->reclen_buf[2] << 8)
-			    | ((u_long) s->reclen_buf[3] << 0));
-      DBG (3, "sane_read: next record length=%ld bytes\n",
-	   (long) s->bytes_remaining);
-      if (s->bytes_remaining == 0xffffffff)
+      available = s->read_buf_end - s->read_buf_start;
+      if (available == 0)
 	{
-	  char ch;
+	  ssize_t nreceived;
 
-	  DBG (2, "sane_read: received error signal\n");
+	  if (nread > 0)
+	    break;
 
-	  /* turn off non-blocking I/O (s->data will be closed anyhow): */
-	  fcntl (s->data, F_SETFL, 0);
+	  /* large requests are read directly into the caller's buffer */
+	  if (s->bytes_remaining >= NET_READ_BUF_SIZE
+	      && max_length >= NET_READ_BUF_SIZE)
+	    {
+	      n = max_length;
+	      if (n > s->bytes_remaining)
+		n = s->bytes_remaining;
+	      nreceived = read (s->data, data, n);
+	      if (nreceived > 0)
+		{
+		  s->bytes_remaining -= nreceived;
+		  nread = nreceived;
+		  break;
+		}
+	    }
+	  else
+	    nreceived = fill_read_buf (s);
 
-	  /* read the status byte: */
-	  if (read (s->data, &ch, sizeof (ch)) != 1)
+	  if (nreceived < 0)
+	    {
+	      DBG (3, "sane_read: read failed (%s)\n", strerror (errno));
+	      if (errno == EAGAIN)
+		{
+		  DBG (3, "sane_read: try again later\n");
+		  return SANE_STATUS_GOOD;
+		}
+	      DBG (1, "sane_read: cancelling read\n");
+	      do_cancel (s);
+	      return SANE_STATUS_IO_ERROR;
+	    }
+	  if (nreceived == 0)
 	    {
-	      DBG (1, "sane_read: failed to read error code\n");
-	      ch = SANE_STATUS_IO_ERROR;
+	      DBG (1, "sane_read: data connection closed unexpectedly\n");
+	      do_cancel (s);
+	      return SANE_STATUS_IO_ERROR;
 	    }
-	  DBG (1, "sane_read: error code %s\n",
-	       sane_strstatus ((SANE_Status) ch));
-	  do_cancel (s);
-	  return (SANE_Status) ch;
+	  continue;
 	}
-    }
 
-  if (max_length > (SANE_Int) s->bytes_remaining)
-    max_length = s->bytes_remaining;
-
-  nread = read (s->data, data, max_length);
-
-  if (nread < 0)
-    {
-      DBG (2, "sane_read: error code %s\n", strerror (errno));
-      if (errno == EAGAIN)
-	return SANE_STATUS_GOOD;
-      else
+      if (s->bytes_remaining == 0)
 	{
-	  DBG (1, "sane_read: cancelling scan\n");
-	  do_cancel (s);
-	  return SANE_STATUS_IO_ERROR;
+	  /* the record length may be split between two reads */
+	  while (s->reclen_buf_offset < 4 && s->read_buf_start < s->read_buf_end)
+	    s->reclen_buf[s->reclen_buf_offset++] =
+	      s->read_buf[s->read_buf_start++];
+	  continue;
 	}
-    }
 
-  s->bytes_remaining -= nread;
+      n = max_length - nread;
+      if (n > s->bytes_remaining)
+	n = s->bytes_remaining;
+      if (n > available)
+	n = available;
+      memcpy (data + nread, s->read_buf + s->read_buf_start, n);
+      s->read_buf_start += n;
+      s->bytes_remaining -= n;
+      nread += n;
+    }
 
   *length = nread;
   /* Check whether we are scanning with a depth of 16 bits/pixel and whether
@@ -2252,7 +2482,7 @@ sane_read (SANE_Handle handle, SANE_Byte * data, SANE_Int max_length,
      necessary to check whether read returned an odd number. If an odd number
      has been returned, we must save the last byte.
   */
-  if ((depth == 16) && (server_big_endian != client_big_endian))
+  if (swap)
     {
       DBG (1,"sane_read: client/server have different byte order; "
 	   "must swap\n");
@@ -2325,12 +2555,8 @@ sane_read (SANE_Handle handle, SANE_Byte * data, SANE_Int max_length,
 	    }
 	}
       /* swap the bytes */
-      for (cnt = start_cnt; cnt < end_cnt - 1; cnt += 2)
-	{
-	  swap_buf = *(data + cnt);
-	  *(data + cnt) = *(data + cnt + 1);
-	  *(data + cnt + 1) = swap_buf;
-	}
+      if (end_cnt > start_cnt)
+	swap_16bit_samples (data + start_cnt, end_cnt - start_cnt);
     }
   DBG (3, "sane_read: %lu bytes read, %lu remaining\n", (u_long) nread,
        (u_long) s->bytes_remaining);
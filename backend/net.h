@@ -70,6 +70,7 @@ typedef struct Net_Scanner
 
     int options_valid;			/* are the options current? */
     SANE_Option_Descriptor_Array opt, local_opt;
+    SANE_Word *opt_hashes;	/* hashes of opt.desc, if known */
 
     SANE_Word handle;		/* remote handle (it's a word, not a ptr!) */
 
@@ -78,6 +79,11 @@ typedef struct Net_Scanner
     u_char reclen_buf[4];
     size_t bytes_remaining;	/* how many bytes left in this record? */
 
+    /* read-ahead buffer for the data socket: */
+    u_char *read_buf;
+    size_t read_buf_start;	/* offset of the first unconsumed byte */
+    size_t read_buf_end;	/* offset past the last received byte */
+
     /* device (host) info: */
     Net_Device *hw;
   }
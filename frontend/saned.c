@@ -78,6 +78,7 @@
 #include <arpa/inet.h>
 
 #include <sys/wait.h>
+#include <sys/uio.h>
 
 #include <pwd.h>
 #include <grp.h>
@@ -100,6 +101,9 @@ struct pollfd
 
 #define POLLIN 0x0001
 #define POLLERR 0x0002
+#define POLLOUT 0x0004
+#define POLLHUP 0x0008
+#define POLLNVAL 0x0010
 
 int
 poll (struct pollfd *ufds, unsigned int nfds, int timeout);
@@ -110,6 +114,7 @@ poll (struct pollfd *ufds, unsigned int nfds, int timeout)
   struct pollfd *fdp;
 
   fd_set rfds;
+  fd_set wfds;
   fd_set efds;
   struct timeval tv;
   int maxfd = 0;
@@ -120,6 +125,7 @@ poll (struct pollfd *ufds, unsigned int nfds, int timeout)
   tv.tv_usec = (timeout - tv.tv_sec * 1000) * 1000;
 
   FD_ZERO (&rfds);
+  FD_ZERO (&wfds);
   FD_ZERO (&efds);
 
   for (i = 0, fdp = ufds; i < nfds; i++, fdp++)
@@ -129,6 +135,9 @@ poll (struct pollfd *ufds, unsigned int nfds, int timeout)
       if (fdp->events & POLLIN)
 	FD_SET (fdp->fd, &rfds);
 
+      if (fdp->events & POLLOUT)
+	FD_SET (fdp->fd, &wfds);
+
       FD_SET (fdp->fd, &efds);
 
       maxfd = (fdp->fd > maxfd) ? fdp->fd : maxfd;
@@ -136,7 +145,7 @@ poll (struct pollfd *ufds, unsigned int nfds, int timeout)
 
   maxfd++;
 
-  ret = select (maxfd, &rfds, NULL, &efds, &tv);
+  ret = select (maxfd, &rfds, &wfds, &efds, timeout < 0 ? NULL : &tv);
 
   if (ret < 0)
     return ret;
@@ -147,6 +156,10 @@ poll (struct pollfd *ufds, unsigned int nfds, int timeout)
 	if (FD_ISSET (fdp->fd, &rfds))
 	  fdp->revents |= POLLIN;
 
+      if (fdp->events & POLLOUT)
+	if (FD_ISSET (fdp->fd, &wfds))
+	  fdp->revents |= POLLOUT;
+
       if (FD_ISSET (fdp->fd, &efds))
 	fdp->revents |= POLLERR;
     }
@@ -254,6 +267,20 @@ static int run_mode;
 static int run_foreground;
 static int run_once;
 static int data_connect_timeout = 4000;
+/* size of the buffer used to send the image data to the client; can be
+   increased via the data_buffer_size option for fast scanners and links */
+#define DATA_BUFFER_SIZE_DEFAULT 8192
+#define DATA_BUFFER_SIZE_MAX (64 * 1024 * 1024)
+static size_t data_buffer_size = DATA_BUFFER_SIZE_DEFAULT;
+/* pre-forked worker pool for standalone mode; with zero workers each
+   connection is handled by a freshly forked process */
+#define POOL_WORKERS_MAX 64
+static int pool_workers;
+static int pool_worker_connections = 100;
+static pid_t *pool_pids;
+static int backend_initialized;
+static int backend_used;
+static SANE_Int backend_version;
 static Handle *handle;
 static char *bind_addr;
 static short bind_port = -1;
@@ -267,7 +294,8 @@ byte_order;
 /* The default-user name.  This is not used to imply any rights.  All
    it does is save a remote user some work by reducing the amount of
    text s/he has to type when authentication is requested.  */
-static const char *default_username = "saned-user";
+static const char saned_default_user[] = "saned-user";
+static const char *default_username = saned_default_user;
 static char *remote_ip;
 
 /* data port range */
@@ -556,6 +584,81 @@ decode_handle (Wire * w, const char *op)
 
 
 
+/* FNV-1a hash of the option descriptors, used to send only the descriptors
+   that changed since the client has fetched them */
+static uint32_t
+hash_bytes (uint32_t hash, const void *data, size_t size)
+{
+  const SANE_Byte *p = data;
+  size_t i;
+
+  for (i = 0; i < size; ++i)
+    {
+      hash ^= p[i];
+      hash *= 16777619;
+    }
+  return hash;
+}
+
+static uint32_t
+hash_word (uint32_t hash, SANE_Word word)
+{
+  return hash_bytes (hash, &word, sizeof (word));
+}
+
+static uint32_t
+hash_string (uint32_t hash, SANE_String_Const str)
+{
+  /* distinguish NULL from empty strings */
+  hash = hash_word (hash, str != NULL);
+  if (str)
+    hash = hash_bytes (hash, str, strlen (str) + 1);
+  return hash;
+}
+
+static SANE_Word
+option_descriptor_hash (const SANE_Option_Descriptor * desc)
+{
+  uint32_t hash = 2166136261U;
+  int i;
+
+  if (!desc)
+    return 0;
+
+  hash = hash_string (hash, desc->name);
+  hash = hash_string (hash, desc->title);
+  hash = hash_string (hash, desc->desc);
+  hash = hash_word (hash, desc->type);
+  hash = hash_word (hash, desc->unit);
+  hash = hash_word (hash, desc->size);
+  hash = hash_word (hash, desc->cap);
+  hash = hash_word (hash, desc->constraint_type);
+
+  switch (desc->constraint_type)
+    {
+    case SANE_CONSTRAINT_RANGE:
+      hash = hash_word (hash, desc->constraint.range->min);
+      hash = hash_word (hash, desc->constraint.range->max);
+      hash = hash_word (hash, desc->constraint.range->quant);
+      break;
+
+    case SANE_CONSTRAINT_WORD_LIST:
+      /* the first element is the number of words */
+      for (i = 0; i <= desc->constraint.word_list[0]; ++i)
+	hash = hash_word (hash, desc->constraint.word_list[i]);
+      break;
+
+    case SANE_CONSTRAINT_STRING_LIST:
+      for (i = 0; desc->constraint.string_list[i]; ++i)
+	hash = hash_string (hash, desc->constraint.string_list[i]);
+      break;
+
+    default:
+      break;
+    }
+  return (SANE_Word) hash;
+}
+
 /* Convert a number of bits to an 8-bit bitmask */
 static unsigned int cidrtomask[9] = { 0x00, 0x80, 0xC0, 0xE0, 0xF0,
 				      0xF8, 0xFC, 0xFE, 0xFF };
@@ -1374,7 +1477,12 @@ init (Wire * w)
       return -1;
     }
 
-  w->version = SANEI_NET_PROTOCOL_VERSION;
+  /* use the delta option descriptor protocol only if the client supports
+     it; older clients ignore the build number up to version 3 */
+  if (SANE_VERSION_BUILD (req.version_code) >= SANEI_NET_PROTOCOL_VERSION)
+    w->version = SANEI_NET_PROTOCOL_VERSION;
+  else
+    w->version = 3;
   if (req.username)
     default_username = strdup (req.username);
 
@@ -1385,18 +1493,23 @@ init (Wire * w)
       return -1;
     }
 
-  reply.version_code = SANE_VERSION_CODE (V_MAJOR, V_MINOR,
-					  SANEI_NET_PROTOCOL_VERSION);
+  reply.version_code = SANE_VERSION_CODE (V_MAJOR, V_MINOR, w->version);
 
   DBG (DBG_WARN, "init: access granted to %s@%s\n",
        default_username, remote_ip);
 
   if (status == SANE_STATUS_GOOD)
     {
-      status = sane_init (&be_version_code, auth_callback);
-      if (status != SANE_STATUS_GOOD)
-	DBG (DBG_ERR, "init: failed to initialize backend (%s)\n",
-	     sane_strstatus (status));
+      /* pool workers have initialized the backends before accepting */
+      if (backend_initialized)
+	be_version_code = backend_version;
+      else
+	{
+	  status = sane_init (&be_version_code, auth_callback);
+	  if (status != SANE_STATUS_GOOD)
+	    DBG (DBG_ERR, "init: failed to initialize backend (%s)\n",
+		 sane_strstatus (status));
+	}
 
       if (SANE_VERSION_MAJOR (be_version_code) != V_MAJOR)
 	{
@@ -1648,157 +1761,204 @@ store_reclen (SANE_Byte * buf, size_t buf_size, int i, size_t reclen)
   return i;
 }
 
+/*
+ * The image data is sent to the client as a sequence of records, each
+ * consisting of a 4 byte big-endian length followed by that many bytes of
+ * data. The length 0xffffffff is followed by a single byte containing the
+ * final status instead.
+ *
+ * The records are stored in a ring buffer of data_buffer_size bytes along with
+ * their length headers. New data is read from the backend whenever there is
+ * enough space left, so reading from the scanner overlaps with sending to the
+ * client, and all pending records are sent with a single writev() call.
+ */
 static void
 do_scan (Wire * w, int h, int data_fd)
 {
-  int num_fds, be_fd = -1, reader, writer, bytes_in_buf, status_dirty = 0;
+  int be_fd = -1, nfds, timeout, status_dirty = 0;
   SANE_Handle be_handle = handle[h].handle;
-  struct timeval tv, *timeout = 0;
-  fd_set rd_set, rd_mask, wr_set, wr_mask;
-  SANE_Byte buf[8192];
+  struct pollfd fds[3];
+  struct iovec iov[2];
+  SANE_Byte small_buf[DATA_BUFFER_SIZE_DEFAULT];
+  SANE_Byte *buf = small_buf;
+  size_t buf_size = data_buffer_size;
+  size_t reader, writer, bytes_in_buf, min_read, start;
   SANE_Status status;
-  long int nwritten;
+  ssize_t nwritten;
   SANE_Int length;
   size_t nbytes;
 
   DBG (3, "do_scan: start\n");
 
-  FD_ZERO (&rd_mask);
-  FD_SET (w->io.fd, &rd_mask);
-  num_fds = w->io.fd + 1;
-
-  FD_ZERO (&wr_mask);
-  FD_SET (data_fd, &wr_mask);
-  if (data_fd >= num_fds)
-    num_fds = data_fd + 1;
-
-  sane_set_io_mode (be_handle, SANE_TRUE);
-  if (sane_get_select_fd (be_handle, &be_fd) == SANE_STATUS_GOOD)
+  if (buf_size > sizeof (small_buf))
     {
-      FD_SET (be_fd, &rd_mask);
-      if (be_fd >= num_fds)
-	num_fds = be_fd + 1;
+      buf = malloc (buf_size);
+      if (!buf)
+	{
+	  DBG (DBG_ERR, "do_scan: could not allocate %lu byte buffer, "
+	       "using %lu bytes\n", (u_long) buf_size,
+	       (u_long) sizeof (small_buf));
+	  buf = small_buf;
+	  buf_size = sizeof (small_buf);
+	}
     }
-  else
+
+  if (buf_size > DATA_BUFFER_SIZE_DEFAULT)
     {
-      memset (&tv, 0, sizeof (tv));
-      timeout = &tv;
+      int sndbuf = buf_size;
+
+      /* let the kernel queue enough data to keep the link busy */
+      if (setsockopt (data_fd, SOL_SOCKET, SO_SNDBUF, &sndbuf,
+		      sizeof (sndbuf)) < 0)
+	DBG (DBG_WARN, "do_scan: failed to set SO_SNDBUF (%s)\n",
+	     strerror (errno));
     }
+  fcntl (data_fd, F_SETFL, fcntl (data_fd, F_GETFL) | O_NONBLOCK);
+
+  /* don't read small chunks while there is still data to send */
+  min_read = buf_size / 4;
+
+  fds[0].fd = w->io.fd;
+  fds[0].events = POLLIN;
+  fds[1].fd = data_fd;
+
+  sane_set_io_mode (be_handle, SANE_TRUE);
+  if (sane_get_select_fd (be_handle, &be_fd) != SANE_STATUS_GOOD)
+    be_fd = -1;
 
   status = SANE_STATUS_GOOD;
   reader = writer = bytes_in_buf = 0;
   do
     {
-      rd_set = rd_mask;
-      wr_set = wr_mask;
-      if (select (num_fds, &rd_set, &wr_set, 0, timeout) < 0)
+      if (status_dirty && buf_size - bytes_in_buf >= 5)
+	{
+	  status_dirty = 0;
+	  reader = store_reclen (buf, buf_size, reader, 0xffffffff);
+	  buf[reader] = status;
+	  reader = (reader + 1) % buf_size;
+	  bytes_in_buf += 5;
+	  DBG (DBG_MSG, "do_scan: statuscode `%s' was added to buffer\n",
+	       sane_strstatus(status));
+	}
+
+      if (bytes_in_buf == 0)
+	reader = writer = 0;
+
+      /* the data of the next record starts after its 4 byte length */
+      start = (reader + 4) % buf_size;
+      nbytes = 0;
+      if (status == SANE_STATUS_GOOD && buf_size - bytes_in_buf > 4)
+	{
+	  nbytes = buf_size - bytes_in_buf - 4;
+	  if (start + nbytes > buf_size)
+	    nbytes = buf_size - start;
+	  if (bytes_in_buf > 0 && nbytes < min_read)
+	    nbytes = 0;
+	}
+
+      fds[1].events = bytes_in_buf > 0 ? POLLOUT : 0;
+      nfds = 2;
+      if (be_fd >= 0)
+	{
+	  fds[2].fd = be_fd;
+	  fds[2].events = nbytes > 0 ? POLLIN : 0;
+	  nfds = 3;
+	}
+
+      /* without a select fd the backend is polled */
+      timeout = (be_fd < 0 && nbytes > 0) ? 0 : -1;
+
+      if (poll (fds, nfds, timeout) < 0)
 	{
+	  if (errno == EINTR)
+	    continue;
 	  if (be_fd >= 0 && errno == EBADF)
 	    {
-	      /* This normally happens when a backend closes a select
-		 filedescriptor when reaching the end of file.  So
-		 pass back this status to the client: */
-	      FD_CLR (be_fd, &rd_mask);
-	      be_fd = -1;
-	      /* only set status_dirty if EOF hasn't been already detected */
-	      if (status == SANE_STATUS_GOOD)
-		status_dirty = 1;
-	      status = SANE_STATUS_EOF;
-	      DBG (DBG_INFO, "do_scan: select_fd was closed --> EOF\n");
-	      continue;
+	      fds[2].revents = POLLNVAL;
 	    }
 	  else
 	    {
 	      status = SANE_STATUS_IO_ERROR;
-	      DBG (DBG_ERR, "do_scan: select failed (%s)\n", strerror (errno));
+	      DBG (DBG_ERR, "do_scan: poll failed (%s)\n", strerror (errno));
 	      break;
 	    }
 	}
 
-      if (bytes_in_buf)
+      if (be_fd >= 0 && (fds[2].revents & POLLNVAL))
 	{
-	  if (FD_ISSET (data_fd, &wr_set))
+	  /* This normally happens when a backend closes a select
+	     filedescriptor when reaching the end of file.  So
+	     pass back this status to the client: */
+	  be_fd = -1;
+	  /* only set status_dirty if EOF hasn't been already detected */
+	  if (status == SANE_STATUS_GOOD)
+	    status_dirty = 1;
+	  status = SANE_STATUS_EOF;
+	  DBG (DBG_INFO, "do_scan: select_fd was closed --> EOF\n");
+	  continue;
+	}
+
+      if (bytes_in_buf > 0 && (fds[1].revents & (POLLOUT | POLLERR | POLLHUP)))
+	{
+	  /* write all pending records, the data may wrap around */
+	  iov[0].iov_base = buf + writer;
+	  iov[0].iov_len = bytes_in_buf;
+	  iov[1].iov_base = buf;
+	  iov[1].iov_len = 0;
+	  if (writer + bytes_in_buf > buf_size)
 	    {
-	      if (bytes_in_buf > 0)
-		{
-		  /* write more input data */
-		  nbytes = bytes_in_buf;
-		  if (writer + nbytes > sizeof (buf))
-		    nbytes = sizeof (buf) - writer;
-		  DBG (DBG_INFO,
-		       "do_scan: trying to write %d bytes to client\n",
-		       nbytes);
-		  nwritten = write (data_fd, buf + writer, nbytes);
-		  DBG (DBG_INFO,
-		       "do_scan: wrote %ld bytes to client\n", nwritten);
-		  if (nwritten < 0)
-		    {
-		      DBG (DBG_ERR, "do_scan: write failed (%s)\n",
-			   strerror (errno));
-		      status = SANE_STATUS_CANCELLED;
-	              handle[h].docancel = 1;
-		      break;
-		    }
-		  bytes_in_buf -= nwritten;
-		  writer += nwritten;
-		  if (writer == sizeof (buf))
-		    writer = 0;
-		}
+	      iov[0].iov_len = buf_size - writer;
+	      iov[1].iov_len = bytes_in_buf - iov[0].iov_len;
+	    }
+	  DBG (DBG_INFO,
+	       "do_scan: trying to write %lu bytes to client\n",
+	       (u_long) bytes_in_buf);
+	  nwritten = writev (data_fd, iov, iov[1].iov_len > 0 ? 2 : 1);
+	  DBG (DBG_INFO,
+	       "do_scan: wrote %ld bytes to client\n", (long) nwritten);
+	  if (nwritten < 0 && errno != EAGAIN && errno != EINTR)
+	    {
+	      DBG (DBG_ERR, "do_scan: write failed (%s)\n",
+		   strerror (errno));
+	      status = SANE_STATUS_CANCELLED;
+	      handle[h].docancel = 1;
+	      break;
+	    }
+	  if (nwritten > 0)
+	    {
+	      bytes_in_buf -= nwritten;
+	      writer = (writer + nwritten) % buf_size;
 	    }
 	}
-      else if (status == SANE_STATUS_GOOD
-	       && (timeout || FD_ISSET (be_fd, &rd_set)))
-	{
-	  int i;
 
+      if (nbytes > 0 && status == SANE_STATUS_GOOD
+	  && (be_fd < 0 || (fds[2].revents & POLLIN)))
+	{
 	  /* get more input data */
-
-	  /* reserve 4 bytes to store the length of the data record: */
-	  i = reader;
-	  reader += 4;
-	  if (reader >= (int) sizeof (buf))
-	    reader -= sizeof(buf);
-
-	  assert (bytes_in_buf == 0);
-	  nbytes = sizeof (buf) - 4;
-	  if (reader + nbytes > sizeof (buf))
-	    nbytes = sizeof (buf) - reader;
-
 	  DBG (DBG_INFO,
-	       "do_scan: trying to read %d bytes from scanner\n", nbytes);
-	  status = sane_read (be_handle, buf + reader, nbytes, &length);
+	       "do_scan: trying to read %lu bytes from scanner\n",
+	       (u_long) nbytes);
+	  status = sane_read (be_handle, buf + start, nbytes, &length);
 	  DBG (DBG_INFO,
 	       "do_scan: read %d bytes from scanner\n", length);
 
 	  reset_watchdog ();
 
-	  reader += length;
-	  if (reader >= (int) sizeof (buf))
-	    reader = 0;
-	  bytes_in_buf += length + 4;
-
 	  if (status != SANE_STATUS_GOOD)
 	    {
-	      reader = i;	/* restore reader index */
 	      status_dirty = 1;
 	      DBG (DBG_MSG,
 		   "do_scan: status = `%s'\n", sane_strstatus(status));
 	    }
-	  else
-	    store_reclen (buf, sizeof (buf), i, length);
-	}
-
-      if (status_dirty && sizeof (buf) - bytes_in_buf >= 5)
-	{
-	  status_dirty = 0;
-	  reader = store_reclen (buf, sizeof (buf), reader, 0xffffffff);
-	  buf[reader] = status;
-	  bytes_in_buf += 5;
-	  DBG (DBG_MSG, "do_scan: statuscode `%s' was added to buffer\n",
-	       sane_strstatus(status));
+	  else if (length > 0)
+	    {
+	      store_reclen (buf, buf_size, reader, length);
+	      reader = (start + length) % buf_size;
+	      bytes_in_buf += length + 4;
+	    }
 	}
 
-      if (FD_ISSET (w->io.fd, &rd_set))
+      if (fds[0].revents & (POLLIN | POLLERR | POLLHUP))
 	{
 	  DBG (DBG_MSG,
 	       "do_scan: processing RPC request on fd %d\n", w->io.fd);
@@ -1812,6 +1972,9 @@ do_scan (Wire * w, int h, int data_fd)
   while (status == SANE_STATUS_GOOD || bytes_in_buf > 0 || status_dirty);
   DBG (DBG_MSG, "do_scan: done, status=%s\n", sane_strstatus (status));
 
+  if (buf != small_buf)
+    free (buf);
+
   if(handle[h].docancel)
     sane_cancel (handle[h].handle);
 
@@ -1935,6 +2098,7 @@ process_request (Wire * w)
 
 	if (reply.status == SANE_STATUS_GOOD)
 	  {
+	    backend_used = 1;
 	    h = get_free_handle ();
 	    if (h < 0)
 	      reply.status = SANE_STATUS_NO_MEM;
@@ -1985,6 +2149,55 @@ process_request (Wire * w)
       }
       break;
 
+    case SANE_NET_GET_OPTION_DESCRIPTORS_DELTA:
+      {
+	SANE_Option_Descriptor_Delta_Req req;
+	SANE_Option_Descriptor_Delta_Reply reply;
+	SANE_Option_Descriptor *desc;
+	SANE_Word hash;
+
+	sanei_w_option_descriptor_delta_req (w, &req);
+	if (w->status || (unsigned) req.handle >= (unsigned) num_handles
+	    || !handle[req.handle].inuse)
+	  {
+	    DBG (DBG_ERR,
+		 "process_request: (get_option_descriptors_delta) error while "
+		 "decoding args h=%d (%s)\n", req.handle, strerror (w->status));
+	    return 1;
+	  }
+	be_handle = handle[req.handle].handle;
+	sane_control_option (be_handle, 0, SANE_ACTION_GET_VALUE,
+			     &reply.num_options, 0);
+
+	reply.num_changed = 0;
+	reply.changed = malloc (reply.num_options * sizeof (reply.changed[0]));
+	for (i = 0; i < reply.num_options; ++i)
+	  {
+	    desc = (SANE_Option_Descriptor *)
+	      sane_get_option_descriptor (be_handle, i);
+	    hash = option_descriptor_hash (desc);
+	    if (i < req.num_hashes && req.hashes[i] == hash)
+	      continue;
+
+	    reply.changed[reply.num_changed].index = i;
+	    reply.changed[reply.num_changed].hash = hash;
+	    reply.changed[reply.num_changed].desc = desc;
+	    ++reply.num_changed;
+	  }
+	DBG (DBG_MSG, "process_request: (get_option_descriptors_delta) "
+	     "%d of %d descriptors changed\n", reply.num_changed,
+	     reply.num_options);
+
+	sanei_w_reply (w,
+		       (WireCodecFunc) sanei_w_option_descriptor_delta_reply,
+		       &reply);
+
+	free (reply.changed);
+	sanei_w_free (w, (WireCodecFunc) sanei_w_option_descriptor_delta_req,
+		      &req);
+      }
+      break;
+
     case SANE_NET_CONTROL_OPTION:
       {
 	SANE_Control_Option_Req req;
@@ -2424,6 +2637,223 @@ handle_client (int fd)
     }
 }
 
+/* Release what a connection left behind so that a pool worker can serve
+   the next client from a clean state. */
+static void
+end_connection (void)
+{
+  int i;
+
+  alarm (0);
+
+  for (i = 0; i < num_handles; ++i)
+    close_handle (i);
+  if (handle)
+    memset (handle, 0, num_handles * sizeof (handle[0]));
+
+  close (wire.io.fd);
+  sanei_w_exit (&wire);
+  sanei_w_init (&wire, sanei_codec_bin_init);
+  wire.io.fd = -1;
+
+  can_authorize = 0;
+  if (default_username != saned_default_user)
+    {
+      free ((char *) default_username);
+      default_username = saned_default_user;
+    }
+  if (remote_ip)
+    {
+      free (remote_ip);
+      remote_ip = NULL;
+    }
+}
+
+/* Initialize the backends of a pool worker and enumerate the devices, so
+   that neither has to be done while a client is waiting. */
+static SANE_Status
+init_worker_backend (void)
+{
+  const SANE_Device **device_list;
+  SANE_Status status;
+
+  status = sane_init (&backend_version, auth_callback);
+  if (status != SANE_STATUS_GOOD)
+    {
+      DBG (DBG_ERR, "init_worker_backend: failed to initialize backend (%s)\n",
+	   sane_strstatus (status));
+      return status;
+    }
+  sane_get_devices (&device_list, SANE_FALSE);
+
+  backend_initialized = 1;
+  backend_used = 0;
+  return SANE_STATUS_GOOD;
+}
+
+/*
+ * A pool worker takes connections from the shared listening sockets and
+ * serves them one after the other. After a client has opened a device the
+ * backends are re-initialized before the next accept, so that every client
+ * starts from the backend defaults just like with a freshly forked saned.
+ * The worker exits after pool_worker_connections connections and is
+ * replaced by the parent, which bounds the lifetime of any state leaked by
+ * a backend.
+ */
+static void
+run_worker (struct pollfd *fds, int nfds)
+{
+  struct pollfd *fdp;
+  int served = 0;
+  int fd;
+  int i;
+
+  signal (SIGINT, quit);
+  signal (SIGTERM, quit);
+
+  if (log_to_syslog)
+    {
+      closelog ();
+      openlog ("saned", LOG_PID | LOG_CONS, LOG_DAEMON);
+    }
+
+  if (init_worker_backend () != SANE_STATUS_GOOD)
+    exit (1);
+  DBG (DBG_MSG, "run_worker: ready\n");
+
+  while (pool_worker_connections == 0 || served < pool_worker_connections)
+    {
+      if (poll (fds, nfds, -1) < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  DBG (DBG_ERR, "run_worker: poll failed: %s\n", strerror (errno));
+	  break;
+	}
+
+      for (i = 0, fdp = fds; i < nfds; i++, fdp++)
+	{
+	  if (fdp->revents & (POLLERR | POLLHUP | POLLNVAL))
+	    {
+	      DBG (DBG_ERR, "run_worker: invalid fd in set\n");
+	      quit (0);
+	    }
+	  if (! (fdp->revents & POLLIN))
+	    continue;
+
+	  /* the listening sockets are non-blocking, so losing the race for
+	     the connection to another worker just returns EAGAIN */
+	  fd = accept (fdp->fd, 0, 0);
+	  if (fd < 0)
+	    {
+	      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+		DBG (DBG_ERR, "run_worker: accept failed: %s\n",
+		     strerror (errno));
+	      continue;
+	    }
+	  fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) & ~O_NONBLOCK);
+
+	  handle_connection (fd);
+	  end_connection ();
+	  served++;
+	  DBG (DBG_MSG, "run_worker: served %d connection(s)\n", served);
+
+	  if (backend_used && served != pool_worker_connections)
+	    {
+	      sane_exit ();
+	      backend_initialized = 0;
+	      if (init_worker_backend () != SANE_STATUS_GOOD)
+		exit (1);
+	    }
+	  break;
+	}
+    }
+
+  DBG (DBG_MSG, "run_worker: recycling worker\n");
+  quit (0);
+}
+
+static void
+spawn_worker (struct pollfd *fds, int nfds, int slot)
+{
+  pid_t pid;
+
+  pid = fork ();
+  if (pid == 0)
+    run_worker (fds, nfds);
+  else if (pid > 0)
+    {
+      pool_pids[slot] = pid;
+      add_child (pid);
+    }
+  else
+    {
+      DBG (DBG_ERR, "spawn_worker: fork() failed: %s\n", strerror (errno));
+      pool_pids[slot] = -1;
+    }
+}
+
+static void
+bail_out (int error);
+
+/* Keep pool_workers workers running; the workers do the accepting. */
+static void
+run_pool (struct pollfd *fds, int nfds)
+{
+  pid_t pid;
+  int status;
+  int i;
+
+  for (i = 0; i < nfds; i++)
+    fcntl (fds[i].fd, F_SETFL, fcntl (fds[i].fd, F_GETFL) | O_NONBLOCK);
+
+  pool_pids = calloc (pool_workers, sizeof (pool_pids[0]));
+  if (!pool_pids)
+    {
+      DBG (DBG_ERR, "run_pool: out of memory\n");
+      bail_out (1);
+    }
+
+  DBG (DBG_MSG, "run_pool: starting %d workers\n", pool_workers);
+  for (i = 0; i < pool_workers; i++)
+    spawn_worker (fds, nfds, i);
+
+  while (1)
+    {
+      /* retry failed forks */
+      for (i = 0; i < pool_workers; i++)
+	if (pool_pids[i] < 0)
+	  spawn_worker (fds, nfds, i);
+
+      pid = wait_child (-1, &status, 0);
+      if (pid < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  /* only possible if no worker could be forked */
+	  sleep (1);
+	  continue;
+	}
+
+      for (i = 0; i < pool_workers; i++)
+	if (pool_pids[i] == pid)
+	  break;
+      if (i == pool_workers)
+	continue;
+
+      /* don't spin if the workers can't even initialize */
+      if (!WIFEXITED (status) || WEXITSTATUS (status) != 0)
+	{
+	  DBG (DBG_WARN, "run_pool: worker %d died, restarting\n", (int) pid);
+	  sleep (1);
+	}
+      else
+	DBG (DBG_INFO, "run_pool: worker %d exited, restarting\n", (int) pid);
+
+      spawn_worker (fds, nfds, i);
+    }
+}
+
 static void
 bail_out (int error)
 {
@@ -2434,6 +2864,18 @@ bail_out (int error)
     kill (avahi_pid, SIGTERM);
 #endif /* WITH_AVAHI */
 
+  if (pool_pids)
+    {
+      int i;
+
+      for (i = 0; i < pool_workers; i++)
+	if (pool_pids[i] > 0)
+	  kill (pool_pids[i], SIGTERM);
+      for (i = 0; i < pool_workers; i++)
+	if (pool_pids[i] > 0)
+	  waitpid (pool_pids[i], NULL, 0);
+    }
+
   while (numchildren > 0)
     wait_child (-1, NULL, 0);
 
@@ -2801,6 +3243,68 @@ read_config (void)
                   DBG (DBG_INFO, "read_config: data port range: %d - %d\n", data_port_lo, data_port_hi);
                 }
             }
+            else if(strstr(config_line, "data_buffer_size") != NULL)
+            {
+              optval = sanei_config_skip_whitespace (++optval);
+              if ((optval != NULL) && (*optval != '\0'))
+              {
+                val = strtol (optval, &endval, 10);
+                if (optval == endval)
+                {
+                  DBG (DBG_ERR, "read_config: invalid value for data_buffer_size\n");
+                  continue;
+                }
+                else if ((val < 8) || (val > DATA_BUFFER_SIZE_MAX / 1024))
+                {
+                  DBG (DBG_ERR, "read_config: data_buffer_size is invalid\n");
+                  continue;
+                }
+                data_buffer_size = val * 1024;
+                DBG (DBG_INFO, "read_config: data buffer size: %lu\n",
+                     (u_long) data_buffer_size);
+              }
+            }
+            else if(strstr(config_line, "pool_worker_connections") != NULL)
+            {
+              optval = sanei_config_skip_whitespace (++optval);
+              if ((optval != NULL) && (*optval != '\0'))
+              {
+                val = strtol (optval, &endval, 10);
+                if (optval == endval)
+                {
+                  DBG (DBG_ERR, "read_config: invalid value for pool_worker_connections\n");
+                  continue;
+                }
+                else if (val < 0)
+                {
+                  DBG (DBG_ERR, "read_config: pool_worker_connections is invalid\n");
+                  continue;
+                }
+                pool_worker_connections = val;
+                DBG (DBG_INFO, "read_config: connections per pool worker: %d\n",
+                     pool_worker_connections);
+              }
+            }
+            else if(strstr(config_line, "pool_workers") != NULL)
+            {
+              optval = sanei_config_skip_whitespace (++optval);
+              if ((optval != NULL) && (*optval != '\0'))
+              {
+                val = strtol (optval, &endval, 10);
+                if (optval == endval)
+                {
+                  DBG (DBG_ERR, "read_config: invalid value for pool_workers\n");
+                  continue;
+                }
+                else if ((val < 0) || (val > POOL_WORKERS_MAX))
+                {
+                  DBG (DBG_ERR, "read_config: pool_workers is invalid\n");
+                  continue;
+                }
+                pool_workers = val;
+                DBG (DBG_INFO, "read_config: pool workers: %d\n", pool_workers);
+              }
+            }
             else if(strstr(config_line, "data_connect_timeout") != NULL)
             {
               optval = sanei_config_skip_whitespace (++optval);
@@ -3258,6 +3762,9 @@ run_standalone (char *user)
   /* NOT REACHED (Avahi process) */
 #endif /* WITH_AVAHI */
 
+  if (pool_workers > 0 && run_once == SANE_FALSE)
+    run_pool (fds, nfds);
+
   DBG (DBG_MSG, "run_standalone: waiting for control connection\n");
 
   while (1)
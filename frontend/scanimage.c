@@ -42,6 +42,13 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/time.h>
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#endif
+#if !defined (MAP_ANONYMOUS) && defined (MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
 
 #ifdef HAVE_LIBPNG
 #include <png.h>
@@ -51,6 +58,10 @@
 #include <jpeglib.h>
 #endif
 
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
 #include "../include/_stdint.h"
 
 #include "../include/sane/sane.h"
@@ -59,6 +70,7 @@
 
 #include "sicc.h"
 #include "stiff.h"
+#include "spdf.h"
 
 #include "../include/md5.h"
 
@@ -71,9 +83,11 @@ typedef struct
   uint8_t *data;
   int width;    /*WARNING: this is in bytes, get pixel width from param*/
   int height;
-  int x;
-  int y;
   int num_channels;
+  uint8_t **chunks;	/* buffered image data, see image_store() */
+  int num_chunks;
+  int max_chunks;
+  size_t chunk_size;
 }
 Image;
 
@@ -85,6 +99,10 @@ Image;
 #define OPTION_BATCH_INCREMENT	1006
 #define OPTION_BATCH_PROMPT    1007
 #define OPTION_BATCH_PRINT     1008
+#define OPTION_BUFFER_COUNT    1009
+#define OPTION_BATCH_WORKERS   1010
+#define OPTION_BENCHMARK       1011
+#define OPTION_TIFF_COMPRESSION 1012
 
 #define BATCH_COUNT_UNLIMITED -1
 
@@ -100,6 +118,7 @@ static struct option basic_options[] = {
   {"all-options", no_argument, NULL, 'A'},
   {"version", no_argument, NULL, 'V'},
   {"buffer-size", optional_argument, NULL, 'B'},
+  {"buffer-count", required_argument, NULL, OPTION_BUFFER_COUNT},
   {"batch", optional_argument, NULL, 'b'},
   {"batch-count", required_argument, NULL, OPTION_BATCH_COUNT},
   {"batch-start", required_argument, NULL, OPTION_BATCH_START_AT},
@@ -107,10 +126,13 @@ static struct option basic_options[] = {
   {"batch-increment", required_argument, NULL, OPTION_BATCH_INCREMENT},
   {"batch-print", no_argument, NULL, OPTION_BATCH_PRINT},
   {"batch-prompt", no_argument, NULL, OPTION_BATCH_PROMPT},
+  {"batch-workers", required_argument, NULL, OPTION_BATCH_WORKERS},
   {"format", required_argument, NULL, OPTION_FORMAT},
   {"accept-md5-only", no_argument, NULL, OPTION_MD5},
   {"icc-profile", required_argument, NULL, 'i'},
   {"dont-scan", no_argument, NULL, 'n'},
+  {"benchmark", optional_argument, NULL, OPTION_BENCHMARK},
+  {"tiff-compression", required_argument, NULL, OPTION_TIFF_COMPRESSION},
   {0, 0, NULL, 0}
 };
 
@@ -119,9 +141,11 @@ static struct option basic_options[] = {
 #define OUTPUT_TIFF     2
 #define OUTPUT_PNG      3
 #define OUTPUT_JPEG     4
+#define OUTPUT_PDF      5
 
 #define BASE_OPTSTRING	"d:hi:Lf:o:B::nvVTAbp"
-#define STRIP_HEIGHT	256	/* # lines we increment image height */
+#define STRIP_HEIGHT	256	/* # lines in a chunk of a buffered image */
+#define PNM_HEIGHT_DIGITS 10	/* room for a height that is filled in later */
 
 static struct option *all_options;
 static int option_number_len;
@@ -156,6 +180,121 @@ static SANE_Word br_x = 0;
 static SANE_Word br_y = 0;
 static SANE_Byte *buffer;
 static size_t buffer_size;
+static int buffer_count = 1;
+
+/* --tiff-compression; 0 keeps the classic uncompressed single strip */
+static int tiff_compression = 0;
+
+/* With --batch and --output-file all pages go into one TIFF or PDF file
+   through these writers. */
+static int multi_page = 0;
+static FILE *multi_page_ofp = NULL;
+static int multi_page_count = 0;	/* pages written so far */
+static SANEI_Tiff_Writer *tiff_writer = NULL;
+#ifdef HAVE_LIBJPEG
+static SANEI_Pdf_Writer *pdf_writer = NULL;
+#endif
+
+#ifdef HAVE_PTHREAD_H
+/* With more than one input buffer, sane_read() is called from a separate
+   thread that fills the buffers while the main thread converts and writes
+   the data, so that slow output formats don't hold up the scanner. */
+typedef struct
+{
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  SANE_Byte **data;		/* buffer_count buffers of buffer_size bytes */
+  SANE_Int *len;
+  SANE_Status *status;
+  int head;			/* oldest filled buffer */
+  int count;			/* filled buffers, including the one in use */
+  int peak;			/* highest count during the scan */
+  int in_use;			/* main thread holds the head buffer */
+  int stop;			/* main thread wants the reader to stop */
+  int done;			/* reader got a status other than GOOD */
+}
+Read_Queue;
+
+static Read_Queue read_queue;
+#endif
+
+/* In pipelined batch mode a page is read from the scanner into memory
+   first and converted and written by a worker thread afterwards, while the
+   next page is already being scanned. */
+typedef struct Page_Chunk
+{
+  struct Page_Chunk *next;
+  SANE_Int len;
+  /* followed by len bytes of data */
+}
+Page_Chunk;
+
+typedef struct Page_Frame
+{
+  struct Page_Frame *next;
+  SANE_Parameters parm;
+  Page_Chunk *chunks;
+  Page_Chunk *last_chunk;
+}
+Page_Frame;
+
+typedef struct Page
+{
+  struct Page *next;		/* next page waiting for a worker */
+  int seq;			/* pages are finished in this order */
+  char path[PATH_MAX];
+  char part_path[PATH_MAX];
+  Page_Frame *frames;
+  Page_Frame *last_frame;
+  Page_Frame *frame;		/* replay position */
+  Page_Chunk *chunk;
+  int started;
+}
+Page;
+
+#ifdef HAVE_PTHREAD_H
+static struct
+{
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  pthread_t *threads;
+  int num_threads;
+  Page *head;			/* pages waiting for a worker */
+  Page *tail;
+  int queued;
+  int next_seq;			/* next page to be renamed and printed */
+  int closing;
+  int print;			/* --batch-print */
+  SANE_Status status;		/* first error of a worker */
+  double blocked;		/* seconds the scanning thread waited */
+}
+batch_pipe;
+#endif
+static int batch_workers = 0;
+
+/* --benchmark: number of scans per buffer size; the buffer sizes are taken
+   from the comma separated --buffer-size list */
+static int benchmark = 0;
+static const char *buffer_size_list = NULL;
+
+/* power-of-two buckets; bucket i counts values in [2^(i-1), 2^i),
+   bucket 0 counts zeros */
+#define HISTOGRAM_BUCKETS 40
+
+typedef struct
+{
+  int scans;
+  uint64_t reads;
+  uint64_t bytes;
+  uint64_t lines;
+  double read_time;		/* seconds spent in sane_read */
+  double read_max;
+  double stream_time;		/* seconds from first byte to end of scan */
+  uint64_t latency[HISTOGRAM_BUCKETS];	/* sane_read time in us */
+  uint64_t sizes[HISTOGRAM_BUCKETS];	/* bytes per sane_read */
+}
+Benchmark_Stats;
 
 
 static void
@@ -1149,8 +1288,11 @@ process_backend_option (SANE_Handle device, int optnum, const char *optarg)
     free(valuep);
 }
 
+/* With height_digits > 0 the height is padded to that many characters,
+   so that the header can be rewritten in place once it is known. */
 static void
-write_pnm_header (SANE_Frame format, int width, int height, int depth, FILE *ofp)
+write_pnm_header (SANE_Frame format, int width, int height, int height_digits,
+		  int depth, FILE *ofp)
 {
   /* The netpbm-package does not define raw image data with maxval > 255. */
   /* But writing maxval 65535 for 16bit data gives at least a chance */
@@ -1161,16 +1303,17 @@ write_pnm_header (SANE_Frame format, int width, int height, int depth, FILE *ofp
     case SANE_FRAME_GREEN:
     case SANE_FRAME_BLUE:
     case SANE_FRAME_RGB:
-      fprintf (ofp, "P6\n# SANE data follows\n%d %d\n%d\n", width, height,
-	      (depth <= 8) ? 255 : 65535);
+      fprintf (ofp, "P6\n# SANE data follows\n%d %*d\n%d\n", width,
+	       height_digits, height, (depth <= 8) ? 255 : 65535);
       break;
 
     default:
       if (depth == 1)
-       fprintf (ofp, "P4\n# SANE data follows\n%d %d\n", width, height);
+       fprintf (ofp, "P4\n# SANE data follows\n%d %*d\n", width,
+		height_digits, height);
       else
-       fprintf (ofp, "P5\n# SANE data follows\n%d %d\n%d\n", width, height,
-		(depth <= 8) ? 255 : 65535);
+       fprintf (ofp, "P5\n# SANE data follows\n%d %*d\n%d\n", width,
+		height_digits, height, (depth <= 8) ? 255 : 65535);
       break;
     }
 #ifdef __EMX__			/* OS2 - write in binary mode. */
@@ -1259,14 +1402,67 @@ write_png_header (SANE_Frame format, int width, int height, int depth, int dpi,
 #endif
 
 #ifdef HAVE_LIBJPEG
+/* libjpeg destination that hands the compressed data to a PDF writer */
+typedef struct
+{
+  struct jpeg_destination_mgr pub;
+  SANEI_Pdf_Writer *pdf;
+  JOCTET buffer[4096];
+}
+Pdf_Destination;
+
+static void
+pdf_init_destination (j_compress_ptr cinfo)
+{
+  Pdf_Destination *dest = (Pdf_Destination *) cinfo->dest;
+
+  dest->pub.next_output_byte = dest->buffer;
+  dest->pub.free_in_buffer = sizeof (dest->buffer);
+}
+
+static boolean
+pdf_empty_output_buffer (j_compress_ptr cinfo)
+{
+  Pdf_Destination *dest = (Pdf_Destination *) cinfo->dest;
+
+  sanei_pdf_writer_write (dest->pdf, dest->buffer, sizeof (dest->buffer));
+  dest->pub.next_output_byte = dest->buffer;
+  dest->pub.free_in_buffer = sizeof (dest->buffer);
+  return TRUE;
+}
+
+static void
+pdf_term_destination (j_compress_ptr cinfo)
+{
+  Pdf_Destination *dest = (Pdf_Destination *) cinfo->dest;
+
+  sanei_pdf_writer_write (dest->pdf, dest->buffer,
+			  sizeof (dest->buffer) - dest->pub.free_in_buffer);
+}
+
+/* Start compressing a JPEG image, into ofp or, if pdf is not NULL, into
+   the current page of a PDF file. */
 static void
 write_jpeg_header (SANE_Frame format, int width, int height, int dpi, FILE *ofp,
+                   SANEI_Pdf_Writer *pdf,
                    struct jpeg_compress_struct *cinfo,
                    struct jpeg_error_mgr *jerr)
 {
   cinfo->err = jpeg_std_error(jerr);
   jpeg_create_compress(cinfo);
-  jpeg_stdio_dest(cinfo, ofp);
+  if (pdf)
+    {
+      Pdf_Destination *dest = (Pdf_Destination *)
+	(*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_PERMANENT,
+				    sizeof (Pdf_Destination));
+      dest->pub.init_destination = pdf_init_destination;
+      dest->pub.empty_output_buffer = pdf_empty_output_buffer;
+      dest->pub.term_destination = pdf_term_destination;
+      dest->pdf = pdf;
+      cinfo->dest = &dest->pub;
+    }
+  else
+    jpeg_stdio_dest(cinfo, ofp);
 
   cinfo->image_width = width;
   cinfo->image_height = height;
@@ -1295,52 +1491,461 @@ write_jpeg_header (SANE_Frame format, int width, int height, int dpi, FILE *ofp,
   jpeg_set_quality(cinfo, 75, TRUE);
   jpeg_start_compress(cinfo, TRUE);
 }
+
+static void
+write_jpeg_row (struct jpeg_compress_struct *cinfo, JSAMPLE *row,
+		int bytes_per_line, int depth)
+{
+  if(depth == 1)
+    {
+      int col1, col8;
+      JSAMPLE *buf8 = malloc(bytes_per_line * 8);
+      for(col1 = 0; col1 < bytes_per_line; col1++)
+	for(col8 = 0; col8 < 8; col8++)
+	  buf8[col1 * 8 + col8] = row[col1] & (1 << (8 - col8 - 1)) ? 0 : 0xff;
+      jpeg_write_scanlines(cinfo, &buf8, 1);
+      free(buf8);
+    } else {
+      jpeg_write_scanlines(cinfo, &row, 1);
+    }
+}
+#endif
+
+/* Images that can't be written as they are read are kept in chunks of
+   STRIP_HEIGHT lines.  The chunks are allocated as the data arrives and
+   never move, so nothing is copied when a long page keeps growing. */
+static uint8_t *
+image_chunk_alloc (size_t size)
+{
+#if defined (HAVE_MMAP) && defined (MAP_ANONYMOUS)
+  void *chunk = mmap (NULL, size, PROT_READ | PROT_WRITE,
+		      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+  return (chunk == MAP_FAILED) ? NULL : chunk;
+#else
+  return calloc (1, size);
+#endif
+}
+
+static void
+image_free (Image * image)
+{
+  int i;
+
+  for (i = 0; i < image->num_chunks; i++)
+#if defined (HAVE_MMAP) && defined (MAP_ANONYMOUS)
+    munmap (image->chunks[i], image->chunk_size);
+#else
+    free (image->chunks[i]);
 #endif
+  free (image->chunks);
+  image->chunks = NULL;
+  image->num_chunks = image->max_chunks = 0;
+}
+
+/* Store len bytes at byte position pos of the image, stride bytes
+   apart; the frames of a three-pass scan are interleaved this way. */
+static int
+image_store (Image * image, size_t pos, const SANE_Byte * data, int len,
+	     int stride)
+{
+  while (len > 0)
+    {
+      size_t chunk = pos / image->chunk_size;
+      size_t off = pos % image->chunk_size;
+      uint8_t *dst;
+      int i, n;
+
+      while ((size_t) image->num_chunks <= chunk)
+	{
+	  if (image->num_chunks == image->max_chunks)
+	    {
+	      int max_chunks = image->max_chunks ? 2 * image->max_chunks : 16;
+	      uint8_t **chunks = realloc (image->chunks,
+					  max_chunks * sizeof (uint8_t *));
+
+	      if (!chunks)
+		goto no_mem;
+	      image->chunks = chunks;
+	      image->max_chunks = max_chunks;
+	    }
+	  image->chunks[image->num_chunks] =
+	    image_chunk_alloc (image->chunk_size);
+	  if (!image->chunks[image->num_chunks])
+	    goto no_mem;
+	  image->num_chunks++;
+	}
+
+      dst = image->chunks[chunk] + off;
+      n = (image->chunk_size - off + stride - 1) / stride;
+      if (n > len)
+	n = len;
+      if (stride == 1)
+	memcpy (dst, data, n);
+      else
+	for (i = 0; i < n; i++)
+	  dst[i * stride] = data[i];
+      data += n;
+      len -= n;
+      pos += (size_t) n * stride;
+    }
+  return 0;
+
+no_mem:
+  fprintf (stderr, "%s: can't allocate image buffer (%dx%d)\n",
+	   prog_name, image->width,
+	   image->num_chunks * STRIP_HEIGHT + STRIP_HEIGHT);
+  return -1;
+}
 
+static uint8_t *
+image_row (Image * image, int y)
+{
+  return image->chunks[y / STRIP_HEIGHT]
+    + (size_t) (y % STRIP_HEIGHT) * image->width * image->num_channels;
+}
+
+#ifdef HAVE_PTHREAD_H
 static void *
-advance (Image * image)
+read_queue_thread (void *arg)
+{
+  Read_Queue *q = arg;
+  SANE_Status status;
+  SANE_Int len;
+  int slot;
+
+  do
+    {
+      pthread_mutex_lock (&q->lock);
+      while (q->count == buffer_count && !q->stop)
+	pthread_cond_wait (&q->cond, &q->lock);
+      if (q->stop)
+	{
+	  pthread_mutex_unlock (&q->lock);
+	  break;
+	}
+      slot = (q->head + q->count) % buffer_count;
+      pthread_mutex_unlock (&q->lock);
+
+      status = sane_read (device, q->data[slot], buffer_size, &len);
+
+      pthread_mutex_lock (&q->lock);
+      q->len[slot] = len;
+      q->status[slot] = status;
+      if (++q->count > q->peak)
+	q->peak = q->count;
+      if (status != SANE_STATUS_GOOD)
+	q->done = 1;
+      pthread_cond_broadcast (&q->cond);
+      pthread_mutex_unlock (&q->lock);
+    }
+  while (status == SANE_STATUS_GOOD);
+
+  return NULL;
+}
+
+static int
+read_queue_alloc (void)
+{
+  int i;
+
+  read_queue.data = calloc (buffer_count, sizeof (read_queue.data[0]));
+  read_queue.len = calloc (buffer_count, sizeof (read_queue.len[0]));
+  read_queue.status = calloc (buffer_count, sizeof (read_queue.status[0]));
+  if (!read_queue.data || !read_queue.len || !read_queue.status)
+    return -1;
+  for (i = 0; i < buffer_count; i++)
+    {
+      read_queue.data[i] = malloc (buffer_size);
+      if (!read_queue.data[i])
+	return -1;
+    }
+  pthread_mutex_init (&read_queue.lock, NULL);
+  pthread_cond_init (&read_queue.cond, NULL);
+  return 0;
+}
+
+/* start reading the current frame in the background */
+static SANE_Status
+read_queue_start (void)
+{
+  read_queue.head = read_queue.count = 0;
+  read_queue.in_use = read_queue.stop = read_queue.done = 0;
+  if (pthread_create (&read_queue.thread, NULL, read_queue_thread,
+		      &read_queue))
+    {
+      fprintf (stderr, "%s: can't create read thread\n", prog_name);
+      return SANE_STATUS_NO_MEM;
+    }
+  return SANE_STATUS_GOOD;
+}
+
+/* hand out the next filled buffer; the previous one is given back */
+static SANE_Status
+read_queue_get (SANE_Byte ** data, SANE_Int * len)
+{
+  Read_Queue *q = &read_queue;
+  SANE_Status status;
+
+  pthread_mutex_lock (&q->lock);
+  if (q->in_use)
+    {
+      q->head = (q->head + 1) % buffer_count;
+      q->count--;
+      q->in_use = 0;
+      pthread_cond_broadcast (&q->cond);
+    }
+  while (q->count == 0)
+    pthread_cond_wait (&q->cond, &q->lock);
+  q->in_use = 1;
+  *data = q->data[q->head];
+  *len = q->len[q->head];
+  status = q->status[q->head];
+  pthread_mutex_unlock (&q->lock);
+
+  return status;
+}
+
+/* wait for the reader; it is cancelled if the frame isn't complete */
+static void
+read_queue_finish (void)
+{
+  Read_Queue *q = &read_queue;
+  int done;
+
+  pthread_mutex_lock (&q->lock);
+  q->stop = 1;
+  done = q->done;
+  pthread_cond_broadcast (&q->cond);
+  pthread_mutex_unlock (&q->lock);
+
+  if (!done)
+    sane_cancel (device);
+  pthread_join (q->thread, NULL);
+}
+#endif
+
+static double
+now (void)
+{
+  struct timeval tv;
+
+  gettimeofday (&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+#ifdef HAVE_PTHREAD_H
+static void
+free_page (Page * page)
+{
+  Page_Frame *frame, *next_frame;
+  Page_Chunk *chunk, *next_chunk;
+
+  for (frame = page->frames; frame; frame = next_frame)
+    {
+      for (chunk = frame->chunks; chunk; chunk = next_chunk)
+	{
+	  next_chunk = chunk->next;
+	  free (chunk);
+	}
+      next_frame = frame->next;
+      free (frame);
+    }
+  free (page);
+}
+
+/* Read all frames of a page into memory; the first frame has already been
+   started. */
+static SANE_Status
+capture_page (Page * page)
 {
-  if (++image->x >= image->width)
+  Page_Frame *frame;
+  Page_Chunk *chunk;
+  SANE_Status status;
+  SANE_Int len;
+  uint64_t total_bytes, hundred_percent;
+
+  do
     {
-      image->x = 0;
-      if (++image->y >= image->height || !image->data)
+      if (page->frames)
+	{
+#ifdef SANE_STATUS_WARMING_UP
+	  do
+	    {
+	      status = sane_start (device);
+	    }
+	  while (status == SANE_STATUS_WARMING_UP);
+#else
+	  status = sane_start (device);
+#endif
+	  if (status != SANE_STATUS_GOOD)
+	    {
+	      fprintf (stderr, "%s: sane_start: %s\n",
+		       prog_name, sane_strstatus (status));
+	      return status;
+	    }
+	}
+
+      frame = calloc (1, sizeof (*frame));
+      if (!frame)
+	return SANE_STATUS_NO_MEM;
+      if (page->last_frame)
+	page->last_frame->next = frame;
+      else
+	page->frames = frame;
+      page->last_frame = frame;
+
+      status = sane_get_parameters (device, &frame->parm);
+      if (status != SANE_STATUS_GOOD)
 	{
-	  size_t old_size = 0, new_size;
+	  fprintf (stderr, "%s: sane_get_parameters: %s\n",
+		   prog_name, sane_strstatus (status));
+	  return status;
+	}
 
-	  if (image->data)
-	    old_size = image->height * image->width * image->num_channels;
+      total_bytes = 0;
+      hundred_percent = ((uint64_t) frame->parm.bytes_per_line)
+	* frame->parm.lines;
+      while (1)
+	{
+	  chunk = malloc (sizeof (*chunk) + buffer_size);
+	  if (!chunk)
+	    return SANE_STATUS_NO_MEM;
 
-	  image->height += STRIP_HEIGHT;
-	  new_size = image->height * image->width * image->num_channels;
+	  status = sane_read (device, (SANE_Byte *) (chunk + 1), buffer_size,
+			      &len);
+	  if (status != SANE_STATUS_GOOD || len == 0)
+	    {
+	      free (chunk);
+	      if (status == SANE_STATUS_GOOD)
+		continue;
+	      if (status != SANE_STATUS_EOF)
+		{
+		  fprintf (stderr, "%s: sane_read: %s\n",
+			   prog_name, sane_strstatus (status));
+		  return status;
+		}
+	      break;
+	    }
 
-	  if (image->data)
-	    image->data = realloc (image->data, new_size);
+	  if ((size_t) len < buffer_size)
+	    {
+	      Page_Chunk *shrunk = realloc (chunk, sizeof (*chunk) + len);
+	      if (shrunk)
+		chunk = shrunk;
+	    }
+	  chunk->next = NULL;
+	  chunk->len = len;
+	  if (frame->last_chunk)
+	    frame->last_chunk->next = chunk;
 	  else
-	    image->data = malloc (new_size);
-	  if (image->data)
-	    memset (image->data + old_size, 0, new_size - old_size);
+	    frame->chunks = chunk;
+	  frame->last_chunk = chunk;
+
+	  total_bytes += len;
+	  if (progress)
+	    {
+	      if (frame->parm.lines >= 0 && hundred_percent > 0)
+		fprintf (stderr, "Progress: %3.1f%%\r",
+			 total_bytes >= hundred_percent ? 100. :
+			 (total_bytes * 100.) / (double) hundred_percent);
+	      else
+		fprintf (stderr, "Progress: (unknown)\r");
+	    }
 	}
     }
-  if (!image->data)
-    fprintf (stderr, "%s: can't allocate image buffer (%dx%d)\n",
-	     prog_name, image->width, image->height);
-  return image->data;
+  while (!frame->parm.last_frame);
+
+  return SANE_STATUS_EOF;
+}
+#endif
+
+/* The following three stand in for sane_start, sane_get_parameters and
+   sane_read when scan_it converts a captured page. */
+static SANE_Status
+page_start (Page * page)
+{
+  if (page->started)
+    page->frame = page->frame ? page->frame->next : NULL;
+  else
+    page->frame = page->frames;
+  page->started = 1;
+  if (!page->frame)
+    return SANE_STATUS_INVAL;
+  page->chunk = page->frame->chunks;
+  return SANE_STATUS_GOOD;
+}
+
+static SANE_Status
+page_get_parameters (Page * page, SANE_Parameters * parm)
+{
+  if (!page->started)
+    page_start (page);
+  if (!page->frame)
+    return SANE_STATUS_INVAL;
+  *parm = page->frame->parm;
+  return SANE_STATUS_GOOD;
+}
+
+static SANE_Status
+page_read (Page * page, SANE_Byte ** data, SANE_Int * len)
+{
+  Page_Chunk *chunk = page->chunk;
+
+  if (!chunk)
+    {
+      *len = 0;
+      return SANE_STATUS_EOF;
+    }
+  page->chunk = chunk->next;
+  *data = (SANE_Byte *) (chunk + 1);
+  *len = chunk->len;
+  return SANE_STATUS_GOOD;
+}
+
+#ifdef HAVE_LIBJPEG
+/* Start a page in the shared PDF file or, outside of multi-page mode, in
+   a new one written to ofp. */
+static SANEI_Pdf_Writer *
+begin_pdf_page (FILE *ofp, SANE_Frame format, int width, int height)
+{
+  SANEI_Pdf_Writer *pdf = pdf_writer;
+
+  if (!pdf)
+    pdf = sanei_pdf_writer_open (ofp);
+  if (pdf)
+    sanei_pdf_writer_begin_page (pdf, width, height, resolution_value,
+				 format != SANE_FRAME_GRAY);
+  return pdf;
 }
+#endif
 
+/* Convert and write the image data either from the scanner or, if page
+   is not NULL, from a captured page. */
 static SANE_Status
-scan_it (FILE *ofp)
+scan_it (FILE *ofp, Page *page)
 {
-  int i, len, first_frame = 1, offset = 0, must_buffer = 0;
+  int i, len, first_frame = 1, must_buffer = 0;
+  size_t offset = 0;
+  long pnm_header_pos = -1;
   uint64_t hundred_percent = 0;
   SANE_Byte min = 0xff, max = 0;
   SANE_Parameters parm;
   SANE_Status status;
-  Image image = { 0, 0, 0, 0, 0, 0 };
+  Image image = { 0 };
   static const char *format_name[] = {
     "gray", "RGB", "red", "green", "blue"
   };
   uint64_t total_bytes = 0, expected_bytes;
   SANE_Int hang_over = -1;
+  SANE_Byte *data;
+  SANEI_Tiff_Writer *tiff = NULL;
+#ifdef HAVE_PTHREAD_H
+  int queued = 0;
+
+  if (!page)
+    read_queue.peak = 0;
+#endif
 #ifdef HAVE_LIBPNG
   int pngrow = 0;
   png_bytep pngbuf = NULL;
@@ -1352,11 +1957,21 @@ scan_it (FILE *ofp)
   JSAMPLE *jpegbuf = NULL;
   struct jpeg_compress_struct cinfo;
   struct jpeg_error_mgr jerr;
+  SANEI_Pdf_Writer *pdf = NULL;
+  int pdf_page_done = 0;
+
+  cinfo.mem = NULL;	/* nothing for jpeg_destroy_compress() yet */
 #endif
 
   do
     {
-      if (!first_frame)
+      if (page && !first_frame)
+	{
+	  status = page_start (page);
+	  if (status != SANE_STATUS_GOOD)
+	    goto cleanup;
+	}
+      else if (!first_frame)
 	{
 #ifdef SANE_STATUS_WARMING_UP
           do
@@ -1375,7 +1990,10 @@ scan_it (FILE *ofp)
 	    }
 	}
 
-      status = sane_get_parameters (device, &parm);
+      if (page)
+	status = page_get_parameters (page, &parm);
+      else
+	status = sane_get_parameters (device, &parm);
       if (status != SANE_STATUS_GOOD)
 	{
 	  fprintf (stderr, "%s: sane_get_parameters: %s\n",
@@ -1405,6 +2023,38 @@ scan_it (FILE *ofp)
 
       if (first_frame)
 	{
+	  /* TIFF files are written strip by strip if they are compressed,
+	     have more than one page or the height of the image isn't
+	     known yet; only the last case can fall back to buffering if
+	     the output isn't seekable */
+	  if (output_format == OUTPUT_TIFF
+	      && (tiff_writer || tiff_compression || parm.lines < 0))
+	    {
+	      tiff = tiff_writer;
+	      if (!tiff)
+		tiff = sanei_tiff_writer_open (ofp, tiff_compression ?
+					       tiff_compression :
+					       SANEI_TIFF_COMPRESSION_NONE);
+	      if (!tiff && tiff_compression)
+		{
+		  fprintf (stderr, "%s: compressed TIFF output needs a "
+			   "seekable output file\n", prog_name);
+		  status = SANE_STATUS_INVAL;
+		  goto cleanup;
+		}
+	      if (tiff
+		  && sanei_tiff_writer_start_page (tiff,
+						   parm.format == SANE_FRAME_GRAY ?
+						   SANE_FRAME_GRAY : SANE_FRAME_RGB,
+						   parm.pixels_per_line,
+						   parm.depth, resolution_value,
+						   icc_profile) < 0)
+		{
+		  status = SANE_STATUS_NO_MEM;
+		  goto cleanup;
+		}
+	    }
+
           image.num_channels = 1;
 	  switch (parm.format)
 	    {
@@ -1422,6 +2072,17 @@ scan_it (FILE *ofp)
 	    case SANE_FRAME_GRAY:
 	      assert ((parm.depth == 1) || (parm.depth == 8)
 		      || (parm.depth == 16));
+	      if (tiff)
+		/* the writer fills in the height at the end */
+		break;
+	      if (parm.lines < 0 && output_format == OUTPUT_PNM
+		  && (pnm_header_pos = ftell (ofp)) >= 0)
+		{
+		  /* the height is patched in at the end */
+		  write_pnm_header (parm.format, parm.pixels_per_line, 0,
+				    PNM_HEIGHT_DIGITS, parm.depth, ofp);
+		  break;
+		}
 	      if (parm.lines < 0)
 		{
 		  must_buffer = 1;
@@ -1438,7 +2099,7 @@ scan_it (FILE *ofp)
 		    break;
 		  case OUTPUT_PNM:
 		    write_pnm_header (parm.format, parm.pixels_per_line,
-				      parm.lines, parm.depth, ofp);
+				      parm.lines, 0, parm.depth, ofp);
 		    break;
 #ifdef HAVE_LIBPNG
 		  case OUTPUT_PNG:
@@ -1451,7 +2112,19 @@ scan_it (FILE *ofp)
 		  case OUTPUT_JPEG:
 		    write_jpeg_header (parm.format, parm.pixels_per_line,
 				       parm.lines, resolution_value,
-				       ofp, &cinfo, &jerr);
+				       ofp, NULL, &cinfo, &jerr);
+		    break;
+		  case OUTPUT_PDF:
+		    pdf = begin_pdf_page (ofp, parm.format,
+					  parm.pixels_per_line, parm.lines);
+		    if (!pdf)
+		      {
+			status = SANE_STATUS_NO_MEM;
+			goto cleanup;
+		      }
+		    write_jpeg_header (parm.format, parm.pixels_per_line,
+				       parm.lines, resolution_value,
+				       ofp, pdf, &cinfo, &jerr);
 		    break;
 #endif
 		  }
@@ -1465,7 +2138,7 @@ scan_it (FILE *ofp)
 	    pngbuf = malloc(parm.bytes_per_line);
 #endif
 #ifdef HAVE_LIBJPEG
-	  if(output_format == OUTPUT_JPEG)
+	  if(output_format == OUTPUT_JPEG || output_format == OUTPUT_PDF)
 	    jpegbuf = malloc(parm.bytes_per_line);
 #endif
 
@@ -1477,22 +2150,8 @@ scan_it (FILE *ofp)
 		 case, we need to buffer all data before we can write
 		 the image.  */
 	      image.width = parm.bytes_per_line;
-
-	      if (parm.lines >= 0)
-		/* See advance(); we allocate one extra line so we
-		   don't end up realloc'ing in when the image has been
-		   filled in.  */
-		image.height = parm.lines - STRIP_HEIGHT + 1;
-	      else
-		image.height = 0;
-
-	      image.x = image.width - 1;
-	      image.y = -1;
-	      if (!advance (&image))
-		{
-		  status = SANE_STATUS_NO_MEM;
-		  goto cleanup;
-		}
+	      image.chunk_size = (size_t) STRIP_HEIGHT * image.width
+		* image.num_channels;
 	    }
 	}
       else
@@ -1500,20 +2159,39 @@ scan_it (FILE *ofp)
 	  assert (parm.format >= SANE_FRAME_RED
 		  && parm.format <= SANE_FRAME_BLUE);
 	  offset = parm.format - SANE_FRAME_RED;
-	  image.x = image.y = 0;
 	}
       hundred_percent = ((uint64_t)parm.bytes_per_line) * parm.lines
 	* ((parm.format == SANE_FRAME_RGB || parm.format == SANE_FRAME_GRAY) ? 1:3);
 
+#ifdef HAVE_PTHREAD_H
+      if (buffer_count > 1 && !page)
+	{
+	  status = read_queue_start ();
+	  if (status != SANE_STATUS_GOOD)
+	    goto cleanup;
+	  queued = 1;
+	}
+#endif
       while (1)
 	{
 	  double progr;
-	  status = sane_read (device, buffer, buffer_size, &len);
+	  if (page)
+	    status = page_read (page, &data, &len);
+	  else
+#ifdef HAVE_PTHREAD_H
+	  if (queued)
+	    status = read_queue_get (&data, &len);
+	  else
+#endif
+	    {
+	      data = buffer;
+	      status = sane_read (device, buffer, buffer_size, &len);
+	    }
 	  total_bytes += (SANE_Word) len;
           progr = ((total_bytes * 100.) / (double) hundred_percent);
           if (progr > 100.)
 	    progr = 100.;
-          if (progress)
+          if (progress && !page)
             {
               if (parm.lines >= 0)
                 fprintf(stderr, "Progress: %3.1f%%\r", progr);
@@ -1523,72 +2201,46 @@ scan_it (FILE *ofp)
 
 	  if (status != SANE_STATUS_GOOD)
 	    {
-	      if (verbose && parm.depth == 8)
+#ifdef HAVE_PTHREAD_H
+	      if (queued)
+		{
+		  read_queue_finish ();
+		  queued = 0;
+		}
+#endif
+	      if (verbose && parm.depth == 8)
 		fprintf (stderr, "%s: min/max graylevel value = %d/%d\n",
 			 prog_name, min, max);
 	      if (status != SANE_STATUS_EOF)
 		{
 		  fprintf (stderr, "%s: sane_read: %s\n",
 			   prog_name, sane_strstatus (status));
-		  return status;
+		  goto cleanup;
 		}
 	      break;
 	    }
 
 	  if (must_buffer)
 	    {
-	      switch (parm.format)
+	      if (image_store (&image, offset, data, len,
+			       image.num_channels) < 0)
 		{
-		case SANE_FRAME_RED:
-		case SANE_FRAME_GREEN:
-		case SANE_FRAME_BLUE:
-		  image.num_channels = 3;
-		  for (i = 0; i < len; ++i)
-		    {
-		      image.data[offset + 3 * i] = buffer[i];
-		      if (!advance (&image))
-			{
-			  status = SANE_STATUS_NO_MEM;
-			  goto cleanup;
-			}
-		    }
-		  offset += 3 * len;
-		  break;
-
-		case SANE_FRAME_RGB:
-		  image.num_channels = 1;
-		  for (i = 0; i < len; ++i)
-		    {
-		      image.data[offset + i] = buffer[i];
-		      if (!advance (&image))
-			  {
-			    status = SANE_STATUS_NO_MEM;
-			    goto cleanup;
-			  }
-		    }
-		  offset += len;
-		  break;
-
-		case SANE_FRAME_GRAY:
-		  image.num_channels = 1;
-		  for (i = 0; i < len; ++i)
-		    {
-		      image.data[offset + i] = buffer[i];
-		      if (!advance (&image))
-			  {
-			    status = SANE_STATUS_NO_MEM;
-			    goto cleanup;
-			  }
-		    }
-		  offset += len;
-		  break;
-
-                default:
-		  break;
+		  status = SANE_STATUS_NO_MEM;
+		  goto cleanup;
 		}
+	      offset += (size_t) image.num_channels * len;
 	    }
 	  else			/* ! must_buffer */
 	    {
+	      if (tiff)
+		{
+		  if (sanei_tiff_writer_write (tiff, data, len) < 0)
+		    {
+		      status = SANE_STATUS_IO_ERROR;
+		      goto cleanup;
+		    }
+		}
+	      else
 #ifdef HAVE_LIBPNG
 	      if (output_format == OUTPUT_PNG)
 	        {
@@ -1596,7 +2248,7 @@ scan_it (FILE *ofp)
 		  int left = len;
 		  while(pngrow + left >= parm.bytes_per_line)
 		    {
-		      memcpy(pngbuf + pngrow, buffer + i, parm.bytes_per_line - pngrow);
+		      memcpy(pngbuf + pngrow, data + i, parm.bytes_per_line - pngrow);
 		      if(parm.depth == 1)
 			{
 			  int j;
@@ -1623,42 +2275,32 @@ scan_it (FILE *ofp)
 		      left -= parm.bytes_per_line - pngrow;
 		      pngrow = 0;
 		    }
-		  memcpy(pngbuf + pngrow, buffer + i, left);
+		  memcpy(pngbuf + pngrow, data + i, left);
 		  pngrow += left;
 		}
 	      else
 #endif
 #ifdef HAVE_LIBJPEG
-	      if (output_format == OUTPUT_JPEG)
+	      if (output_format == OUTPUT_JPEG || output_format == OUTPUT_PDF)
 	        {
 		  int i = 0;
 		  int left = len;
 		  while(jpegrow + left >= parm.bytes_per_line)
 		    {
-		      memcpy(jpegbuf + jpegrow, buffer + i, parm.bytes_per_line - jpegrow);
-		      if(parm.depth == 1)
-			{
-			  int col1, col8;
-			  JSAMPLE *buf8 = malloc(parm.bytes_per_line * 8);
-			  for(col1 = 0; col1 < parm.bytes_per_line; col1++)
-			    for(col8 = 0; col8 < 8; col8++)
-			      buf8[col1 * 8 + col8] = jpegbuf[col1] & (1 << (8 - col8 - 1)) ? 0 : 0xff;
-		          jpeg_write_scanlines(&cinfo, &buf8, 1);
-			  free(buf8);
-			} else {
-		          jpeg_write_scanlines(&cinfo, &jpegbuf, 1);
-			}
+		      memcpy(jpegbuf + jpegrow, data + i, parm.bytes_per_line - jpegrow);
+		      write_jpeg_row (&cinfo, jpegbuf, parm.bytes_per_line,
+				      parm.depth);
 		      i += parm.bytes_per_line - jpegrow;
 		      left -= parm.bytes_per_line - jpegrow;
 		      jpegrow = 0;
 		    }
-		  memcpy(jpegbuf + jpegrow, buffer + i, left);
+		  memcpy(jpegbuf + jpegrow, data + i, left);
 		  jpegrow += left;
 		}
 	      else
 #endif
 	      if ((output_format == OUTPUT_TIFF) || (parm.depth != 16))
-		fwrite (buffer, 1, len, ofp);
+		fwrite (data, 1, len, ofp);
 	      else
 		{
 #if !defined(WORDS_BIGENDIAN)
@@ -1669,8 +2311,8 @@ scan_it (FILE *ofp)
 		    {
 		      if (len > 0)
 			{
-			  fwrite (buffer, 1, 1, ofp);
-			  buffer[0] = (SANE_Byte) hang_over;
+			  fwrite (data, 1, 1, ofp);
+			  data[0] = (SANE_Byte) hang_over;
 			  hang_over = -1;
 			  start = 1;
 			}
@@ -1679,47 +2321,64 @@ scan_it (FILE *ofp)
 		  for (i = start; i < (len - 1); i += 2)
 		    {
 		      unsigned char LSB;
-		      LSB = buffer[i];
-		      buffer[i] = buffer[i + 1];
-		      buffer[i + 1] = LSB;
+		      LSB = data[i];
+		      data[i] = data[i + 1];
+		      data[i + 1] = LSB;
 		    }
 		  /* check if we have an odd number of bytes */
 		  if (((len - start) % 2) != 0)
 		    {
-		      hang_over = buffer[len - 1];
+		      hang_over = data[len - 1];
 		      len--;
 		    }
 #endif
-		  fwrite (buffer, 1, len, ofp);
+		  fwrite (data, 1, len, ofp);
 		}
 	    }
 
 	  if (verbose && parm.depth == 8)
 	    {
 	      for (i = 0; i < len; ++i)
-		if (buffer[i] >= max)
-		  max = buffer[i];
-		else if (buffer[i] < min)
-		  min = buffer[i];
+		if (data[i] >= max)
+		  max = data[i];
+		else if (data[i] < min)
+		  min = data[i];
 	    }
 	}
       first_frame = 0;
     }
   while (!parm.last_frame);
 
+  if (pnm_header_pos >= 0)
+    {
+      if (fseek (ofp, pnm_header_pos, SEEK_SET) != 0)
+	{
+	  status = SANE_STATUS_IO_ERROR;
+	  goto cleanup;
+	}
+      write_pnm_header (parm.format, parm.pixels_per_line,
+			(int) (total_bytes / parm.bytes_per_line),
+			PNM_HEIGHT_DIGITS,
+			parm.depth, ofp);
+      fseek (ofp, 0, SEEK_END);
+    }
+
   if (must_buffer)
     {
-      image.height = image.y;
+      int y, row_bytes = image.width * image.num_channels;
+
+      image.height = offset / row_bytes;
 
       switch(output_format) {
       case OUTPUT_TIFF:
-	sanei_write_tiff_header (parm.format, parm.pixels_per_line,
-				 image.height, parm.depth, resolution_value,
-				 icc_profile, ofp);
+	if (!tiff)
+	  sanei_write_tiff_header (parm.format, parm.pixels_per_line,
+				   image.height, parm.depth, resolution_value,
+				   icc_profile, ofp);
       break;
       case OUTPUT_PNM:
 	write_pnm_header (parm.format, parm.pixels_per_line,
-                          image.height, parm.depth, ofp);
+                          image.height, 0, parm.depth, ofp);
       break;
 #ifdef HAVE_LIBPNG
       case OUTPUT_PNG:
@@ -1731,43 +2390,107 @@ scan_it (FILE *ofp)
 #ifdef HAVE_LIBJPEG
       case OUTPUT_JPEG:
 	write_jpeg_header (parm.format, parm.pixels_per_line,
-			   parm.lines, resolution_value,
-			   ofp, &cinfo, &jerr);
+			   image.height, resolution_value,
+			   ofp, NULL, &cinfo, &jerr);
+      break;
+      case OUTPUT_PDF:
+	pdf = begin_pdf_page (ofp, parm.format, parm.pixels_per_line,
+			      image.height);
+	if (!pdf)
+	  {
+	    status = SANE_STATUS_NO_MEM;
+	    goto cleanup;
+	  }
+	write_jpeg_header (parm.format, parm.pixels_per_line,
+			   image.height, resolution_value,
+			   ofp, pdf, &cinfo, &jerr);
       break;
 #endif
       }
 
-#if !defined(WORDS_BIGENDIAN)
-      /* multibyte pnm file may need byte swap to LE */
-      /* FIXME: other bit depths? */
-      if (output_format != OUTPUT_TIFF && parm.depth == 16)
+      for (y = 0; y < image.height; y++)
 	{
-	  int i;
-	  for (i = 0; i < image.height * image.width; i += 2)
+	  uint8_t *row = image_row (&image, y);
+
+#if !defined(WORDS_BIGENDIAN)
+	  /* multibyte pnm file may need byte swap to LE */
+	  /* FIXME: other bit depths? */
+	  if (output_format != OUTPUT_TIFF && parm.depth == 16)
 	    {
-	      unsigned char LSB;
-	      LSB = image.data[i];
-	      image.data[i] = image.data[i + 1];
-	      image.data[i + 1] = LSB;
+	      int i;
+	      for (i = 0; i < row_bytes; i += 2)
+		{
+		  unsigned char LSB;
+		  LSB = row[i];
+		  row[i] = row[i + 1];
+		  row[i + 1] = LSB;
+		}
 	    }
-	}
 #endif
 
-	fwrite (image.data, 1, image.height * image.width * image.num_channels, ofp);
+	  if (tiff)
+	    {
+	      if (sanei_tiff_writer_write (tiff, row, row_bytes) < 0)
+		{
+		  status = SANE_STATUS_IO_ERROR;
+		  goto cleanup;
+		}
+	    }
+#ifdef HAVE_LIBPNG
+	  else if (output_format == OUTPUT_PNG)
+	    {
+	      if (parm.depth == 1)
+		{
+		  int i;
+		  for (i = 0; i < row_bytes; i++)
+		    row[i] = ~row[i];
+		}
+	      png_write_row (png_ptr, row);
+	    }
+#endif
+#ifdef HAVE_LIBJPEG
+	  else if (output_format == OUTPUT_JPEG || output_format == OUTPUT_PDF)
+	    write_jpeg_row (&cinfo, row, row_bytes, parm.depth);
+#endif
+	  else
+	    fwrite (row, 1, row_bytes, ofp);
+	}
     }
 #ifdef HAVE_LIBPNG
     if(output_format == OUTPUT_PNG)
 	png_write_end(png_ptr, info_ptr);
 #endif
 #ifdef HAVE_LIBJPEG
-    if(output_format == OUTPUT_JPEG)
+    if(output_format == OUTPUT_JPEG || output_format == OUTPUT_PDF)
 	jpeg_finish_compress(&cinfo);
+    if (pdf)
+      {
+	pdf_page_done = 1;
+	if (sanei_pdf_writer_end_page (pdf, 1) < 0)
+	  status = SANE_STATUS_IO_ERROR;
+	else if (pdf == pdf_writer)
+	  multi_page_count++;
+      }
 #endif
+    if (tiff)
+      {
+	if (sanei_tiff_writer_end_page (tiff) < 0)
+	  status = SANE_STATUS_IO_ERROR;
+	else if (tiff == tiff_writer)
+	  multi_page_count++;
+      }
 
   /* flush the output buffer */
   fflush( ofp );
 
 cleanup:
+#ifdef HAVE_PTHREAD_H
+  if (queued)
+    read_queue_finish ();
+  if (verbose && buffer_count > 1 && !page)
+    fprintf (stderr, "%s: peak read queue depth: %d of %d buffers\n",
+	     prog_name, read_queue.peak, buffer_count);
+#endif
 #ifdef HAVE_LIBPNG
   if(output_format == OUTPUT_PNG) {
     png_destroy_write_struct(&png_ptr, &info_ptr);
@@ -1775,13 +2498,23 @@ cleanup:
   }
 #endif
 #ifdef HAVE_LIBJPEG
-  if(output_format == OUTPUT_JPEG) {
+  if(output_format == OUTPUT_JPEG || output_format == OUTPUT_PDF) {
     jpeg_destroy_compress(&cinfo);
     free(jpegbuf);
   }
+  if (pdf)
+    {
+      /* a page that failed is left out of the document */
+      if (!pdf_page_done)
+	sanei_pdf_writer_end_page (pdf, 0);
+      if (pdf != pdf_writer && sanei_pdf_writer_close (pdf) < 0
+	  && status == SANE_STATUS_EOF)
+	status = SANE_STATUS_IO_ERROR;
+    }
 #endif
-  if (image.data)
-    free (image.data);
+  if (tiff && tiff != tiff_writer)
+    sanei_tiff_writer_close (tiff);
+  image_free (&image);
 
 
   expected_bytes = ((uint64_t)parm.bytes_per_line) * parm.lines *
@@ -1801,6 +2534,163 @@ cleanup:
   return status;
 }
 
+#ifdef HAVE_PTHREAD_H
+static void *
+batch_worker (void *arg)
+{
+  Page *page;
+  SANE_Status status;
+  FILE *fp;
+
+  (void) arg;
+
+  while (1)
+    {
+      pthread_mutex_lock (&batch_pipe.lock);
+      while (!batch_pipe.head && !batch_pipe.closing)
+	pthread_cond_wait (&batch_pipe.cond, &batch_pipe.lock);
+      page = batch_pipe.head;
+      if (page)
+	{
+	  batch_pipe.head = page->next;
+	  if (!batch_pipe.head)
+	    batch_pipe.tail = NULL;
+	  batch_pipe.queued--;
+	  pthread_cond_broadcast (&batch_pipe.cond);
+	}
+      pthread_mutex_unlock (&batch_pipe.lock);
+      if (!page)
+	break;
+
+      fp = NULL;
+      if (multi_page)
+	{
+	  /* there is only one worker, so the pages stay in order */
+	  status = scan_it (multi_page_ofp, page);
+	  if (status == SANE_STATUS_EOF)
+	    status = SANE_STATUS_GOOD;
+	}
+      else if (!(fp = fopen (page->part_path, "w")))
+	{
+	  fprintf (stderr, "cannot open %s\n", page->part_path);
+	  status = SANE_STATUS_ACCESS_DENIED;
+	}
+      else
+	{
+	  status = scan_it (fp, page);
+	  if (status == SANE_STATUS_EOF)
+	    status = SANE_STATUS_GOOD;
+	  if (0 != fclose (fp) && status == SANE_STATUS_GOOD)
+	    {
+	      fprintf (stderr, "cannot close image file\n");
+	      status = SANE_STATUS_ACCESS_DENIED;
+	    }
+	}
+
+      /* pages show up and are printed in the order they were scanned;
+	 after an error the remaining pages are dropped */
+      pthread_mutex_lock (&batch_pipe.lock);
+      while (page->seq != batch_pipe.next_seq)
+	pthread_cond_wait (&batch_pipe.cond, &batch_pipe.lock);
+      if (status == SANE_STATUS_GOOD && batch_pipe.status == SANE_STATUS_GOOD
+	  && !multi_page)
+	{
+	  if (rename (page->part_path, page->path))
+	    {
+	      fprintf (stderr, "cannot rename %s to %s\n",
+		       page->part_path, page->path);
+	      status = SANE_STATUS_ACCESS_DENIED;
+	    }
+	  else if (batch_pipe.print)
+	    {
+	      fprintf (stdout, "%s\n", page->path);
+	      fflush (stdout);
+	    }
+	}
+      else if (fp)
+	unlink (page->part_path);
+      if (batch_pipe.status == SANE_STATUS_GOOD)
+	batch_pipe.status = status;
+      batch_pipe.next_seq++;
+      pthread_cond_broadcast (&batch_pipe.cond);
+      pthread_mutex_unlock (&batch_pipe.lock);
+
+      free_page (page);
+    }
+
+  return NULL;
+}
+
+static int
+batch_pipe_start (int print)
+{
+  int i;
+
+  pthread_mutex_init (&batch_pipe.lock, NULL);
+  pthread_cond_init (&batch_pipe.cond, NULL);
+  batch_pipe.print = print;
+  batch_pipe.status = SANE_STATUS_GOOD;
+  batch_pipe.threads = calloc (batch_workers, sizeof (pthread_t));
+  if (!batch_pipe.threads)
+    return -1;
+  for (i = 0; i < batch_workers; i++)
+    {
+      if (pthread_create (&batch_pipe.threads[i], NULL, batch_worker, NULL))
+	break;
+      batch_pipe.num_threads++;
+    }
+  return batch_pipe.num_threads > 0 ? 0 : -1;
+}
+
+/* Queue a captured page for conversion, waiting while all workers are
+   busy and as many pages are already queued. Returns the status of the
+   workers so far. */
+static SANE_Status
+batch_pipe_put (Page * page)
+{
+  SANE_Status status;
+  double start = now ();
+
+  pthread_mutex_lock (&batch_pipe.lock);
+  while (batch_pipe.queued >= batch_pipe.num_threads
+	 && batch_pipe.status == SANE_STATUS_GOOD)
+    pthread_cond_wait (&batch_pipe.cond, &batch_pipe.lock);
+  batch_pipe.blocked += now () - start;
+  page->next = NULL;
+  if (batch_pipe.tail)
+    batch_pipe.tail->next = page;
+  else
+    batch_pipe.head = page;
+  batch_pipe.tail = page;
+  batch_pipe.queued++;
+  status = batch_pipe.status;
+  pthread_cond_broadcast (&batch_pipe.cond);
+  pthread_mutex_unlock (&batch_pipe.lock);
+
+  return status;
+}
+
+/* Wait for all queued pages to be written. */
+static SANE_Status
+batch_pipe_finish (void)
+{
+  double start = now ();
+  int i;
+
+  pthread_mutex_lock (&batch_pipe.lock);
+  batch_pipe.closing = 1;
+  pthread_cond_broadcast (&batch_pipe.cond);
+  pthread_mutex_unlock (&batch_pipe.lock);
+
+  for (i = 0; i < batch_pipe.num_threads; i++)
+    pthread_join (batch_pipe.threads[i], NULL);
+  free (batch_pipe.threads);
+  batch_pipe.blocked += now () - start;
+
+  return batch_pipe.status;
+}
+#endif
+
 #define clean_buffer(buf,size)	memset ((buf), 0x23, size)
 
 static void
@@ -1828,7 +2718,7 @@ test_it (void)
   int i, len;
   SANE_Parameters parm;
   SANE_Status status;
-  Image image = { 0, 0, 0, 0, 0, 0 };
+  Image image = { 0 };
   static const char *format_name[] =
     { "gray", "RGB", "red", "green", "blue" };
 
@@ -1915,6 +2805,190 @@ cleanup:
 }
 
 
+static void
+histogram_add (uint64_t * histogram, uint64_t value)
+{
+  int i = 0;
+
+  while (value && i < HISTOGRAM_BUCKETS - 1)
+    {
+      value >>= 1;
+      i++;
+    }
+  histogram[i]++;
+}
+
+static void
+histogram_print (const char *name, size_t size, const uint64_t * histogram)
+{
+  int i;
+
+  printf ("%s buffer_size=%lu", name, (u_long) size);
+  for (i = 0; i < HISTOGRAM_BUCKETS; i++)
+    if (histogram[i])
+      printf (" %" PRIu64 ":%" PRIu64,
+	      i ? (uint64_t) 1 << (i - 1) : (uint64_t) 0, histogram[i]);
+  printf ("\n");
+}
+
+/* Do one complete scan, reading and discarding the data, and print its
+   timings on a "scan" line. */
+static SANE_Status
+benchmark_scan (int n, Benchmark_Stats * stats)
+{
+  SANE_Parameters parm;
+  SANE_Status status;
+  SANE_Int len;
+  double t_start, t_started = 0, t_first = 0, t_end, t0, t1;
+  uint64_t bytes = 0, lines = 0, frame_bytes, reads = 0;
+  int first_frame = 1;
+
+  t_start = now ();
+  do
+    {
+#ifdef SANE_STATUS_WARMING_UP
+      do
+	{
+	  status = sane_start (device);
+	}
+      while (status == SANE_STATUS_WARMING_UP);
+#else
+      status = sane_start (device);
+#endif
+      if (status != SANE_STATUS_GOOD)
+	{
+	  fprintf (stderr, "%s: sane_start: %s\n",
+		   prog_name, sane_strstatus (status));
+	  return status;
+	}
+      if (first_frame)
+	t_started = now ();
+
+      status = sane_get_parameters (device, &parm);
+      if (status != SANE_STATUS_GOOD)
+	{
+	  fprintf (stderr, "%s: sane_get_parameters: %s\n",
+		   prog_name, sane_strstatus (status));
+	  return status;
+	}
+
+      frame_bytes = 0;
+      while (1)
+	{
+	  t0 = now ();
+	  status = sane_read (device, buffer, buffer_size, &len);
+	  t1 = now ();
+	  if (status != SANE_STATUS_GOOD)
+	    break;
+
+	  if (len > 0 && !t_first)
+	    t_first = t1;
+	  reads++;
+	  frame_bytes += len;
+	  stats->read_time += t1 - t0;
+	  if (t1 - t0 > stats->read_max)
+	    stats->read_max = t1 - t0;
+	  histogram_add (stats->latency, (uint64_t) ((t1 - t0) * 1e6));
+	  histogram_add (stats->sizes, len);
+	}
+      if (status != SANE_STATUS_EOF)
+	{
+	  fprintf (stderr, "%s: sane_read: %s\n",
+		   prog_name, sane_strstatus (status));
+	  return status;
+	}
+
+      bytes += frame_bytes;
+      if (parm.format == SANE_FRAME_RGB || parm.format == SANE_FRAME_GRAY
+	  || first_frame)
+	lines += parm.bytes_per_line ? frame_bytes / parm.bytes_per_line : 0;
+      first_frame = 0;
+    }
+  while (!parm.last_frame);
+  t_end = now ();
+
+  sane_cancel (device);
+
+  if (!t_first)
+    t_first = t_end;
+  printf ("scan buffer_size=%lu n=%d start_us=%.0f ttfb_us=%.0f"
+	  " bytes=%" PRIu64 " lines=%" PRIu64 " seconds=%.6f"
+	  " mb_per_s=%.3f lines_per_s=%.1f reads=%" PRIu64 "\n",
+	  (u_long) buffer_size, n, (t_started - t_start) * 1e6,
+	  (t_first - t_started) * 1e6, bytes, lines, t_end - t_start,
+	  t_end > t_first ? bytes / (t_end - t_first) / 1e6 : 0.0,
+	  t_end > t_first ? lines / (t_end - t_first) : 0.0, reads);
+  fflush (stdout);
+
+  stats->scans++;
+  stats->reads += reads;
+  stats->bytes += bytes;
+  stats->lines += lines;
+  stats->stream_time += t_end - t_first;
+
+  return SANE_STATUS_GOOD;
+}
+
+/* Run --benchmark scans for every buffer size and print the results as
+   one record per line, suitable for comparing runs. */
+static SANE_Status
+benchmark_it (void)
+{
+  Benchmark_Stats stats;
+  SANE_Status status = SANE_STATUS_GOOD;
+  const char *list = buffer_size_list;
+  char *end;
+  long kib;
+  int i;
+
+  do
+    {
+      if (list)
+	{
+	  kib = strtol (list, &end, 10);
+	  if (end == list || kib <= 0)
+	    {
+	      fprintf (stderr, "%s: invalid buffer size list: %s\n",
+		       prog_name, buffer_size_list);
+	      return SANE_STATUS_INVAL;
+	    }
+	  buffer_size = kib * 1024;
+	  list = *end == ',' ? end + 1 : NULL;
+	}
+
+      free (buffer);
+      buffer = malloc (buffer_size);
+      if (!buffer)
+	return SANE_STATUS_NO_MEM;
+
+      memset (&stats, 0, sizeof (stats));
+      for (i = 1; i <= benchmark; i++)
+	{
+	  status = benchmark_scan (i, &stats);
+	  if (status != SANE_STATUS_GOOD)
+	    break;
+	}
+      if (!stats.scans)
+	break;
+
+      printf ("summary buffer_size=%lu scans=%d bytes=%" PRIu64
+	      " mb_per_s=%.3f lines_per_s=%.1f reads=%" PRIu64
+	      " read_avg_us=%.1f read_max_us=%.0f\n",
+	      (u_long) buffer_size, stats.scans, stats.bytes,
+	      stats.stream_time > 0 ? stats.bytes / stats.stream_time / 1e6 : 0.0,
+	      stats.stream_time > 0 ? stats.lines / stats.stream_time : 0.0,
+	      stats.reads,
+	      stats.reads ? stats.read_time * 1e6 / stats.reads : 0.0,
+	      stats.read_max * 1e6);
+      histogram_print ("read_us", buffer_size, stats.latency);
+      histogram_print ("read_bytes", buffer_size, stats.sizes);
+      fflush (stdout);
+    }
+  while (list && status == SANE_STATUS_GOOD);
+
+  return status;
+}
+
 static int
 get_resolution (void)
 {
@@ -2017,7 +3091,8 @@ static int guess_output_format(const char* output_file)
         { ".jpg", OUTPUT_JPEG },
         { ".jpeg", OUTPUT_JPEG },
         { ".tiff", OUTPUT_TIFF },
-        { ".tif", OUTPUT_TIFF }
+        { ".tif", OUTPUT_TIFF },
+        { ".pdf", OUTPUT_PDF }
       };
       for (unsigned i = 0; i < sizeof(formats) / sizeof(formats[0]); ++i)
         {
@@ -2102,13 +3177,40 @@ main (int argc, char **argv)
           break;
 	case 'B':
           if (optarg)
-	    buffer_size = 1024 * atoi(optarg);
+	    {
+	      buffer_size = 1024 * atoi(optarg);
+	      buffer_size_list = optarg;
+	    }
           else
 	    buffer_size = (1024 * 1024);
 	  break;
+	case OPTION_BUFFER_COUNT:
+	  buffer_count = atoi (optarg);
+	  if (buffer_count < 1)
+	    {
+	      fprintf (stderr, "%s: invalid buffer count: %s\n", prog_name,
+		       optarg);
+	      exit (1);
+	    }
+#ifndef HAVE_PTHREAD_H
+	  if (buffer_count > 1)
+	    fprintf (stderr, "%s: built without thread support, "
+		     "ignoring --buffer-count\n", prog_name);
+	  buffer_count = 1;
+#endif
+	  break;
 	case 'T':
 	  test = 1;
 	  break;
+	case OPTION_BENCHMARK:
+	  benchmark = optarg ? atoi (optarg) : 3;
+	  if (benchmark < 1)
+	    {
+	      fprintf (stderr, "%s: invalid number of benchmark scans: %s\n",
+		       prog_name, optarg);
+	      exit (1);
+	    }
+	  break;
 	case 'A':
 	  all = 1;
 	  break;
@@ -2130,10 +3232,39 @@ main (int argc, char **argv)
 	case OPTION_BATCH_DOUBLE:
 	  batch_increment = 2;
 	  break;
+	case OPTION_BATCH_WORKERS:
+	  batch_workers = atoi (optarg);
+	  if (batch_workers < 0)
+	    {
+	      fprintf (stderr, "%s: invalid number of batch workers: %s\n",
+		       prog_name, optarg);
+	      exit (1);
+	    }
+#ifndef HAVE_PTHREAD_H
+	  if (batch_workers > 0)
+	    fprintf (stderr, "%s: built without thread support, "
+		     "ignoring --batch-workers\n", prog_name);
+	  batch_workers = 0;
+#endif
+	  break;
 	case OPTION_BATCH_COUNT:
 	  batch_count = atoi (optarg);
 	  batch = 1;
 	  break;
+	case OPTION_TIFF_COMPRESSION:
+	  if (strcmp (optarg, "none") == 0)
+	    tiff_compression = 0;
+	  else if (strcmp (optarg, "packbits") == 0)
+	    tiff_compression = SANEI_TIFF_COMPRESSION_PACKBITS;
+	  else if (strcmp (optarg, "lzw") == 0)
+	    tiff_compression = SANEI_TIFF_COMPRESSION_LZW;
+	  else
+	    {
+	      fprintf (stderr, "%s: unknown TIFF compression '%s', "
+		       "use none, packbits or lzw\n", prog_name, optarg);
+	      exit (1);
+	    }
+	  break;
 	case OPTION_FORMAT:
 	  if (strcmp (optarg, "tiff") == 0)
 	    output_format = OUTPUT_TIFF;
@@ -2153,6 +3284,15 @@ main (int argc, char **argv)
 #else
 	      fprintf(stderr, "JPEG support not compiled in\n");
 	      exit(1);
+#endif
+	    }
+	  else if (strcmp (optarg, "pdf") == 0)
+	    {
+#ifdef HAVE_LIBJPEG
+	      output_format = OUTPUT_PDF;
+#else
+	      fprintf(stderr, "PDF support needs JPEG support, which is not compiled in\n");
+	      exit(1);
 #endif
 	    }
           else if (strcmp (optarg, "pnm") == 0)
@@ -2167,7 +3307,7 @@ main (int argc, char **argv)
               fprintf(stderr, ", png");
 #endif
 #ifdef HAVE_LIBJPEG
-              fprintf(stderr, ", jpeg");
+              fprintf(stderr, ", jpeg, pdf");
 #endif
               fprintf(stderr, ".\n");
               exit(1);
@@ -2308,7 +3448,8 @@ standard output.\n\
 Parameters are separated by a blank from single-character options (e.g.\n\
 -d epson) and by a \"=\" from multi-character options (e.g. --device-name=epson).\n\
 -d, --device-name=DEVICE   use a given scanner device (e.g. hp:/dev/scanner)\n\
-    --format=pnm|tiff|png|jpeg  file format of output file\n\
+    --format=pnm|tiff|png|jpeg|pdf  file format of output file\n\
+    --tiff-compression=none|packbits|lzw  compression of TIFF files\n\
 -i, --icc-profile=PROFILE  include this ICC profile into TIFF file\n", prog_name);
       printf ("\
 -L, --list-devices         show available scanner devices\n\
@@ -2317,8 +3458,9 @@ Parameters are separated by a blank from single-character options (e.g.\n\
                            %%m (model), %%t (type), %%i (index number), and\n\
                            %%n (newline)\n\
 -b, --batch[=FORMAT]       working in batch mode, FORMAT is `out%%d.pnm' `out%%d.tif'\n\
-                           `out%%d.png' or `out%%d.jpg' by default depending on --format\n\
-                           This option is incompatible with --output-file.");
+                           `out%%d.png' `out%%d.jpg' or `out%%d.pdf' by default depending\n\
+                           on --format. With --output-file all pages are written\n\
+                           to a single TIFF or PDF file.");
       printf ("\
     --batch-start=#        page number to start naming files with\n\
     --batch-count=#        how many pages to scan in batch mode\n\
@@ -2326,31 +3468,46 @@ Parameters are separated by a blank from single-character options (e.g.\n\
     --batch-double         increment page number by two, same as\n\
                            --batch-increment=2\n\
     --batch-print          print image filenames to stdout\n\
-    --batch-prompt         ask for pressing a key before scanning a page\n");
+    --batch-prompt         ask for pressing a key before scanning a page\n\
+    --batch-workers=#      convert and write pages in # threads while the\n\
+                           next page is being scanned (default 0)\n");
       printf ("\
     --accept-md5-only      only accept authorization requests using md5\n\
 -p, --progress             print progress messages\n\
 -o, --output-file=PATH     save output to the given file instead of stdout.\n\
-                           This option is incompatible with --batch.\n\
+                           With --batch this needs TIFF or PDF output.\n\
 -n, --dont-scan            only set options, don't actually scan\n\
 -T, --test                 test backend thoroughly\n\
+    --benchmark[=#]        do # scans (default 3) for each of the sizes\n\
+                           in --buffer-size=#[,#...] and print timings\n\
 -A, --all-options          list all available backend options\n\
 -h, --help                 display this help message and exit\n\
 -v, --verbose              give even more status messages\n\
--B, --buffer-size=#        change input buffer size (in kB, default 32)\n");
+-B, --buffer-size=#        change input buffer size (in kB, default 32)\n\
+    --buffer-count=#       number of input buffers; with more than one the\n\
+                           scanner is read in a separate thread (default 1)\n");
       printf ("\
 -V, --version              print version information\n");
     }
 
+  if (output_format == OUTPUT_UNKNOWN)
+    output_format = guess_output_format(output_file);
+
   if (batch && output_file != NULL)
     {
-      fprintf(stderr, "--batch and --output-file can't be used together.\n");
-      exit(1);
+      if (output_format != OUTPUT_TIFF && output_format != OUTPUT_PDF)
+	{
+	  fprintf(stderr, "--batch and --output-file can only be used "
+		  "together for TIFF and PDF output.\n");
+	  exit(1);
+	}
+      /* all pages go into output_file; a single worker keeps them in
+	 order */
+      multi_page = 1;
+      if (batch_workers > 1)
+	batch_workers = 1;
     }
 
-  if (output_format == OUTPUT_UNKNOWN)
-    output_format = guess_output_format(output_file);
-
   if (!devname)
     {
       /* If no device name was specified explicitly, we look at the
@@ -2603,9 +3760,13 @@ List of available devices:", prog_name);
   signal (SIGINT, sighandler);
   signal (SIGTERM, sighandler);
 
-  if (test == 0)
+  if (test == 0 && benchmark == 0)
     {
       int n = batch_start_at;
+      double batch_started;
+#ifdef HAVE_PTHREAD_H
+      int pages_queued = 0;
+#endif
 
       if (batch && NULL == format)
 	{
@@ -2625,11 +3786,14 @@ List of available devices:", prog_name);
 	  case OUTPUT_JPEG:
 	    format = "out%d.jpg";
 	    break;
+	  case OUTPUT_PDF:
+	    format = "out%d.pdf";
+	    break;
 #endif
 	  }
 	}
 
-      if (!batch)
+      if (!batch || multi_page)
         {
           ofp = stdout;
           if (output_file != NULL)
@@ -2644,6 +3808,27 @@ List of available devices:", prog_name);
             }
         }
 
+      if (multi_page)
+	{
+	  multi_page_ofp = ofp;
+	  if (output_format == OUTPUT_TIFF)
+	    tiff_writer = sanei_tiff_writer_open (ofp, tiff_compression ?
+						  tiff_compression :
+						  SANEI_TIFF_COMPRESSION_NONE);
+#ifdef HAVE_LIBJPEG
+	  else
+	    pdf_writer = sanei_pdf_writer_open (ofp);
+	  if (!tiff_writer && !pdf_writer)
+#else
+	  if (!tiff_writer)
+#endif
+	    {
+	      fprintf (stderr, "%s: can't write pages to '%s', exiting\n",
+		       prog_name, output_file);
+	      scanimage_exit (1);
+	    }
+	}
+
       if (batch)
 	{
 	  fputs("Scanning ", stderr);
@@ -2662,6 +3847,21 @@ List of available devices:", prog_name);
       }
 
       buffer = malloc (buffer_size);
+#ifdef HAVE_PTHREAD_H
+      if (buffer_count > 1 && read_queue_alloc () < 0)
+	{
+	  fprintf (stderr, "%s: can't allocate %d input buffers\n",
+		   prog_name, buffer_count);
+	  scanimage_exit (1);
+	}
+      if (batch && batch_workers > 0
+	  && batch_pipe_start (batch_print && !multi_page) < 0)
+	{
+	  fprintf (stderr, "%s: can't start batch workers\n", prog_name);
+	  scanimage_exit (1);
+	}
+#endif
+      batch_started = now ();
 
       do
 	{
@@ -2687,7 +3887,7 @@ List of available devices:", prog_name);
 
 		  if (readbuf2 == NULL)
 		    {
-		      if (ofp)
+		      if (ofp && !multi_page)
 			{
 			  fclose (ofp);
 			  ofp = NULL;
@@ -2711,7 +3911,7 @@ List of available devices:", prog_name);
 	    {
 	      fprintf (stderr, "%s: sane_start: %s\n",
 		       prog_name, sane_strstatus (status));
-	      if (ofp)
+	      if (ofp && !multi_page)
 		{
 		  fclose (ofp);
 		  ofp = NULL;
@@ -2720,8 +3920,35 @@ List of available devices:", prog_name);
 	    }
 
 
+#ifdef HAVE_PTHREAD_H
+	  /* hand the page to the workers and go on with the next one */
+	  if (batch && batch_workers > 0)
+	    {
+	      Page *page = calloc (1, sizeof (*page));
+
+	      if (!page)
+		{
+		  status = SANE_STATUS_NO_MEM;
+		  break;
+		}
+	      strcpy (page->path, path);
+	      strcpy (page->part_path, part_path);
+	      page->seq = pages_queued++;
+
+	      status = capture_page (page);
+	      fprintf (stderr, "Scanned page %d.", n);
+	      fprintf (stderr, " (scanner status = %d)\n", status);
+	      if (status == SANE_STATUS_EOF)
+		status = batch_pipe_put (page);
+	      else
+		free_page (page);
+	      n += batch_increment;
+	      continue;
+	    }
+#endif
+
 	  /* write to .part file while scanning is in progress */
-	  if (batch)
+	  if (batch && !multi_page)
 	    {
 	      if (NULL == (ofp = fopen (part_path, "w")))
 		{
@@ -2731,7 +3958,7 @@ List of available devices:", prog_name);
 		}
 	    }
 
-	  status = scan_it (ofp);
+	  status = scan_it (ofp, NULL);
 	  if (batch)
 	    {
 	      fprintf (stderr, "Scanned page %d.", n);
@@ -2743,6 +3970,8 @@ List of available devices:", prog_name);
 	    case SANE_STATUS_GOOD:
 	    case SANE_STATUS_EOF:
 	      status = SANE_STATUS_GOOD;
+	      if (multi_page)
+		break;
 	      if (batch)
 		{
 		  if (!ofp || 0 != fclose(ofp))
@@ -2779,6 +4008,8 @@ List of available devices:", prog_name);
                 }
 	      break;
 	    default:
+	      if (multi_page)
+		break;		/* the page is left out of the file */
 	      if (batch)
 		{
 		  if (ofp)
@@ -2805,11 +4036,59 @@ List of available devices:", prog_name);
 	      && (batch_count == BATCH_COUNT_UNLIMITED || --batch_count))
 	     && SANE_STATUS_GOOD == status);
 
+#ifdef HAVE_PTHREAD_H
+      if (batch && batch_workers > 0)
+	{
+	  SANE_Status pipe_status = batch_pipe_finish ();
+
+	  if (pipe_status != SANE_STATUS_GOOD)
+	    status = pipe_status;
+	}
+#endif
+
+      if (multi_page)
+	{
+	  int error = 0;
+
+	  if (tiff_writer)
+	    sanei_tiff_writer_close (tiff_writer);
+#ifdef HAVE_LIBJPEG
+	  if (pdf_writer)
+	    error = sanei_pdf_writer_close (pdf_writer);
+#endif
+	  if (0 != fclose (multi_page_ofp) || error)
+	    {
+	      fprintf (stderr, "cannot close image file\n");
+	      status = SANE_STATUS_ACCESS_DENIED;
+	    }
+	  else if (multi_page_count == 0)
+	    unlink (output_file);
+	  else if (batch_print)
+	    {
+	      fprintf (stdout, "%s\n", output_file);
+	      fflush (stdout);
+	    }
+	  ofp = NULL;
+	}
+
       if (batch)
 	{
 	  int num_pgs = (n - batch_start_at) / batch_increment;
+	  double elapsed = now () - batch_started;
+
 	  fprintf (stderr, "Batch terminated, %d page%s scanned\n",
 		   num_pgs, num_pgs == 1 ? "" : "s");
+	  if (num_pgs > 0 && elapsed > 0)
+	    {
+	      fprintf (stderr, "%s: %.1f pages/minute", prog_name,
+		       num_pgs * 60.0 / elapsed);
+#ifdef HAVE_PTHREAD_H
+	      if (batch_workers > 0)
+		fprintf (stderr, ", %.1f s blocked on encoding",
+			 batch_pipe.blocked);
+#endif
+	      fputc ('\n', stderr);
+	    }
 	}
 
       if (batch
@@ -2820,6 +4099,8 @@ List of available devices:", prog_name);
 
       sane_cancel (device);
     }
+  else if (benchmark)
+    status = benchmark_it ();
   else
     status = test_it ();
 
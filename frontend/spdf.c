@@ -0,0 +1,217 @@
+/* Write a PDF file with one JPEG image per page
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+   The file is written strictly sequentially, so the output can be a
+   pipe: the JPEG data of a page goes out as it is compressed, its length
+   follows in a separate object, and the page tree, the cross-reference
+   table and the trailer are written when the file is closed.
+*/
+
+#include "../include/sane/config.h"
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "spdf.h"
+
+#define CATALOG_OBJ 1
+#define PAGES_OBJ   2
+
+/* image, image length, contents and page */
+#define OBJS_PER_PAGE 4
+
+struct SANEI_Pdf_Writer
+{
+  FILE *fptr;
+  long pos;                     /* bytes written so far */
+  int error;
+
+  long *offsets;                /* file offset of each object */
+  int num_objs, max_objs;
+  int *pages;                   /* object number of each finished page */
+  int num_pages, max_pages;
+
+  /* current page */
+  int image_obj;
+  long stream_start;
+  int width, height, resolution;
+};
+
+static void
+pdf_printf (SANEI_Pdf_Writer *w, const char *fmt, ...)
+{
+  va_list ap;
+  int n;
+
+  va_start (ap, fmt);
+  n = vfprintf (w->fptr, fmt, ap);
+  va_end (ap);
+  if (n < 0)
+    w->error = 1;
+  else
+    w->pos += n;
+}
+
+static void
+pdf_begin_obj (SANEI_Pdf_Writer *w, int obj)
+{
+  if (obj >= w->max_objs)
+    {
+      int max_objs = 2 * obj + 16;
+      long *offsets = realloc (w->offsets, max_objs * sizeof (long));
+
+      if (!offsets)
+        {
+          w->error = 1;
+          return;
+        }
+      w->offsets = offsets;
+      w->max_objs = max_objs;
+    }
+  w->offsets[obj] = w->pos;
+  if (obj >= w->num_objs)
+    w->num_objs = obj + 1;
+  pdf_printf (w, "%d 0 obj\n", obj);
+}
+
+/* PDF units are 1/72 inch; print with two decimals independent of
+   the locale */
+static void
+pdf_units (char *buf, size_t size, int pixels, int resolution)
+{
+  long hundredths = (long) pixels * 7200 / resolution;
+
+  snprintf (buf, size, "%ld.%02ld", hundredths / 100, hundredths % 100);
+}
+
+SANEI_Pdf_Writer *
+sanei_pdf_writer_open (FILE *fptr)
+{
+  SANEI_Pdf_Writer *w = calloc (1, sizeof (SANEI_Pdf_Writer));
+
+  if (!w)
+    return NULL;
+
+  w->fptr = fptr;
+  w->num_objs = PAGES_OBJ + 1;
+  /* the binary comment marks the file as binary for transfer programs */
+  pdf_printf (w, "%%PDF-1.4\n%%\342\343\317\323\n");
+  return w;
+}
+
+int
+sanei_pdf_writer_begin_page (SANEI_Pdf_Writer *w, int width, int height,
+                             int resolution, int color)
+{
+  w->image_obj = w->num_objs;
+  w->width = width;
+  w->height = height;
+  w->resolution = resolution > 0 ? resolution : 72;
+
+  pdf_begin_obj (w, w->image_obj);
+  pdf_printf (w, "<< /Type /XObject /Subtype /Image /Width %d /Height %d\n"
+              "   /ColorSpace /%s /BitsPerComponent 8 /Filter /DCTDecode\n"
+              "   /Length %d 0 R >>\nstream\n",
+              width, height, color ? "DeviceRGB" : "DeviceGray",
+              w->image_obj + 1);
+  w->stream_start = w->pos;
+  return w->error ? -1 : 0;
+}
+
+int
+sanei_pdf_writer_write (SANEI_Pdf_Writer *w, const void *data, size_t len)
+{
+  if (fwrite (data, 1, len, w->fptr) != len)
+    w->error = 1;
+  w->pos += len;
+  return w->error ? -1 : 0;
+}
+
+/* Finish the objects of the current page. A page that isn't kept stays
+   in the file but isn't part of the document. */
+int
+sanei_pdf_writer_end_page (SANEI_Pdf_Writer *w, int keep)
+{
+  char contents[128], width[32], height[32];
+  int obj = w->image_obj;
+  long length = w->pos - w->stream_start;
+
+  pdf_printf (w, "\nendstream\nendobj\n");
+  pdf_begin_obj (w, obj + 1);
+  pdf_printf (w, "%ld\nendobj\n", length);
+
+  pdf_units (width, sizeof (width), w->width, w->resolution);
+  pdf_units (height, sizeof (height), w->height, w->resolution);
+  snprintf (contents, sizeof (contents), "q %s 0 0 %s 0 0 cm /Im0 Do Q\n",
+            width, height);
+  pdf_begin_obj (w, obj + 2);
+  pdf_printf (w, "<< /Length %d >>\nstream\n%sendstream\nendobj\n",
+              (int) strlen (contents), contents);
+
+  pdf_begin_obj (w, obj + 3);
+  pdf_printf (w, "<< /Type /Page /Parent %d 0 R /MediaBox [0 0 %s %s]\n"
+              "   /Resources << /XObject << /Im0 %d 0 R >> >>\n"
+              "   /Contents %d 0 R >>\nendobj\n",
+              PAGES_OBJ, width, height, obj, obj + 2);
+
+  if (keep && !w->error)
+    {
+      if (w->num_pages == w->max_pages)
+        {
+          int max_pages = w->max_pages ? 2 * w->max_pages : 64;
+          int *pages = realloc (w->pages, max_pages * sizeof (int));
+
+          if (!pages)
+            return -1;
+          w->pages = pages;
+          w->max_pages = max_pages;
+        }
+      w->pages[w->num_pages++] = obj + 3;
+    }
+  return w->error ? -1 : 0;
+}
+
+/* Write the page tree and the trailer and free the writer; the file
+   itself is left open. */
+int
+sanei_pdf_writer_close (SANEI_Pdf_Writer *w)
+{
+  long xref;
+  int i, error;
+
+  pdf_begin_obj (w, PAGES_OBJ);
+  pdf_printf (w, "<< /Type /Pages /Count %d /Kids [", w->num_pages);
+  for (i = 0; i < w->num_pages; i++)
+    pdf_printf (w, "%s%d 0 R", i % 8 ? " " : "\n", w->pages[i]);
+  pdf_printf (w, " ] >>\nendobj\n");
+
+  pdf_begin_obj (w, CATALOG_OBJ);
+  pdf_printf (w, "<< /Type /Catalog /Pages %d 0 R >>\nendobj\n", PAGES_OBJ);
+
+  xref = w->pos;
+  pdf_printf (w, "xref\n0 %d\n0000000000 65535 f \n", w->num_objs);
+  for (i = 1; i < w->num_objs; i++)
+    pdf_printf (w, "%010ld 00000 n \n", w->offsets[i]);
+  pdf_printf (w, "trailer\n<< /Size %d /Root %d 0 R >>\nstartxref\n%ld\n%%%%EOF\n",
+              w->num_objs, CATALOG_OBJ, xref);
+
+  error = w->error;
+  free (w->offsets);
+  free (w->pages);
+  free (w);
+  return error ? -1 : 0;
+}
@@ -0,0 +1,33 @@
+/* Write a PDF file with one JPEG image per page
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+typedef struct SANEI_Pdf_Writer SANEI_Pdf_Writer;
+
+SANEI_Pdf_Writer *
+sanei_pdf_writer_open (FILE *fptr);
+
+int
+sanei_pdf_writer_begin_page (SANEI_Pdf_Writer *w, int width, int height,
+                             int resolution, int color);
+
+int
+sanei_pdf_writer_write (SANEI_Pdf_Writer *w, const void *data, size_t len);
+
+int
+sanei_pdf_writer_end_page (SANEI_Pdf_Writer *w, int keep);
+
+int
+sanei_pdf_writer_close (SANEI_Pdf_Writer *w);
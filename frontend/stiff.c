@@ -29,6 +29,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "../include/sane/config.h"
 #include "../include/sane/sane.h"
@@ -147,17 +148,10 @@ write_i4 (FILE *fptr, int val, int motorola)
 }
 
 static void
-write_ifd (FILE *fptr, IFD *ifd, int motorola)
+write_ifd_entries (FILE *fptr, IFD *ifd, int motorola, int next_ifd)
 {int k;
     IFD_ENTRY *ifde;
 
-    if (!ifd) return;
-
-    if (motorola) putc ('M', fptr), putc ('M', fptr);
-    else putc ('I', fptr), putc ('I', fptr);
-
-    write_i2 (fptr, 42, motorola);  /* Magic */
-    write_i4 (fptr, 8, motorola);   /* Offset to first IFD */
     write_i2 (fptr, ifd->ntags, motorola);
 
     for (k = 0; k < ifd->ntags; k++)
@@ -176,7 +170,20 @@ write_ifd (FILE *fptr, IFD *ifd, int motorola)
             write_i4 (fptr, ifde->val, motorola);
         }
     }
-    write_i4 (fptr, 0, motorola); /* End of IFD chain */
+    write_i4 (fptr, next_ifd, motorola);
+}
+
+static void
+write_ifd (FILE *fptr, IFD *ifd, int motorola)
+{
+    if (!ifd) return;
+
+    if (motorola) putc ('M', fptr), putc ('M', fptr);
+    else putc ('I', fptr), putc ('I', fptr);
+
+    write_i2 (fptr, 42, motorola);  /* Magic */
+    write_i4 (fptr, 8, motorola);   /* Offset to first IFD */
+    write_ifd_entries (fptr, ifd, motorola, 0); /* End of IFD chain */
 }
 
 
@@ -559,3 +566,455 @@ sanei_write_tiff_header (SANE_Frame format, int width, int height, int depth,
         break;
     }
 }
+
+
+/* Streaming multi-page TIFF writer.
+
+   The image data of a page is collected in strips of about 64 KiB that
+   are compressed and written as soon as they are full. The IFD of a page
+   follows its strips and is only written when the page is complete, so
+   the height doesn't have to be known in advance and no more than one
+   strip is held in memory. Chaining the IFDs needs a seekable file. */
+
+#define STRIP_SIZE   (64 * 1024)
+
+#define LZW_CLEAR    256
+#define LZW_EOI      257
+#define LZW_FIRST    258
+#define LZW_MAX_CODE 4095
+#define LZW_HSIZE    9001   /* prime, about twice the code table */
+
+struct SANEI_Tiff_Writer
+{
+    FILE *fptr;
+    long base;              /* file position of the TIFF header */
+    int compression;
+    int motorola;
+    long next_ifd_link;     /* where the offset of the next IFD goes */
+
+    /* current page */
+    int in_page;
+    SANE_Frame format;
+    int width, depth, resolution, channels;
+    const char *icc_profile;
+    size_t bytes_per_line;
+    int rows_per_strip;
+    unsigned char *strip;
+    size_t strip_len, strip_size;
+    unsigned char *out;
+    size_t out_len;
+    long *strip_offsets;
+    long *strip_counts;
+    int nstrips, maxstrips;
+    size_t total_bytes;
+
+    /* LZW encoder */
+    int lzw_key[LZW_HSIZE];
+    short lzw_code[LZW_HSIZE];
+    unsigned long bit_buf;
+    int bit_count;
+};
+
+static long
+writer_tell (SANEI_Tiff_Writer *w)
+{
+    return ftell (w->fptr) - w->base;
+}
+
+static void
+lzw_put_code (SANEI_Tiff_Writer *w, int code, int nbits)
+{
+    w->bit_buf = (w->bit_buf << nbits) | code;
+    w->bit_count += nbits;
+    while (w->bit_count >= 8)
+    {
+        w->bit_count -= 8;
+        w->out[w->out_len++] = (w->bit_buf >> w->bit_count) & 0xff;
+    }
+    w->bit_buf &= (1UL << w->bit_count) - 1;
+}
+
+static void
+lzw_reset (SANEI_Tiff_Writer *w)
+{int k;
+
+    for (k = 0; k < LZW_HSIZE; k++)
+        w->lzw_key[k] = -1;
+}
+
+/* TIFF flavour of LZW: MSB first, code width grows one code early */
+static void
+lzw_encode (SANEI_Tiff_Writer *w, const unsigned char *data, size_t len)
+{
+    int nbits = 9, next = LZW_FIRST;
+    int prefix, key, h;
+    size_t k;
+
+    w->bit_buf = 0;
+    w->bit_count = 0;
+    lzw_reset (w);
+    lzw_put_code (w, LZW_CLEAR, nbits);
+
+    prefix = data[0];
+    for (k = 1; k < len; k++)
+    {
+        key = (prefix << 8) | data[k];
+        h = key % LZW_HSIZE;
+        while (w->lzw_key[h] != -1 && w->lzw_key[h] != key)
+            if (++h == LZW_HSIZE) h = 0;
+        if (w->lzw_key[h] == key)
+        {
+            prefix = w->lzw_code[h];
+            continue;
+        }
+
+        lzw_put_code (w, prefix, nbits);
+        prefix = data[k];
+        w->lzw_key[h] = key;
+        w->lzw_code[h] = next++;
+        if (next == LZW_MAX_CODE - 1)
+        {
+            lzw_put_code (w, LZW_CLEAR, nbits);
+            lzw_reset (w);
+            nbits = 9;
+            next = LZW_FIRST;
+        }
+        else if (next > (1 << nbits) - 1)
+            nbits++;
+    }
+    lzw_put_code (w, prefix, nbits);
+
+    /* the decoder adds a table entry for the last code as well */
+    next++;
+    if (next == LZW_MAX_CODE - 1)
+    {
+        lzw_put_code (w, LZW_CLEAR, nbits);
+        nbits = 9;
+    }
+    else if (next > (1 << nbits) - 1)
+        nbits++;
+    lzw_put_code (w, LZW_EOI, nbits);
+
+    if (w->bit_count > 0)
+        w->out[w->out_len++] = (w->bit_buf << (8 - w->bit_count)) & 0xff;
+}
+
+/* PackBits works on each row separately */
+static void
+packbits_encode (SANEI_Tiff_Writer *w, const unsigned char *row, size_t len)
+{size_t i = 0, run, lit;
+    unsigned char *out = w->out + w->out_len;
+
+    while (i < len)
+    {
+        run = 1;
+        while (i + run < len && run < 128 && row[i + run] == row[i])
+            run++;
+        if (run >= 2)
+        {
+            *out++ = (unsigned char) (257 - run);
+            *out++ = row[i];
+            i += run;
+            continue;
+        }
+
+        lit = 1;
+        while (i + lit < len && lit < 128
+               && !(i + lit + 1 < len && row[i + lit] == row[i + lit + 1]))
+            lit++;
+        *out++ = (unsigned char) (lit - 1);
+        memcpy (out, row + i, lit);
+        out += lit;
+        i += lit;
+    }
+    w->out_len = out - w->out;
+}
+
+static int
+flush_strip (SANEI_Tiff_Writer *w)
+{
+    const unsigned char *data = w->strip;
+    size_t len = w->strip_len, r;
+
+    if (len == 0) return 0;
+
+    if (w->nstrips == w->maxstrips)
+    {
+        long *offsets, *counts;
+        int maxstrips = w->maxstrips ? 2 * w->maxstrips : 64;
+
+        offsets = realloc (w->strip_offsets, maxstrips * sizeof (long));
+        if (offsets == NULL) return -1;
+        w->strip_offsets = offsets;
+        counts = realloc (w->strip_counts, maxstrips * sizeof (long));
+        if (counts == NULL) return -1;
+        w->strip_counts = counts;
+        w->maxstrips = maxstrips;
+    }
+
+    switch (w->compression)
+    {
+    case SANEI_TIFF_COMPRESSION_LZW:
+        w->out_len = 0;
+        lzw_encode (w, w->strip, w->strip_len);
+        data = w->out;
+        len = w->out_len;
+        break;
+
+    case SANEI_TIFF_COMPRESSION_PACKBITS:
+        w->out_len = 0;
+        for (r = 0; r < w->strip_len; r += w->bytes_per_line)
+            packbits_encode (w, w->strip + r, w->bytes_per_line);
+        data = w->out;
+        len = w->out_len;
+        break;
+    }
+
+    w->strip_offsets[w->nstrips] = writer_tell (w);
+    w->strip_counts[w->nstrips] = len;
+    w->nstrips++;
+    w->strip_len = 0;
+
+    return (fwrite (data, 1, len, w->fptr) == len) ? 0 : -1;
+}
+
+SANEI_Tiff_Writer *
+sanei_tiff_writer_open (FILE *fptr, int compression)
+{SANEI_Tiff_Writer *w;
+    int check = 1;
+
+#ifdef __EMX__	/* OS2 - write in binary mode. */
+    _fsetmode(fptr, "b");
+#endif
+    /* the IFDs are linked by patching the file */
+    if (fseek (fptr, 0, SEEK_CUR) != 0)
+        return NULL;
+
+    w = (SANEI_Tiff_Writer *) calloc (1, sizeof (SANEI_Tiff_Writer));
+    if (w == NULL) return NULL;
+
+    w->fptr = fptr;
+    w->base = ftell (fptr);
+    w->compression = compression;
+    /* 16 bit samples are in native byte order, so is the whole file */
+    w->motorola = ((*((char *)&check)) == 0);
+
+    if (w->motorola) putc ('M', fptr), putc ('M', fptr);
+    else putc ('I', fptr), putc ('I', fptr);
+    write_i2 (fptr, 42, w->motorola);
+    w->next_ifd_link = writer_tell (w);
+    write_i4 (fptr, 0, w->motorola);
+
+    return w;
+}
+
+int
+sanei_tiff_writer_start_page (SANEI_Tiff_Writer *w, SANE_Frame format,
+                              int width, int depth, int resolution,
+                              const char *icc_profile)
+{
+    w->format = format;
+    w->width = width;
+    w->depth = depth;
+    w->resolution = resolution;
+    w->icc_profile = icc_profile;
+    w->channels = (format == SANE_FRAME_GRAY) ? 1 : 3;
+    if (depth == 1)
+        w->bytes_per_line = (width + 7) / 8;
+    else
+        w->bytes_per_line = (size_t) width * w->channels * ((depth > 8) ? 2 : 1);
+    if (w->bytes_per_line == 0)
+        return -1;
+
+    w->rows_per_strip = STRIP_SIZE / w->bytes_per_line;
+    if (w->rows_per_strip < 1)
+        w->rows_per_strip = 1;
+    w->strip_size = w->rows_per_strip * w->bytes_per_line;
+
+    /* a page that was never finished is dropped */
+    free (w->strip);
+    free (w->out);
+    w->strip = malloc (w->strip_size);
+    /* worst case of LZW is 12 bits per byte plus a few codes */
+    w->out = malloc (w->strip_size * 2 + 16);
+    if (w->strip == NULL || w->out == NULL)
+        return -1;
+
+    w->strip_len = 0;
+    w->nstrips = 0;
+    w->total_bytes = 0;
+    w->in_page = 1;
+    return 0;
+}
+
+int
+sanei_tiff_writer_write (SANEI_Tiff_Writer *w, const void *data, size_t len)
+{
+    const unsigned char *p = data;
+    size_t n;
+
+    while (len > 0)
+    {
+        n = w->strip_size - w->strip_len;
+        if (n > len) n = len;
+        memcpy (w->strip + w->strip_len, p, n);
+        w->strip_len += n;
+        w->total_bytes += n;
+        p += n;
+        len -= n;
+
+        if (w->strip_len == w->strip_size && flush_strip (w) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+int
+sanei_tiff_writer_end_page (SANEI_Tiff_Writer *w)
+{IFD *ifd;
+    long pos, ifd_offset, bps_offset = 0, offsets_offset = 0;
+    long counts_offset = 0, res_offset = 0, icc_offset = 0;
+    size_t height, partial, icc_size = 0;
+    void *icc_buffer = NULL;
+    int k;
+
+    if (!w->in_page) return -1;
+    w->in_page = 0;
+
+    /* complete a partial last line */
+    height = (w->total_bytes + w->bytes_per_line - 1) / w->bytes_per_line;
+    partial = w->total_bytes % w->bytes_per_line;
+    if (partial)
+    {
+        memset (w->strip + w->strip_len, 0, w->bytes_per_line - partial);
+        w->strip_len += w->bytes_per_line - partial;
+    }
+    if (height == 0 || flush_strip (w) < 0)
+        return -1;
+
+    /* the values that don't fit into the IFD go first */
+    pos = writer_tell (w);
+    if (pos & 1)
+    {
+        putc (0, w->fptr);
+        pos++;
+    }
+    if (w->channels == 3)
+    {
+        bps_offset = pos;
+        for (k = 0; k < 3; k++)
+            write_i2 (w->fptr, w->depth, w->motorola);
+        pos += 3*2;
+    }
+    if (w->nstrips > 1)
+    {
+        offsets_offset = pos;
+        for (k = 0; k < w->nstrips; k++)
+            write_i4 (w->fptr, w->strip_offsets[k], w->motorola);
+        pos += 4 * w->nstrips;
+        counts_offset = pos;
+        for (k = 0; k < w->nstrips; k++)
+            write_i4 (w->fptr, w->strip_counts[k], w->motorola);
+        pos += 4 * w->nstrips;
+    }
+    if (w->resolution > 0)
+    {
+        res_offset = pos;
+        write_i4 (w->fptr, w->resolution, w->motorola);
+        write_i4 (w->fptr, 1, w->motorola);
+        write_i4 (w->fptr, w->resolution, w->motorola);
+        write_i4 (w->fptr, 1, w->motorola);
+        pos += 2*2*4;
+    }
+    if (w->icc_profile && w->depth > 1)
+        icc_buffer = sanei_load_icc_profile (w->icc_profile, &icc_size);
+    if (icc_size > 0)
+    {
+        icc_offset = pos;
+        fwrite (icc_buffer, icc_size, 1, w->fptr);
+        pos += icc_size;
+        if (pos & 1)
+        {
+            putc (0, w->fptr);
+            pos++;
+        }
+    }
+    free (icc_buffer);
+    ifd_offset = pos;
+
+    ifd = create_ifd ();
+    if (ifd == NULL) return -1;
+
+    /* New subfile type */
+    add_ifd_entry (ifd, 254, IFDE_TYP_LONG, 1, 0);
+    /* image width */
+    add_ifd_entry (ifd, 256, (w->width > 0xffff) ? IFDE_TYP_LONG : IFDE_TYP_SHORT,
+                   1, w->width);
+    /* image length */
+    add_ifd_entry (ifd, 257, (height > 0xffff) ? IFDE_TYP_LONG : IFDE_TYP_SHORT,
+                   1, (int) height);
+    /* bits per sample */
+    if (w->channels == 3)
+        add_ifd_entry (ifd, 258, IFDE_TYP_SHORT, 3, bps_offset);
+    else
+        add_ifd_entry (ifd, 258, IFDE_TYP_SHORT, 1, w->depth);
+    /* compression */
+    add_ifd_entry (ifd, 259, IFDE_TYP_SHORT, 1, w->compression);
+    /* photometric interpretation */
+    add_ifd_entry (ifd, 262, IFDE_TYP_SHORT, 1,
+                   (w->channels == 3) ? 2 : (w->depth == 1) ? 0 : 1);
+    /* fill order */
+    if (w->depth == 1)
+        add_ifd_entry (ifd, 266, IFDE_TYP_SHORT, 1, 1);
+    /* strip offsets */
+    add_ifd_entry (ifd, 273, IFDE_TYP_LONG, w->nstrips,
+                   (w->nstrips > 1) ? offsets_offset : w->strip_offsets[0]);
+    /* orientation */
+    add_ifd_entry (ifd, 274, IFDE_TYP_SHORT, 1, 1);
+    /* samples per pixel */
+    add_ifd_entry (ifd, 277, IFDE_TYP_SHORT, 1, w->channels);
+    /* rows per strip */
+    add_ifd_entry (ifd, 278, IFDE_TYP_LONG, 1, w->rows_per_strip);
+    /* strip bytecounts */
+    add_ifd_entry (ifd, 279, IFDE_TYP_LONG, w->nstrips,
+                   (w->nstrips > 1) ? counts_offset : w->strip_counts[0]);
+    if (w->resolution > 0)
+    {
+        /* x resolution */
+        add_ifd_entry (ifd, 282, IFDE_TYP_RATIONAL, 1, res_offset);
+        /* y resolution */
+        add_ifd_entry (ifd, 283, IFDE_TYP_RATIONAL, 1, res_offset + 2*4);
+        /* resolution unit (dpi) */
+        add_ifd_entry (ifd, 296, IFDE_TYP_SHORT, 1, 2);
+    }
+    if (icc_size > 0)
+        add_ifd_entry (ifd, 34675, 7, (int) icc_size, icc_offset);
+
+    write_ifd_entries (w->fptr, ifd, w->motorola, 0);
+
+    /* link the page into the chain */
+    if (fseek (w->fptr, w->base + w->next_ifd_link, SEEK_SET) != 0)
+    {
+        free_ifd (ifd);
+        return -1;
+    }
+    write_i4 (w->fptr, ifd_offset, w->motorola);
+    w->next_ifd_link = ifd_offset + 2 + ifd->ntags*12;
+    free_ifd (ifd);
+
+    if (fseek (w->fptr, 0, SEEK_END) != 0 || ferror (w->fptr))
+        return -1;
+    return 0;
+}
+
+void
+sanei_tiff_writer_close (SANEI_Tiff_Writer *w)
+{
+    if (w == NULL) return;
+
+    free (w->strip);
+    free (w->out);
+    free (w->strip_offsets);
+    free (w->strip_counts);
+    free (w);
+}
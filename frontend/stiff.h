@@ -18,3 +18,29 @@
 void
 sanei_write_tiff_header (SANE_Frame format, int width, int height, int depth,
                          int resolution, const char *icc_profile, FILE *ofp);
+
+/* Streaming writer for (multi-page) TIFF files, see stiff.c. The output
+   file must be seekable. */
+
+#define SANEI_TIFF_COMPRESSION_NONE      1
+#define SANEI_TIFF_COMPRESSION_LZW       5
+#define SANEI_TIFF_COMPRESSION_PACKBITS  32773
+
+typedef struct SANEI_Tiff_Writer SANEI_Tiff_Writer;
+
+SANEI_Tiff_Writer *
+sanei_tiff_writer_open (FILE *fptr, int compression);
+
+int
+sanei_tiff_writer_start_page (SANEI_Tiff_Writer *w, SANE_Frame format,
+                              int width, int depth, int resolution,
+                              const char *icc_profile);
+
+int
+sanei_tiff_writer_write (SANEI_Tiff_Writer *w, const void *data, size_t len);
+
+int
+sanei_tiff_writer_end_page (SANEI_Tiff_Writer *w);
+
+void
+sanei_tiff_writer_close (SANEI_Tiff_Writer *w);
@@ -20,7 +20,11 @@
 #include <sane/sane.h>
 #include <sane/sanei_wire.h>
 
-#define SANEI_NET_PROTOCOL_VERSION	3
+/* Version 4 adds SANE_NET_GET_OPTION_DESCRIPTORS_DELTA.  The client sends
+   the highest version it supports in SANE_NET_INIT and the server replies
+   with the version that will be used, so the new procedure is only used if
+   both peers support it.  */
+#define SANEI_NET_PROTOCOL_VERSION	4
 
 typedef enum
   {
@@ -41,7 +45,8 @@ typedef enum
     SANE_NET_START,
     SANE_NET_CANCEL,
     SANE_NET_AUTHORIZE,
-    SANE_NET_EXIT
+    SANE_NET_EXIT,
+    SANE_NET_GET_OPTION_DESCRIPTORS_DELTA
   }
 SANE_Net_Procedure_Number;
 
@@ -81,6 +86,33 @@ typedef struct
   }
 SANE_Option_Descriptor_Array;
 
+/* The client sends the hashes of the option descriptors it has cached,
+   indexed by option number.  The server replies with the current number of
+   options and with the descriptors whose hash differs.  */
+typedef struct
+  {
+    SANE_Word handle;
+    SANE_Word num_hashes;
+    SANE_Word *hashes;
+  }
+SANE_Option_Descriptor_Delta_Req;
+
+typedef struct
+  {
+    SANE_Word index;
+    SANE_Word hash;
+    SANE_Option_Descriptor *desc;
+  }
+SANE_Option_Descriptor_Delta;
+
+typedef struct
+  {
+    SANE_Word num_options;
+    SANE_Word num_changed;
+    SANE_Option_Descriptor_Delta *changed;
+  }
+SANE_Option_Descriptor_Delta_Reply;
+
 typedef struct
   {
     SANE_Word handle;
@@ -133,6 +165,10 @@ extern void sanei_w_get_devices_reply (Wire *w, SANE_Get_Devices_Reply *reply);
 extern void sanei_w_open_reply (Wire *w, SANE_Open_Reply *reply);
 extern void sanei_w_option_descriptor_array (Wire *w,
 					   SANE_Option_Descriptor_Array *opt);
+extern void sanei_w_option_descriptor_delta_req (Wire *w,
+				SANE_Option_Descriptor_Delta_Req *req);
+extern void sanei_w_option_descriptor_delta_reply (Wire *w,
+				SANE_Option_Descriptor_Delta_Reply *reply);
 extern void sanei_w_control_option_req (Wire *w, SANE_Control_Option_Req *req);
 extern void sanei_w_control_option_reply (Wire *w,
 					  SANE_Control_Option_Reply *reply);
@@ -195,7 +195,16 @@ struct sanei_usb_dev_descriptor
     prepend all output commands before that node before an output command is
     encountered.
 
-    @param path Path to the XML data file.
+    The data file may also be a binary capture as written when recording to a
+    file with the ".sanecap" suffix. Binary captures are mapped into memory and
+    the transaction data is not hex-decoded, which makes replay of large
+    captures much faster. Development mode is supported only for XML files.
+
+    If the SANE_USB_REPLAY_TIMING environment variable is set to "recorded",
+    the transactions are replayed with the same relative timing as they were
+    recorded with.
+
+    @param path Path to the XML or binary data file.
     @param development_mode Enables development mode.
  */
 extern SANE_Status sanei_usb_testing_enable_replay(SANE_String_Const path,
@@ -206,7 +215,10 @@ extern SANE_Status sanei_usb_testing_enable_replay(SANE_String_Const path,
  * Initializes sanei_usb for recording communication with the scanner. This
  * function must be called before sanei_usb_init().
  *
- * @param path Path to the XML data file.
+ * If the path has the ".sanecap" suffix, the data is written in the binary
+ * capture format, otherwise as XML.
+ *
+ * @param path Path to the XML or binary data file.
  * @param be_name The name of the backend to enable recording for.
  */
 extern SANE_Status sanei_usb_testing_enable_record(SANE_String_Const path,
@@ -244,6 +256,18 @@ extern void sanei_usb_testing_record_clear();
  */
 extern void sanei_usb_testing_record_message(SANE_String_Const message);
 
+/** Converts a USB capture between the XML and binary formats.
+ *
+ * The format of the input file is detected from its contents. The output file
+ * is written in the binary format if its name has the ".sanecap" suffix,
+ * otherwise as XML.
+ *
+ * @param in_path Path to the capture to read
+ * @param out_path Path to the capture to write
+ */
+extern SANE_Status sanei_usb_testing_convert_capture(SANE_String_Const in_path,
+                                                     SANE_String_Const out_path);
+
 /** Initialize sanei_usb.
  *
  * Call this before any other sanei_usb function.
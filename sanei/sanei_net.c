@@ -131,6 +131,33 @@ sanei_w_option_descriptor_array (Wire *w, SANE_Option_Descriptor_Array *a)
 		 sizeof (a->desc[0]));
 }
 
+void
+sanei_w_option_descriptor_delta_req (Wire *w,
+				     SANE_Option_Descriptor_Delta_Req *req)
+{
+  sanei_w_word (w, &req->handle);
+  sanei_w_array (w, &req->num_hashes, (void **) &req->hashes,
+		 (WireCodecFunc) sanei_w_word, sizeof (req->hashes[0]));
+}
+
+static void
+w_option_descriptor_delta (Wire *w, SANE_Option_Descriptor_Delta *delta)
+{
+  sanei_w_word (w, &delta->index);
+  sanei_w_word (w, &delta->hash);
+  sanei_w_option_descriptor_ptr (w, &delta->desc);
+}
+
+void
+sanei_w_option_descriptor_delta_reply (Wire *w,
+				       SANE_Option_Descriptor_Delta_Reply *reply)
+{
+  sanei_w_word (w, &reply->num_options);
+  sanei_w_array (w, &reply->num_changed, (void **) &reply->changed,
+		 (WireCodecFunc) w_option_descriptor_delta,
+		 sizeof (reply->changed[0]));
+}
+
 void
 sanei_w_control_option_req (Wire *w, SANE_Control_Option_Req *req)
 {
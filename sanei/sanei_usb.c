@@ -66,6 +66,12 @@
 
 #if WITH_USB_RECORD_REPLAY
 #include <libxml/tree.h>
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#endif
 #endif
 
 #ifdef HAVE_RESMGR
@@ -206,6 +212,42 @@ static xmlNode* testing_append_commands_node = NULL;
 static SANE_String testing_xml_path = NULL;
 static xmlDoc* testing_xml_doc = NULL;
 static xmlNode* testing_xml_next_tx_node = NULL;
+
+// A USB capture in the binary format, see the description of the format below
+struct sanei_usb_capture
+{
+  const uint8_t* data;
+  size_t size;
+  int is_mmapped;
+
+  uint64_t description_offset;
+  uint64_t description_size;
+  uint64_t tx_count;
+  uint64_t index_offset;
+  uint64_t data_offset;
+  uint64_t data_size;
+};
+
+// Binary file from which we read testing data. If data is not NULL, the
+// transactions are read from it instead of from testing_xml_doc which then
+// contains just the description of the device.
+static struct sanei_usb_capture testing_capture;
+// The index of the transaction within testing_capture that
+// testing_xml_next_tx_node has been created from
+static uint64_t testing_capture_next_tx = 0;
+// The transaction node that has been returned last from
+// sanei_xml_get_next_tx_node(). Freed on the next call.
+static xmlNode* testing_capture_prev_tx_node = NULL;
+
+// The time when the recording has been started
+static uint64_t testing_record_start_usec = 0;
+
+// Whether the replay should be delayed to follow the timestamps of the
+// transactions, see SANE_USB_REPLAY_TIMING
+static int testing_replay_recorded_timing = 0;
+static uint64_t testing_replay_start_usec = 0;
+static uint64_t testing_replay_first_tx_usec = 0;
+static int testing_replay_timing_started = 0;
 #endif // WITH_USB_RECORD_REPLAY
 
 #if defined(HAVE_LIBUSB_LEGACY) || defined(HAVE_LIBUSB)
@@ -498,15 +540,364 @@ sanei_libusb_strerror (int errcode)
 #endif /* HAVE_LIBUSB */
 
 #if WITH_USB_RECORD_REPLAY
+
+/* The binary USB capture format.
+
+   The XML format stores the data as hex text which makes full-page captures
+   hundreds of MB large and slow to load. The binary format stores the same
+   information, but the data is kept as is and the transactions can be
+   accessed through an index without parsing the whole file. All integers are
+   little-endian.
+
+   Header (64 bytes):
+      0  char[8] magic, "SANEUSBC"
+      8  u32     version, 1
+     12  u32     reserved, 0
+     16  u64     offset of the description
+     24  u64     size of the description
+     32  u64     number of transactions
+     40  u64     offset of the transaction index
+     48  u64     offset of the data section
+     56  u64     size of the data section
+
+   The description is a <device_capture> XML document with the same contents
+   as in the XML format, except that the <transactions> node is empty.
+
+   Transaction index entry (48 bytes):
+      0  u32     transaction type, index into sanei_usb_capture_tx_names
+      4  u32     seq
+      8  u64     time_usec
+     16  u64     offset of the attributes within the data section
+     24  u32     size of the attributes
+     28  u32     flags, SANEI_USB_CAPTURE_TX_HAS_*
+     32  u64     offset of the data within the data section
+     40  u64     size of the data
+
+   The attributes other than seq and time_usec are stored as consecutive
+   NUL-terminated name and value strings.
+*/
+
+#define SANEI_USB_CAPTURE_MAGIC "SANEUSBC"
+#define SANEI_USB_CAPTURE_MAGIC_SIZE 8
+#define SANEI_USB_CAPTURE_VERSION 1
+#define SANEI_USB_CAPTURE_HEADER_SIZE 64
+#define SANEI_USB_CAPTURE_TX_SIZE 48
+
+#define SANEI_USB_CAPTURE_TX_HAS_DATA 0x1
+#define SANEI_USB_CAPTURE_TX_HAS_SEQ 0x2
+#define SANEI_USB_CAPTURE_TX_HAS_TIME 0x4
+
+// Binary captures are written instead of XML if the file name has this suffix
+#define SANEI_USB_CAPTURE_BINARY_SUFFIX ".sanecap"
+
+static const char* sanei_usb_capture_tx_names[] = {
+  "control_tx", "bulk_tx", "interrupt_tx",
+  "get_descriptor", "debug", "known_commands_end"
+};
+
+#define SANEI_USB_CAPTURE_TX_TYPE_COUNT \
+  (sizeof(sanei_usb_capture_tx_names) / sizeof(sanei_usb_capture_tx_names[0]))
+
+static uint32_t sanei_usb_capture_get_u32(const uint8_t* p)
+{
+  return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) |
+      ((uint32_t) p[3] << 24);
+}
+
+static uint64_t sanei_usb_capture_get_u64(const uint8_t* p)
+{
+  return (uint64_t) sanei_usb_capture_get_u32(p) |
+      ((uint64_t) sanei_usb_capture_get_u32(p + 4) << 32);
+}
+
+static void sanei_usb_capture_put_u32(uint8_t* p, uint32_t value)
+{
+  p[0] = value & 0xff;
+  p[1] = (value >> 8) & 0xff;
+  p[2] = (value >> 16) & 0xff;
+  p[3] = (value >> 24) & 0xff;
+}
+
+static void sanei_usb_capture_put_u64(uint8_t* p, uint64_t value)
+{
+  sanei_usb_capture_put_u32(p, value & 0xffffffff);
+  sanei_usb_capture_put_u32(p + 4, value >> 32);
+}
+
+static int sanei_usb_capture_has_binary_suffix(const char* path)
+{
+  size_t path_len = strlen(path);
+  size_t suffix_len = strlen(SANEI_USB_CAPTURE_BINARY_SUFFIX);
+  return path_len >= suffix_len &&
+      strcmp(path + path_len - suffix_len, SANEI_USB_CAPTURE_BINARY_SUFFIX) == 0;
+}
+
+// Returns 1 if the file at the given path is a capture in the binary format
+static int sanei_usb_capture_is_binary(const char* path)
+{
+  char magic[SANEI_USB_CAPTURE_MAGIC_SIZE];
+  FILE* f = fopen(path, "rb");
+  if (f == NULL)
+    return 0;
+
+  size_t read_size = fread(magic, 1, sizeof(magic), f);
+  fclose(f);
+
+  return read_size == sizeof(magic) &&
+      memcmp(magic, SANEI_USB_CAPTURE_MAGIC, sizeof(magic)) == 0;
+}
+
+static void sanei_usb_capture_close(struct sanei_usb_capture* capture)
+{
+  if (capture->data != NULL)
+    {
+#ifdef HAVE_MMAP
+      if (capture->is_mmapped)
+        munmap((void*) capture->data, capture->size);
+      else
+#endif
+        free((void*) capture->data);
+    }
+  memset(capture, 0, sizeof(*capture));
+}
+
+// returns 1 if the range is within the given size
+static int sanei_usb_capture_range_is_valid(uint64_t offset, uint64_t size,
+                                            uint64_t max_size)
+{
+  return offset <= max_size && size <= max_size - offset;
+}
+
+// Maps the given binary capture file into memory and validates its header
+static SANE_Status sanei_usb_capture_open(struct sanei_usb_capture* capture,
+                                          const char* path)
+{
+  memset(capture, 0, sizeof(*capture));
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    {
+      DBG(1, "%s: could not open %s\n", __func__, path);
+      return SANE_STATUS_ACCESS_DENIED;
+    }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0)
+    {
+      DBG(1, "%s: could not stat %s\n", __func__, path);
+      close(fd);
+      return SANE_STATUS_ACCESS_DENIED;
+    }
+  capture->size = st.st_size;
+
+#ifdef HAVE_MMAP
+  if (capture->size > 0)
+    {
+      void* data = mmap(NULL, capture->size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data != MAP_FAILED)
+        {
+          capture->data = data;
+          capture->is_mmapped = 1;
+        }
+    }
+#endif
+
+  if (capture->data == NULL)
+    {
+      // mmap is not available, read the whole file instead
+      uint8_t* data = malloc(capture->size + 1);
+      size_t total_read = 0;
+      while (data != NULL && total_read < capture->size)
+        {
+          ssize_t read_size = read(fd, data + total_read, capture->size - total_read);
+          if (read_size < 0 && errno == EINTR)
+            continue;
+          if (read_size <= 0)
+            break;
+          total_read += read_size;
+        }
+      if (data == NULL || total_read != capture->size)
+        {
+          DBG(1, "%s: could not read %s\n", __func__, path);
+          free(data);
+          close(fd);
+          return SANE_STATUS_IO_ERROR;
+        }
+      capture->data = data;
+    }
+  close(fd);
+
+  const uint8_t* header = capture->data;
+  if (capture->size < SANEI_USB_CAPTURE_HEADER_SIZE ||
+      memcmp(header, SANEI_USB_CAPTURE_MAGIC, SANEI_USB_CAPTURE_MAGIC_SIZE) != 0)
+    {
+      DBG(1, "%s: %s is not a binary USB capture\n", __func__, path);
+      sanei_usb_capture_close(capture);
+      return SANE_STATUS_INVAL;
+    }
+
+  uint32_t version = sanei_usb_capture_get_u32(header + 8);
+  if (version != SANEI_USB_CAPTURE_VERSION)
+    {
+      DBG(1, "%s: unsupported binary USB capture version %u\n", __func__, version);
+      sanei_usb_capture_close(capture);
+      return SANE_STATUS_INVAL;
+    }
+
+  capture->description_offset = sanei_usb_capture_get_u64(header + 16);
+  capture->description_size = sanei_usb_capture_get_u64(header + 24);
+  capture->tx_count = sanei_usb_capture_get_u64(header + 32);
+  capture->index_offset = sanei_usb_capture_get_u64(header + 40);
+  capture->data_offset = sanei_usb_capture_get_u64(header + 48);
+  capture->data_size = sanei_usb_capture_get_u64(header + 56);
+
+  if (!sanei_usb_capture_range_is_valid(capture->description_offset,
+                                        capture->description_size, capture->size) ||
+      !sanei_usb_capture_range_is_valid(capture->data_offset, capture->data_size,
+                                        capture->size) ||
+      capture->index_offset > capture->size ||
+      capture->tx_count > (capture->size - capture->index_offset) / SANEI_USB_CAPTURE_TX_SIZE)
+    {
+      DBG(1, "%s: %s is corrupted\n", __func__, path);
+      sanei_usb_capture_close(capture);
+      return SANE_STATUS_INVAL;
+    }
+
+  return SANE_STATUS_GOOD;
+}
+
+static xmlDoc* sanei_usb_capture_read_description(const struct sanei_usb_capture* capture)
+{
+  return xmlReadMemory((const char*) capture->data + capture->description_offset,
+                       capture->description_size, NULL, NULL, 0);
+}
+
+static const uint8_t* sanei_usb_capture_get_tx_entry(const struct sanei_usb_capture* capture,
+                                                     uint64_t index)
+{
+  return capture->data + capture->index_offset + index * SANEI_USB_CAPTURE_TX_SIZE;
+}
+
+// Returns the data of the transaction. The range has been validated by
+// sanei_usb_capture_tx_to_node().
+static const uint8_t* sanei_usb_capture_get_tx_data(const struct sanei_usb_capture* capture,
+                                                    const uint8_t* entry, size_t* size)
+{
+  *size = sanei_usb_capture_get_u64(entry + 40);
+  return capture->data + capture->data_offset + sanei_usb_capture_get_u64(entry + 32);
+}
+
+static void sanei_usb_capture_set_uint64_attr(xmlNode* node, const char* attr_name,
+                                              uint64_t attr_value)
+{
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%llu", (unsigned long long) attr_value);
+  xmlNewProp(node, (const xmlChar*)attr_name, (const xmlChar*)buf);
+}
+
+// Creates a node equivalent to the one in the XML format for the transaction
+// with the given index. The node does not contain the data, it is accessed
+// via node->_private instead. Returns NULL if the transaction is invalid.
+static xmlNode* sanei_usb_capture_tx_to_node(const struct sanei_usb_capture* capture,
+                                             uint64_t index)
+{
+  const uint8_t* entry = sanei_usb_capture_get_tx_entry(capture, index);
+
+  uint32_t type = sanei_usb_capture_get_u32(entry);
+  uint32_t seq = sanei_usb_capture_get_u32(entry + 4);
+  uint64_t time_usec = sanei_usb_capture_get_u64(entry + 8);
+  uint64_t attrs_offset = sanei_usb_capture_get_u64(entry + 16);
+  uint32_t attrs_size = sanei_usb_capture_get_u32(entry + 24);
+  uint32_t flags = sanei_usb_capture_get_u32(entry + 28);
+  uint64_t data_offset = sanei_usb_capture_get_u64(entry + 32);
+  uint64_t data_size = sanei_usb_capture_get_u64(entry + 40);
+
+  if (type >= SANEI_USB_CAPTURE_TX_TYPE_COUNT ||
+      !sanei_usb_capture_range_is_valid(attrs_offset, attrs_size, capture->data_size) ||
+      !sanei_usb_capture_range_is_valid(data_offset, data_size, capture->data_size))
+    {
+      DBG(1, "%s: transaction %llu is corrupted\n", __func__, (unsigned long long) index);
+      return NULL;
+    }
+
+  xmlNode* node = xmlNewNode(NULL, (const xmlChar*) sanei_usb_capture_tx_names[type]);
+  if (flags & SANEI_USB_CAPTURE_TX_HAS_TIME)
+    sanei_usb_capture_set_uint64_attr(node, "time_usec", time_usec);
+  if (flags & SANEI_USB_CAPTURE_TX_HAS_SEQ)
+    sanei_usb_capture_set_uint64_attr(node, "seq", seq);
+
+  const char* attrs = (const char*) capture->data + capture->data_offset + attrs_offset;
+  const char* attrs_end = attrs + attrs_size;
+  while (attrs < attrs_end)
+    {
+      const char* name_end = memchr(attrs, 0, attrs_end - attrs);
+      if (name_end == NULL)
+        break;
+      const char* value = name_end + 1;
+      const char* value_end = value < attrs_end ? memchr(value, 0, attrs_end - value) : NULL;
+      if (value_end == NULL)
+        break;
+
+      xmlNewProp(node, (const xmlChar*) attrs, (const xmlChar*) value);
+      attrs = value_end + 1;
+    }
+
+  if (attrs != attrs_end)
+    {
+      DBG(1, "%s: attributes of transaction %llu are corrupted\n", __func__,
+          (unsigned long long) index);
+      xmlFreeNode(node);
+      return NULL;
+    }
+
+  if (flags & SANEI_USB_CAPTURE_TX_HAS_DATA)
+    node->_private = (void*) entry;
+  return node;
+}
+
+static uint64_t sanei_usb_testing_get_time_usec()
+{
+#ifdef HAVE_SYS_TIME_H
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+#else
+  return (uint64_t) time(NULL) * 1000000;
+#endif
+}
+
 SANE_Status sanei_usb_testing_enable_replay(SANE_String_Const path,
                                             int development_mode)
 {
   testing_mode = sanei_usb_testing_mode_replay;
   testing_development_mode = development_mode;
 
+  const char* timing = getenv("SANE_USB_REPLAY_TIMING");
+  testing_replay_recorded_timing = timing != NULL && strcmp(timing, "recorded") == 0;
+
   // TODO: we'll leak if no one ever inits sane_usb properly
   testing_xml_path = strdup(path);
-  testing_xml_doc = xmlReadFile(testing_xml_path, NULL, 0);
+
+  if (sanei_usb_capture_is_binary(testing_xml_path))
+    {
+      // development mode modifies the capture which is supported only for XML files
+      if (development_mode)
+        {
+          DBG(1, "%s: development mode requires a capture in the XML format\n", __func__);
+          return SANE_STATUS_UNSUPPORTED;
+        }
+
+      SANE_Status status = sanei_usb_capture_open(&testing_capture, testing_xml_path);
+      if (status != SANE_STATUS_GOOD)
+        return status;
+
+      testing_xml_doc = sanei_usb_capture_read_description(&testing_capture);
+    }
+  else
+    {
+      testing_xml_doc = xmlReadFile(testing_xml_path, NULL, 0);
+    }
+
   if (!testing_xml_doc)
     return SANE_STATUS_ACCESS_DENIED;
 
@@ -537,6 +928,7 @@ SANE_Status sanei_usb_testing_enable_record(SANE_String_Const path, SANE_String_
   testing_mode = sanei_usb_testing_mode_record;
   testing_record_backend = strdup(be_name);
   testing_xml_path = strdup(path);
+  testing_record_start_usec = sanei_usb_testing_get_time_usec();
 
   return SANE_STATUS_GOOD;
 }
@@ -670,6 +1062,54 @@ static int sanei_xml_is_known_commands_end(xmlNode* node)
   return xmlStrcmp(node->name, (const xmlChar*)"known_commands_end") == 0;
 }
 
+// Creates the node of the first transaction that is not ignored starting at
+// testing_capture_next_tx
+static xmlNode* sanei_usb_capture_skip_non_tx_nodes()
+{
+  while (testing_capture_next_tx < testing_capture.tx_count)
+    {
+      xmlNode* node = sanei_usb_capture_tx_to_node(&testing_capture,
+                                                   testing_capture_next_tx);
+      if (node == NULL)
+        return NULL;
+
+      if (sanei_xml_is_transaction_ignored(node) == 0)
+        return node;
+
+      xmlFreeNode(node);
+      testing_capture_next_tx++;
+    }
+  return NULL;
+}
+
+// Delays the replay until the time of the given transaction relative to the
+// first transaction has elapsed.
+static void sanei_usb_replay_wait_for_tx_time(xmlNode* node)
+{
+  char* attr = sanei_xml_get_prop(node, "time_usec");
+  if (attr == NULL)
+    return;
+
+  uint64_t tx_usec = strtoull(attr, NULL, 0);
+  xmlFree(attr);
+
+  uint64_t now_usec = sanei_usb_testing_get_time_usec();
+  if (!testing_replay_timing_started)
+    {
+      testing_replay_timing_started = 1;
+      testing_replay_start_usec = now_usec;
+      testing_replay_first_tx_usec = tx_usec;
+      return;
+    }
+
+  if (tx_usec < testing_replay_first_tx_usec)
+    return;
+
+  uint64_t target_usec = testing_replay_start_usec + (tx_usec - testing_replay_first_tx_usec);
+  if (target_usec > now_usec)
+    usleep(target_usec - now_usec);
+}
+
 static xmlNode* sanei_xml_peek_next_tx_node()
 {
   return testing_xml_next_tx_node;
@@ -679,6 +1119,25 @@ static xmlNode* sanei_xml_get_next_tx_node()
 {
   xmlNode* next = testing_xml_next_tx_node;
 
+  if (next != NULL && testing_replay_recorded_timing)
+    sanei_usb_replay_wait_for_tx_time(next);
+
+  if (testing_capture.data != NULL)
+    {
+      // the nodes are not part of any document, so they are freed once
+      // the caller is done with them
+      if (testing_capture_prev_tx_node != NULL)
+        xmlFreeNode(testing_capture_prev_tx_node);
+      testing_capture_prev_tx_node = next;
+
+      if (next != NULL)
+        {
+          testing_capture_next_tx++;
+          testing_xml_next_tx_node = sanei_usb_capture_skip_non_tx_nodes();
+        }
+      return next;
+    }
+
   if (sanei_xml_is_known_commands_end(next))
     {
       testing_append_commands_node = xmlPreviousElementSibling(next);
@@ -763,6 +1222,19 @@ static char* sanei_xml_get_hex_data_slow_path(xmlNode* node, xmlChar* content, x
 // freeing the returned value
 static char* sanei_xml_get_hex_data(xmlNode* node, size_t* size)
 {
+  if (node->_private != NULL)
+    {
+      // the node has been created from a binary capture, the data does not
+      // need to be parsed
+      size_t data_size = 0;
+      const uint8_t* data = sanei_usb_capture_get_tx_data(&testing_capture, node->_private,
+                                                          &data_size);
+      char* ret_data = malloc(data_size + 1);
+      memcpy(ret_data, data, data_size);
+      *size = data_size;
+      return ret_data;
+    }
+
   xmlChar* content = xmlNodeGetContent(node);
 
   // let's overallocate to simplify the implementation. We expect the string
@@ -889,10 +1361,17 @@ static xmlNode* sanei_xml_append_command(xmlNode* sibling,
   return xmlAddNextSibling(sibling, e_command);
 }
 
+static void sanei_xml_set_time_attr(xmlNode* node)
+{
+  sanei_usb_capture_set_uint64_attr(node, "time_usec",
+                                    sanei_usb_testing_get_time_usec() -
+                                    testing_record_start_usec);
+}
+
 static void sanei_xml_command_common_props(xmlNode* node, int endpoint_number,
                                            const char* direction)
 {
-  xmlNewProp(node, (const xmlChar*)"time_usec", (const xmlChar*)"0");
+  sanei_xml_set_time_attr(node);
   sanei_xml_set_uint_attr(node, "seq", ++testing_last_known_seq);
   sanei_xml_set_uint_attr(node, "endpoint_number", endpoint_number);
   xmlNewProp(node, (const xmlChar*)"direction", (const xmlChar*)direction);
@@ -1029,6 +1508,264 @@ static int sanei_usb_check_data_equal(xmlNode* node,
   return 0;
 }
 
+// returns 1 if the text contains only hex digits and whitespace
+static int sanei_xml_is_hex_text(const xmlChar* text)
+{
+  for (; *text != 0; ++text)
+    {
+      if (sanei_xml_char_types[(uint8_t)*text] == CHAR_TYPE_INVALID)
+        return 0;
+    }
+  return 1;
+}
+
+static int sanei_usb_capture_tx_type(xmlNode* node)
+{
+  for (unsigned i = 0; i < SANEI_USB_CAPTURE_TX_TYPE_COUNT; ++i)
+    {
+      if (xmlStrcmp(node->name, (const xmlChar*) sanei_usb_capture_tx_names[i]) == 0)
+        return i;
+    }
+  return -1;
+}
+
+// Appends the given data to the buffer, growing it as needed. Returns 0 if
+// out of memory.
+static int sanei_usb_capture_buffer_append(uint8_t** buffer, size_t* size, size_t* capacity,
+                                           const void* data, size_t data_size)
+{
+  if (*size + data_size > *capacity)
+    {
+      size_t new_capacity = *capacity > 0 ? *capacity * 2 : 4096;
+      while (new_capacity < *size + data_size)
+        new_capacity *= 2;
+      uint8_t* new_buffer = realloc(*buffer, new_capacity);
+      if (new_buffer == NULL)
+        return 0;
+      *buffer = new_buffer;
+      *capacity = new_capacity;
+    }
+  memcpy(*buffer + *size, data, data_size);
+  *size += data_size;
+  return 1;
+}
+
+// Writes the capture in the given XML document to a file in the binary format
+static SANE_Status sanei_usb_capture_write(xmlDoc* doc, const char* path)
+{
+  xmlNode* el_root = xmlDocGetRootElement(doc);
+  if (el_root == NULL ||
+      xmlStrcmp(el_root->name, (const xmlChar*)"device_capture") != 0)
+    {
+      DBG(1, "%s: the document is not USB capture\n", __func__);
+      return SANE_STATUS_INVAL;
+    }
+
+  xmlNode* el_transactions =
+      sanei_xml_find_first_child_with_name(el_root, "transactions");
+  if (el_transactions == NULL)
+    {
+      DBG(1, "%s: could not find transactions node\n", __func__);
+      return SANE_STATUS_INVAL;
+    }
+
+  // the description is the document without the transactions
+  xmlDoc* description_doc = xmlNewDoc((const xmlChar*)"1.0");
+  xmlNode* description_root = xmlCopyNode(el_root, 2);
+  xmlDocSetRootElement(description_doc, description_root);
+  for (xmlNode* child = el_root->children; child != NULL; child = child->next)
+    {
+      if (child == el_transactions)
+        xmlAddChild(description_root, xmlNewNode(NULL, (const xmlChar*)"transactions"));
+      else
+        xmlAddChild(description_root, xmlCopyNode(child, 1));
+    }
+
+  xmlChar* description = NULL;
+  int description_size = 0;
+  xmlDocDumpMemory(description_doc, &description, &description_size);
+  xmlFreeDoc(description_doc);
+
+  FILE* f = fopen(path, "wb");
+  if (f == NULL)
+    {
+      DBG(1, "%s: could not open %s for writing\n", __func__, path);
+      xmlFree(description);
+      return SANE_STATUS_ACCESS_DENIED;
+    }
+
+  uint8_t header[SANEI_USB_CAPTURE_HEADER_SIZE];
+  memset(header, 0, sizeof(header));
+  fwrite(header, 1, sizeof(header), f);
+  fwrite(description, 1, description_size, f);
+  xmlFree(description);
+
+  uint64_t data_offset = SANEI_USB_CAPTURE_HEADER_SIZE + description_size;
+  uint64_t data_size = 0;
+  uint64_t tx_count = 0;
+
+  uint8_t* index = NULL;
+  size_t index_size = 0;
+  size_t index_capacity = 0;
+
+  uint8_t* attrs = NULL;
+  size_t attrs_capacity = 0;
+
+  SANE_Status status = SANE_STATUS_GOOD;
+
+  for (xmlNode* node = xmlFirstElementChild(el_transactions); node != NULL;
+       node = xmlNextElementSibling(node))
+    {
+      int type = sanei_usb_capture_tx_type(node);
+      if (type < 0)
+        {
+          DBG(3, "%s: skipping unknown node %s\n", __func__, (const char*) node->name);
+          continue;
+        }
+
+      uint32_t flags = 0;
+      uint32_t seq = 0;
+      uint64_t time_usec = 0;
+      size_t attrs_size = 0;
+
+      for (xmlAttr* attr = node->properties; attr != NULL; attr = attr->next)
+        {
+          char* value = sanei_xml_get_prop(node, (const char*) attr->name);
+          if (value == NULL)
+            continue;
+
+          if (xmlStrcmp(attr->name, (const xmlChar*)"seq") == 0)
+            {
+              flags |= SANEI_USB_CAPTURE_TX_HAS_SEQ;
+              seq = strtoul(value, NULL, 0);
+            }
+          else if (xmlStrcmp(attr->name, (const xmlChar*)"time_usec") == 0)
+            {
+              flags |= SANEI_USB_CAPTURE_TX_HAS_TIME;
+              time_usec = strtoull(value, NULL, 0);
+            }
+          else if (!sanei_usb_capture_buffer_append(&attrs, &attrs_size, &attrs_capacity,
+                                                    attr->name,
+                                                    strlen((const char*) attr->name) + 1) ||
+                   !sanei_usb_capture_buffer_append(&attrs, &attrs_size, &attrs_capacity,
+                                                    value, strlen(value) + 1))
+            {
+              status = SANE_STATUS_NO_MEM;
+            }
+          xmlFree(value);
+        }
+
+      uint64_t attrs_offset = data_size;
+      fwrite(attrs, 1, attrs_size, f);
+      data_size += attrs_size;
+
+      uint64_t tx_data_offset = data_size;
+      size_t tx_data_size = 0;
+      if (node->children != NULL)
+        {
+          xmlChar* content = xmlNodeGetContent(node);
+          int is_hex = sanei_xml_is_hex_text(content);
+          xmlFree(content);
+          if (!is_hex)
+            {
+              // e.g. "(unknown read of size N)" placeholders written in development mode
+              FAIL_TEST_TX(__func__, node, "transaction data is not hex data\n");
+              status = SANE_STATUS_INVAL;
+              break;
+            }
+
+          char* tx_data = sanei_xml_get_hex_data(node, &tx_data_size);
+          fwrite(tx_data, 1, tx_data_size, f);
+          free(tx_data);
+          data_size += tx_data_size;
+          flags |= SANEI_USB_CAPTURE_TX_HAS_DATA;
+        }
+
+      uint8_t entry[SANEI_USB_CAPTURE_TX_SIZE];
+      sanei_usb_capture_put_u32(entry, type);
+      sanei_usb_capture_put_u32(entry + 4, seq);
+      sanei_usb_capture_put_u64(entry + 8, time_usec);
+      sanei_usb_capture_put_u64(entry + 16, attrs_offset);
+      sanei_usb_capture_put_u32(entry + 24, attrs_size);
+      sanei_usb_capture_put_u32(entry + 28, flags);
+      sanei_usb_capture_put_u64(entry + 32, tx_data_offset);
+      sanei_usb_capture_put_u64(entry + 40, tx_data_size);
+
+      if (!sanei_usb_capture_buffer_append(&index, &index_size, &index_capacity,
+                                           entry, sizeof(entry)))
+        status = SANE_STATUS_NO_MEM;
+
+      if (status != SANE_STATUS_GOOD)
+        break;
+      tx_count++;
+    }
+
+  uint64_t index_offset = data_offset + data_size;
+  fwrite(index, 1, index_size, f);
+  free(index);
+  free(attrs);
+
+  memcpy(header, SANEI_USB_CAPTURE_MAGIC, SANEI_USB_CAPTURE_MAGIC_SIZE);
+  sanei_usb_capture_put_u32(header + 8, SANEI_USB_CAPTURE_VERSION);
+  sanei_usb_capture_put_u64(header + 16, SANEI_USB_CAPTURE_HEADER_SIZE);
+  sanei_usb_capture_put_u64(header + 24, description_size);
+  sanei_usb_capture_put_u64(header + 32, tx_count);
+  sanei_usb_capture_put_u64(header + 40, index_offset);
+  sanei_usb_capture_put_u64(header + 48, data_offset);
+  sanei_usb_capture_put_u64(header + 56, data_size);
+
+  fseek(f, 0, SEEK_SET);
+  fwrite(header, 1, sizeof(header), f);
+
+  if (ferror(f))
+    {
+      DBG(1, "%s: could not write %s\n", __func__, path);
+      status = SANE_STATUS_IO_ERROR;
+    }
+  fclose(f);
+  return status;
+}
+
+// Converts the given binary capture to a document in the XML format
+static xmlDoc* sanei_usb_capture_to_xml(const struct sanei_usb_capture* capture)
+{
+  xmlDoc* doc = sanei_usb_capture_read_description(capture);
+  if (doc == NULL)
+    return NULL;
+
+  xmlNode* el_transactions =
+      sanei_xml_find_first_child_with_name(xmlDocGetRootElement(doc), "transactions");
+  if (el_transactions == NULL)
+    {
+      DBG(1, "%s: could not find transactions node\n", __func__);
+      xmlFreeDoc(doc);
+      return NULL;
+    }
+
+  xmlNode* last_node = xmlAddChild(el_transactions, xmlNewText((const xmlChar*)""));
+  for (uint64_t i = 0; i < capture->tx_count; ++i)
+    {
+      xmlNode* node = sanei_usb_capture_tx_to_node(capture, i);
+      if (node == NULL)
+        {
+          xmlFreeDoc(doc);
+          return NULL;
+        }
+
+      if (node->_private != NULL)
+        {
+          size_t data_size = 0;
+          const uint8_t* data = sanei_usb_capture_get_tx_data(capture, node->_private,
+                                                              &data_size);
+          sanei_xml_set_hex_data(node, (const char*) data, data_size);
+          node->_private = NULL;
+        }
+      last_node = sanei_xml_append_command(last_node, 1, node);
+    }
+  xmlAddNextSibling(last_node, xmlNewText((const xmlChar*)"\n  "));
+  return doc;
+}
+
 SANE_String sanei_usb_testing_get_backend()
 {
   if (testing_xml_doc == NULL)
@@ -1287,6 +2024,18 @@ static SANE_Status sanei_usb_testing_init()
                                                 "configuration");
     }
 
+  if (testing_capture.data != NULL)
+    {
+      testing_capture_next_tx = 0;
+      testing_xml_next_tx_node = sanei_usb_capture_skip_non_tx_nodes();
+      if (testing_xml_next_tx_node == NULL)
+        {
+          DBG(1, "%s: no transactions within capture\n", __func__);
+          return SANE_STATUS_INVAL;
+        }
+      return SANE_STATUS_GOOD;
+    }
+
   xmlNode* el_transactions =
       sanei_xml_find_first_child_with_name(el_root, "transactions");
 
@@ -1319,7 +2068,21 @@ static void sanei_usb_testing_exit()
           xmlAddNextSibling(testing_append_commands_node, xmlNewText((const xmlChar*)"\n  "));
           free(testing_record_backend);
         }
-      xmlSaveFileEnc(testing_xml_path, testing_xml_doc, "UTF-8");
+      if (testing_mode == sanei_usb_testing_mode_record &&
+          sanei_usb_capture_has_binary_suffix(testing_xml_path))
+        sanei_usb_capture_write(testing_xml_doc, testing_xml_path);
+      else
+        xmlSaveFileEnc(testing_xml_path, testing_xml_doc, "UTF-8");
+    }
+  if (testing_capture.data != NULL)
+    {
+      // the transaction nodes created from the binary capture are not part of
+      // testing_xml_doc
+      if (testing_capture_prev_tx_node != NULL)
+        xmlFreeNode(testing_capture_prev_tx_node);
+      if (testing_xml_next_tx_node != NULL)
+        xmlFreeNode(testing_xml_next_tx_node);
+      sanei_usb_capture_close(&testing_capture);
     }
   xmlFreeDoc(testing_xml_doc);
   free(testing_xml_path);
@@ -1336,6 +2099,55 @@ static void sanei_usb_testing_exit()
   testing_xml_path = NULL;
   testing_xml_doc = NULL;
   testing_xml_next_tx_node = NULL;
+
+  testing_capture_next_tx = 0;
+  testing_capture_prev_tx_node = NULL;
+  testing_record_start_usec = 0;
+  testing_replay_recorded_timing = 0;
+  testing_replay_start_usec = 0;
+  testing_replay_first_tx_usec = 0;
+  testing_replay_timing_started = 0;
+}
+
+SANE_Status sanei_usb_testing_convert_capture(SANE_String_Const in_path,
+                                              SANE_String_Const out_path)
+{
+  xmlDoc* doc = NULL;
+
+  if (sanei_usb_capture_is_binary(in_path))
+    {
+      struct sanei_usb_capture capture;
+      SANE_Status status = sanei_usb_capture_open(&capture, in_path);
+      if (status != SANE_STATUS_GOOD)
+        return status;
+
+      doc = sanei_usb_capture_to_xml(&capture);
+      sanei_usb_capture_close(&capture);
+    }
+  else
+    {
+      doc = xmlReadFile(in_path, NULL, 0);
+    }
+
+  if (doc == NULL)
+    {
+      DBG(1, "%s: could not read %s\n", __func__, in_path);
+      return SANE_STATUS_INVAL;
+    }
+
+  SANE_Status status = SANE_STATUS_GOOD;
+  if (sanei_usb_capture_has_binary_suffix(out_path))
+    {
+      status = sanei_usb_capture_write(doc, out_path);
+    }
+  else if (xmlSaveFileEnc(out_path, doc, "UTF-8") < 0)
+    {
+      DBG(1, "%s: could not write %s\n", __func__, out_path);
+      status = SANE_STATUS_IO_ERROR;
+    }
+
+  xmlFreeDoc(doc);
+  return status;
 }
 #else // WITH_USB_RECORD_REPLAY
 SANE_Status sanei_usb_testing_enable_replay(SANE_String_Const path,
@@ -1375,6 +2187,16 @@ void sanei_usb_testing_record_message(SANE_String_Const message)
 {
   (void) message;
 }
+
+SANE_Status sanei_usb_testing_convert_capture(SANE_String_Const in_path,
+                                              SANE_String_Const out_path)
+{
+  (void) in_path;
+  (void) out_path;
+
+  DBG(1, "USB record-replay mode support is missing\n");
+  return SANE_STATUS_UNSUPPORTED;
+}
 #endif // WITH_USB_RECORD_REPLAY
 
 void
@@ -4870,8 +5692,8 @@ sanei_usb_record_get_descriptor(SANE_Int dn,
 
   xmlNode* e_tx = xmlNewNode(NULL, (const xmlChar*)"get_descriptor");
 
-  xmlNewProp(e_tx, (const xmlChar*)"time_usec", (const xmlChar*)"0");
-  sanei_xml_set_uint_attr(node, "seq", ++testing_last_known_seq);
+  sanei_xml_set_time_attr(e_tx);
+  sanei_xml_set_uint_attr(e_tx, "seq", ++testing_last_known_seq);
 
   sanei_xml_set_hex_attr(e_tx, "descriptor_type", desc->desc_type);
   sanei_xml_set_hex_attr(e_tx, "bcd_usb", desc->bcd_usb);
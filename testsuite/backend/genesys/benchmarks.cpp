@@ -0,0 +1,281 @@
+/* sane - Scanner Access Now Easy.
+
+   Copyright (C) 2026 agent <agent@local>
+
+   This file is part of the SANE package.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#define DEBUG_DECLARE_ONLY
+
+#include "image_pipeline_reference.h"
+#include "table_index_reference.h"
+
+#include "../../../backend/genesys/genesys.h"
+#include "../../../backend/genesys/image_pipeline.h"
+#include "../../../backend/genesys/low.h"
+#include "../../../backend/genesys/table_index.h"
+#include "../../../backend/genesys/test_settings.h"
+#include "../../../include/sane/saneopts.h"
+
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <unordered_set>
+
+// Measures the speed of optimized code paths against their reference implementations
+
+namespace genesys {
+
+// Returns the time in milliseconds that the given function takes to run
+template<class F>
+double measure_time_ms(F&& function)
+{
+    auto begin = std::chrono::steady_clock::now();
+    function();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - begin).count();
+}
+
+bool check_same_output(const char* name, const std::vector<std::uint8_t>& data,
+                       const std::vector<std::uint8_t>& expected_data)
+{
+    if (data != expected_data) {
+        std::cerr << name << ": output differs from the reference implementation\n";
+        return false;
+    }
+    return true;
+}
+
+// Compares the format-specialized row functions against per-pixel dispatch on a 16-bit color
+// image of 4800 dpi width
+bool benchmark_node_desegment_and_pixel_shift_lines()
+{
+    auto format = PixelFormat::RGB161616;
+    std::size_t width = 4800 * 8;
+    std::size_t height = 32;
+    std::vector<unsigned> segment_order = { 0, 2, 1, 3 };
+    std::size_t segment_pixels = width / segment_order.size();
+    std::vector<std::size_t> shifts = { 0, 4 };
+
+    auto in_data = create_random_data(get_pixel_row_bytes(format, width) * height, 3);
+
+    std::vector<std::uint8_t> expected_data;
+    auto desegment_reference_ms = measure_time_ms([&]()
+    {
+        expected_data = desegment_reference(in_data, width, height, format, width,
+                                            segment_order, segment_pixels);
+    });
+
+    std::vector<std::uint8_t> out_data;
+    auto desegment_ms = measure_time_ms([&]()
+    {
+        ImagePipelineStack stack;
+        stack.push_first_node<ImagePipelineNodeArraySource>(width, height, format, in_data);
+        stack.push_node<ImagePipelineNodeDesegment>(width, segment_order, segment_pixels, 1, 1);
+        out_data = stack.get_all_data();
+    });
+    bool success = check_same_output("desegment", out_data, expected_data);
+
+    auto shift_reference_ms = measure_time_ms([&]()
+    {
+        expected_data = pixel_shift_lines_reference(in_data, width, height, format, shifts);
+    });
+
+    auto shift_ms = measure_time_ms([&]()
+    {
+        ImagePipelineStack stack;
+        stack.push_first_node<ImagePipelineNodeArraySource>(width, height, format, in_data);
+        stack.push_node<ImagePipelineNodePixelShiftLines>(shifts);
+        out_data = stack.get_all_data();
+    });
+    success &= check_same_output("pixel shift lines", out_data, expected_data);
+
+    std::cout << "desegment RGB161616 " << width << "x" << height
+              << ": per-pixel dispatch " << desegment_reference_ms << " ms, node "
+              << desegment_ms << " ms\n";
+    std::cout << "pixel shift lines RGB161616 " << width << "x" << height
+              << ": per-pixel dispatch " << shift_reference_ms << " ms, node "
+              << shift_ms << " ms\n";
+    return success;
+}
+
+// Compares scaling with precomputed weights against per-channel dispatch for an 8.5 inch wide
+// scan at common resolution ratios
+bool benchmark_node_scale_rows()
+{
+    std::size_t height = 32;
+    std::vector<std::pair<unsigned, unsigned>> resolutions = {
+        { 1200, 300 }, { 2400, 600 }, { 600, 1200 }
+    };
+
+    bool success = true;
+    for (auto format : { PixelFormat::RGB888, PixelFormat::RGB161616 }) {
+        for (const auto& resolution : resolutions) {
+            std::size_t src_width = resolution.first * 17 / 2;
+            std::size_t dst_width = resolution.second * 17 / 2;
+
+            auto in_data = create_random_data(get_pixel_row_bytes(format, src_width) * height, 7);
+
+            std::vector<std::uint8_t> expected_data;
+            auto reference_ms = measure_time_ms([&]()
+            {
+                expected_data = scale_rows_reference(in_data, src_width, height, format,
+                                                     dst_width);
+            });
+
+            std::vector<std::uint8_t> out_data;
+            auto node_ms = measure_time_ms([&]()
+            {
+                ImagePipelineStack stack;
+                stack.push_first_node<ImagePipelineNodeArraySource>(src_width, height, format,
+                                                                    in_data);
+                stack.push_node<ImagePipelineNodeScaleRows>(dst_width);
+                out_data = stack.get_all_data();
+            });
+            success &= check_same_output("scale rows", out_data, expected_data);
+
+            std::cout << "scale rows " << get_pixel_format_depth(format) << "-bit "
+                      << resolution.first << "->" << resolution.second
+                      << " dpi: per-channel dispatch " << reference_ms << " ms, node "
+                      << node_ms << " ms\n";
+        }
+    }
+    return success;
+}
+
+// Compares the sensor table index against the linear search for every sensor, scan method and
+// resolution in the table
+bool benchmark_sensor_table_index()
+{
+    genesys_init_sensor_tables();
+
+    auto ids_and_methods = get_sensor_ids_and_methods();
+    auto resolutions = get_test_resolutions();
+
+    bool success = true;
+    auto run_lookups = [&](const std::function<Genesys_Sensor*(SensorId, unsigned, unsigned,
+                                                               ScanMethod)>& find)
+    {
+        std::size_t found_count = 0;
+        for (const auto& id_method : ids_and_methods) {
+            for (auto dpi : resolutions) {
+                for (unsigned channels : { 1, 3 }) {
+                    if (find(id_method.first, dpi, channels, id_method.second)) {
+                        found_count++;
+                    }
+                }
+            }
+        }
+        if (found_count == 0) {
+            std::cerr << "sensor lookup: no sensors found\n";
+            success = false;
+        }
+    };
+
+    auto reference_ms = measure_time_ms([&]()
+    {
+        run_lookups(find_sensor_reference);
+    });
+    auto index_ms = measure_time_ms([&]()
+    {
+        run_lookups([](SensorId sensor_id, unsigned dpi, unsigned channels, ScanMethod method)
+        {
+            return s_sensor_index->find(sensor_id, dpi, channels, method);
+        });
+    });
+
+    std::cout << "sensor lookup (" << s_sensors->size() << " sensors, "
+              << ids_and_methods.size() * resolutions.size() * 2 << " lookups): linear search "
+              << reference_ms << " ms, index " << index_ms << " ms\n";
+    return success;
+}
+
+// Measures how long a resolution change via sane_control_option() takes on each tested scanner
+// model, going through all resolutions of the initially selected scan method
+bool benchmark_resolution_change()
+{
+    // sane_init() rebuilds the device tables, thus the devices are collected up front
+    genesys_init_usb_device_tables();
+    std::vector<UsbDeviceEntry> usb_devices;
+    std::unordered_set<std::string> model_names;
+    for (const auto& usb_dev : *s_usb_devices) {
+        const auto& model = usb_dev.model();
+        if (!has_flag(model.flags, ModelFlag::UNTESTED) && model_names.insert(model.name).second) {
+            usb_devices.push_back(usb_dev);
+        }
+    }
+
+    std::map<AsicType, std::pair<std::size_t, double>> changes_and_ms;
+    for (const auto& usb_dev : usb_devices) {
+        enable_testing_mode(usb_dev.vendor_id(), usb_dev.product_id(), usb_dev.bcd_device(),
+                            [](const Genesys_Device&, TestScannerInterface&,
+                               const std::string&) {});
+        SANE_Handle handle;
+        TIE(sane_init(nullptr, nullptr));
+        TIE(sane_open(get_testing_device_name().c_str(), &handle));
+
+        SANE_Int option_count = 0;
+        TIE(sane_control_option(handle, 0, SANE_ACTION_GET_VALUE, &option_count, nullptr));
+        SANE_Int resolution_option = 0;
+        for (SANE_Int i = 1; i < option_count; ++i) {
+            const auto* option = sane_get_option_descriptor(handle, i);
+            if (option->name != nullptr &&
+                std::strcmp(option->name, SANE_NAME_SCAN_RESOLUTION) == 0)
+            {
+                resolution_option = i;
+            }
+        }
+
+        auto* s = reinterpret_cast<Genesys_Scanner*>(handle);
+        auto asic_type = s->dev->model->asic_type;
+        auto resolutions = s->dev->model->get_resolutions(s->scan_method);
+        auto ms = measure_time_ms([&]()
+        {
+            for (SANE_Int resolution : resolutions) {
+                TIE(sane_control_option(handle, resolution_option, SANE_ACTION_SET_VALUE,
+                                        &resolution, nullptr));
+            }
+        });
+
+        sane_close(handle);
+        sane_exit();
+        disable_testing_mode();
+
+        auto& totals = changes_and_ms[asic_type];
+        totals.first += resolutions.size();
+        totals.second += ms;
+    }
+
+    for (const auto& kv : changes_and_ms) {
+        std::cout << "resolution change " << kv.first << ": "
+                  << kv.second.second * 1000 / kv.second.first << " us\n";
+    }
+    return true;
+}
+
+} // namespace genesys
+
+int main()
+{
+    bool success = true;
+    success &= genesys::benchmark_node_desegment_and_pixel_shift_lines();
+    success &= genesys::benchmark_node_scale_rows();
+    success &= genesys::benchmark_sensor_table_index();
+    success &= genesys::benchmark_resolution_change();
+    return success ? 0 : 1;
+}
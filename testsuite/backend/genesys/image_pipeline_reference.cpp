@@ -0,0 +1,148 @@
+/* sane - Scanner Access Now Easy.
+
+   Copyright (C) 2026 agent <agent@local>
+
+   This file is part of the SANE package.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#define DEBUG_DECLARE_ONLY
+
+#include "image_pipeline_reference.h"
+
+#include <algorithm>
+#include <random>
+
+namespace genesys {
+
+std::vector<std::uint8_t> create_random_data(std::size_t size, unsigned seed)
+{
+    std::mt19937 rng{seed};
+    std::uniform_int_distribution<unsigned> dist{0, 255};
+
+    std::vector<std::uint8_t> data;
+    data.resize(size);
+    for (auto& value : data) {
+        value = dist(rng);
+    }
+    return data;
+}
+
+std::vector<std::uint8_t> desegment_reference(const std::vector<std::uint8_t>& in_data,
+                                              std::size_t width, std::size_t height,
+                                              PixelFormat format, std::size_t output_width,
+                                              const std::vector<unsigned>& segment_order,
+                                              std::size_t segment_pixels)
+{
+    auto in_row_bytes = get_pixel_row_bytes(format, width);
+    auto out_row_bytes = get_pixel_row_bytes(format, output_width);
+    auto segment_count = segment_order.size();
+
+    std::vector<std::uint8_t> out_data;
+    out_data.resize(out_row_bytes * height);
+
+    for (std::size_t y = 0; y < height; ++y) {
+        const auto* in_row = in_data.data() + y * in_row_bytes;
+        auto* out_row = out_data.data() + y * out_row_bytes;
+        for (std::size_t igroup = 0; igroup < output_width / segment_count; ++igroup) {
+            for (std::size_t isegment = 0; isegment < segment_count; ++isegment) {
+                auto in_x = igroup + segment_pixels * segment_order[isegment];
+                auto pixel = get_raw_pixel_from_row(in_row, in_x, format);
+                set_raw_pixel_to_row(out_row, igroup * segment_count + isegment, pixel, format);
+            }
+        }
+    }
+    return out_data;
+}
+
+std::vector<std::uint8_t> pixel_shift_lines_reference(const std::vector<std::uint8_t>& in_data,
+                                                      std::size_t width, std::size_t height,
+                                                      PixelFormat format,
+                                                      const std::vector<std::size_t>& shifts)
+{
+    auto row_bytes = get_pixel_row_bytes(format, width);
+    auto extra_height = *std::max_element(shifts.begin(), shifts.end());
+    auto out_height = height - extra_height;
+
+    std::vector<std::uint8_t> out_data;
+    out_data.resize(row_bytes * out_height);
+
+    for (std::size_t y = 0; y < out_height; ++y) {
+        for (std::size_t x = 0; x < width; ++x) {
+            const auto* in_row = in_data.data() + (y + shifts[x % shifts.size()]) * row_bytes;
+            auto pixel = get_raw_pixel_from_row(in_row, x, format);
+            set_raw_pixel_to_row(out_data.data() + y * row_bytes, x, pixel, format);
+        }
+    }
+    return out_data;
+}
+
+std::vector<std::uint8_t> scale_rows_reference(const std::vector<std::uint8_t>& in_data,
+                                               std::size_t src_width, std::size_t height,
+                                               PixelFormat format, std::size_t dst_width)
+{
+    auto src_row_bytes = get_pixel_row_bytes(format, src_width);
+    auto dst_row_bytes = get_pixel_row_bytes(format, dst_width);
+    auto channels = get_pixel_channels(format);
+
+    std::vector<std::uint8_t> out_data;
+    out_data.resize(dst_row_bytes * height);
+
+    for (std::size_t y = 0; y < height; ++y) {
+        const auto* src_data = in_data.data() + y * src_row_bytes;
+        auto* dst_data = out_data.data() + y * dst_row_bytes;
+
+        if (src_width > dst_width) {
+            std::uint32_t counter = src_width / 2;
+            unsigned src_x = 0;
+            for (unsigned dst_x = 0; dst_x < dst_width; dst_x++) {
+                unsigned avg[3] = {0, 0, 0};
+                unsigned count = 0;
+                while (counter < src_width && src_x < src_width) {
+                    counter += dst_width;
+                    for (unsigned c = 0; c < channels; c++) {
+                        avg[c] += get_raw_channel_from_row(src_data, src_x, c, format);
+                    }
+                    src_x++;
+                    count++;
+                }
+                counter -= src_width;
+
+                for (unsigned c = 0; c < channels; c++) {
+                    set_raw_channel_to_row(dst_data, dst_x, c, avg[c] / count, format);
+                }
+            }
+        } else {
+            std::uint32_t counter = dst_width / 2;
+            unsigned dst_x = 0;
+            for (unsigned src_x = 0; src_x < src_width; src_x++) {
+                while ((counter < dst_width || src_x + 1 == src_width) && dst_x < dst_width) {
+                    counter += src_width;
+                    for (unsigned c = 0; c < channels; c++) {
+                        set_raw_channel_to_row(dst_data, dst_x, c,
+                                               get_raw_channel_from_row(src_data, src_x, c,
+                                                                        format),
+                                               format);
+                    }
+                    dst_x++;
+                }
+                counter -= dst_width;
+            }
+        }
+    }
+    return out_data;
+}
+
+} // namespace genesys
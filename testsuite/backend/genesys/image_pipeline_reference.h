@@ -0,0 +1,56 @@
+/* sane - Scanner Access Now Easy.
+
+   Copyright (C) 2026 agent <agent@local>
+
+   This file is part of the SANE package.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef SANE_TESTSUITE_BACKEND_GENESYS_IMAGE_PIPELINE_REFERENCE_H
+#define SANE_TESTSUITE_BACKEND_GENESYS_IMAGE_PIPELINE_REFERENCE_H
+
+#include "../../../backend/genesys/enums.h"
+#include "../../../backend/genesys/image_pixel.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace genesys {
+
+std::vector<std::uint8_t> create_random_data(std::size_t size, unsigned seed);
+
+// The reference implementations below copy each pixel via the generic functions that dispatch
+// on the pixel format at runtime. They are used to verify the image pipeline nodes in the unit
+// tests and as the baseline in the benchmarks.
+std::vector<std::uint8_t> desegment_reference(const std::vector<std::uint8_t>& in_data,
+                                              std::size_t width, std::size_t height,
+                                              PixelFormat format, std::size_t output_width,
+                                              const std::vector<unsigned>& segment_order,
+                                              std::size_t segment_pixels);
+
+std::vector<std::uint8_t> pixel_shift_lines_reference(const std::vector<std::uint8_t>& in_data,
+                                                      std::size_t width, std::size_t height,
+                                                      PixelFormat format,
+                                                      const std::vector<std::size_t>& shifts);
+
+// Scales rows by averaging or duplicating pixels one channel at a time. The distribution of the
+// pixels is the same as in ImagePipelineNodeScaleRows.
+std::vector<std::uint8_t> scale_rows_reference(const std::vector<std::uint8_t>& in_data,
+                                               std::size_t src_width, std::size_t height,
+                                               PixelFormat format, std::size_t dst_width);
+
+} // namespace genesys
+
+#endif // SANE_TESTSUITE_BACKEND_GENESYS_IMAGE_PIPELINE_REFERENCE_H
@@ -30,11 +30,18 @@
 #include "../../../backend/genesys/utilities.h"
 #include "../../../include/sane/saneopts.h"
 #include "sys/stat.h"
+#include "sys/wait.h"
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <fstream>
+#include <map>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <unordered_set>
 
 #define XSTR(s) STR(s)
@@ -248,7 +255,30 @@ void print_checkpoint(const genesys::Genesys_Device& dev,
     out << "\n";
 }
 
-void run_single_test_scan(const TestConfig& config, std::stringstream& out)
+// The number of USB transactions used to write registers during sane_start()
+struct RegisterWriteStats
+{
+    genesys::AsicType asic_type = genesys::AsicType::UNKNOWN;
+    std::size_t transactions = 0;
+    std::size_t unoptimized_transactions = 0;
+};
+
+// The wall time spent in scan setup during sane_start()
+struct ScanSetupTimes
+{
+    double compute_session_ms = 0;
+    double init_regs_for_scan_ms = 0;
+};
+
+// Statistics collected while running a single test. Note that this is sent from worker processes
+// as raw bytes, so it must stay trivially copyable.
+struct TestStats
+{
+    RegisterWriteStats register_writes;
+    ScanSetupTimes setup_times;
+};
+
+void run_single_test_scan(const TestConfig& config, std::stringstream& out, TestStats& stats)
 {
     auto print_checkpoint_wrapper = [&](const genesys::Genesys_Device& dev,
                                         genesys::TestScannerInterface& iface,
@@ -279,8 +309,28 @@ void run_single_test_scan(const TestConfig& config, std::stringstream& out)
     options.set_value_int(SANE_NAME_SCAN_RESOLUTION, config.resolution);
     options.close();
 
+    auto* dev = reinterpret_cast<genesys::Genesys_Scanner*>(handle)->dev;
+    auto& iface = static_cast<genesys::TestScannerInterface&>(*dev->interface);
+    iface.reset_register_write_transactions();
+    iface.reset_recorded_times();
+
     TIE(sane_start(handle));
 
+    stats.register_writes.asic_type = dev->model->asic_type;
+    stats.register_writes.transactions = iface.register_write_transactions();
+    stats.register_writes.unoptimized_transactions =
+            iface.unoptimized_register_write_transactions();
+
+    const auto& times_ms = iface.recorded_times_ms();
+    auto compute_session_it = times_ms.find("compute_session");
+    if (compute_session_it != times_ms.end()) {
+        stats.setup_times.compute_session_ms = compute_session_it->second;
+    }
+    auto init_regs_it = times_ms.find("init_regs_for_scan");
+    if (init_regs_it != times_ms.end()) {
+        stats.setup_times.init_regs_for_scan_ms = init_regs_it->second;
+    }
+
     SANE_Parameters params;
     TIE(sane_get_parameters(handle, &params));
 
@@ -340,6 +390,7 @@ struct TestResult
     bool success = true;
     TestConfig config;
     std::string failure_message;
+    TestStats stats;
 };
 
 TestResult perform_single_test(const TestConfig& config, const std::string& check_directory,
@@ -351,7 +402,7 @@ TestResult perform_single_test(const TestConfig& config, const std::string& chec
     std::stringstream result_output_stream;
     std::string exception_output;
     try {
-        run_single_test_scan(config, result_output_stream);
+        run_single_test_scan(config, result_output_stream, test_result.stats);
     } catch (const std::exception& exc) {
         exception_output = std::string("got exception: ") + typeid(exc).name() +
                            " with message\n" + exc.what() + "\n";
@@ -452,10 +503,146 @@ std::vector<TestConfig> get_all_test_configs()
     return configs;
 }
 
+// The result of a single test as sent from a worker process to the main process
+struct WorkerTestResult
+{
+    std::uint32_t index = 0;
+    bool success = false;
+    TestStats stats;
+};
+
+void write_all(int fd, const void* data, std::size_t size)
+{
+    const auto* bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        auto written = write(fd, bytes, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error("Could not write test result");
+        }
+        bytes += written;
+        size -= written;
+    }
+}
+
+bool read_all(int fd, void* data, std::size_t size)
+{
+    auto* bytes = static_cast<char*>(data);
+    while (size > 0) {
+        auto got = read(fd, bytes, size);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return false;
+        }
+        bytes += got;
+        size -= got;
+    }
+    return true;
+}
+
+TestResult perform_and_report_single_test(const std::vector<TestConfig>& configs,
+                                          std::size_t index,
+                                          const std::string& check_directory,
+                                          const std::string& output_directory)
+{
+    auto result = perform_single_test(configs[index], check_directory, output_directory);
+
+    // Several worker processes may write to stderr concurrently, so write each report at once
+    std::stringstream report;
+    report << "(" << index << "/" << configs.size() << "): "
+           << (result.success ? "SUCCESS: " : "FAIL: ")
+           << result.config.name() << "\n";
+    if (!result.success) {
+        report << result.failure_message;
+    }
+    std::cerr << report.str() << std::flush;
+    return result;
+}
+
+// Runs the tests with the given indices. The backend keeps global state, so tests that run in
+// parallel are executed in separate worker processes, each of which runs every job_count-th test.
+std::map<std::size_t, TestResult> run_tests(const std::vector<TestConfig>& configs,
+                                            const std::vector<std::size_t>& indices,
+                                            unsigned job_count,
+                                            const std::string& check_directory,
+                                            const std::string& output_directory)
+{
+    std::map<std::size_t, TestResult> results;
+
+    if (job_count <= 1 || indices.size() <= 1) {
+        for (auto index : indices) {
+            results[index] = perform_and_report_single_test(configs, index, check_directory,
+                                                            output_directory);
+        }
+        return results;
+    }
+
+    job_count = std::min<std::size_t>(job_count, indices.size());
+
+    std::vector<pid_t> workers;
+    std::vector<int> worker_fds;
+    for (unsigned job = 0; job < job_count; ++job) {
+        int fds[2];
+        if (pipe(fds) != 0) {
+            throw std::runtime_error("Could not create pipe");
+        }
+        auto pid = fork();
+        if (pid < 0) {
+            throw std::runtime_error("Could not create worker process");
+        }
+        if (pid == 0) {
+            close(fds[0]);
+            for (std::size_t i = job; i < indices.size(); i += job_count) {
+                auto result = perform_and_report_single_test(configs, indices[i],
+                                                             check_directory, output_directory);
+                WorkerTestResult worker_result;
+                worker_result.index = indices[i];
+                worker_result.success = result.success;
+                worker_result.stats = result.stats;
+                write_all(fds[1], &worker_result, sizeof(worker_result));
+            }
+            close(fds[1]);
+            _exit(0);
+        }
+        close(fds[1]);
+        workers.push_back(pid);
+        worker_fds.push_back(fds[0]);
+    }
+
+    for (unsigned job = 0; job < job_count; ++job) {
+        WorkerTestResult worker_result;
+        while (read_all(worker_fds[job], &worker_result, sizeof(worker_result))) {
+            auto& result = results[worker_result.index];
+            result.success = worker_result.success;
+            result.config = configs[worker_result.index];
+            result.stats = worker_result.stats;
+        }
+        close(worker_fds[job]);
+        waitpid(workers[job], nullptr, 0);
+    }
+
+    // tests whose worker process has crashed don't have results
+    for (auto index : indices) {
+        if (results.find(index) == results.end()) {
+            auto& result = results[index];
+            result.success = false;
+            result.config = configs[index];
+            std::cerr << "(" << index << "/" << configs.size() << "): FAIL: "
+                      << result.config.name() << "\nworker process crashed\n";
+        }
+    }
+    return results;
+}
+
 void print_help()
 {
     std::cerr << "Usage:\n"
-              << "session_config_test [--test={test_name}] {check_directory} [{output_directory}]\n"
+              << "session_config_test [--test={test_name}] [--jobs={count}] "
+                 "[--timing_report={path}] {check_directory} [{output_directory}]\n"
               << "session_config_test --help\n"
               << "session_config_test --print_test_names\n";
 }
@@ -465,12 +652,18 @@ int main(int argc, const char* argv[])
     std::string check_directory;
     std::string output_directory;
     std::string test_name_filter;
+    std::string timing_report_path;
+    unsigned job_count = std::max(1u, std::thread::hardware_concurrency());
     bool print_test_names = false;
 
     for (int argi = 1; argi < argc; ++argi) {
         std::string arg = argv[argi];
         if (arg.rfind("--test=", 0) == 0) {
             test_name_filter = arg.substr(7);
+        } else if (arg.rfind("--jobs=", 0) == 0) {
+            job_count = std::max(1, std::atoi(arg.substr(7).c_str()));
+        } else if (arg.rfind("--timing_report=", 0) == 0) {
+            timing_report_path = arg.substr(16);
         } else if (arg == "-h" || arg == "--help") {
             print_help();
             return 0;
@@ -497,23 +690,68 @@ int main(int argc, const char* argv[])
         return 1;
     }
 
+    std::vector<std::size_t> indices;
+    for (std::size_t i = 0; i < configs.size(); ++i) {
+        if (test_name_filter.empty() || configs[i].name() == test_name_filter) {
+            indices.push_back(i);
+        }
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    auto results = run_tests(configs, indices, job_count, check_directory, output_directory);
+    auto end = std::chrono::steady_clock::now();
+
     bool test_success = true;
-    for (unsigned i = 0; i < configs.size(); ++i) {
-        const auto& config = configs[i];
+    std::map<genesys::AsicType, std::vector<RegisterWriteStats>> register_write_stats;
+    std::map<genesys::AsicType, std::vector<ScanSetupTimes>> setup_times;
+    std::stringstream timing_report;
+    timing_report << "test\tcompute_session_ms\tinit_regs_for_scan_ms\n";
 
-        if (!test_name_filter.empty() && config.name() != test_name_filter) {
-            continue;
+    for (const auto& index_result : results) {
+        const auto& result = index_result.second;
+        test_success &= result.success;
+
+        const auto& stats = result.stats.register_writes;
+        if (stats.asic_type != genesys::AsicType::UNKNOWN) {
+            register_write_stats[stats.asic_type].push_back(stats);
+            setup_times[stats.asic_type].push_back(result.stats.setup_times);
+            timing_report << result.config.name()
+                          << '\t' << result.stats.setup_times.compute_session_ms
+                          << '\t' << result.stats.setup_times.init_regs_for_scan_ms << '\n';
         }
+    }
+
+    std::cerr << "\nRan " << indices.size() << " tests using " << job_count << " jobs in "
+              << std::chrono::duration<double>(end - begin).count() << " s\n";
 
-        auto result = perform_single_test(config, check_directory, output_directory);
-        std::cerr << "(" << i << "/" << configs.size() << "): "
-                  << (result.success ? "SUCCESS: " : "FAIL: ")
-                  << result.config.name() << "\n";
-        if (!result.success) {
-            std::cerr << result.failure_message;
+    std::cerr << "\nRegister write USB transactions per sane_start():\n";
+    for (const auto& kv : register_write_stats) {
+        std::size_t transactions = 0;
+        std::size_t unoptimized_transactions = 0;
+        for (const auto& stats : kv.second) {
+            transactions += stats.transactions;
+            unoptimized_transactions += stats.unoptimized_transactions;
         }
+        std::cerr << kv.first << ": " << transactions / kv.second.size()
+                  << " (" << unoptimized_transactions / kv.second.size()
+                  << " without batching and skipping of unchanged registers)\n";
+    }
+
+    std::cerr << "\nAverage scan setup time per sane_start():\n";
+    for (const auto& kv : setup_times) {
+        double compute_session_ms = 0;
+        double init_regs_for_scan_ms = 0;
+        for (const auto& times : kv.second) {
+            compute_session_ms += times.compute_session_ms;
+            init_regs_for_scan_ms += times.init_regs_for_scan_ms;
+        }
+        std::cerr << kv.first << ": compute_session "
+                  << compute_session_ms * 1000 / kv.second.size() << " us, init_regs_for_scan "
+                  << init_regs_for_scan_ms * 1000 / kv.second.size() << " us\n";
+    }
 
-        test_success &= result.success;
+    if (!timing_report_path.empty()) {
+        write_string_to_file(timing_report_path, timing_report.str());
     }
 
     if (!test_success) {
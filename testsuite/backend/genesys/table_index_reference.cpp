@@ -0,0 +1,63 @@
+/* sane - Scanner Access Now Easy.
+
+   Copyright (C) 2026 agent <agent@local>
+
+   This file is part of the SANE package.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#define DEBUG_DECLARE_ONLY
+
+#include "table_index_reference.h"
+
+#include "../../../backend/genesys/low.h"
+
+namespace genesys {
+
+Genesys_Sensor* find_sensor_reference(SensorId sensor_id, unsigned dpi, unsigned channels,
+                                      ScanMethod scan_method)
+{
+    for (auto& sensor : *s_sensors) {
+        if (sensor_id == sensor.sensor_id && sensor.resolutions.matches(dpi) &&
+            sensor.matches_channel_count(channels) && sensor.method == scan_method)
+        {
+            return &sensor;
+        }
+    }
+    return nullptr;
+}
+
+std::set<std::pair<SensorId, ScanMethod>> get_sensor_ids_and_methods()
+{
+    std::set<std::pair<SensorId, ScanMethod>> result;
+    for (const auto& sensor : *s_sensors) {
+        result.emplace(sensor.sensor_id, sensor.method);
+    }
+    // a scan method that no sensor supports
+    result.emplace(s_sensors->front().sensor_id, ScanMethod::TRANSPARENCY_INFRARED);
+    return result;
+}
+
+std::vector<unsigned> get_test_resolutions()
+{
+    std::set<unsigned> result = { 1, 50, 100, 4800, 9600 };
+    for (const auto& sensor : *s_sensors) {
+        const auto& values = sensor.resolutions.values();
+        result.insert(values.begin(), values.end());
+    }
+    return { result.begin(), result.end() };
+}
+
+} // namespace genesys
@@ -0,0 +1,47 @@
+/* sane - Scanner Access Now Easy.
+
+   Copyright (C) 2026 agent <agent@local>
+
+   This file is part of the SANE package.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef SANE_TESTSUITE_BACKEND_GENESYS_TABLE_INDEX_REFERENCE_H
+#define SANE_TESTSUITE_BACKEND_GENESYS_TABLE_INDEX_REFERENCE_H
+
+#include "../../../backend/genesys/enums.h"
+#include "../../../backend/genesys/sensor.h"
+
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace genesys {
+
+// Finds the sensor by walking the whole sensor table. Used to verify TableIndex in the unit tests
+// and as the baseline in the benchmarks.
+Genesys_Sensor* find_sensor_reference(SensorId sensor_id, unsigned dpi, unsigned channels,
+                                      ScanMethod scan_method);
+
+// Returns all sensor ID and scan method pairs of the sensor table plus one pair that no sensor
+// supports
+std::set<std::pair<SensorId, ScanMethod>> get_sensor_ids_and_methods();
+
+// Returns all resolutions listed in the sensor table plus a few that no sensor lists
+std::vector<unsigned> get_test_resolutions();
+
+} // namespace genesys
+
+#endif // SANE_TESTSUITE_BACKEND_GENESYS_TABLE_INDEX_REFERENCE_H
@@ -29,7 +29,10 @@ int main()
     genesys::test_image();
     genesys::test_image_pipeline();
     genesys::test_motor();
+    genesys::test_perf_counters();
+    genesys::test_register_cache();
     genesys::test_row_buffer();
+    genesys::test_table_index();
     genesys::test_utilities();
     return finish_tests();
 }
@@ -27,7 +27,10 @@ void test_calibration_parsing();
 void test_image();
 void test_image_pipeline();
 void test_motor();
+void test_perf_counters();
+void test_register_cache();
 void test_row_buffer();
+void test_table_index();
 void test_utilities();
 
 } // namespace genesys
@@ -25,6 +25,8 @@
 
 #include "../../../backend/genesys/low.h"
 
+#include <cstdio>
+#include <fstream>
 #include <sstream>
 
 namespace genesys {
@@ -121,9 +123,200 @@ void test_calibration_roundtrip()
     ASSERT_TRUE(str.eof());
 }
 
+std::string read_file_contents(const std::string& path)
+{
+    std::ifstream str{path, std::ios::binary};
+    return std::string{std::istreambuf_iterator<char>(str), std::istreambuf_iterator<char>()};
+}
+
+void write_file_contents(const std::string& path, const std::string& contents)
+{
+    std::ofstream str{path, std::ios::binary | std::ios::trunc};
+    str.write(contents.data(), contents.size());
+}
+
+void test_calibration_cache_roundtrip()
+{
+    const std::string path = "test_calibration_cache_roundtrip.cal";
+
+    auto entry1 = create_fake_calibration_entry();
+    auto entry2 = create_fake_calibration_entry();
+    entry2.params.xres = 600;
+    entry2.average_size = 3;
+
+    CalibrationCache cache;
+    cache.insert(entry1);
+    cache.insert(entry2);
+    ASSERT_EQ(cache.size(), 2u);
+    cache.save(path);
+    ASSERT_EQ(cache.path(), path);
+
+    CalibrationCache loaded;
+    ASSERT_TRUE(loaded.open(path));
+    ASSERT_EQ(loaded.size(), 2u);
+
+    const auto* found1 = loaded.find(entry1.params);
+    ASSERT_TRUE(found1 != nullptr);
+    ASSERT_TRUE(*found1 == entry1);
+
+    const auto* found2 = loaded.find(entry2.params);
+    ASSERT_TRUE(found2 != nullptr);
+    ASSERT_TRUE(*found2 == entry2);
+
+    auto missing_params = entry1.params;
+    missing_params.yres = 1234;
+    ASSERT_TRUE(loaded.find(missing_params) == nullptr);
+
+    std::remove(path.c_str());
+}
+
+void test_calibration_cache_append()
+{
+    const std::string path = "test_calibration_cache_append.cal";
+
+    auto entry1 = create_fake_calibration_entry();
+    auto entry2 = create_fake_calibration_entry();
+    entry2.params.xres = 600;
+
+    CalibrationCache cache;
+    cache.insert(entry1);
+    cache.insert(entry2);
+    cache.save(path);
+    auto initial_contents = read_file_contents(path);
+
+    // saving without modifications does not touch the file
+    cache.save(path);
+    ASSERT_EQ(read_file_contents(path), initial_contents);
+
+    CalibrationCache loaded;
+    ASSERT_TRUE(loaded.open(path));
+    auto updated_entry = entry1;
+    updated_entry.average_size = 5;
+    updated_entry.white_average_data = { 1, 2, 3, 4, 5 };
+    loaded.insert(updated_entry);
+    loaded.save(path);
+
+    // only the modified entry is appended
+    auto appended_contents = read_file_contents(path);
+    ASSERT_TRUE(appended_contents.size() > initial_contents.size());
+    ASSERT_EQ(appended_contents.substr(0, initial_contents.size()), initial_contents);
+
+    CalibrationCache reloaded;
+    ASSERT_TRUE(reloaded.open(path));
+    ASSERT_EQ(reloaded.size(), 2u);
+    const auto* found1 = reloaded.find(entry1.params);
+    ASSERT_TRUE(found1 != nullptr);
+    ASSERT_TRUE(*found1 == updated_entry);
+    const auto* found2 = reloaded.find(entry2.params);
+    ASSERT_TRUE(found2 != nullptr);
+    ASSERT_TRUE(*found2 == entry2);
+
+    // the file is compacted once the replaced records outnumber the entries
+    for (unsigned i = 0; i < 4; ++i) {
+        updated_entry.average_size = 10 + i;
+        reloaded.insert(updated_entry);
+        reloaded.save(path);
+    }
+    auto compacted_contents = read_file_contents(path);
+    ASSERT_TRUE(compacted_contents.size() < appended_contents.size() + 3 * (appended_contents.size() -
+                                                                         initial_contents.size()));
+
+    CalibrationCache compacted;
+    ASSERT_TRUE(compacted.open(path));
+    ASSERT_EQ(compacted.size(), 2u);
+    ASSERT_EQ(compacted.find(entry1.params)->average_size, 13u);
+
+    std::remove(path.c_str());
+}
+
+void test_calibration_cache_invalid_files()
+{
+    const std::string path = "test_calibration_cache_invalid.cal";
+    std::remove(path.c_str());
+
+    CalibrationCache cache;
+    cache.insert(create_fake_calibration_entry());
+
+    ASSERT_FALSE(cache.open(path));
+    ASSERT_EQ(cache.size(), 1u);
+
+    write_file_contents(path, "sane_genesys 31\nnot a binary cache");
+    ASSERT_FALSE(cache.open(path));
+    ASSERT_EQ(cache.size(), 1u);
+
+    // a truncated record at the end of the file is ignored
+    auto entry1 = create_fake_calibration_entry();
+    auto entry2 = create_fake_calibration_entry();
+    entry2.params.xres = 600;
+
+    cache.clear();
+    cache.insert(entry1);
+    cache.save(path);
+    auto single_entry_size = read_file_contents(path).size();
+    cache.insert(entry2);
+    cache.save(path);
+
+    auto contents = read_file_contents(path);
+    write_file_contents(path, contents.substr(0, contents.size() - 10));
+
+    CalibrationCache truncated;
+    ASSERT_TRUE(truncated.open(path));
+    ASSERT_EQ(truncated.size(), 1u);
+    ASSERT_TRUE(truncated.find(entry1.params) != nullptr);
+    ASSERT_TRUE(truncated.find(entry2.params) == nullptr);
+
+    // the garbage is not kept when saving
+    truncated.save(path);
+    ASSERT_EQ(read_file_contents(path).size(), single_entry_size);
+
+    std::remove(path.c_str());
+}
+
+void test_calibration_cache_shared_file()
+{
+    const std::string path = "test_calibration_cache_shared.cal";
+
+    auto entry1 = create_fake_calibration_entry();
+    auto entry2 = create_fake_calibration_entry();
+    entry2.params.xres = 600;
+
+    CalibrationCache cache;
+    cache.insert(entry1);
+    cache.insert(entry2);
+    cache.save(path);
+
+    // another process has the file open and loads entries lazily
+    CalibrationCache other;
+    ASSERT_TRUE(other.open(path));
+
+    // rewriting the file replaces it instead of truncating it
+    CalibrationCache rewriting;
+    rewriting.insert(entry2);
+    rewriting.save(path);
+    ASSERT_TRUE(read_file_contents(path + ".tmp").empty());
+
+    const auto* found1 = other.find(entry1.params);
+    ASSERT_TRUE(found1 != nullptr);
+    ASSERT_TRUE(*found1 == entry1);
+
+    // a mapped file that has been truncated in place is not accessed. If the file has been read
+    // into memory instead, the entry is still available.
+    CalibrationCache truncated;
+    ASSERT_TRUE(truncated.open(path));
+    write_file_contents(path, "");
+    const auto* found2 = truncated.find(entry2.params);
+    ASSERT_TRUE(found2 == nullptr || *found2 == entry2);
+
+    std::remove(path.c_str());
+}
+
 void test_calibration_parsing()
 {
     test_calibration_roundtrip();
+    test_calibration_cache_roundtrip();
+    test_calibration_cache_append();
+    test_calibration_cache_invalid_files();
+    test_calibration_cache_shared_file();
 }
 
 } // namespace genesys
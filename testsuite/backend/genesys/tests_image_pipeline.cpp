@@ -23,14 +23,58 @@
 #include "tests.h"
 #include "minigtest.h"
 #include "tests_printers.h"
+#include "image_pipeline_reference.h"
 
 #include "../../../backend/genesys/image_pipeline.h"
+#include "../../../backend/genesys/utilities.h"
 
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
 #include <numeric>
+#include <random>
 
 namespace genesys {
 
 
+void test_image_buffer_direct_reads()
+{
+    std::vector<std::uint8_t*> request_ptrs;
+    std::uint8_t next_value = 0;
+
+    auto on_read = [&](std::size_t x, std::uint8_t* data)
+    {
+        request_ptrs.push_back(data);
+        for (std::size_t i = 0; i < x; ++i) {
+            data[i] = next_value++;
+        }
+        return true;
+    };
+
+    ImageBuffer buffer{4, on_read};
+    buffer.set_remaining_size(22);
+
+    std::vector<std::uint8_t> out_data;
+    out_data.resize(22);
+
+    // whole chunks are read straight into the output, the rest go through the buffer
+    ASSERT_TRUE(buffer.get_data(8, out_data.data()));
+    ASSERT_TRUE(buffer.get_data(6, out_data.data() + 8));
+    ASSERT_TRUE(buffer.get_data(8, out_data.data() + 14));
+
+    ASSERT_EQ(request_ptrs.size(), 6u);
+    ASSERT_TRUE(request_ptrs[0] == out_data.data());
+    ASSERT_TRUE(request_ptrs[1] == out_data.data() + 4);
+    ASSERT_TRUE(request_ptrs[2] == out_data.data() + 8);
+    ASSERT_TRUE(request_ptrs[3] != out_data.data() + 12);
+    ASSERT_TRUE(request_ptrs[4] == out_data.data() + 16);
+    ASSERT_TRUE(request_ptrs[5] != out_data.data() + 20);
+
+    std::vector<std::uint8_t> expected_data(22);
+    std::iota(expected_data.begin(), expected_data.end(), 0);
+    ASSERT_EQ(out_data, expected_data);
+}
+
 void test_image_buffer_exact_reads()
 {
     std::vector<std::size_t> requests;
@@ -167,6 +211,134 @@ void test_image_buffer_capped_remaining_bytes()
     ASSERT_EQ(requests, expected);
 }
 
+void test_image_buffer_read_ahead()
+{
+    std::vector<std::size_t> requests;
+    std::uint8_t next_value = 0;
+
+    // called from the read ahead thread only
+    auto on_read = [&](std::size_t x, std::uint8_t* data)
+    {
+        requests.push_back(x);
+        for (std::size_t i = 0; i < x; ++i) {
+            data[i] = next_value++;
+        }
+        return true;
+    };
+
+    ImageBuffer buffer{1000, on_read};
+    buffer.set_remaining_size(2500);
+    buffer.set_last_read_multiple(16);
+    buffer.enable_read_ahead(2);
+
+    std::vector<std::uint8_t> data;
+    data.resize(2500);
+
+    ASSERT_TRUE(buffer.get_data(700, data.data()));
+    ASSERT_TRUE(buffer.get_data(1200, data.data() + 700));
+    ASSERT_TRUE(buffer.get_data(600, data.data() + 1900));
+
+    std::vector<std::uint8_t> dummy;
+    dummy.resize(100);
+    ASSERT_FALSE(buffer.get_data(100, dummy.data()));
+    buffer.stop_read_ahead();
+
+    std::vector<std::size_t> expected_requests = {
+        // note that the last size is rounded-up to 16 bytes
+        1000, 1000, 512
+    };
+    ASSERT_EQ(requests, expected_requests);
+
+    std::vector<std::uint8_t> expected_data;
+    expected_data.resize(2500);
+    std::iota(expected_data.begin(), expected_data.end(), 0);
+    ASSERT_EQ(data, expected_data);
+}
+
+void test_image_buffer_read_ahead_uncapped_remaining_bytes()
+{
+    unsigned request_count = 0;
+
+    auto on_read = [&](std::size_t x, std::uint8_t* data)
+    {
+        (void) x;
+        (void) data;
+        request_count++;
+        return request_count < 4;
+    };
+
+    ImageBuffer buffer{1000, on_read};
+    buffer.enable_read_ahead(3);
+
+    std::vector<std::uint8_t> dummy;
+    dummy.resize(3000);
+
+    ASSERT_TRUE(buffer.get_data(3000, dummy.data()));
+    ASSERT_FALSE(buffer.get_data(3000, dummy.data()));
+    ASSERT_FALSE(buffer.get_data(3000, dummy.data()));
+    ASSERT_EQ(request_count, 4u);
+}
+
+void test_image_buffer_read_ahead_error()
+{
+    unsigned request_count = 0;
+
+    auto on_read = [&](std::size_t x, std::uint8_t* data)
+    {
+        (void) x;
+        (void) data;
+        if (request_count++ == 1) {
+            throw SaneException(SANE_STATUS_IO_ERROR, "read failed");
+        }
+        return true;
+    };
+
+    ImageBuffer buffer{1000, on_read};
+    buffer.set_remaining_size(10000);
+    buffer.enable_read_ahead(4);
+
+    std::vector<std::uint8_t> dummy;
+    dummy.resize(1000);
+
+    // the data that has been read before the error is still returned
+    ASSERT_TRUE(buffer.get_data(1000, dummy.data()));
+
+    bool got_exception = false;
+    try {
+        buffer.get_data(1000, dummy.data());
+    } catch (const SaneException& e) {
+        got_exception = e.status() == SANE_STATUS_IO_ERROR;
+    }
+    ASSERT_TRUE(got_exception);
+}
+
+void test_image_buffer_read_ahead_stop()
+{
+    unsigned request_count = 0;
+
+    auto on_read = [&](std::size_t x, std::uint8_t* data)
+    {
+        (void) x;
+        (void) data;
+        request_count++;
+        return true;
+    };
+
+    ImageBuffer buffer{1000, on_read};
+    buffer.set_remaining_size(100000);
+    buffer.enable_read_ahead(2);
+
+    std::vector<std::uint8_t> dummy;
+    dummy.resize(1000);
+
+    ASSERT_TRUE(buffer.get_data(1000, dummy.data()));
+    buffer.stop_read_ahead();
+
+    // at most one chunk is consumed and two are read ahead
+    ASSERT_TRUE(request_count <= 3);
+    ASSERT_FALSE(buffer.get_data(1000, dummy.data()));
+}
+
 void test_node_buffered_callable_source()
 {
     using Data = std::vector<std::uint8_t>;
@@ -211,6 +383,73 @@ void test_node_buffered_callable_source()
     ASSERT_EQ(curr_index, 12u);
 }
 
+void test_node_buffered_callable_source_read_ahead()
+{
+    using Data = std::vector<std::uint8_t>;
+
+    const std::size_t width = 10;
+    const std::size_t height = 25;
+    const std::size_t chunk_size = 64;
+    const std::size_t total_size = width * height;
+
+    std::atomic<std::size_t> curr_index{0};
+    std::atomic<unsigned> request_count{0};
+
+    // behaves like a scanner: reading past the end of the image would block until a timeout
+    auto data_source_cb = [&](std::size_t size, std::uint8_t* out_data)
+    {
+        request_count++;
+        std::size_t index = curr_index;
+        if (index >= total_size) {
+            throw SaneException(SANE_STATUS_IO_ERROR, "read past the end of the image");
+        }
+        for (std::size_t i = 0; i < size; ++i) {
+            out_data[i] = static_cast<std::uint8_t>(index + i);
+        }
+        curr_index = index + size;
+        return true;
+    };
+
+    ImagePipelineStack stack;
+    auto& src_node = stack.push_first_node<ImagePipelineNodeBufferedCallableSource>(
+                width, height, PixelFormat::I8, chunk_size, data_source_cb);
+    src_node.set_last_read_multiple(2);
+    src_node.enable_read_ahead(3);
+
+    Data out_data;
+    out_data.resize(total_size);
+    for (std::size_t y = 0; y < height; ++y) {
+        ASSERT_TRUE(stack.get_next_row_data(out_data.data() + y * width));
+    }
+    src_node.stop_read_ahead();
+
+    // the last read is not rounded up to the chunk size
+    ASSERT_EQ(request_count.load(), 4u);
+    ASSERT_EQ(curr_index.load(), total_size);
+
+    Data expected_data;
+    expected_data.resize(total_size);
+    for (std::size_t i = 0; i < total_size; ++i) {
+        expected_data[i] = static_cast<std::uint8_t>(i);
+    }
+    ASSERT_EQ(out_data, expected_data);
+
+    // reading ahead without knowing where the image ends is refused
+    ImagePipelineStack unbounded_stack;
+    auto& unbounded_src_node =
+            unbounded_stack.push_first_node<ImagePipelineNodeBufferedCallableSource>(
+                width, height, PixelFormat::I8, chunk_size, data_source_cb);
+    unbounded_src_node.set_remaining_bytes(ImageBuffer::BUFFER_SIZE_UNSET);
+
+    bool got_exception = false;
+    try {
+        unbounded_src_node.enable_read_ahead(3);
+    } catch (const SaneException&) {
+        got_exception = true;
+    }
+    ASSERT_TRUE(got_exception);
+}
+
 void test_node_format_convert()
 {
     using Data = std::vector<std::uint8_t>;
@@ -634,6 +873,133 @@ void test_node_pixel_shift_lines_4lines()
     ASSERT_EQ(out_data, expected_data);
 }
 
+void test_node_desegment_all_formats()
+{
+    std::vector<unsigned> segment_order = { 1, 3, 0, 2 };
+    std::size_t segment_pixels = 40;
+    std::size_t width = segment_pixels * segment_order.size();
+    std::size_t height = 3;
+
+    for (auto format : { PixelFormat::I1, PixelFormat::RGB111, PixelFormat::I8,
+                         PixelFormat::RGB888, PixelFormat::BGR888, PixelFormat::I16,
+                         PixelFormat::RGB161616, PixelFormat::BGR161616 })
+    {
+        auto in_data = create_random_data(get_pixel_row_bytes(format, width) * height, 1);
+        auto expected_data = desegment_reference(in_data, width, height, format, width,
+                                                 segment_order, segment_pixels);
+
+        ImagePipelineStack stack;
+        stack.push_first_node<ImagePipelineNodeArraySource>(width, height, format,
+                                                            std::move(in_data));
+        stack.push_node<ImagePipelineNodeDesegment>(width, segment_order, segment_pixels, 1, 1);
+
+        ASSERT_EQ(stack.get_all_data(), expected_data);
+    }
+}
+
+void test_node_pixel_shift_lines_all_formats()
+{
+    std::vector<std::size_t> shifts = { 0, 3, 1, 2 };
+    std::size_t width = 81;
+    std::size_t height = 7;
+
+    for (auto format : { PixelFormat::I1, PixelFormat::RGB111, PixelFormat::I8,
+                         PixelFormat::RGB888, PixelFormat::BGR888, PixelFormat::I16,
+                         PixelFormat::RGB161616, PixelFormat::BGR161616 })
+    {
+        auto in_data = create_random_data(get_pixel_row_bytes(format, width) * height, 2);
+        auto expected_data = pixel_shift_lines_reference(in_data, width, height, format, shifts);
+
+        ImagePipelineStack stack;
+        stack.push_first_node<ImagePipelineNodeArraySource>(width, height, format,
+                                                            std::move(in_data));
+        stack.push_node<ImagePipelineNodePixelShiftLines>(shifts);
+
+        ASSERT_EQ(stack.get_all_data(), expected_data);
+    }
+}
+
+// Checks the format-specialized row functions on a 16-bit color image of 4800 dpi width
+void test_node_desegment_and_pixel_shift_lines_wide()
+{
+    auto format = PixelFormat::RGB161616;
+    std::size_t width = 4800 * 8;
+    std::size_t height = 8;
+    std::vector<unsigned> segment_order = { 0, 2, 1, 3 };
+    std::size_t segment_pixels = width / segment_order.size();
+    std::vector<std::size_t> shifts = { 0, 4 };
+
+    auto in_data = create_random_data(get_pixel_row_bytes(format, width) * height, 3);
+
+    ImagePipelineStack desegment_stack;
+    desegment_stack.push_first_node<ImagePipelineNodeArraySource>(width, height, format, in_data);
+    desegment_stack.push_node<ImagePipelineNodeDesegment>(width, segment_order, segment_pixels,
+                                                          1, 1);
+    ASSERT_EQ(desegment_stack.get_all_data(),
+              desegment_reference(in_data, width, height, format, width, segment_order,
+                                  segment_pixels));
+
+    ImagePipelineStack shift_stack;
+    shift_stack.push_first_node<ImagePipelineNodeArraySource>(width, height, format, in_data);
+    shift_stack.push_node<ImagePipelineNodePixelShiftLines>(shifts);
+    ASSERT_EQ(shift_stack.get_all_data(),
+              pixel_shift_lines_reference(in_data, width, height, format, shifts));
+}
+
+void test_node_scale_rows()
+{
+    using Data = std::vector<std::uint8_t>;
+
+    Data in_data = {
+        0x10, 0x20, 0x30, 0x40, 0x50, 0x60, 0x70, 0x80,
+        0x1a, 0x2a, 0x3a, 0x4a, 0x5a, 0x6a, 0x7a, 0x8a,
+    };
+
+    ImagePipelineStack stack;
+    stack.push_first_node<ImagePipelineNodeArraySource>(8, 2, PixelFormat::I8, std::move(in_data));
+    stack.push_node<ImagePipelineNodeScaleRows>(3);
+
+    ASSERT_EQ(stack.get_output_width(), 3u);
+    ASSERT_EQ(stack.get_output_height(), 2u);
+    ASSERT_EQ(stack.get_output_format(), PixelFormat::I8);
+
+    auto out_data = stack.get_all_data();
+
+    Data expected_data = {
+        0x18, 0x38, 0x60,
+        0x22, 0x42, 0x6a,
+    };
+
+    ASSERT_EQ(out_data, expected_data);
+}
+
+void test_node_scale_rows_matches_reference()
+{
+    std::size_t height = 3;
+    std::vector<std::pair<std::size_t, std::size_t>> widths = {
+        { 100, 25 }, { 101, 23 }, { 97, 96 }, { 1000, 1 }, { 64, 64 }, { 25, 100 }, { 23, 101 },
+        { 1, 17 },
+    };
+
+    for (auto format : { PixelFormat::I1, PixelFormat::RGB111, PixelFormat::I8,
+                         PixelFormat::RGB888, PixelFormat::BGR888, PixelFormat::I16,
+                         PixelFormat::RGB161616, PixelFormat::BGR161616 })
+    {
+        for (const auto& width : widths) {
+            auto in_data = create_random_data(get_pixel_row_bytes(format, width.first) * height, 6);
+            auto expected_data = scale_rows_reference(in_data, width.first, height, format,
+                                                      width.second);
+
+            ImagePipelineStack stack;
+            stack.push_first_node<ImagePipelineNodeArraySource>(width.first, height, format,
+                                                                std::move(in_data));
+            stack.push_node<ImagePipelineNodeScaleRows>(width.second);
+
+            ASSERT_EQ(stack.get_all_data(), expected_data);
+        }
+    }
+}
+
 void test_node_pixel_shift_columns_compute_max_width()
 {
     ASSERT_EQ(compute_pixel_shift_extra_width(12, {0, 1, 2, 3}), 0u);
@@ -921,14 +1287,311 @@ void test_node_calibrate_16bit()
     ASSERT_EQ(out_data, expected_data);
 }
 
+void test_node_calibrate_matches_reference()
+{
+    std::mt19937 rng{4};
+    std::uniform_int_distribution<unsigned> dist{0, 65535};
+
+    std::size_t width = 1001;
+    std::size_t height = 8;
+
+    for (auto format : { PixelFormat::I8, PixelFormat::RGB888, PixelFormat::BGR888,
+                         PixelFormat::I16, PixelFormat::RGB161616 })
+    {
+        auto channels = get_pixel_channels(format);
+        auto row_bytes = get_pixel_row_bytes(format, width);
+        auto in_data = create_random_data(row_bytes * height, 5);
+
+        // the calibration data may be shorter than the row, and may contain degenerate entries
+        // where top is equal to or less than bottom
+        for (auto calib_size : { width * channels, width * channels - 5 }) {
+            std::vector<std::uint16_t> bottom;
+            std::vector<std::uint16_t> top;
+            for (std::size_t i = 0; i < calib_size; ++i) {
+                auto bottom_value = dist(rng) / 4;
+                bottom.push_back(bottom_value);
+                switch (i % 16) {
+                    case 0: top.push_back(bottom_value); break;
+                    case 1: top.push_back(bottom_value / 2); break;
+                    case 2: top.push_back(bottom_value + 1); break;
+                    default: top.push_back(std::max(bottom_value + 1, dist(rng))); break;
+                }
+            }
+
+            ImagePipelineStack stack;
+            stack.push_first_node<ImagePipelineNodeArraySource>(width, height, format, in_data);
+            auto& node = stack.push_node<ImagePipelineNodeCalibrate>(bottom, top, 0);
+
+            for (std::size_t y = 0; y < height; ++y) {
+                std::vector<std::uint8_t> row(in_data.begin() + y * row_bytes,
+                                              in_data.begin() + (y + 1) * row_bytes);
+                auto expected_row = row;
+                node.calibrate_row_reference(expected_row.data());
+                node.calibrate_row(row.data());
+                ASSERT_EQ(row, expected_row);
+            }
+        }
+    }
+}
+
+void test_node_fused_pixel_operations_matches_chain()
+{
+    std::size_t width = 37;
+    std::size_t height = 3;
+
+    for (auto format : { PixelFormat::I1, PixelFormat::RGB111, PixelFormat::I8,
+                         PixelFormat::RGB888, PixelFormat::BGR888, PixelFormat::I16,
+                         PixelFormat::RGB161616, PixelFormat::BGR161616 })
+    {
+        auto depth = get_pixel_format_depth(format);
+        auto channels = get_pixel_channels(format);
+        auto in_data = create_random_data(get_pixel_row_bytes(format, width) * height, 8);
+
+        std::vector<std::uint16_t> bottom;
+        std::vector<std::uint16_t> top;
+        for (std::size_t i = 0; i < width * channels; ++i) {
+            bottom.push_back(0x800 + i * 0x40);
+            top.push_back(0xe000 - i * 0x100);
+        }
+
+        for (unsigned flags = 0; flags < 16; ++flags) {
+            FusedPixelOperations ops;
+            ops.swap_16bit_endian = flags & 1;
+            ops.invert = flags & 2;
+            if (flags & 4) {
+                if (channels != 3 || depth == 1) {
+                    continue;
+                }
+                ops.dst_format = create_pixel_format(depth, channels,
+                                                     get_pixel_format_color_order(format) ==
+                                                        ColorOrder::RGB ? ColorOrder::BGR
+                                                                        : ColorOrder::RGB);
+            }
+            if (flags & 8) {
+                if (depth == 1) {
+                    continue;
+                }
+                ops.calibrate = true;
+                ops.calibration_bottom = bottom;
+                ops.calibration_top = top;
+                ops.calibration_x_start = 2;
+            }
+
+            ImagePipelineStack chain;
+            chain.push_first_node<ImagePipelineNodeArraySource>(width, height, format, in_data);
+            if (ops.swap_16bit_endian) {
+                chain.push_node<ImagePipelineNodeSwap16BitEndian>();
+            }
+            if (ops.invert) {
+                chain.push_node<ImagePipelineNodeInvert>();
+            }
+            if (ops.dst_format != PixelFormat::UNKNOWN) {
+                chain.push_node<ImagePipelineNodeFormatConvert>(ops.dst_format);
+            }
+            if (ops.calibrate) {
+                chain.push_node<ImagePipelineNodeCalibrate>(bottom, top, 2);
+            }
+
+            ImagePipelineStack fused;
+            fused.push_first_node<ImagePipelineNodeArraySource>(width, height, format, in_data);
+            fused.push_node<ImagePipelineNodeFusedPixelOperations>(ops);
+
+            ASSERT_EQ(fused.get_output_format(), chain.get_output_format());
+            ASSERT_EQ(fused.get_all_data(), chain.get_all_data());
+        }
+    }
+}
+
+void test_node_calibration_accumulator_8bit()
+{
+    using Data = std::vector<std::uint8_t>;
+
+    Data in_data = {
+        0x10, 0x20, 0x30, 0x40, 0x50, 0x60,
+        0x12, 0x22, 0x32, 0x42, 0x52, 0x62,
+        0xff, 0x00, 0x34, 0x44, 0x54, 0x64,
+        0x14, 0x24, 0x36, 0x46, 0x56, 0x66,
+    };
+
+    ImagePipelineStack stack;
+    stack.push_first_node<ImagePipelineNodeArraySource>(2, 4, PixelFormat::RGB888, in_data);
+    auto& node = stack.push_node<ImagePipelineNodeCalibrationAccumulator>();
+
+    ASSERT_EQ(stack.get_output_width(), 2u);
+    ASSERT_EQ(stack.get_output_height(), 4u);
+    ASSERT_EQ(stack.get_output_format(), PixelFormat::RGB888);
+
+    auto out_data = stack.get_all_data();
+    ASSERT_EQ(out_data, in_data);
+    ASSERT_EQ(node.get_row_count(), 4u);
+
+    // the minimum and the maximum of each value are not included in the average
+    std::vector<std::uint16_t> expected_averages = {
+        0x13, 0x21, 0x33, 0x43, 0x53, 0x63
+    };
+    ASSERT_EQ(node.get_averages(), expected_averages);
+}
+
+void test_node_calibration_accumulator_16bit()
+{
+    using Data = std::vector<std::uint8_t>;
+
+    Data in_data = {
+        0x00, 0x10, 0x00, 0x20,
+        0x02, 0x10, 0x00, 0x30,
+    };
+
+    ImagePipelineStack stack;
+    stack.push_first_node<ImagePipelineNodeArraySource>(2, 2, PixelFormat::I16,
+                                                        std::move(in_data));
+    auto& node = stack.push_node<ImagePipelineNodeCalibrationAccumulator>();
+    node.consume_remaining_rows();
+
+    ASSERT_TRUE(node.eof());
+    ASSERT_EQ(node.get_row_count(), 2u);
+
+    // with less than 3 rows all values are included in the average
+    std::vector<std::uint16_t> expected_averages = {
+        0x1001, 0x2800
+    };
+    ASSERT_EQ(node.get_averages(), expected_averages);
+}
+
+// Creates 16-bit calibration data with the given number of lines as it comes from the scanner,
+// i.e. with pixel interleaved channels for CCD sensors and line planar channels for CIS sensors.
+// Each value fluctuates around a level depending on its position and one line contains a dark
+// speck of dust.
+std::vector<std::uint8_t> create_raw_calibration_data(std::size_t pixels, std::size_t lines,
+                                                      bool is_planar)
+{
+    unsigned channels = 3;
+    std::vector<std::uint8_t> data;
+    data.reserve(pixels * channels * lines * 2);
+
+    for (std::size_t y = 0; y < lines; ++y) {
+        for (std::size_t i = 0; i < pixels * channels; ++i) {
+            std::size_t x = is_planar ? i % pixels : i / channels;
+            unsigned ch = is_planar ? i / pixels : i % channels;
+
+            int value = 0x1000 + x * 0x40 + ch * 0x800 + (x * 7 + y * 3 + ch) % 5 - 2;
+            if (y == 4 && x >= 3 && x < 6) {
+                value /= 4;
+            }
+            data.push_back(value & 0xff);
+            data.push_back((value >> 8) & 0xff);
+        }
+    }
+    return data;
+}
+
+void test_node_calibration_accumulator_matches_percentile(bool is_planar)
+{
+    std::size_t pixels = 37;
+    std::size_t lines = 10;
+    std::size_t elements_per_line = pixels * 3;
+
+    auto in_data = create_raw_calibration_data(pixels, lines, is_planar);
+
+    std::vector<std::uint16_t> values(elements_per_line * lines);
+    std::memcpy(values.data(), in_data.data(), in_data.size());
+
+    std::vector<std::uint16_t> expected_averages(elements_per_line);
+    compute_array_percentile_approx(expected_averages.data(), values.data(), lines,
+                                    elements_per_line, 0.5f);
+
+    ImagePipelineStack stack;
+    stack.push_first_node<ImagePipelineNodeArraySource>(pixels, lines, PixelFormat::RGB161616,
+                                                        std::move(in_data));
+    auto& node = stack.push_node<ImagePipelineNodeCalibrationAccumulator>();
+    node.consume_remaining_rows();
+
+    ASSERT_EQ(node.get_row_count(), lines);
+
+    auto averages = node.get_averages();
+    ASSERT_EQ(averages.size(), elements_per_line);
+
+    // the streamed averages exclude the dust speck just like the median did
+    for (std::size_t i = 0; i < elements_per_line; ++i) {
+        ASSERT_TRUE(std::abs(static_cast<int>(averages[i]) -
+                             static_cast<int>(expected_averages[i])) <= 1);
+    }
+}
+
+void test_node_row_parallel()
+{
+    auto format = PixelFormat::RGB161616;
+    std::size_t width = 301;
+    std::size_t height = 37;
+    auto in_data = create_random_data(get_pixel_row_bytes(format, width) * height, 9);
+
+    std::vector<std::uint16_t> bottom(width * 3, 0x1000);
+    std::vector<std::uint16_t> top(width * 3, 0xd000);
+
+    FusedPixelOperations ops;
+    ops.invert = true;
+    ops.calibrate = true;
+    ops.calibration_bottom = bottom;
+    ops.calibration_top = top;
+
+    auto build_stages = [&](ImagePipelineStack& stack)
+    {
+        stack.push_node<ImagePipelineNodeFusedPixelOperations>(ops);
+        stack.push_node<ImagePipelineNodeScaleRows>(100);
+    };
+
+    ImagePipelineStack expected_stack;
+    expected_stack.push_first_node<ImagePipelineNodeArraySource>(width, height, format, in_data);
+    build_stages(expected_stack);
+    auto expected_data = expected_stack.get_all_data();
+
+    for (std::size_t thread_count : { 1, 2, 3, 8 }) {
+        for (std::size_t batch_rows : { 1, 5, 16, 64 }) {
+            ImagePipelineStack stack;
+            stack.push_first_node<ImagePipelineNodeArraySource>(width, height, format, in_data);
+            stack.push_node<ImagePipelineNodeRowParallel>(thread_count, batch_rows, build_stages);
+
+            ASSERT_EQ(stack.get_output_width(), 100u);
+            ASSERT_EQ(stack.get_output_height(), height);
+            ASSERT_EQ(stack.get_output_format(), format);
+            ASSERT_EQ(stack.get_all_data(), expected_data);
+        }
+    }
+}
+
+void test_node_row_parallel_error()
+{
+    std::size_t width = 10;
+    std::size_t height = 20;
+    std::vector<std::uint8_t> in_data(width * height, 0);
+
+    ImagePipelineStack stack;
+    stack.push_first_node<ImagePipelineNodeArraySource>(width, height, PixelFormat::I8, in_data);
+    // calibration is not supported for 1-bit data, so processing any row throws
+    stack.push_node<ImagePipelineNodeRowParallel>(4, 8, [](ImagePipelineStack& stack)
+    {
+        stack.push_node<ImagePipelineNodeFormatConvert>(PixelFormat::I1);
+        stack.push_node<ImagePipelineNodeCalibrate>(std::vector<std::uint16_t>(10, 0),
+                                                    std::vector<std::uint16_t>(10, 1), 0);
+    });
+
+    std::vector<std::uint8_t> out_data(stack.get_output_row_bytes());
+    ASSERT_RAISES(stack.get_next_row_data(out_data.data()), SaneException);
+}
+
 void test_image_pipeline()
 {
+    test_image_buffer_direct_reads();
     test_image_buffer_exact_reads();
     test_image_buffer_smaller_reads();
     test_image_buffer_larger_reads();
     test_image_buffer_uncapped_remaining_bytes();
     test_image_buffer_capped_remaining_bytes();
+    test_image_buffer_read_ahead();
+    test_image_buffer_read_ahead_uncapped_remaining_bytes();
+    test_image_buffer_read_ahead_error();
+    test_image_buffer_read_ahead_stop();
     test_node_buffered_callable_source();
+    test_node_buffered_callable_source_read_ahead();
     test_node_format_convert();
     test_node_desegment_1_line();
     test_node_deinterleave_lines_i8();
@@ -947,9 +1610,22 @@ void test_image_pipeline()
     test_node_pixel_shift_columns_group_switch_pixel_large_offsets_not_multiple();
     test_node_pixel_shift_lines_2lines();
     test_node_pixel_shift_lines_4lines();
+    test_node_desegment_all_formats();
+    test_node_pixel_shift_lines_all_formats();
+    test_node_desegment_and_pixel_shift_lines_wide();
+    test_node_scale_rows();
+    test_node_scale_rows_matches_reference();
     test_node_pixel_shift_columns_compute_max_width();
     test_node_calibrate_8bit();
     test_node_calibrate_16bit();
+    test_node_calibrate_matches_reference();
+    test_node_fused_pixel_operations_matches_chain();
+    test_node_calibration_accumulator_8bit();
+    test_node_calibration_accumulator_16bit();
+    test_node_calibration_accumulator_matches_percentile(false);
+    test_node_calibration_accumulator_matches_percentile(true);
+    test_node_row_parallel();
+    test_node_row_parallel_error();
 }
 
 } // namespace genesys
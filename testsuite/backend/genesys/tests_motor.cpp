@@ -247,6 +247,46 @@ void test_create_slope_table_large_half_step()
     ASSERT_EQ(table.pixeltime_sum(), 367399u);
 }
 
+void test_slope_table_cache()
+{
+    unsigned max_table_size = 1024;
+
+    MotorSlope slope;
+    slope.initial_speed_w = 54612;
+    slope.max_speed_w = 1500;
+    slope.acceleration = 1.013948e-9;
+
+    MotorSlopeTableCache cache;
+
+    auto expected = create_slope_table_for_speed(slope, 3000, StepType::FULL, 4, 8,
+                                                 max_table_size);
+    auto table = cache.get(slope, 3000, StepType::FULL, 4, 8, max_table_size);
+    ASSERT_EQ(table.table, expected.table);
+    ASSERT_EQ(table.pixeltime_sum(), expected.pixeltime_sum());
+    ASSERT_EQ(cache.size(), 1u);
+
+    // the same parameters return the cached table
+    table = cache.get(slope, 3000, StepType::FULL, 4, 8, max_table_size);
+    ASSERT_EQ(table.table, expected.table);
+    ASSERT_EQ(table.pixeltime_sum(), expected.pixeltime_sum());
+    ASSERT_EQ(cache.size(), 1u);
+
+    // any change of the parameters results in a different table
+    expected = create_slope_table_for_speed(slope, 3000, StepType::HALF, 4, 8, max_table_size);
+    table = cache.get(slope, 3000, StepType::HALF, 4, 8, max_table_size);
+    ASSERT_EQ(table.table, expected.table);
+    ASSERT_EQ(cache.size(), 2u);
+
+    slope.max_speed_w = 2000;
+    expected = create_slope_table_for_speed(slope, 3000, StepType::FULL, 4, 8, max_table_size);
+    table = cache.get(slope, 3000, StepType::FULL, 4, 8, max_table_size);
+    ASSERT_EQ(table.table, expected.table);
+    ASSERT_EQ(cache.size(), 3u);
+
+    cache.clear();
+    ASSERT_EQ(cache.size(), 0u);
+}
+
 void test_motor()
 {
     test_create_slope_table_small_full_step();
@@ -254,6 +294,7 @@ void test_motor()
     test_create_slope_table_small_half_step();
     test_create_slope_table_large_full_step();
     test_create_slope_table_large_half_step();
+    test_slope_table_cache();
 }
 
 } // namespace genesys
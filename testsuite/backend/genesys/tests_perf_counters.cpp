@@ -0,0 +1,165 @@
+/* sane - Scanner Access Now Easy.
+
+   Copyright (C) 2026 agent <agent@local>
+
+   This file is part of the SANE package.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+   As a special exception, the authors of SANE give permission for
+   additional uses of the libraries contained in this release of SANE.
+
+   The exception is that, if you link a SANE library with other files
+   to produce an executable, this does not by itself cause the
+   resulting executable to be covered by the GNU General Public
+   License.  Your use of that executable is in no way restricted on
+   account of linking the SANE library code into it.
+
+   This exception does not, however, invalidate any other reasons why
+   the executable file might be covered by the GNU General Public
+   License.
+
+   If you submit changes to SANE to the maintainers to be included in
+   a subsequent release, you agree by submitting the changes that
+   those changes may be distributed with this exception intact.
+
+   If you write modifications of your own for SANE, it is your choice
+   whether to permit this exception to apply to your modifications.
+   If you do not wish that, delete this exception notice.
+*/
+
+#define DEBUG_DECLARE_ONLY
+#include "tests.h"
+#include "minigtest.h"
+
+#include "../../../backend/genesys/image_pipeline.h"
+#include "../../../backend/genesys/perf_counters.h"
+
+#include <sstream>
+
+namespace genesys {
+
+void test_perf_counters_disabled()
+{
+    PerfCounters counters;
+    counters.set_enabled(false);
+
+    counters.add("usb.bulk_in", 1, 100, 1000);
+    {
+        PerfTimer timer{counters, "usb.bulk_out"};
+        timer.add_bytes(100);
+    }
+
+    ASSERT_TRUE(counters.empty());
+
+    ImagePipelineStack stack;
+    stack.enable_perf_counters(counters, "pipeline");
+    stack.push_first_node<ImagePipelineNodeArraySource>(4, 2, PixelFormat::I8,
+                                                        std::vector<std::uint8_t>(8));
+    stack.get_all_data();
+    stack.clear();
+
+    ASSERT_TRUE(counters.empty());
+}
+
+void test_perf_counters_accumulate()
+{
+    PerfCounters counters;
+    counters.set_enabled(true);
+
+    counters.add("usb.bulk_in", 1, 100, 1000);
+    counters.add("usb.bulk_in", 1, 200, 3000);
+    counters.add(std::string{"usb.control_out"}, 1, 8, 500);
+
+    PerfCounter expected_bulk_in;
+    expected_bulk_in.count = 2;
+    expected_bulk_in.bytes = 300;
+    expected_bulk_in.time_ns = 4000;
+    ASSERT_TRUE(counters.get("usb.bulk_in") == expected_bulk_in);
+    ASSERT_TRUE(counters.get("missing") == PerfCounter{});
+
+    std::ostringstream json;
+    counters.write_json(json);
+    ASSERT_EQ(json.str(),
+              std::string("{\"usb.bulk_in\": {\"count\": 2, \"bytes\": 300, \"time_ns\": 4000, "
+                          "\"avg_time_ns\": 2000}, "
+                          "\"usb.control_out\": {\"count\": 1, \"bytes\": 8, \"time_ns\": 500, "
+                          "\"avg_time_ns\": 500}}"));
+
+    {
+        PerfTimer timer{counters, "wait"};
+        timer.set_count(5);
+        timer.add_bytes(10);
+        timer.add_bytes(20);
+    }
+    auto wait = counters.get("wait");
+    ASSERT_EQ(wait.count, std::uint64_t{5});
+    ASSERT_EQ(wait.bytes, std::uint64_t{30});
+
+    counters.clear();
+    ASSERT_TRUE(counters.empty());
+}
+
+void test_perf_counters_pipeline()
+{
+    PerfCounters counters;
+    counters.set_enabled(true);
+
+    std::vector<std::uint8_t> in_data = {
+        0x10, 0x20, 0x30, 0x40,
+        0x11, 0x21, 0x31, 0x41,
+        0x12, 0x22, 0x32, 0x42,
+    };
+
+    ImagePipelineStack stack;
+    stack.enable_perf_counters(counters, "pipeline");
+    stack.push_first_node<ImagePipelineNodeArraySource>(4, 3, PixelFormat::I8,
+                                                        std::move(in_data));
+    stack.push_node<ImagePipelineNodeInvert>();
+
+    ASSERT_EQ(stack.get_output_width(), 4u);
+    ASSERT_EQ(stack.get_output_height(), 3u);
+    ASSERT_EQ(stack.get_output_format(), PixelFormat::I8);
+
+    std::vector<std::uint8_t> expected_data = {
+        0xef, 0xdf, 0xcf, 0xbf,
+        0xee, 0xde, 0xce, 0xbe,
+        0xed, 0xdd, 0xcd, 0xbd,
+    };
+    ASSERT_EQ(stack.get_all_data(), expected_data);
+
+    // the counters are added when the pipeline is destroyed
+    ASSERT_TRUE(counters.empty());
+    stack.clear();
+
+    auto all = counters.get_all();
+    ASSERT_EQ(all.size(), 2u);
+
+    auto source = counters.get("pipeline.00.ArraySource");
+    ASSERT_EQ(source.count, std::uint64_t{3});
+    ASSERT_EQ(source.bytes, std::uint64_t{12});
+
+    auto invert = counters.get("pipeline.01.Invert");
+    ASSERT_EQ(invert.count, std::uint64_t{3});
+    ASSERT_EQ(invert.bytes, std::uint64_t{12});
+}
+
+void test_perf_counters()
+{
+    test_perf_counters_disabled();
+    test_perf_counters_accumulate();
+    test_perf_counters_pipeline();
+}
+
+} // namespace genesys
@@ -0,0 +1,132 @@
+/* sane - Scanner Access Now Easy.
+
+   Copyright (C) 2026 agent <agent@local>
+
+   This file is part of the SANE package.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#define DEBUG_DECLARE_ONLY
+
+#include "tests.h"
+#include "minigtest.h"
+#include "tests_printers.h"
+
+#include "../../../backend/genesys/register_cache.h"
+#include "../../../backend/genesys/error.h"
+
+#include <vector>
+
+namespace genesys {
+
+namespace {
+
+bool is_cacheable_for_test(std::uint16_t address)
+{
+    return address != 0x0e && address != 0x0f;
+}
+
+std::vector<std::uint16_t> write_and_get_addresses(RegisterWriteCache& cache,
+                                                   const Genesys_Register_Set& regs)
+{
+    std::vector<std::uint16_t> addresses;
+    cache.write(regs, is_cacheable_for_test, [&](const Genesys_Register_Set& changed_regs)
+    {
+        for (const auto& reg : changed_regs) {
+            addresses.push_back(reg.address);
+        }
+    });
+    return addresses;
+}
+
+Genesys_Register_Set make_test_regs(std::uint8_t value)
+{
+    Genesys_Register_Set regs{Genesys_Register_Set::SEQUENTIAL};
+    regs.init_reg(0x10, value);
+    regs.init_reg(0x11, 0x22);
+    regs.init_reg(0x0f, 0x01);
+    return regs;
+}
+
+} // namespace
+
+void test_register_cache_skips_unchanged()
+{
+    RegisterWriteCache cache;
+    auto regs = make_test_regs(0x11);
+
+    std::vector<std::uint16_t> expected = { 0x10, 0x11, 0x0f };
+    ASSERT_EQ(write_and_get_addresses(cache, regs), expected);
+
+    expected = { 0x0f };
+    ASSERT_EQ(write_and_get_addresses(cache, regs), expected);
+
+    regs = make_test_regs(0x12);
+    expected = { 0x10, 0x0f };
+    ASSERT_EQ(write_and_get_addresses(cache, regs), expected);
+}
+
+void test_register_cache_reset()
+{
+    RegisterWriteCache cache;
+    auto regs = make_test_regs(0x11);
+    write_and_get_addresses(cache, regs);
+
+    Genesys_Register_Set reset_regs{Genesys_Register_Set::SEQUENTIAL};
+    reset_regs.init_reg(0x0e, 0x01);
+    std::vector<std::uint16_t> expected = { 0x0e };
+    ASSERT_EQ(write_and_get_addresses(cache, reset_regs), expected);
+
+    expected = { 0x10, 0x11, 0x0f };
+    ASSERT_EQ(write_and_get_addresses(cache, regs), expected);
+}
+
+void test_register_cache_failed_write()
+{
+    RegisterWriteCache cache;
+    auto regs = make_test_regs(0x11);
+
+    auto throwing_write = [](const Genesys_Register_Set&)
+    {
+        throw SaneException(SANE_STATUS_IO_ERROR, "write failed");
+    };
+
+    ASSERT_RAISES(cache.write(regs, is_cacheable_for_test, throwing_write), SaneException);
+
+    // nothing has reached the scanner, so everything must be written again
+    std::vector<std::uint16_t> expected = { 0x10, 0x11, 0x0f };
+    ASSERT_EQ(write_and_get_addresses(cache, regs), expected);
+
+    // a failed write of changed values must not forget the values written before it
+    auto changed_regs = make_test_regs(0x12);
+    ASSERT_RAISES(cache.write(changed_regs, is_cacheable_for_test, throwing_write),
+                  SaneException);
+
+    expected = { 0x10, 0x0f };
+    ASSERT_EQ(write_and_get_addresses(cache, changed_regs), expected);
+
+    expected = { 0x0f };
+    ASSERT_EQ(write_and_get_addresses(cache, changed_regs), expected);
+}
+
+void test_register_cache()
+{
+    test_register_cache_skips_unchanged();
+    test_register_cache_reset();
+    test_register_cache_failed_write();
+}
+
+} // namespace genesys
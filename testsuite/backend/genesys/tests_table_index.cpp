@@ -0,0 +1,104 @@
+/* sane - Scanner Access Now Easy.
+
+   Copyright (C) 2026 agent <agent@local>
+
+   This file is part of the SANE package.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#define DEBUG_DECLARE_ONLY
+#include "tests.h"
+#include "minigtest.h"
+#include "table_index_reference.h"
+
+#include "../../../backend/genesys/low.h"
+#include "../../../backend/genesys/table_index.h"
+
+namespace genesys {
+
+void test_sensor_table_index_matches_linear_search()
+{
+    genesys_init_sensor_tables();
+
+    auto ids_and_methods = get_sensor_ids_and_methods();
+    auto resolutions = get_test_resolutions();
+
+    for (const auto& id_method : ids_and_methods) {
+        auto sensor_id = id_method.first;
+        auto method = id_method.second;
+
+        for (auto dpi : resolutions) {
+            for (unsigned channels : { 1, 3 }) {
+                ASSERT_TRUE(s_sensor_index->find(sensor_id, dpi, channels, method) ==
+                            find_sensor_reference(sensor_id, dpi, channels, method));
+            }
+        }
+
+        std::vector<const Genesys_Sensor*> expected_all;
+        for (const auto& sensor : *s_sensors) {
+            if (sensor.sensor_id == sensor_id && sensor.method == method) {
+                expected_all.push_back(&sensor);
+            }
+        }
+        std::vector<const Genesys_Sensor*> all;
+        for (const Genesys_Sensor& sensor : s_sensor_index->find_all(sensor_id, method)) {
+            all.push_back(&sensor);
+        }
+        ASSERT_TRUE(all == expected_all);
+
+        const Genesys_Sensor* expected_any = nullptr;
+        for (const auto& sensor : *s_sensors) {
+            if (sensor.sensor_id == sensor_id) {
+                expected_any = &sensor;
+                break;
+            }
+        }
+        ASSERT_TRUE(s_sensor_index->find_any(sensor_id) == expected_any);
+    }
+
+    ASSERT_TRUE(s_sensor_index->find_any(SensorId::UNKNOWN) == nullptr);
+    ASSERT_TRUE(s_sensor_index->find_all(SensorId::UNKNOWN, ScanMethod::FLATBED).empty());
+}
+
+void test_id_table_index()
+{
+    genesys_init_motor_tables();
+    genesys_init_frontend_tables();
+
+    for (std::size_t i = 0; i < s_motors->size(); ++i) {
+        auto id = (*s_motors)[i].id;
+        auto index = s_motor_index->find(id);
+        ASSERT_TRUE(index >= 0);
+        ASSERT_TRUE(static_cast<std::size_t>(index) <= i);
+        ASSERT_EQ((*s_motors)[index].id, id);
+    }
+    ASSERT_EQ(s_motor_index->find(MotorId::UNKNOWN), std::ptrdiff_t{-1});
+
+    for (std::size_t i = 0; i < s_frontends->size(); ++i) {
+        auto id = (*s_frontends)[i].id;
+        auto index = s_frontend_index->find(id);
+        ASSERT_TRUE(index >= 0);
+        ASSERT_TRUE(static_cast<std::size_t>(index) <= i);
+        ASSERT_EQ((*s_frontends)[index].id, id);
+    }
+}
+
+void test_table_index()
+{
+    test_sensor_table_index_matches_linear_search();
+    test_id_table_index();
+}
+
+} // namespace genesys
@@ -826,6 +826,335 @@ test_attach (void)
   return 1;
 }
 
+#if WITH_USB_RECORD_REPLAY
+
+#define CAPTURE_XML_PATH "sanei_usb_test_capture.xml"
+#define CAPTURE_BINARY_PATH "sanei_usb_test_capture.sanecap"
+#define CAPTURE_CONVERTED_XML_PATH "sanei_usb_test_capture_converted.xml"
+#define CAPTURE_RECONVERTED_BINARY_PATH "sanei_usb_test_capture_reconverted.sanecap"
+#define CAPTURE_CORRUPTED_PATH "sanei_usb_test_capture_corrupted.sanecap"
+
+/**
+ * capture with one transaction of each kind replayed by replay_capture()
+ */
+static const char *capture_xml =
+  "<?xml version=\"1.0\"?>\n"
+  "<device_capture backend=\"test\">\n"
+  "  <description id_vendor=\"0x04a9\" id_product=\"0x1905\">\n"
+  "    <configurations>\n"
+  "      <configuration number=\"1\">\n"
+  "        <interface number=\"0\">\n"
+  "          <endpoint transfer_type=\"BULK\" number=\"1\" direction=\"IN\""
+  " address=\"0x81\"/>\n"
+  "          <endpoint transfer_type=\"BULK\" number=\"2\" direction=\"OUT\""
+  " address=\"0x02\"/>\n"
+  "        </interface>\n"
+  "      </configuration>\n"
+  "    </configurations>\n"
+  "  </description>\n"
+  "  <transactions>\n"
+  "    <get_descriptor time_usec=\"0\" seq=\"1\" descriptor_type=\"0x01\""
+  " bcd_usb=\"0x200\" bcd_device=\"0x301\" device_class=\"0xff\""
+  " device_sub_class=\"0xff\" device_protocol=\"0xff\""
+  " max_packet_size=\"0x40\"/>\n"
+  "    <control_tx time_usec=\"10\" seq=\"2\" direction=\"IN\""
+  " bmRequestType=\"0xc0\" bRequest=\"0x0c\" wValue=\"0x008e\""
+  " wIndex=\"0x0000\" wLength=\"2\">12 34</control_tx>\n"
+  "    <control_tx time_usec=\"20\" seq=\"3\" direction=\"OUT\""
+  " bmRequestType=\"0x40\" bRequest=\"0x0c\" wValue=\"0x0083\""
+  " wIndex=\"0x0000\" wLength=\"2\">55 aa</control_tx>\n"
+  "    <bulk_tx time_usec=\"30\" seq=\"4\" endpoint_number=\"0x01\""
+  " direction=\"IN\">00 01 02 03 04 05 06 07</bulk_tx>\n"
+  "  </transactions>\n"
+  "</device_capture>\n";
+
+/** read a whole file into memory
+ * @param path path of the file
+ * @param size set to the size of the file
+ * @return file contents to be freed by the caller, NULL on failure
+ */
+static uint8_t *
+read_file (const char *path, size_t * size)
+{
+  FILE *f = fopen (path, "rb");
+  uint8_t *data = NULL;
+  long file_size;
+
+  if (f == NULL)
+    return NULL;
+  if (fseek (f, 0, SEEK_END) == 0 && (file_size = ftell (f)) >= 0)
+    {
+      data = malloc (file_size + 1);
+      rewind (f);
+      if (data != NULL && fread (data, 1, file_size, f) != (size_t) file_size)
+	{
+	  free (data);
+	  data = NULL;
+	}
+      *size = file_size;
+    }
+  fclose (f);
+  return data;
+}
+
+/** write the given data to a file
+ * @return 1 on success, else 0
+ */
+static int
+write_file (const char *path, const void *data, size_t size)
+{
+  FILE *f = fopen (path, "wb");
+  int rc;
+
+  if (f == NULL)
+    return 0;
+  rc = fwrite (data, 1, size, f) == size;
+  return fclose (f) == 0 && rc;
+}
+
+/** replay the transactions of capture_xml from the given file
+ * checks the returned data and that the seq of each transaction, including
+ * get_descriptor, is kept in the capture
+ * @return 1 on success, else 0
+ */
+static int
+replay_capture (const char *path)
+{
+  struct sanei_usb_dev_descriptor desc;
+  SANE_Byte control_in[2] = { 0, 0 };
+  SANE_Byte control_out[2] = { 0x55, 0xaa };
+  SANE_Byte bulk[8];
+  size_t bulk_size = sizeof (bulk);
+  SANE_Status status;
+  SANE_Int dn = -1;
+  int rc = 1;
+  int i;
+
+  printf ("%s: replaying %s ...\n", __func__, path);
+  status = sanei_usb_testing_enable_replay (path, 0);
+  if (status != SANE_STATUS_GOOD)
+    {
+      printf ("ERROR: could not enable replay of %s: %d\n", path, status);
+      return 0;
+    }
+  sanei_usb_init ();
+
+  status = sanei_usb_open (path, &dn);
+  if (status != SANE_STATUS_GOOD)
+    {
+      printf ("ERROR: could not open the replayed device: %d\n", status);
+      dn = -1;
+      rc = 0;
+    }
+
+  if (rc)
+    {
+      status = sanei_usb_get_descriptor (dn, &desc);
+      if (status != SANE_STATUS_GOOD || desc.desc_type != 0x01
+	  || desc.bcd_usb != 0x200 || desc.bcd_dev != 0x301
+	  || desc.dev_class != 0xff || desc.max_packet_size != 0x40)
+	{
+	  printf ("ERROR: wrong descriptor replayed!\n");
+	  rc = 0;
+	}
+      else if (testing_last_known_seq != 1)
+	{
+	  printf ("ERROR: get_descriptor has seq %d, expected 1!\n",
+		  testing_last_known_seq);
+	  rc = 0;
+	}
+    }
+
+  if (rc)
+    {
+      status = sanei_usb_control_msg (dn, 0xc0, 0x0c, 0x8e, 0, 2, control_in);
+      if (status != SANE_STATUS_GOOD || control_in[0] != 0x12
+	  || control_in[1] != 0x34 || testing_last_known_seq != 2)
+	{
+	  printf ("ERROR: wrong control IN transaction replayed!\n");
+	  rc = 0;
+	}
+    }
+
+  if (rc)
+    {
+      status = sanei_usb_control_msg (dn, 0x40, 0x0c, 0x83, 0, 2, control_out);
+      if (status != SANE_STATUS_GOOD || testing_last_known_seq != 3)
+	{
+	  printf ("ERROR: wrong control OUT transaction replayed!\n");
+	  rc = 0;
+	}
+    }
+
+  if (rc)
+    {
+      status = sanei_usb_read_bulk (dn, bulk, &bulk_size);
+      if (status != SANE_STATUS_GOOD || bulk_size != sizeof (bulk)
+	  || testing_last_known_seq != 4)
+	{
+	  printf ("ERROR: wrong bulk transaction replayed!\n");
+	  rc = 0;
+	}
+      for (i = 0; rc && i < (int) sizeof (bulk); i++)
+	{
+	  if (bulk[i] != i)
+	    {
+	      printf ("ERROR: wrong bulk data replayed!\n");
+	      rc = 0;
+	    }
+	}
+    }
+
+  if (dn >= 0)
+    sanei_usb_close (dn);
+  sanei_usb_exit ();
+  testing_mode = sanei_usb_testing_mode_disabled;
+  return rc;
+}
+
+/** test conversion of captures between the XML and binary formats
+ * converts XML to binary, back to XML and again to binary the same way
+ * sane-usb-capture-convert does and replays all of them
+ * @return 1 on success, else 0
+ */
+static int
+test_capture_round_trip (void)
+{
+  uint8_t *binary, *reconverted;
+  size_t binary_size = 0, reconverted_size = 0;
+  xmlDoc *doc;
+  xmlNode *node;
+  char *seq;
+  int rc = 1;
+
+  printf ("%s starting ...\n", __func__);
+  if (!write_file (CAPTURE_XML_PATH, capture_xml, strlen (capture_xml)))
+    {
+      printf ("ERROR: could not write %s\n", CAPTURE_XML_PATH);
+      return 0;
+    }
+
+  if (sanei_usb_testing_convert_capture (CAPTURE_XML_PATH, CAPTURE_BINARY_PATH)
+      != SANE_STATUS_GOOD
+      || sanei_usb_testing_convert_capture (CAPTURE_BINARY_PATH,
+					    CAPTURE_CONVERTED_XML_PATH)
+      != SANE_STATUS_GOOD
+      || sanei_usb_testing_convert_capture (CAPTURE_CONVERTED_XML_PATH,
+					    CAPTURE_RECONVERTED_BINARY_PATH)
+      != SANE_STATUS_GOOD)
+    {
+      printf ("ERROR: could not convert the capture!\n");
+      return 0;
+    }
+
+  if (!sanei_usb_capture_is_binary (CAPTURE_BINARY_PATH)
+      || sanei_usb_capture_is_binary (CAPTURE_CONVERTED_XML_PATH))
+    {
+      printf ("ERROR: the capture has been written in the wrong format!\n");
+      return 0;
+    }
+
+  /* converting back and forth must not lose anything */
+  binary = read_file (CAPTURE_BINARY_PATH, &binary_size);
+  reconverted = read_file (CAPTURE_RECONVERTED_BINARY_PATH, &reconverted_size);
+  if (binary == NULL || reconverted == NULL || binary_size != reconverted_size
+      || memcmp (binary, reconverted, binary_size) != 0)
+    {
+      printf ("ERROR: the binary capture changed after a round trip!\n");
+      rc = 0;
+    }
+  free (binary);
+  free (reconverted);
+
+  /* get_descriptor must keep its seq in the converted XML */
+  doc = xmlReadFile (CAPTURE_CONVERTED_XML_PATH, NULL, 0);
+  node = doc != NULL ? xmlDocGetRootElement (doc) : NULL;
+  if (node != NULL)
+    node = sanei_xml_find_first_child_with_name (node, "transactions");
+  node = node != NULL ? xmlFirstElementChild (node) : NULL;
+  seq = node != NULL ? sanei_xml_get_prop (node, "seq") : NULL;
+  if (seq == NULL || strcmp (seq, "1") != 0
+      || xmlStrcmp (node->name, (const xmlChar *) "get_descriptor") != 0)
+    {
+      printf ("ERROR: get_descriptor lost its seq in the converted capture!\n");
+      rc = 0;
+    }
+  xmlFree (seq);
+  xmlFreeDoc (doc);
+
+  rc = rc && replay_capture (CAPTURE_XML_PATH);
+  rc = rc && replay_capture (CAPTURE_BINARY_PATH);
+  rc = rc && replay_capture (CAPTURE_CONVERTED_XML_PATH);
+
+  printf ("\n");
+  return rc;
+}
+
+/** test that binary captures with out of range offsets are rejected
+ * @return 1 on success, else 0
+ */
+static int
+test_capture_offset_validation (void)
+{
+  struct sanei_usb_capture capture;
+  uint8_t *data;
+  size_t size = 0;
+  uint64_t index_offset;
+  int rc = 1;
+
+  printf ("%s starting ...\n", __func__);
+  data = read_file (CAPTURE_BINARY_PATH, &size);
+  if (data == NULL || size < SANEI_USB_CAPTURE_HEADER_SIZE)
+    {
+      printf ("ERROR: could not read %s\n", CAPTURE_BINARY_PATH);
+      free (data);
+      return 0;
+    }
+
+  /* the data section extends past the end of the file */
+  sanei_usb_capture_put_u64 (data + 56, size);
+  if (!write_file (CAPTURE_CORRUPTED_PATH, data, size)
+      || sanei_usb_capture_open (&capture, CAPTURE_CORRUPTED_PATH)
+      != SANE_STATUS_INVAL)
+    {
+      printf ("ERROR: accepted a data section past the end of the file!\n");
+      rc = 0;
+    }
+  free (data);
+
+  /* the transaction index does not fit into the file */
+  data = read_file (CAPTURE_BINARY_PATH, &size);
+  sanei_usb_capture_put_u64 (data + 32, 1000);
+  if (!write_file (CAPTURE_CORRUPTED_PATH, data, size)
+      || sanei_usb_capture_open (&capture, CAPTURE_CORRUPTED_PATH)
+      != SANE_STATUS_INVAL)
+    {
+      printf ("ERROR: accepted a transaction index past the end of the file!\n");
+      rc = 0;
+    }
+  free (data);
+
+  /* the data of a transaction is outside of the data section */
+  data = read_file (CAPTURE_BINARY_PATH, &size);
+  index_offset = sanei_usb_capture_get_u64 (data + 40);
+  sanei_usb_capture_put_u64 (data + index_offset + 3 * SANEI_USB_CAPTURE_TX_SIZE + 32,
+			     UINT64_MAX - 4);
+  if (!write_file (CAPTURE_CORRUPTED_PATH, data, size)
+      || sanei_usb_testing_convert_capture (CAPTURE_CORRUPTED_PATH,
+					    CAPTURE_CONVERTED_XML_PATH)
+      == SANE_STATUS_GOOD)
+    {
+      printf ("ERROR: accepted transaction data outside of the data section!\n");
+      rc = 0;
+    }
+  free (data);
+
+  printf ("\n");
+  return rc;
+}
+
+#endif /* WITH_USB_RECORD_REPLAY */
+
 int
 main (int __sane_unused__ argc, char **argv)
 {
@@ -942,6 +1271,14 @@ main (int __sane_unused__ argc, char **argv)
   /* finally free resources */
   assert (test_exit (0));
 
+#if WITH_USB_RECORD_REPLAY
+  /* convert captures between the XML and binary formats and replay them */
+  assert (test_capture_round_trip ());
+
+  /* binary captures with invalid offsets must be rejected */
+  assert (test_capture_offset_validation ());
+#endif
+
   /* all the tests are OK ! */
   return 0;
 }
@@ -0,0 +1,60 @@
+/*
+   sane-usb-capture-convert.c -- convert USB captures between the XML and
+   binary formats
+
+   This file is part of the SANE package.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "../include/sane/config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../include/sane/sane.h"
+#include "../include/sane/sanei_usb.h"
+
+static void
+usage (const char *prog_name)
+{
+  fprintf (stderr, "Usage: %s INPUT OUTPUT\n\n", prog_name);
+  fprintf (stderr,
+	   "Converts a USB capture recorded via the fakeusbout device name\n"
+	   "prefix between the XML and binary formats. The format of INPUT\n"
+	   "is detected automatically. OUTPUT is written in\n"
+	   "the binary format if its name ends with \".sanecap\", otherwise\n"
+	   "as XML.\n");
+}
+
+int
+main (int argc, char **argv)
+{
+  SANE_Status status;
+
+  if (argc != 3)
+    {
+      usage (argv[0]);
+      return EXIT_FAILURE;
+    }
+
+  status = sanei_usb_testing_convert_capture (argv[1], argv[2]);
+  if (status != SANE_STATUS_GOOD)
+    {
+      fprintf (stderr, "%s: could not convert %s to %s: %s\n", argv[0],
+	       argv[1], argv[2], sane_strstatus (status));
+      return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}